@@ -2,6 +2,7 @@
 #include "interfaces.h"
 #include "bsec_interface.h"
 #include "bsecIntegration.h"
+#include "bsecRecorder.h"
 
 extern struct Bme680State _s;
 
@@ -76,6 +77,10 @@ le_result_t mangOH_bme680_Configure(
         NUM_ARRAY_MEMBERS(virtualOutputs),
         requiredSensorSettings,
         &numRequiredSensorSettings);
+    if (status == BSEC_OK)
+    {
+        BsecRecorder_Subscription(virtualOutputs, NUM_ARRAY_MEMBERS(virtualOutputs));
+    }
 
     if (samplingRate != _s.samplingRate)
     {
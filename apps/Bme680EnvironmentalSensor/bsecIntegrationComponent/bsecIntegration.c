@@ -4,15 +4,40 @@
 #include "bme680_linux_i2c.h"
 #include "bme680.h"
 #include "bsecIntegration.h"
+#include "bsecState.h"
+#include "bsecRecorder.h"
 
-#define BSEC_STATE_FILE "bsec_state.bin"
-#define SAMPLES_BETWEEN_SAVES 200
 #define BME680_I2C_ADDR 0x76
 
 struct Bme680State _s;
 
 static struct bme680_linux *Bme680;
 
+// Interval between checks for completion once the expected conversion time has elapsed.
+#define MEASUREMENT_POLL_MS 5
+// Give up on a conversion that has not completed after this many polls.
+#define MEASUREMENT_MAX_POLLS 100
+
+enum MeasurementPhase
+{
+    MEASUREMENT_PHASE_IDLE,         ///< Waiting for the next BSEC call.
+    MEASUREMENT_PHASE_CONVERTING,   ///< Forced-mode conversion in progress.
+};
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * State of the measurement cycle, carried between timer expiries.
+ */
+//--------------------------------------------------------------------------------------------------
+static struct
+{
+    enum MeasurementPhase phase;
+    bsec_bme_settings_t sensorSettings;  ///< Settings returned by the last bsec_sensor_control().
+    int64_t triggerTimestamp;           ///< Time at which the current cycle was started.
+    unsigned int numPolls;              ///< Completion polls made in the current conversion.
+    uint32_t startTransactions;         ///< I2C transaction count at the start of the cycle.
+} Measurement;
+
 
 int64_t GetTimestampNs(void)
 {
@@ -23,162 +48,57 @@ int64_t GetTimestampNs(void)
     return (monotime.tv_sec * 1000LL * 1000LL * 1000LL) + (monotime.tv_nsec);
 }
 
-static void SleepNs(uint64_t ns)
-{
-    const uint64_t ns_per_s = (1000LL * 1000LL * 1000LL);
-    const struct timespec delay = {
-        .tv_sec = ns / ns_per_s,
-        .tv_nsec = ns % ns_per_s,
-    };
-    int ret = nanosleep(&delay, NULL);
-    if (ret) {
-        LE_ERROR("nanosleep failed with error: %s\n", strerror(errno));
-    }
-}
-
-/*
-static le_result_t LoadState(void)
+//--------------------------------------------------------------------------------------------------
+/**
+ * Configure the BME680 as requested by BSEC and start a forced-mode conversion.
+ *
+ * @return LE_OK if the conversion was started, in which case *measPeriodMs is set to the expected
+ *         conversion time.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t TriggerMeasurement(
+    struct bme680_dev *bme680,
+    const bsec_bme_settings_t *sensorSettings,
+    uint16_t *measPeriodMs)
 {
     le_result_t res = LE_OK;
-    uint8_t bsecState[BSEC_MAX_PROPERTY_BLOB_SIZE] = {0};
 
-    int fd = open(BSEC_STATE_FILE, O_RDONLY);
-    if (fd == -1)
-    {
-        LE_ERROR("Couldn't open \"%s\" for reading - %s\n", BSEC_STATE_FILE, strerror(errno));
-        res = LE_FAULT;
-        goto done;
-    }
+    bme680->tph_sett.os_hum = sensorSettings->humidity_oversampling;
+    bme680->tph_sett.os_pres = sensorSettings->pressure_oversampling;
+    bme680->tph_sett.os_temp = sensorSettings->temperature_oversampling;
+    bme680->gas_sett.run_gas = sensorSettings->run_gas;
+    bme680->gas_sett.heatr_temp = sensorSettings->heater_temperature;
+    bme680->gas_sett.heatr_dur = sensorSettings->heating_duration;
+    bme680->power_mode = BME680_FORCED_MODE;
 
-    size_t numRead = 0;
-    while (true) {
-        ssize_t spaceRemaining = NUM_ARRAY_MEMBERS(bsecState) - numRead;
-        if (spaceRemaining == 0) {
-            LE_ERROR("File content in \"%s\" too large to fit in buffer\n", BSEC_STATE_FILE);
-            res = LE_FAULT;
-            goto fail_read;
-        }
-        int readRes = read(fd, &bsecState[numRead], spaceRemaining);
-        if (readRes < 0) {
-            LE_ERROR("Failed to read \"%s\" - %s\n", BSEC_STATE_FILE, strerror(errno));
-            res = LE_FAULT;
-            goto fail_read;
-        }
-        if (readRes == 0) {
-            // Reached EOF
-            break;
-        }
-        numRead += readRes;
-    }
-    close(fd);
+    // Send the register writes of the whole settings update in as few bus transactions as possible.
+    bme680_linux_i2c_begin_batch(bme680->context);
 
-    uint8_t workBuffer[BSEC_MAX_PROPERTY_BLOB_SIZE] = {0};
-    bsec_library_return_t bsecRes = bsec_set_state(bsecState, numRead, workBuffer, NUM_ARRAY_MEMBERS(workBuffer));
-    if (bsecRes != BSEC_OK)
+    int8_t bme680Status = bme680_set_sensor_settings(
+        BME680_OST_SEL | BME680_OSP_SEL | BME680_OSH_SEL | BME680_GAS_SENSOR_SEL, bme680);
+    if (bme680Status != BME680_OK)
     {
-        LE_ERROR("Failed to set BSEC state");
+        LE_ERROR("Failed to set sensor settings");
         res = LE_FAULT;
+        goto done;
     }
-
-    return res;
-
-fail_read:
-    close(fd);
-done:
-    return res;
-}
-*/
-
-static le_result_t SaveState(void)
-{
-    le_result_t ret = LE_OK;
-
-    uint8_t bsecState[BSEC_MAX_STATE_BLOB_SIZE];
-    uint8_t workBuffer[BSEC_MAX_STATE_BLOB_SIZE];
-    uint32_t bsecStateLen = 0;
-    bsec_library_return_t bsecStatus = bsec_get_state(0,
-                                                      bsecState,
-                                                      sizeof(bsecState),
-                                                      workBuffer,
-                                                      sizeof(workBuffer),
-                                                      &bsecStateLen);
-    if (bsecStatus != BSEC_OK)
+    bme680Status = bme680_set_sensor_mode(bme680);
+    if (bme680Status != BME680_OK)
     {
-        LE_ERROR("Couldn't get state out of BSEC");
-        return LE_FAULT;
-    }
-
-    int fd = open(BSEC_STATE_FILE, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-    if (fd == -1) {
-        LE_ERROR("Couldn't open \"%s\" for writing - %s\n", BSEC_STATE_FILE, strerror(errno));
-        return LE_FAULT;
-    }
-
-    unsigned int numWritten = 0;
-    do {
-        const size_t numToWrite = bsecStateLen - numWritten;
-        int res = write(fd, &bsecState[numWritten], numToWrite);
-        if (res < 0) {
-            LE_ERROR("Failed to write \"%s\" - %s\n", BSEC_STATE_FILE, strerror(errno));
-            ret = LE_FAULT;
-            goto done;
-        }
-        numWritten += res;
-    } while (numWritten < bsecStateLen);
-
-    int res = fsync(fd);
-    if (res) {
-        LE_ERROR("Failed to write \"%s\" - %s\n", BSEC_STATE_FILE, strerror(errno));
-        ret = LE_FAULT;
+        LE_ERROR("Failed to set sensor mode");
+        res = LE_FAULT;
         goto done;
     }
 
-done:
-    close(fd);
-    return ret;
-}
+    bme680_get_profile_dur(measPeriodMs, bme680);
 
-static void TriggerMeasurement(struct bme680_dev *bme680, const bsec_bme_settings_t *sensorSettings)
-{
-    if (sensorSettings->trigger_measurement)
+done:
+    if (bme680_linux_i2c_end_batch(bme680->context) != BME680_OK)
     {
-        bme680->tph_sett.os_hum = sensorSettings->humidity_oversampling;
-        bme680->tph_sett.os_pres = sensorSettings->pressure_oversampling;
-        bme680->tph_sett.os_temp = sensorSettings->temperature_oversampling;
-        bme680->gas_sett.run_gas = sensorSettings->run_gas;
-        bme680->gas_sett.heatr_temp = sensorSettings->heater_temperature;
-        bme680->gas_sett.heatr_dur = sensorSettings->heating_duration;
-        bme680->power_mode = BME680_FORCED_MODE;
-
-        int8_t bme680Status = bme680_set_sensor_settings(
-            BME680_OST_SEL | BME680_OSP_SEL | BME680_OSH_SEL | BME680_GAS_SENSOR_SEL, bme680);
-        if (bme680Status != BME680_OK)
-        {
-            LE_ERROR("Failed to set sensor settings");
-            return;
-        }
-        bme680Status = bme680_set_sensor_mode(bme680);
-        if (bme680Status != BME680_OK)
-        {
-            LE_ERROR("Failed to set sensor mode");
-            return;
-        }
-
-        uint16_t measPeriodMs;
-        bme680_get_profile_dur(&measPeriodMs, bme680);
-
-        SleepNs(measPeriodMs * 1000 * 1000);
+        LE_ERROR("Failed to write sensor settings");
+        res = LE_FAULT;
     }
-
-    do
-    {
-        int8_t bme680Status = bme680_get_sensor_mode(bme680);
-        if (bme680Status == BME680_OK && bme680->power_mode != BME680_FORCED_MODE)
-        {
-            break;
-        }
-        SleepNs(5 * 1000 * 1000);
-    } while(true);
+    return res;
 }
 
 static void ReadData(
@@ -271,6 +191,7 @@ static void ProcessData(bsec_input_t *bsecInputs, size_t numBsecInputs, int64_t
         uint8_t numBsecOutputs = NUM_ARRAY_MEMBERS(bsecOutputs);
         bsec_library_return_t bsecStatus = bsec_do_steps(bsecInputs, numBsecInputs, bsecOutputs, &numBsecOutputs);
         LE_ASSERT(bsecStatus == BSEC_OK);
+        BsecRecorder_Step(timestamp, bsecInputs, numBsecInputs, bsecOutputs, numBsecOutputs);
         for (size_t i = 0; i < numBsecOutputs; i++)
         {
             switch (bsecOutputs[i].sensor_id)
@@ -330,41 +251,103 @@ static void ProcessData(bsec_input_t *bsecInputs, size_t numBsecInputs, int64_t
     }
 }
 
+static void StartTimer(le_timer_Ref_t t, int64_t ms)
+{
+    if (ms <= 0)
+    {
+        LE_WARN("Next timer set to occur in %" PRId64 " ms. Setting to 1 ms instead", ms);
+        ms = 1;
+    }
+    LE_ASSERT_OK(le_timer_SetMsInterval(t, ms));
+    LE_ASSERT_OK(le_timer_Start(t));
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Arm the timer for the next time BSEC wants to be called.
+ */
+//--------------------------------------------------------------------------------------------------
+static void ScheduleNextCall(le_timer_Ref_t t)
+{
+    int64_t nextTimerMs = (Measurement.sensorSettings.next_call - GetTimestampNs()) / (1000LL * 1000LL);
+    LE_DEBUG("Configuring timer to %" PRId64 " ms", nextTimerMs);
+    StartTimer(t, nextTimerMs);
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Drives the measurement cycle. Each expiry performs one step and re-arms the timer rather than
+ * sleeping, so that IPC requests are serviced while the gas heater is running:
+ *
+ *  - IDLE: ask BSEC for the sensor settings and trigger a forced-mode conversion. The timer is set
+ *    to the expected conversion time.
+ *  - CONVERTING: check whether the conversion is done. If not, poll again shortly. Otherwise read
+ *    the data, feed it to BSEC and schedule the next BSEC call.
+ */
+//--------------------------------------------------------------------------------------------------
 static void TimerHandler(le_timer_Ref_t t)
 {
-    static size_t samplesSinceSave = 0;
-    bsec_bme_settings_t sensorSettings;
-    int64_t timestamp = GetTimestampNs();
-    bsec_sensor_control(timestamp, &sensorSettings);
+    struct bme680_dev *bme680 = &Bme680->dev;
 
-    TriggerMeasurement(&Bme680->dev, &sensorSettings);
+    if (Measurement.phase == MEASUREMENT_PHASE_IDLE)
+    {
+        Measurement.triggerTimestamp = GetTimestampNs();
+        Measurement.startTransactions = bme680_linux_i2c_get_num_transactions(Bme680);
+        bsec_sensor_control(Measurement.triggerTimestamp, &Measurement.sensorSettings);
+
+        if (Measurement.sensorSettings.trigger_measurement)
+        {
+            uint16_t measPeriodMs;
+            if (TriggerMeasurement(bme680, &Measurement.sensorSettings, &measPeriodMs) != LE_OK)
+            {
+                ScheduleNextCall(t);
+                return;
+            }
+            Measurement.phase = MEASUREMENT_PHASE_CONVERTING;
+            Measurement.numPolls = 0;
+            StartTimer(t, measPeriodMs);
+            return;
+        }
+    }
+    else
+    {
+        int8_t bme680Status = bme680_get_sensor_mode(bme680);
+        if (bme680Status != BME680_OK || bme680->power_mode == BME680_FORCED_MODE)
+        {
+            Measurement.numPolls++;
+            if (Measurement.numPolls < MEASUREMENT_MAX_POLLS)
+            {
+                StartTimer(t, MEASUREMENT_POLL_MS);
+                return;
+            }
+            LE_ERROR("Measurement did not complete after %u polls", Measurement.numPolls);
+            Measurement.phase = MEASUREMENT_PHASE_IDLE;
+            ScheduleNextCall(t);
+            return;
+        }
+        Measurement.phase = MEASUREMENT_PHASE_IDLE;
+    }
 
     /* Allocate enough memory for up to BSEC_MAX_PHYSICAL_SENSOR physical inputs*/
     bsec_input_t bsecInputs[BSEC_MAX_PHYSICAL_SENSOR];
 
     /* Number of inputs to BSEC */
     size_t numBsecInputs = 0;
-    ReadData(&Bme680->dev, timestamp, bsecInputs, &numBsecInputs, &sensorSettings);
+    ReadData(
+        bme680,
+        Measurement.triggerTimestamp,
+        bsecInputs,
+        &numBsecInputs,
+        &Measurement.sensorSettings);
 
-    ProcessData(bsecInputs, numBsecInputs, timestamp);
+    LE_DEBUG("Measurement took %" PRIu32 " I2C transactions",
+             bme680_linux_i2c_get_num_transactions(Bme680) - Measurement.startTransactions);
 
-    samplesSinceSave++;
-    if (samplesSinceSave >= SAMPLES_BETWEEN_SAVES)
-    {
-        if (SaveState() == LE_OK)
-        {
-            samplesSinceSave = 0;
-        }
-    }
-    int64_t nextTimerMs = (sensorSettings.next_call - GetTimestampNs()) / (1000LL * 1000LL);
-    LE_DEBUG("Configuring timer to %" PRId64 " ms", nextTimerMs);
-    if (nextTimerMs <= 0)
-    {
-        LE_WARN("Next timer set to occur in %" PRId64 " ms. Setting to 1 ms instead", nextTimerMs);
-        nextTimerMs = 1;
-    }
-    LE_ASSERT_OK(le_timer_SetMsInterval(t, nextTimerMs));
-    LE_ASSERT_OK(le_timer_Start(t));
+    ProcessData(bsecInputs, numBsecInputs, Measurement.triggerTimestamp);
+
+    BsecState_Update(Measurement.triggerTimestamp);
+
+    ScheduleNextCall(t);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -379,6 +362,18 @@ int8_t ReadAmbientTemperature(void)
     return (int8_t)round(_s.ambientTemperature);
 }
 
+//--------------------------------------------------------------------------------------------------
+/**
+ * Save the BSEC state before exiting so that calibration progress since the last periodic save is
+ * not lost.
+ */
+//--------------------------------------------------------------------------------------------------
+static void SigTermHandler(int sigNum)
+{
+    BsecState_Flush();
+    exit(EXIT_SUCCESS);
+}
+
 
 COMPONENT_INIT
 {
@@ -398,11 +393,21 @@ COMPONENT_INIT
         bsecVersion.minor_bugfix);
 
     /*
-     * It seems that sometimes the state is going "bad" in some way and this can
-     * lead to abnormally high humidity readings (for example). Disable loading
-     * of the state for now so that we can ensure a clean state on app start.
+     * Restoring the state lets IAQ resume at the accuracy reached before the restart instead of
+     * recalibrating from scratch. Corrupt or partially written states are rejected by the
+     * checksum, in which case BSEC simply starts uncalibrated.
      */
-    // LoadState();
+    le_result_t stateRes = BsecState_Restore();
+    if (stateRes != LE_OK)
+    {
+        LE_INFO("No usable BSEC state restored (%s). Starting uncalibrated.", LE_RESULT_TXT(stateRes));
+    }
+
+    BsecRecorder_Init();
+
+    // Persist the latest calibration when the app is stopped in an orderly fashion.
+    le_sig_Block(SIGTERM);
+    le_sig_SetEventHandler(SIGTERM, SigTermHandler);
 
     _s.ambientTemperature = 22.0; // Assume room temperature (degC), until told otherwise.
 
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------------------
+/**
+ * Binary format of BSEC recordings.
+ *
+ * A recording captures everything needed to re-run the BSEC library offline: the raw physical
+ * sensor inputs passed to bsec_do_steps() with their timestamps, the outputs BSEC produced on the
+ * device, output subscriptions and the state BSEC was started from. It is shared between the
+ * on-device recorder and the host-side replayer, so it must not depend on Legato.
+ *
+ * All multi-byte fields are little endian and unaligned. The file starts with a header:
+ *
+ *   char[4]    magic ("BSRC")
+ *   uint8      format version
+ *   uint8[4]   BSEC library version (major, minor, major_bugfix, minor_bugfix)
+ *   uint8[3]   reserved, zero
+ *
+ * followed by records, each starting with a uint8 type and a uint8 count:
+ *
+ *   SESSION        count = 0. The BSEC library was (re)initialized, e.g. the app restarted.
+ *   STATE          count = 0, uint16 length, length bytes of serialized BSEC state.
+ *   SUBSCRIPTION   count * { uint8 sensor_id, float sample_rate }
+ *   STEP           int64 timestamp (ns), count * { uint8 sensor_id, float signal }
+ *   OUTPUTS        int64 timestamp (ns), count * { uint8 sensor_id, uint8 accuracy, float signal }
+ *
+ * Every STEP is followed by the OUTPUTS produced for it.
+ */
+//--------------------------------------------------------------------------------------------------
+#ifndef _BSEC_RECORD_H_
+#define _BSEC_RECORD_H_
+
+#define BSEC_RECORD_MAGIC "BSRC"
+#define BSEC_RECORD_VERSION 1
+#define BSEC_RECORD_HEADER_SIZE 12
+
+enum BsecRecordType
+{
+    BSEC_RECORD_SESSION = 1,
+    BSEC_RECORD_STATE = 2,
+    BSEC_RECORD_SUBSCRIPTION = 3,
+    BSEC_RECORD_STEP = 4,
+    BSEC_RECORD_OUTPUTS = 5,
+};
+
+// Size of the type and count bytes at the start of every record.
+#define BSEC_RECORD_PREFIX_SIZE 2
+#define BSEC_RECORD_TIMESTAMP_SIZE 8
+#define BSEC_RECORD_STATE_LENGTH_SIZE 2
+#define BSEC_RECORD_SUBSCRIPTION_ENTRY_SIZE 5
+#define BSEC_RECORD_STEP_ENTRY_SIZE 5
+#define BSEC_RECORD_OUTPUT_ENTRY_SIZE 6
+
+#endif // _BSEC_RECORD_H_
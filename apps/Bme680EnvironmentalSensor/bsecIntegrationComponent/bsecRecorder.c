@@ -0,0 +1,236 @@
+//--------------------------------------------------------------------------------------------------
+/**
+ * Records the raw BSEC input streams so that they can be replayed offline through the BSEC library
+ * (see bsecReplay). The format is described in bsecRecord.h.
+ *
+ * Recording is disabled unless the BSEC_RECORD_FILE environment variable is set (see
+ * environment.adef). New sessions are appended to an existing recording, so a recording survives
+ * app restarts. Once the file reaches BSEC_RECORD_MAX_KB (default 16384) recording stops.
+ *
+ * Copyright (C) Sierra Wireless Inc.
+ */
+//--------------------------------------------------------------------------------------------------
+
+#include "legato.h"
+#include "bsec_interface.h"
+#include "bsecRecord.h"
+#include "bsecRecorder.h"
+
+#define DEFAULT_MAX_KB (16 * 1024)
+
+// Largest single write: a STEP record followed by its OUTPUTS record.
+#define MAX_STEP_BYTES \
+    (2 * (BSEC_RECORD_PREFIX_SIZE + BSEC_RECORD_TIMESTAMP_SIZE) + \
+     BSEC_MAX_PHYSICAL_SENSOR * BSEC_RECORD_STEP_ENTRY_SIZE + \
+     BSEC_NUMBER_OUTPUTS * BSEC_RECORD_OUTPUT_ENTRY_SIZE)
+
+static struct
+{
+    FILE *file;
+    const char *path;
+    size_t numBytes;
+    size_t maxBytes;
+} Recorder;
+
+
+static uint8_t *PutU8(uint8_t *p, uint8_t v)
+{
+    *p = v;
+    return p + 1;
+}
+
+static uint8_t *PutU16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *PutU32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = v >> (8 * i);
+    }
+    return p + 4;
+}
+
+static uint8_t *PutI64(uint8_t *p, int64_t v)
+{
+    uint64_t u = (uint64_t)v;
+    for (int i = 0; i < 8; i++)
+    {
+        p[i] = u >> (8 * i);
+    }
+    return p + 8;
+}
+
+static uint8_t *PutFloat(uint8_t *p, float v)
+{
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    return PutU32(p, u);
+}
+
+static void Stop(void)
+{
+    fclose(Recorder.file);
+    Recorder.file = NULL;
+}
+
+static void Write(const uint8_t *buf, size_t len)
+{
+    if (!Recorder.file)
+    {
+        return;
+    }
+
+    if (Recorder.numBytes + len > Recorder.maxBytes)
+    {
+        LE_WARN("Recording \"%s\" reached %zu bytes. Recording stopped.",
+                Recorder.path, Recorder.numBytes);
+        Stop();
+        return;
+    }
+
+    // Flush every record so that a crash loses at most the record being written.
+    if (fwrite(buf, 1, len, Recorder.file) != len || fflush(Recorder.file) != 0)
+    {
+        LE_ERROR("Failed to write \"%s\" - %s. Recording stopped.", Recorder.path, strerror(errno));
+        Stop();
+        return;
+    }
+    Recorder.numBytes += len;
+}
+
+void BsecRecorder_Init(void)
+{
+    Recorder.path = getenv("BSEC_RECORD_FILE");
+    if (!Recorder.path || Recorder.path[0] == '\0')
+    {
+        return;
+    }
+
+    Recorder.maxBytes = DEFAULT_MAX_KB * 1024;
+    const char *maxKb = getenv("BSEC_RECORD_MAX_KB");
+    if (maxKb)
+    {
+        Recorder.maxBytes = strtoul(maxKb, NULL, 10) * 1024;
+    }
+
+    Recorder.file = fopen(Recorder.path, "ab");
+    if (!Recorder.file)
+    {
+        LE_ERROR("Couldn't open \"%s\" for recording - %s", Recorder.path, strerror(errno));
+        return;
+    }
+    // Where an append stream starts is implementation-defined, so go to the end before asking
+    // whether the file is new.
+    long size = -1;
+    if (fseek(Recorder.file, 0, SEEK_END) == 0)
+    {
+        size = ftell(Recorder.file);
+    }
+    if (size < 0)
+    {
+        LE_ERROR("Couldn't size \"%s\" - %s", Recorder.path, strerror(errno));
+        Stop();
+        return;
+    }
+    Recorder.numBytes = size;
+
+    uint8_t buf[BSEC_RECORD_HEADER_SIZE + BSEC_RECORD_PREFIX_SIZE];
+    uint8_t *p = buf;
+    if (Recorder.numBytes == 0)
+    {
+        bsec_version_t version;
+        LE_ASSERT(bsec_get_version(&version) == BSEC_OK);
+        memcpy(p, BSEC_RECORD_MAGIC, 4);
+        p += 4;
+        p = PutU8(p, BSEC_RECORD_VERSION);
+        p = PutU8(p, version.major);
+        p = PutU8(p, version.minor);
+        p = PutU8(p, version.major_bugfix);
+        p = PutU8(p, version.minor_bugfix);
+        memset(p, 0, 3);
+        p += 3;
+    }
+    p = PutU8(p, BSEC_RECORD_SESSION);
+    p = PutU8(p, 0);
+    Write(buf, p - buf);
+
+    // Capture the state BSEC is starting from so that the replay starts from the same point.
+    uint8_t state[BSEC_MAX_STATE_BLOB_SIZE];
+    uint8_t workBuffer[BSEC_MAX_STATE_BLOB_SIZE];
+    uint32_t stateLen = 0;
+    if (bsec_get_state(0, state, sizeof(state), workBuffer, sizeof(workBuffer), &stateLen) == BSEC_OK)
+    {
+        uint8_t stateRecord[BSEC_RECORD_PREFIX_SIZE + BSEC_RECORD_STATE_LENGTH_SIZE +
+                            BSEC_MAX_STATE_BLOB_SIZE];
+        p = stateRecord;
+        p = PutU8(p, BSEC_RECORD_STATE);
+        p = PutU8(p, 0);
+        p = PutU16(p, stateLen);
+        memcpy(p, state, stateLen);
+        p += stateLen;
+        Write(stateRecord, p - stateRecord);
+    }
+
+    LE_INFO("Recording BSEC inputs to \"%s\"", Recorder.path);
+}
+
+void BsecRecorder_Subscription(const bsec_sensor_configuration_t *outputs, size_t numOutputs)
+{
+    if (!Recorder.file)
+    {
+        return;
+    }
+
+    LE_ASSERT(numOutputs <= UINT8_MAX);
+    uint8_t buf[BSEC_RECORD_PREFIX_SIZE + UINT8_MAX * BSEC_RECORD_SUBSCRIPTION_ENTRY_SIZE];
+    uint8_t *p = buf;
+    p = PutU8(p, BSEC_RECORD_SUBSCRIPTION);
+    p = PutU8(p, numOutputs);
+    for (size_t i = 0; i < numOutputs; i++)
+    {
+        p = PutU8(p, outputs[i].sensor_id);
+        p = PutFloat(p, outputs[i].sample_rate);
+    }
+    Write(buf, p - buf);
+}
+
+void BsecRecorder_Step(
+    int64_t timestamp,
+    const bsec_input_t *inputs,
+    size_t numInputs,
+    const bsec_output_t *outputs,
+    size_t numOutputs)
+{
+    if (!Recorder.file)
+    {
+        return;
+    }
+
+    LE_ASSERT(numInputs <= BSEC_MAX_PHYSICAL_SENSOR && numOutputs <= BSEC_NUMBER_OUTPUTS);
+    uint8_t buf[MAX_STEP_BYTES];
+    uint8_t *p = buf;
+    p = PutU8(p, BSEC_RECORD_STEP);
+    p = PutU8(p, numInputs);
+    p = PutI64(p, timestamp);
+    for (size_t i = 0; i < numInputs; i++)
+    {
+        p = PutU8(p, inputs[i].sensor_id);
+        p = PutFloat(p, inputs[i].signal);
+    }
+
+    p = PutU8(p, BSEC_RECORD_OUTPUTS);
+    p = PutU8(p, numOutputs);
+    p = PutI64(p, timestamp);
+    for (size_t i = 0; i < numOutputs; i++)
+    {
+        p = PutU8(p, outputs[i].sensor_id);
+        p = PutU8(p, outputs[i].accuracy);
+        p = PutFloat(p, outputs[i].signal);
+    }
+    Write(buf, p - buf);
+}
@@ -0,0 +1,31 @@
+#ifndef _BSEC_RECORDER_H_
+#define _BSEC_RECORDER_H_
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Start recording if the BSEC_RECORD_FILE environment variable names a file. Must be called after
+ * the BSEC library has been initialized and its state restored.
+ */
+//--------------------------------------------------------------------------------------------------
+void BsecRecorder_Init(void);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Record an output subscription passed to bsec_update_subscription().
+ */
+//--------------------------------------------------------------------------------------------------
+void BsecRecorder_Subscription(const bsec_sensor_configuration_t *outputs, size_t numOutputs);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Record the inputs of one bsec_do_steps() call along with the outputs it produced.
+ */
+//--------------------------------------------------------------------------------------------------
+void BsecRecorder_Step(
+    int64_t timestamp,
+    const bsec_input_t *inputs,
+    size_t numInputs,
+    const bsec_output_t *outputs,
+    size_t numOutputs);
+
+#endif // _BSEC_RECORDER_H_
@@ -0,0 +1,435 @@
+//--------------------------------------------------------------------------------------------------
+/**
+ * Crash-safe persistence of the BSEC library state.
+ *
+ * The state is written alternately to two slot files (A and B). Each slot starts with a small
+ * header holding a sequence number, the blob length and a CRC32 over the header and the blob. A
+ * save always goes to the slot that does not hold the newest valid state, so a write that is
+ * interrupted by a crash or power loss can only damage the older copy. At start-up both slots are
+ * validated and the newest one that BSEC accepts is restored.
+ *
+ * To limit flash wear, the state is only compared against the last persisted copy once per save
+ * interval. The interval backs off while the state is stable (e.g. once calibration has settled)
+ * and shrinks again while the state is changing quickly (e.g. during initial calibration).
+ *
+ * Copyright (C) Sierra Wireless Inc.
+ */
+//--------------------------------------------------------------------------------------------------
+
+#include "legato.h"
+#include "bsec_interface.h"
+#include "bsecState.h"
+
+#define LEGACY_STATE_FILE "bsec_state.bin"
+
+#define STATE_MAGIC 0x43455342 // "BSEC" in little endian
+#define STATE_FORMAT_VERSION 1
+
+#define NS_PER_MINUTE (60LL * 1000LL * 1000LL * 1000LL)
+
+// Bounds of the adaptive interval between state checks.
+#define SAVE_INTERVAL_MIN_NS (10 * NS_PER_MINUTE)
+#define SAVE_INTERVAL_MAX_NS (8 * 60 * NS_PER_MINUTE)
+
+/*
+ * Fraction of the state blob (in parts per thousand) that must differ from the persisted copy.
+ * Below the low threshold the write is deferred and the interval grows. Above the high threshold
+ * the state is written and the interval shrinks.
+ */
+#define CHANGE_LOW_PERMILLE 10
+#define CHANGE_HIGH_PERMILLE 100
+
+#define NUM_SLOTS 2
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Header stored in front of the state blob in each slot file.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;  ///< Incremented on every save. The highest valid sequence is the newest.
+    uint32_t length;    ///< Number of bytes of state blob following the header.
+    uint32_t crc;       ///< CRC32 over the preceding header fields and the blob.
+}
+StateHeader_t;
+
+static const char *const SlotFiles[NUM_SLOTS] = {
+    "bsec_state_a.bin",
+    "bsec_state_b.bin",
+};
+
+static struct
+{
+    int newestSlot;         ///< Slot holding the newest valid state, or -1 if none.
+    uint32_t sequence;      ///< Sequence number of the newest valid state.
+    uint8_t blob[BSEC_MAX_STATE_BLOB_SIZE]; ///< Copy of the last persisted state.
+    uint32_t blobLen;
+    int64_t lastCheckNs;    ///< Time of the last comparison, 0 before the first sample.
+    int64_t intervalNs;     ///< Current adaptive interval between comparisons.
+} Persist = {
+    .newestSlot = -1,
+    .intervalNs = SAVE_INTERVAL_MIN_NS,
+};
+
+
+static uint32_t ComputeCrc(const StateHeader_t *header, const uint8_t *blob)
+{
+    uint32_t crc = le_crc_Crc32(
+        (const uint8_t *)header, offsetof(StateHeader_t, crc), LE_CRC_START_CRC32);
+    return le_crc_Crc32(blob, header->length, crc);
+}
+
+static le_result_t ReadAll(int fd, void *buf, size_t len)
+{
+    size_t numRead = 0;
+    while (numRead < len)
+    {
+        ssize_t res = read(fd, (uint8_t *)buf + numRead, len - numRead);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return LE_FAULT;
+        }
+        if (res == 0)
+        {
+            // Truncated file
+            return LE_UNDERFLOW;
+        }
+        numRead += res;
+    }
+    return LE_OK;
+}
+
+static le_result_t WriteAll(int fd, const void *buf, size_t len)
+{
+    size_t numWritten = 0;
+    while (numWritten < len)
+    {
+        ssize_t res = write(fd, (const uint8_t *)buf + numWritten, len - numWritten);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return LE_FAULT;
+        }
+        numWritten += res;
+    }
+    return LE_OK;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Read and validate one slot.
+ *
+ * @return LE_OK if the slot holds a complete state with a matching checksum.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t ReadSlot(int slot, StateHeader_t *header, uint8_t *blob)
+{
+    const char *path = SlotFiles[slot];
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        if (errno != ENOENT)
+        {
+            LE_WARN("Couldn't open \"%s\" for reading - %s", path, strerror(errno));
+        }
+        return LE_NOT_FOUND;
+    }
+
+    le_result_t res = ReadAll(fd, header, sizeof(*header));
+    if (res != LE_OK)
+    {
+        LE_WARN("Couldn't read state header from \"%s\"", path);
+        goto done;
+    }
+
+    if (header->magic != STATE_MAGIC ||
+        header->version != STATE_FORMAT_VERSION ||
+        header->length == 0 ||
+        header->length > BSEC_MAX_STATE_BLOB_SIZE)
+    {
+        LE_WARN("Invalid state header in \"%s\"", path);
+        res = LE_FORMAT_ERROR;
+        goto done;
+    }
+
+    res = ReadAll(fd, blob, header->length);
+    if (res != LE_OK)
+    {
+        LE_WARN("Couldn't read %u byte state from \"%s\"", header->length, path);
+        goto done;
+    }
+
+    if (ComputeCrc(header, blob) != header->crc)
+    {
+        LE_WARN("Checksum mismatch in \"%s\"", path);
+        res = LE_FORMAT_ERROR;
+    }
+
+done:
+    close(fd);
+    return res;
+}
+
+static le_result_t WriteSlot(int slot, uint32_t sequence, const uint8_t *blob, uint32_t len)
+{
+    const char *path = SlotFiles[slot];
+    StateHeader_t header = {
+        .magic = STATE_MAGIC,
+        .version = STATE_FORMAT_VERSION,
+        .sequence = sequence,
+        .length = len,
+    };
+    header.crc = ComputeCrc(&header, blob);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+    {
+        LE_ERROR("Couldn't open \"%s\" for writing - %s", path, strerror(errno));
+        return LE_FAULT;
+    }
+
+    le_result_t res = WriteAll(fd, &header, sizeof(header));
+    if (res == LE_OK)
+    {
+        res = WriteAll(fd, blob, len);
+    }
+    if (res != LE_OK)
+    {
+        LE_ERROR("Failed to write \"%s\" - %s", path, strerror(errno));
+        goto done;
+    }
+
+    if (fsync(fd))
+    {
+        LE_ERROR("Failed to sync \"%s\" - %s", path, strerror(errno));
+        res = LE_FAULT;
+    }
+
+done:
+    close(fd);
+    return res;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Serial number comparison so that sequence wraparound doesn't confuse the slot selection.
+ */
+//--------------------------------------------------------------------------------------------------
+static bool IsNewer(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+le_result_t BsecState_Restore(void)
+{
+    StateHeader_t headers[NUM_SLOTS];
+    uint8_t blobs[NUM_SLOTS][BSEC_MAX_STATE_BLOB_SIZE];
+    bool valid[NUM_SLOTS];
+
+    for (int slot = 0; slot < NUM_SLOTS; slot++)
+    {
+        valid[slot] = (ReadSlot(slot, &headers[slot], blobs[slot]) == LE_OK);
+    }
+
+    // Try the newest valid slot first and fall back to the older one if BSEC rejects it.
+    int order[NUM_SLOTS] = {0, 1};
+    if (valid[0] && valid[1] && IsNewer(headers[1].sequence, headers[0].sequence))
+    {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    le_result_t res = LE_NOT_FOUND;
+    int restoredSlot = -1;
+    for (int i = 0; i < NUM_SLOTS; i++)
+    {
+        const int slot = order[i];
+        if (!valid[slot])
+        {
+            continue;
+        }
+
+        uint8_t workBuffer[BSEC_MAX_PROPERTY_BLOB_SIZE];
+        bsec_library_return_t bsecRes = bsec_set_state(
+            blobs[slot], headers[slot].length, workBuffer, sizeof(workBuffer));
+        if (bsecRes != BSEC_OK)
+        {
+            LE_WARN("BSEC rejected state in \"%s\" (%d)", SlotFiles[slot], bsecRes);
+            res = LE_FAULT;
+            continue;
+        }
+
+        LE_INFO("Restored BSEC state #%u from \"%s\"", headers[slot].sequence, SlotFiles[slot]);
+        memcpy(Persist.blob, blobs[slot], headers[slot].length);
+        Persist.blobLen = headers[slot].length;
+        restoredSlot = slot;
+        res = LE_OK;
+        break;
+    }
+
+    /*
+     * The next sequence number must be above every stored one so the next save is seen as the
+     * newest copy.
+     */
+    for (int slot = 0; slot < NUM_SLOTS; slot++)
+    {
+        if (valid[slot] &&
+            (Persist.newestSlot == -1 || IsNewer(headers[slot].sequence, Persist.sequence)))
+        {
+            Persist.newestSlot = slot;
+            Persist.sequence = headers[slot].sequence;
+        }
+    }
+
+    /*
+     * The next save goes to the other slot than the one being protected. That is the slot BSEC
+     * accepted, so a rejected newer copy gets overwritten first. If nothing was accepted, the newest
+     * intact copy is kept instead.
+     */
+    if (restoredSlot != -1)
+    {
+        Persist.newestSlot = restoredSlot;
+    }
+
+    // The unversioned, unchecked state file from earlier releases is never trusted.
+    if (unlink(LEGACY_STATE_FILE) == 0)
+    {
+        LE_INFO("Removed legacy state file \"%s\"", LEGACY_STATE_FILE);
+    }
+
+    return res;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Fetch the current state from BSEC and compute how much of it differs from the persisted copy.
+ *
+ * @return LE_OK on success, with the differing fraction in parts per thousand in *changePermille.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t GetState(uint8_t *blob, uint32_t *len, uint32_t *changePermille)
+{
+    uint8_t workBuffer[BSEC_MAX_STATE_BLOB_SIZE];
+    bsec_library_return_t bsecStatus = bsec_get_state(
+        0, blob, BSEC_MAX_STATE_BLOB_SIZE, workBuffer, sizeof(workBuffer), len);
+    if (bsecStatus != BSEC_OK || *len == 0)
+    {
+        LE_ERROR("Couldn't get state out of BSEC (%d)", bsecStatus);
+        return LE_FAULT;
+    }
+
+    if (*len != Persist.blobLen)
+    {
+        *changePermille = 1000;
+        return LE_OK;
+    }
+
+    uint32_t numChanged = 0;
+    for (uint32_t i = 0; i < *len; i++)
+    {
+        if (blob[i] != Persist.blob[i])
+        {
+            numChanged++;
+        }
+    }
+    *changePermille = (numChanged * 1000 + *len - 1) / *len;
+    return LE_OK;
+}
+
+static le_result_t Save(const uint8_t *blob, uint32_t len)
+{
+    const int slot = (Persist.newestSlot == 0) ? 1 : 0;
+    const uint32_t sequence = Persist.sequence + 1;
+
+    le_result_t res = WriteSlot(slot, sequence, blob, len);
+    if (res != LE_OK)
+    {
+        return res;
+    }
+
+    LE_DEBUG("Saved BSEC state #%u to \"%s\"", sequence, SlotFiles[slot]);
+    Persist.newestSlot = slot;
+    Persist.sequence = sequence;
+    memcpy(Persist.blob, blob, len);
+    Persist.blobLen = len;
+    return LE_OK;
+}
+
+void BsecState_Update(int64_t nowNs)
+{
+    if (Persist.lastCheckNs == 0)
+    {
+        Persist.lastCheckNs = nowNs;
+        return;
+    }
+    if (nowNs - Persist.lastCheckNs < Persist.intervalNs)
+    {
+        return;
+    }
+    Persist.lastCheckNs = nowNs;
+
+    uint8_t blob[BSEC_MAX_STATE_BLOB_SIZE];
+    uint32_t len;
+    uint32_t changePermille;
+    if (GetState(blob, &len, &changePermille) != LE_OK)
+    {
+        return;
+    }
+
+    if (changePermille == 0 ||
+        (changePermille < CHANGE_LOW_PERMILLE && Persist.intervalNs < SAVE_INTERVAL_MAX_NS))
+    {
+        // Not worth a flash write yet. Compare against the same persisted copy next time so that
+        // small changes still accumulate towards the threshold.
+        Persist.intervalNs *= 2;
+        if (Persist.intervalNs > SAVE_INTERVAL_MAX_NS)
+        {
+            Persist.intervalNs = SAVE_INTERVAL_MAX_NS;
+        }
+        LE_DEBUG("BSEC state changed by %u/1000, deferring save. Next check in %" PRId64 " min",
+                 changePermille, Persist.intervalNs / NS_PER_MINUTE);
+        return;
+    }
+
+    if (Save(blob, len) != LE_OK)
+    {
+        // Retry at the shortest interval rather than waiting for a backed-off one.
+        Persist.intervalNs = SAVE_INTERVAL_MIN_NS;
+        return;
+    }
+
+    if (changePermille >= CHANGE_HIGH_PERMILLE)
+    {
+        Persist.intervalNs /= 2;
+        if (Persist.intervalNs < SAVE_INTERVAL_MIN_NS)
+        {
+            Persist.intervalNs = SAVE_INTERVAL_MIN_NS;
+        }
+    }
+    LE_DEBUG("BSEC state changed by %u/1000, saved. Next check in %" PRId64 " min",
+             changePermille, Persist.intervalNs / NS_PER_MINUTE);
+}
+
+le_result_t BsecState_Flush(void)
+{
+    uint8_t blob[BSEC_MAX_STATE_BLOB_SIZE];
+    uint32_t len;
+    uint32_t changePermille;
+    le_result_t res = GetState(blob, &len, &changePermille);
+    if (res != LE_OK || changePermille == 0)
+    {
+        return res;
+    }
+
+    return Save(blob, len);
+}
@@ -0,0 +1,33 @@
+#ifndef _BSEC_STATE_H_
+#define _BSEC_STATE_H_
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Restore the newest valid BSEC state from flash.
+ *
+ * @return
+ *      - LE_OK if a state was restored into the BSEC library
+ *      - LE_NOT_FOUND if no valid state exists
+ *      - LE_FAULT if BSEC rejected every stored state
+ */
+//--------------------------------------------------------------------------------------------------
+le_result_t BsecState_Restore(void);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Give the state persistence logic a chance to run. This is cheap to call after every sample; the
+ * state is only fetched from BSEC once the current save interval has elapsed and only written to
+ * flash if it has changed enough.
+ */
+//--------------------------------------------------------------------------------------------------
+void BsecState_Update(int64_t nowNs);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write the current BSEC state to flash if it differs from the last persisted state, regardless of
+ * the save interval. Intended for orderly shutdown.
+ */
+//--------------------------------------------------------------------------------------------------
+le_result_t BsecState_Flush(void);
+
+#endif // _BSEC_STATE_H_
@@ -0,0 +1,609 @@
+/*
+ * Host-side replayer for BSEC recordings made by the bme680EnvSensor recorder.
+ *
+ * Feeds the recorded inputs through bsec_do_steps() as fast as possible, compares the outputs with
+ * a golden set and reports the processing time per step. By default the golden set is the outputs
+ * that BSEC produced on the device, which are stored in the recording itself. This allows a new
+ * BSEC library or configuration to be qualified against field data in a fraction of the recorded
+ * time.
+ *
+ * Usage: bsecReplay [options] RECORDING
+ *   -g FILE   compare against the outputs in FILE instead of those in RECORDING
+ *   -w FILE   write the replayed outputs to FILE for use as a future golden set
+ *   -c FILE   load a serialized BSEC configuration before replaying
+ *   -s        ignore recorded states and replay from a freshly initialized library
+ *   -t TOL    relative tolerance for output signals (default 1e-4)
+ *   -v        print every mismatch instead of only the first few
+ *
+ * Exit status is 0 if all outputs matched, 1 on mismatches and 2 on errors.
+ *
+ * Copyright (C) Sierra Wireless Inc.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bsec_interface.h"
+#include "bsecRecord.h"
+
+#define MAX_REPORTED_MISMATCHES 10
+
+struct Buffer
+{
+    uint8_t *data;
+    size_t len;
+    size_t pos;
+};
+
+struct Record
+{
+    uint8_t type;
+    uint8_t count;
+    const uint8_t *payload;
+};
+
+static struct
+{
+    double tolerance;
+    bool ignoreState;
+    bool verbose;
+    FILE *goldenOut;
+    struct Buffer config;
+} Options = {
+    .tolerance = 1e-4,
+};
+
+static struct
+{
+    unsigned long sessions;
+    unsigned long steps;
+    unsigned long outputs;
+    unsigned long mismatches;
+    unsigned long bsecWarnings;
+    double totalStepNs;
+    double maxStepNs;
+    double recordedNs;      ///< Sum of the intervals between steps within each session.
+    bool havePrevious;
+    int64_t previousTimestamp;
+} Stats;
+
+
+static uint16_t GetU16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t GetU32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int64_t GetI64(const uint8_t *p)
+{
+    uint64_t u = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        u = (u << 8) | p[i];
+    }
+    return (int64_t)u;
+}
+
+static float GetFloat(const uint8_t *p)
+{
+    uint32_t u = GetU32(p);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static void PutBytes(FILE *f, const void *buf, size_t len)
+{
+    if (fwrite(buf, 1, len, f) != len)
+    {
+        fprintf(stderr, "Failed to write golden output - %s\n", strerror(errno));
+        exit(2);
+    }
+}
+
+static bool LoadFile(const char *path, struct Buffer *buf)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Couldn't open \"%s\" - %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf->data = malloc(len > 0 ? len : 1);
+    buf->len = len;
+    buf->pos = 0;
+    bool ok = buf->data && fread(buf->data, 1, len, f) == (size_t)len;
+    fclose(f);
+    if (!ok)
+    {
+        fprintf(stderr, "Couldn't read \"%s\"\n", path);
+    }
+    return ok;
+}
+
+static bool CheckHeader(const char *path, struct Buffer *buf)
+{
+    if (buf->len < BSEC_RECORD_HEADER_SIZE ||
+        memcmp(buf->data, BSEC_RECORD_MAGIC, 4) != 0 ||
+        buf->data[4] != BSEC_RECORD_VERSION)
+    {
+        fprintf(stderr, "\"%s\" is not a version %d BSEC recording\n", path, BSEC_RECORD_VERSION);
+        return false;
+    }
+    buf->pos = BSEC_RECORD_HEADER_SIZE;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Fetch the next record from a buffer.
+ *
+ * @return 1 if a record was returned, 0 at the end of the buffer and -1 if the buffer is corrupt.
+ */
+//--------------------------------------------------------------------------------------------------
+static int NextRecord(struct Buffer *buf, struct Record *rec)
+{
+    if (buf->pos == buf->len)
+    {
+        return 0;
+    }
+    if (buf->len - buf->pos < BSEC_RECORD_PREFIX_SIZE)
+    {
+        return -1;
+    }
+
+    const uint8_t *p = &buf->data[buf->pos];
+    rec->type = p[0];
+    rec->count = p[1];
+    rec->payload = p + BSEC_RECORD_PREFIX_SIZE;
+    const size_t avail = buf->len - buf->pos - BSEC_RECORD_PREFIX_SIZE;
+
+    size_t size;
+    switch (rec->type)
+    {
+    case BSEC_RECORD_SESSION:
+        size = 0;
+        break;
+    case BSEC_RECORD_STATE:
+        if (avail < BSEC_RECORD_STATE_LENGTH_SIZE)
+        {
+            return -1;
+        }
+        size = BSEC_RECORD_STATE_LENGTH_SIZE + GetU16(rec->payload);
+        break;
+    case BSEC_RECORD_SUBSCRIPTION:
+        size = rec->count * BSEC_RECORD_SUBSCRIPTION_ENTRY_SIZE;
+        break;
+    case BSEC_RECORD_STEP:
+        size = BSEC_RECORD_TIMESTAMP_SIZE + rec->count * BSEC_RECORD_STEP_ENTRY_SIZE;
+        break;
+    case BSEC_RECORD_OUTPUTS:
+        size = BSEC_RECORD_TIMESTAMP_SIZE + rec->count * BSEC_RECORD_OUTPUT_ENTRY_SIZE;
+        break;
+    default:
+        fprintf(stderr, "Unknown record type %u at offset %zu\n", rec->type, buf->pos);
+        return -1;
+    }
+
+    if (size > avail)
+    {
+        fprintf(stderr, "Truncated record at offset %zu\n", buf->pos);
+        return -1;
+    }
+    buf->pos += BSEC_RECORD_PREFIX_SIZE + size;
+    return 1;
+}
+
+static int NextOutputsRecord(struct Buffer *buf, struct Record *rec)
+{
+    int res;
+    while ((res = NextRecord(buf, rec)) == 1 && rec->type != BSEC_RECORD_OUTPUTS)
+    {
+    }
+    return res;
+}
+
+static double ElapsedNs(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void ReportMismatch(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void ReportMismatch(const char *fmt, ...)
+{
+    Stats.mismatches++;
+    if (Options.verbose || Stats.mismatches <= MAX_REPORTED_MISMATCHES)
+    {
+        va_list args;
+        va_start(args, fmt);
+        printf("step %lu: ", Stats.steps);
+        vprintf(fmt, args);
+        printf("\n");
+        va_end(args);
+    }
+}
+
+static void CompareOutputs(const bsec_output_t *outputs, uint8_t numOutputs, const struct Record *golden)
+{
+    bool matched[UINT8_MAX] = {false};
+
+    for (uint8_t i = 0; i < numOutputs; i++)
+    {
+        int found = -1;
+        for (uint8_t j = 0; j < golden->count; j++)
+        {
+            const uint8_t *entry = golden->payload + BSEC_RECORD_TIMESTAMP_SIZE +
+                                   j * BSEC_RECORD_OUTPUT_ENTRY_SIZE;
+            if (!matched[j] && entry[0] == outputs[i].sensor_id)
+            {
+                found = j;
+                break;
+            }
+        }
+        if (found < 0)
+        {
+            ReportMismatch("unexpected output %u", outputs[i].sensor_id);
+            continue;
+        }
+        matched[found] = true;
+
+        const uint8_t *entry = golden->payload + BSEC_RECORD_TIMESTAMP_SIZE +
+                               found * BSEC_RECORD_OUTPUT_ENTRY_SIZE;
+        const uint8_t accuracy = entry[1];
+        const float signal = GetFloat(&entry[2]);
+        const double limit = Options.tolerance * fmax(1.0, fabs(signal));
+        if (accuracy != outputs[i].accuracy || fabs(outputs[i].signal - signal) > limit)
+        {
+            ReportMismatch("output %u is %f (accuracy %u), expected %f (accuracy %u)",
+                           outputs[i].sensor_id, outputs[i].signal, outputs[i].accuracy,
+                           signal, accuracy);
+        }
+    }
+
+    for (uint8_t j = 0; j < golden->count; j++)
+    {
+        if (!matched[j])
+        {
+            const uint8_t *entry = golden->payload + BSEC_RECORD_TIMESTAMP_SIZE +
+                                   j * BSEC_RECORD_OUTPUT_ENTRY_SIZE;
+            ReportMismatch("missing output %u", entry[0]);
+        }
+    }
+}
+
+static void WriteGoldenOutputs(int64_t timestamp, const bsec_output_t *outputs, uint8_t numOutputs)
+{
+    uint8_t prefix[BSEC_RECORD_PREFIX_SIZE + BSEC_RECORD_TIMESTAMP_SIZE] = {
+        BSEC_RECORD_OUTPUTS,
+        numOutputs,
+    };
+    for (int i = 0; i < 8; i++)
+    {
+        prefix[BSEC_RECORD_PREFIX_SIZE + i] = (uint64_t)timestamp >> (8 * i);
+    }
+    PutBytes(Options.goldenOut, prefix, sizeof(prefix));
+
+    for (uint8_t i = 0; i < numOutputs; i++)
+    {
+        uint32_t u;
+        memcpy(&u, &outputs[i].signal, sizeof(u));
+        const uint8_t entry[BSEC_RECORD_OUTPUT_ENTRY_SIZE] = {
+            outputs[i].sensor_id, outputs[i].accuracy, u, u >> 8, u >> 16, u >> 24,
+        };
+        PutBytes(Options.goldenOut, entry, sizeof(entry));
+    }
+}
+
+static bool ReplayStep(const struct Record *rec, struct Buffer *golden)
+{
+    const int64_t timestamp = GetI64(rec->payload);
+    bsec_input_t inputs[BSEC_MAX_PHYSICAL_SENSOR];
+    if (rec->count > BSEC_MAX_PHYSICAL_SENSOR)
+    {
+        fprintf(stderr, "Step with %u inputs exceeds BSEC_MAX_PHYSICAL_SENSOR\n", rec->count);
+        return false;
+    }
+    for (uint8_t i = 0; i < rec->count; i++)
+    {
+        const uint8_t *entry = rec->payload + BSEC_RECORD_TIMESTAMP_SIZE +
+                               i * BSEC_RECORD_STEP_ENTRY_SIZE;
+        memset(&inputs[i], 0, sizeof(inputs[i]));
+        inputs[i].sensor_id = entry[0];
+        inputs[i].signal = GetFloat(&entry[1]);
+        inputs[i].time_stamp = timestamp;
+    }
+
+    // Timestamps are from the device's monotonic clock, which restarts on reboot.
+    if (Stats.havePrevious && timestamp > Stats.previousTimestamp)
+    {
+        Stats.recordedNs += timestamp - Stats.previousTimestamp;
+    }
+    Stats.havePrevious = true;
+    Stats.previousTimestamp = timestamp;
+
+    // The device calls bsec_sensor_control() at the start of every measurement cycle.
+    bsec_bme_settings_t sensorSettings;
+    bsec_sensor_control(timestamp, &sensorSettings);
+
+    bsec_output_t outputs[BSEC_NUMBER_OUTPUTS];
+    uint8_t numOutputs = BSEC_NUMBER_OUTPUTS;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bsec_library_return_t res = bsec_do_steps(inputs, rec->count, outputs, &numOutputs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const double stepNs = ElapsedNs(&start, &end);
+    Stats.totalStepNs += stepNs;
+    if (stepNs > Stats.maxStepNs)
+    {
+        Stats.maxStepNs = stepNs;
+    }
+    Stats.steps++;
+    Stats.outputs += numOutputs;
+
+    if (res < BSEC_OK)
+    {
+        fprintf(stderr, "bsec_do_steps failed (%d) at step %lu\n", res, Stats.steps);
+        return false;
+    }
+    if (res > BSEC_OK)
+    {
+        Stats.bsecWarnings++;
+    }
+
+    if (Options.goldenOut)
+    {
+        WriteGoldenOutputs(timestamp, outputs, numOutputs);
+    }
+
+    if (golden)
+    {
+        struct Record goldenRec;
+        int gres = NextOutputsRecord(golden, &goldenRec);
+        if (gres != 1)
+        {
+            ReportMismatch("no golden outputs left");
+            return true;
+        }
+        CompareOutputs(outputs, numOutputs, &goldenRec);
+    }
+    return true;
+}
+
+static bool ApplyConfiguration(void)
+{
+    if (!Options.config.data)
+    {
+        return true;
+    }
+
+    uint8_t workBuffer[BSEC_MAX_PROPERTY_BLOB_SIZE];
+    bsec_library_return_t res = bsec_set_configuration(
+        Options.config.data, Options.config.len, workBuffer, sizeof(workBuffer));
+    if (res != BSEC_OK)
+    {
+        fprintf(stderr, "bsec_set_configuration failed (%d)\n", res);
+        return false;
+    }
+    return true;
+}
+
+static bool Replay(struct Buffer *recording, struct Buffer *golden)
+{
+    struct Record rec;
+    int res;
+    while ((res = NextRecord(recording, &rec)) == 1)
+    {
+        switch (rec.type)
+        {
+        case BSEC_RECORD_SESSION:
+            // Every session starts from a freshly initialized library, as on the device.
+            if (bsec_init() != BSEC_OK)
+            {
+                fprintf(stderr, "bsec_init failed\n");
+                return false;
+            }
+            if (!ApplyConfiguration())
+            {
+                return false;
+            }
+            Stats.sessions++;
+            Stats.havePrevious = false;
+            break;
+
+        case BSEC_RECORD_STATE:
+            if (!Options.ignoreState)
+            {
+                uint8_t workBuffer[BSEC_MAX_PROPERTY_BLOB_SIZE];
+                bsec_library_return_t bres = bsec_set_state(
+                    rec.payload + BSEC_RECORD_STATE_LENGTH_SIZE,
+                    GetU16(rec.payload),
+                    workBuffer,
+                    sizeof(workBuffer));
+                if (bres != BSEC_OK)
+                {
+                    fprintf(stderr, "Warning: bsec_set_state failed (%d)\n", bres);
+                }
+            }
+            break;
+
+        case BSEC_RECORD_SUBSCRIPTION:
+        {
+            bsec_sensor_configuration_t outputs[UINT8_MAX];
+            for (uint8_t i = 0; i < rec.count; i++)
+            {
+                const uint8_t *entry = rec.payload + i * BSEC_RECORD_SUBSCRIPTION_ENTRY_SIZE;
+                outputs[i].sensor_id = entry[0];
+                outputs[i].sample_rate = GetFloat(&entry[1]);
+            }
+            bsec_sensor_configuration_t required[BSEC_MAX_PHYSICAL_SENSOR];
+            uint8_t numRequired = BSEC_MAX_PHYSICAL_SENSOR;
+            bsec_library_return_t bres = bsec_update_subscription(
+                outputs, rec.count, required, &numRequired);
+            if (bres != BSEC_OK)
+            {
+                fprintf(stderr, "Warning: bsec_update_subscription failed (%d)\n", bres);
+            }
+            break;
+        }
+
+        case BSEC_RECORD_STEP:
+            if (!ReplayStep(&rec, golden))
+            {
+                return false;
+            }
+            break;
+
+        case BSEC_RECORD_OUTPUTS:
+            // Device outputs. Only of interest when the recording is its own golden set.
+            break;
+        }
+    }
+    return res == 0;
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-g GOLDEN] [-w OUT] [-c CONFIG] [-s] [-t TOL] [-v] RECORDING\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *goldenPath = NULL;
+    const char *goldenOutPath = NULL;
+    const char *configPath = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "g:w:c:st:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'g':
+            goldenPath = optarg;
+            break;
+        case 'w':
+            goldenOutPath = optarg;
+            break;
+        case 'c':
+            configPath = optarg;
+            break;
+        case 's':
+            Options.ignoreState = true;
+            break;
+        case 't':
+            Options.tolerance = strtod(optarg, NULL);
+            break;
+        case 'v':
+            Options.verbose = true;
+            break;
+        default:
+            Usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        Usage(argv[0]);
+    }
+    const char *recordingPath = argv[optind];
+
+    struct Buffer recording;
+    if (!LoadFile(recordingPath, &recording) || !CheckHeader(recordingPath, &recording))
+    {
+        return 2;
+    }
+
+    struct Buffer golden;
+    if (!goldenPath)
+    {
+        golden = recording;
+    }
+    else if (!LoadFile(goldenPath, &golden) || !CheckHeader(goldenPath, &golden))
+    {
+        return 2;
+    }
+
+    bsec_version_t version;
+    if (bsec_init() != BSEC_OK || bsec_get_version(&version) != BSEC_OK)
+    {
+        fprintf(stderr, "Failed to initialize the BSEC library\n");
+        return 2;
+    }
+    printf("Recorded with BSEC v%u.%u.%u.%u, replaying with v%u.%u.%u.%u\n",
+           recording.data[5], recording.data[6], recording.data[7], recording.data[8],
+           version.major, version.minor, version.major_bugfix, version.minor_bugfix);
+
+    if (configPath && !LoadFile(configPath, &Options.config))
+    {
+        return 2;
+    }
+
+    if (goldenOutPath)
+    {
+        Options.goldenOut = fopen(goldenOutPath, "wb");
+        if (!Options.goldenOut)
+        {
+            fprintf(stderr, "Couldn't open \"%s\" - %s\n", goldenOutPath, strerror(errno));
+            return 2;
+        }
+        // The golden file reuses the recording header so that it identifies the BSEC version.
+        uint8_t header[BSEC_RECORD_HEADER_SIZE] = {0};
+        memcpy(header, BSEC_RECORD_MAGIC, 4);
+        header[4] = BSEC_RECORD_VERSION;
+        header[5] = version.major;
+        header[6] = version.minor;
+        header[7] = version.major_bugfix;
+        header[8] = version.minor_bugfix;
+        PutBytes(Options.goldenOut, header, sizeof(header));
+    }
+
+    bool ok = Replay(&recording, &golden);
+
+    if (Options.goldenOut && fclose(Options.goldenOut) != 0)
+    {
+        fprintf(stderr, "Failed to write \"%s\" - %s\n", goldenOutPath, strerror(errno));
+        ok = false;
+    }
+
+    const double recordedS = Stats.recordedNs / 1e9;
+    const double processingS = Stats.totalStepNs / 1e9;
+    printf("Sessions:          %lu\n", Stats.sessions);
+    printf("Steps:             %lu (%lu outputs, %lu BSEC warnings)\n",
+           Stats.steps, Stats.outputs, Stats.bsecWarnings);
+    printf("Recorded span:     %.1f h\n", recordedS / 3600.0);
+    printf("Processing time:   %.3f s (%.1f us/step mean, %.1f us/step max)\n",
+           processingS,
+           Stats.steps ? Stats.totalStepNs / Stats.steps / 1e3 : 0.0,
+           Stats.maxStepNs / 1e3);
+    if (processingS > 0)
+    {
+        printf("Throughput:        %.0f steps/s (%.0fx real time)\n",
+               Stats.steps / processingS, recordedS / processingS);
+    }
+    printf("Mismatches:        %lu\n", Stats.mismatches);
+
+    if (!ok)
+    {
+        return 2;
+    }
+    return Stats.mismatches ? 1 : 0;
+}
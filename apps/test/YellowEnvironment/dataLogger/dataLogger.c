@@ -1,25 +1,22 @@
 //--------------------------------------------------------------------------------------------------
 /**
  * Data Logger that captures sensor data from the various on-board sensors on the mangOH
- * Yellow.  This utilizes the Data Hub's persistent observation buffers to capture a historical
- * log of the samples over time.
+ * Yellow.  Samples are pushed to this app by the Data Hub and appended to a compressed,
+ * append-only time-series store (see tsStore.h), one stream per sensor (or per member of a
+ * sensor's JSON value, e.g. "accel.x").
  *
- * The on-board flash has about 70 MB available (in /mnt/flash, where the Data Hub persistant
- * backups are kept).  We shouldn't use more than half of this, because the Data Hub uses the
- * Atomic File Access API to do the saving, which requires twice the space for each file.
+ * The on-board flash has about 70 MB available.  Unlike the Data Hub's persistent observation
+ * buffers, the store doesn't rewrite its files to save them, so it can use most of that space.
+ * With typically a few bytes per compressed sample, that holds months of samples instead of days.
+ * When the space is used up, the oldest samples are discarded.
  *
- * All of the work that this app does is actually done at start-up.  First, it configures the
- * data hub for observing the sensors, then it saves any previously sampled data from the
- * observations and erases those old sensor readings to make room for new samples that may have
- * the same timestamp range as the old samples (because there's no battery for the RTC), and
- * finally, it enables the sensors.
+ * Samples are kept across restarts (there's no battery for the RTC, so timestamps from before a
+ * restart may overlap later ones; samples are returned in the order they were appended).
  *
- * Unfortunately, because the Data Hub doesn't have a synchronous version of
- * dhubQuery_ReadBufferJson(), we have to break up the work as follows:
- * - COMPONENT_INIT configures the Data Hub and starts saving the observation buffers to files.
- *   There will be one separate callback to BufferReadComplete() for each observation.
- * - BufferReadComplete() (completion callback from dhubQuery_ReadBufferJson()) closes the file,
- *   erases the observation buffer, and enables the sensor.
+ * To read the samples back, send the dataLogger process SIGUSR1 (kill -USR1 <pid>).
+ * The samples of the last EXPORT_WINDOW_S seconds of every stream are then written to
+ * EXPORT_DIR_PATH "/<stream>.json", in the same format the Data Hub's buffer dumps used:
+ * [{"t":<timestamp>,"v":<value>},...]
  *
  * Copyright (C) Sierra Wireless Inc.
  */
@@ -27,12 +24,16 @@
 
 #include "legato.h"
 #include "interfaces.h"
+#include "tsStore.h"
 
 #define SAMPLES_PER_MINUTE 6
-#define MAX_SAMPLES_PER_SENSOR (SAMPLES_PER_MINUTE * 60 /*mins*/ * 24 /*hrs*/ * 5 /*days*/)
-#define BACKUP_PERIOD 60 // seconds between buffer backups to flash.
 
 #define SAVE_DIR_PATH "/home/root/save"
+#define STORE_DIR_PATH SAVE_DIR_PATH "/tsStore"
+#define STORE_MAX_BYTES (48 * 1024 * 1024)
+
+#define EXPORT_DIR_PATH SAVE_DIR_PATH "/export"
+#define EXPORT_WINDOW_S (24 * 60 * 60)
 
 //--------------------------------------------------------------------------------------------------
 /**
@@ -41,13 +42,11 @@
 //--------------------------------------------------------------------------------------------------
 typedef struct
 {
-    const char* name;   ///< The name of the sensor, to be used to name the save files and the
+    const char* name;   ///< The name of the sensor, to be used to name the streams and the
                         ///< observation.
 
     const char* resPath; ///< DataHub path where the sensor's value, period, and enable can be
                          ///< found. (e.g., "/app/light" or "/app/environment/pressure")
-
-    int saveFd;     ///< File descriptor of save file (or -1 if file not open).
 }
 Sensor_t;
 
@@ -59,59 +58,113 @@ Sensor_t;
 //--------------------------------------------------------------------------------------------------
 static Sensor_t SensorContextList[] =
 {
-    // name,        resPath,            saveFd (-1)
-    { "light",      "/app/light",       -1 },
-    { "battery",    "/app/battery",     -1 },
-    { "gyro",       "/app/imu/gyro",    -1 },
-    { "accel",      "/app/imu/accel",   -1 },
-    { "imuTemp",    "/app/imu/temp",    -1 },
-    { "env",        "/app/environment", -1 }
+    // name,        resPath
+    { "light",      "/app/light" },
+    { "battery",    "/app/battery" },
+    { "gyro",       "/app/imu/gyro" },
+    { "accel",      "/app/imu/accel" },
+    { "imuTemp",    "/app/imu/temp" },
+    { "env",        "/app/environment" }
 };
 
 
 //--------------------------------------------------------------------------------------------------
 /**
- * Create a save directory whose name is an unsigned integer under the "/save" directory.
- * The lowest unsigned integer that doesn't already exist under /save will be used.
+ * Append a sample to the stream with the given name.
+ */
+//--------------------------------------------------------------------------------------------------
+static void StoreSample
+(
+    const char* streamName,
+    double timestamp,
+    double value
+)
+//--------------------------------------------------------------------------------------------------
+{
+    tsStore_StreamRef_t streamRef = tsStore_GetStream(streamName);
+    if (streamRef == NULL)
+    {
+        return;
+    }
+
+    le_result_t result = tsStore_Append(streamRef, timestamp, value);
+    if (result != LE_OK)
+    {
+        LE_ERROR("Failed (%s) to store %s sample.", LE_RESULT_TXT(result), streamName);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call-back for samples pushed to a sensor's observation.
  *
- * @return The integer identifier of the directory.
+ * A plain number is stored in the stream named after the sensor.  Each numeric member of a
+ * flat JSON object (e.g., {"x":1.0,"y":2.0,"z":3.0}) is stored in a stream named
+ * "<sensor>.<member>".  Anything else is ignored.
  */
 //--------------------------------------------------------------------------------------------------
-static uint MakeSaveDir
+static void SampleHandler
 (
-    void
+    double timestamp,
+    const char* value,
+    void* contextPtr
 )
 //--------------------------------------------------------------------------------------------------
 {
-    // Make the parent directory, if it doesn't yet exist.
-    LE_ASSERT(le_dir_MakePath(SAVE_DIR_PATH, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == LE_OK);
+    Sensor_t* sensorPtr = contextPtr;
+    char* endPtr;
 
-    char path[128];
-    uint dirId;
-    le_result_t result;
+    double number = strtod(value, &endPtr);
+    if (endPtr != value)
+    {
+        StoreSample(sensorPtr->name, timestamp, number);
+        return;
+    }
 
-    // Start at 0 and keep incrementing until we find an integer that doesn't already have
-    // a directory with that name.
-    for (dirId = 0, result = LE_DUPLICATE; result == LE_DUPLICATE; dirId++)
+    const char* p = strchr(value, '{');
+    while (p != NULL && (p = strchr(p, '"')) != NULL)
     {
-        LE_ASSERT(sizeof(path) > snprintf(path, sizeof(path), SAVE_DIR_PATH "/%u", dirId));
+        const char* keyPtr = p + 1;
+        const char* keyEndPtr = strchr(keyPtr, '"');
+        if (keyEndPtr == NULL)
+        {
+            break;
+        }
 
-        result = le_dir_Make(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+        p = keyEndPtr + 1;
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (*p != ':')
+        {
+            continue;
+        }
 
-        if (result == LE_OK)
+        number = strtod(p + 1, &endPtr);
+        if (endPtr != p + 1)
         {
-            return dirId;
+            char streamName[TSSTORE_MAX_NAME_BYTES];
+            if (sizeof(streamName) > snprintf(streamName,
+                                              sizeof(streamName),
+                                              "%s.%.*s",
+                                              sensorPtr->name,
+                                              (int)(keyEndPtr - keyPtr),
+                                              keyPtr))
+            {
+                StoreSample(streamName, timestamp, number);
+            }
+            p = endPtr;
         }
     }
-
-    LE_FATAL("Error (%s) creating save directory (%s).", LE_RESULT_TXT(result), path);
 }
 
 
 //--------------------------------------------------------------------------------------------------
 /**
- * Use the Data Hub Admin API to configure the monitoring and persistent buffering of a
- * sensor input's samples under an observation.
+ * Use the Data Hub Admin API to route a sensor input's samples to an observation and have the
+ * observation's samples pushed to this app.
  */
 //--------------------------------------------------------------------------------------------------
 static void ConfigureLogging
@@ -128,8 +181,7 @@ static void ConfigureLogging
     LE_ASSERT(sizeof(valPath) > snprintf(valPath, sizeof(valPath), "%s/value", sensorPtr->resPath));
 
     dhubAdmin_SetSource(obsPath, valPath);
-    dhubAdmin_SetBufferMaxCount(obsPath, MAX_SAMPLES_PER_SENSOR);
-    dhubAdmin_SetBufferBackupPeriod(obsPath, BACKUP_PERIOD);
+    dhubAdmin_AddJsonPushHandler(obsPath, SampleHandler, sensorPtr);
 }
 
 
@@ -158,121 +210,235 @@ static void EnableSensor
 
 //--------------------------------------------------------------------------------------------------
 /**
- * Erase an observation's buffer of samples.
+ * State of the export of one stream to a JSON file.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct
+{
+    int fd;             ///< Export file, opened with the Atomic File Access API.
+    le_result_t result; ///< First write error, LE_OK if none.
+    size_t numSamples;
+    size_t len;         ///< Bytes used in buf.
+    char buf[4096];
+}
+Export_t;
+
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write out the buffered part of an export file.
  */
 //--------------------------------------------------------------------------------------------------
-static void EraseObservationBuffer
+static void ExportWrite
 (
-    Sensor_t* sensorPtr
+    Export_t* exportPtr
 )
 //--------------------------------------------------------------------------------------------------
 {
-    // Erase the observation buffer contents by setting the maximum number of samples to zero
-    // momentarily.
-    uint32_t bufferMaxCount = dhubAdmin_GetBufferMaxCount(sensorPtr->name);
-    dhubAdmin_SetBufferMaxCount(sensorPtr->name, 0);
-    dhubAdmin_SetBufferMaxCount(sensorPtr->name, bufferMaxCount);
+    size_t written = 0;
+    while (exportPtr->result == LE_OK && written < exportPtr->len)
+    {
+        ssize_t res = write(exportPtr->fd, exportPtr->buf + written, exportPtr->len - written);
+        if (res < 0 && errno != EINTR)
+        {
+            exportPtr->result = LE_IO_ERROR;
+        }
+        else if (res > 0)
+        {
+            written += res;
+        }
+    }
+    exportPtr->len = 0;
 }
 
 
 //--------------------------------------------------------------------------------------------------
 /**
- * Completion call-back for dhubQuery_ReadBufferJson().  This closes the file, erases the
- * observation buffer and enables the sensor to begin the delivery of new samples to the
- * observation.
+ * Append text to an export file.
  */
 //--------------------------------------------------------------------------------------------------
-static void BufferReadComplete
+static void ExportPrint
 (
-    le_result_t result,
-    void* contextPtr
+    Export_t* exportPtr,
+    const char* format,
+    ...
 )
 //--------------------------------------------------------------------------------------------------
 {
-    Sensor_t* sensorPtr = contextPtr;
+    char line[128];
+    va_list args;
 
-    if (result != LE_OK)
-    {
-        LE_CRIT("Failed (%s) to read observation buffer (%s) to file.",
-                LE_RESULT_TXT(result),
-                sensorPtr->name);
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    LE_ASSERT(len >= 0 && len < sizeof(line));
 
-        // Continue on, losing old samples. :(
+    if (exportPtr->len + len > sizeof(exportPtr->buf))
+    {
+        ExportWrite(exportPtr);
     }
+    memcpy(exportPtr->buf + exportPtr->len, line, len);
+    exportPtr->len += len;
+}
 
-    LE_ASSERT(le_atomFile_Close(sensorPtr->saveFd) == LE_OK);
-    LE_INFO("Successfully saved %s samples (to fd %d)", sensorPtr->name, sensorPtr->saveFd);
-    sensorPtr->saveFd = -1;
 
-    EraseObservationBuffer(sensorPtr);
-    EnableSensor(sensorPtr);
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call-back for the samples of a stream being exported.
+ */
+//--------------------------------------------------------------------------------------------------
+static void ExportSample
+(
+    double timestamp,
+    double value,
+    void* contextPtr
+)
+//--------------------------------------------------------------------------------------------------
+{
+    Export_t* exportPtr = contextPtr;
+
+    ExportPrint(exportPtr,
+                "%s{\"t\":%.3f,\"v\":%.17g}",
+                exportPtr->numSamples ? "," : "",
+                timestamp,
+                value);
+    exportPtr->numSamples++;
 }
 
 
 //--------------------------------------------------------------------------------------------------
 /**
- * Read old samples from an observation into a file.  BufferSaveComplete() will be called when
- * the old samples have all be written to the file.
- *
- * The file will be saved at the path "/save/<dirId>/<name>".
- *
- * @warning It is assumed that the directory "/save/<dirId>" exists before this function is called.
+ * Export the samples of one stream within the export window to EXPORT_DIR_PATH "/<name>.json".
+ * The file is replaced atomically, a failed export leaves the previous one in place.
  */
 //--------------------------------------------------------------------------------------------------
-static void SaveOldSamples
+static void ExportStream
 (
-    Sensor_t* sensorPtr,
-    uint dirId
+    const char* name,
+    void* contextPtr
 )
 //--------------------------------------------------------------------------------------------------
 {
+    const double* nowPtr = contextPtr;
     char path[128];
 
-    LE_ASSERT(sizeof(path) > snprintf(path,
-                                      sizeof(path),
-                                      SAVE_DIR_PATH "/%u/%s",
-                                      dirId,
-                                      sensorPtr->name) );
+    tsStore_StreamRef_t streamRef = tsStore_GetStream(name);
+    if (streamRef == NULL)
+    {
+        return;
+    }
 
-    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-    int fd = le_atomFile_Create(path, LE_FLOCK_WRITE, LE_FLOCK_FAIL_IF_EXIST, mode);
-    if (fd < 0)
+    LE_ASSERT(sizeof(path) > snprintf(path, sizeof(path), EXPORT_DIR_PATH "/%s.json", name));
+
+    static Export_t export;
+    export.fd = le_atomFile_Create(path,
+                                   LE_FLOCK_WRITE,
+                                   LE_FLOCK_REPLACE_IF_EXIST,
+                                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (export.fd < 0)
+    {
+        LE_ERROR("Failed (%s) to open export file (%s).", LE_RESULT_TXT(export.fd), path);
+        return;
+    }
+    export.result = LE_OK;
+    export.numSamples = 0;
+    export.len = 0;
+
+    ExportPrint(&export, "[");
+    le_result_t result = tsStore_Query(streamRef,
+                                       *nowPtr - EXPORT_WINDOW_S,
+                                       *nowPtr,
+                                       ExportSample,
+                                       &export);
+    ExportPrint(&export, "]\n");
+    ExportWrite(&export);
+
+    if (result != LE_OK && result != LE_FORMAT_ERROR)
+    {
+        LE_ERROR("Failed (%s) to read %s samples.", LE_RESULT_TXT(result), name);
+        le_atomFile_Cancel(export.fd);
+        return;
+    }
+    if (result == LE_FORMAT_ERROR)
     {
-        LE_CRIT("Failed (%s) to open save file (%s).", LE_RESULT_TXT(fd), path);
+        LE_WARN("Skipped corrupt %s samples.", name);
+    }
 
-        // Limp on, losing the old samples. :(
-        EraseObservationBuffer(sensorPtr);
-        EnableSensor(sensorPtr);
+    if (export.result != LE_OK)
+    {
+        LE_ERROR("Failed (%s) to write export file (%s).", LE_RESULT_TXT(export.result), path);
+        le_atomFile_Cancel(export.fd);
+        return;
     }
-    else
+
+    result = le_atomFile_Close(export.fd);
+    if (result != LE_OK)
     {
-        LE_INFO("Backing up %s samples to %s", sensorPtr->name, path);
+        LE_ERROR("Failed (%s) to save export file (%s).", LE_RESULT_TXT(result), path);
+        return;
+    }
 
-        sensorPtr->saveFd = fd; // Remember the file descriptor so we can close it later.
+    LE_INFO("Exported %zu %s samples to %s", export.numSamples, name, path);
+}
 
-        // dhubQuery_ReadBufferJson() will take ownership of the fd and pass it across to
-        // the Data Hub.  But, we need to use the Atomic File API to close the same fd later,
-        // so we pass a duplicate fd to the Data Hub instead.
-        fd = dup(fd);
-        LE_FATAL_IF(fd < 0, "Failed to dup fd %d (%m)", sensorPtr->saveFd)
-        dhubQuery_ReadBufferJson(sensorPtr->name, NAN, fd, BufferReadComplete, sensorPtr);
 
-        // Wait for call-back to BufferReadComplete().
+//--------------------------------------------------------------------------------------------------
+/**
+ * Export the recent samples of every stream on request.
+ */
+//--------------------------------------------------------------------------------------------------
+static void SigUsr1Handler
+(
+    int sigNum
+)
+//--------------------------------------------------------------------------------------------------
+{
+    if (le_dir_MakePath(EXPORT_DIR_PATH, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != LE_OK)
+    {
+        LE_ERROR("Couldn't create export directory (%s).", EXPORT_DIR_PATH);
+        return;
     }
+
+    le_clk_Time_t now = le_clk_GetAbsoluteTime();
+    double nowSec = now.sec + now.usec / 1000000.0;
+
+    tsStore_ForEachStream(ExportStream, &nowSec);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write the buffered samples to flash before exiting.
+ */
+//--------------------------------------------------------------------------------------------------
+static void SigTermHandler
+(
+    int sigNum
+)
+//--------------------------------------------------------------------------------------------------
+{
+    tsStore_Flush();
+    exit(EXIT_SUCCESS);
 }
 
 
 COMPONENT_INIT
 {
-    uint dirId = MakeSaveDir();
+    tsStore_Init(STORE_DIR_PATH, STORE_MAX_BYTES);
 
-    LE_INFO("---- Started Data Logger instance %u ----", dirId);
+    le_sig_Block(SIGTERM);
+    le_sig_SetEventHandler(SIGTERM, SigTermHandler);
+
+    le_sig_Block(SIGUSR1);
+    le_sig_SetEventHandler(SIGUSR1, SigUsr1Handler);
+
+    LE_INFO("---- Started Data Logger ----");
 
     uint i;
     for (i = 0; i < NUM_ARRAY_MEMBERS(SensorContextList); i++)
     {
         Sensor_t* sensorPtr = SensorContextList + i;
         ConfigureLogging(sensorPtr);
-        SaveOldSamples(sensorPtr, dirId);
+        EnableSensor(sensorPtr);
     }
 }
@@ -0,0 +1,1108 @@
+//--------------------------------------------------------------------------------------------------
+/**
+ * @file tsStore.c
+ *
+ * Append-only, compressed storage for numeric sensor time series.
+ *
+ * Each stream is stored in its own directory as a sequence of numbered segment files
+ * ("<n>.seg"), each at most SEGMENT_SIZE bytes. A segment holds a sequence of self-contained
+ * blocks. A block starts with a header carrying the sample count, the first timestamp and value,
+ * the block's time range and a CRC, followed by a bit stream of the remaining samples:
+ *
+ * - Timestamps (milliseconds) are stored as the delta-of-delta from the previous sample, in a
+ *   variable-length bucket. Periodic sampling makes most of them fit in 1 to 9 bits.
+ * - Values are XORed with the previous value and only the meaningful (non-zero) bits of the result
+ *   are stored, reusing the previous leading/trailing zero counts when possible. Slowly changing
+ *   readings typically take a few bits to a few bytes each.
+ *
+ * Samples are encoded into a fixed-size block buffer in RAM, so appending takes constant memory.
+ * A block is written to flash when it is full or when tsStore_Flush() is called (periodically
+ * and on shutdown), so a crash loses at most the samples of one unwritten block per stream.
+ *
+ * The time range in each block header, together with the per-segment time ranges held in RAM,
+ * acts as a time index: queries skip segments and blocks outside the requested range.
+ *
+ * Copyright (C) Sierra Wireless Inc.
+ */
+//--------------------------------------------------------------------------------------------------
+
+#include "legato.h"
+#include "tsStore.h"
+#include <dirent.h>
+
+#define SEGMENT_SIZE (128 * 1024)
+#define BLOCK_PAYLOAD_SIZE 512
+#define BLOCK_MAGIC 0x31425354 // "TSB1"
+
+/// Maximum number of streams that can be open at the same time.
+#define MAX_STREAMS 32
+
+/// Partially filled blocks are written to flash at least this often.
+#define FLUSH_PERIOD_S (15 * 60)
+
+/// Largest encoding of one sample: 5 + 64 bits of timestamp and 1 + 1 + 5 + 6 + 64 bits of value.
+#define MAX_SAMPLE_BITS 146
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Header written in front of every block's bit stream.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t magic;
+    uint16_t numSamples;        ///< Including the first sample, which is held in the header.
+    uint16_t numBytes;          ///< Size of the bit stream following the header.
+    int64_t firstTimestamp;     ///< Milliseconds since the Epoch.
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    uint64_t firstValue;        ///< Bit pattern of the first value.
+    uint32_t crc;               ///< CRC32 over the preceding fields and the bit stream.
+    uint32_t reserved;
+}
+BlockHeader_t;
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * In-memory index entry for one segment.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t seq;
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    size_t size;
+}
+SegmentInfo_t;
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Delta-of-delta and XOR coder state.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct
+{
+    int64_t prevTimestamp;
+    int64_t prevDelta;
+    uint64_t prevValue;
+    int prevLeading;            ///< -1 until a value with meaningful bits has been coded.
+    int prevTrailing;
+}
+Coder_t;
+
+typedef struct tsStore_Stream
+{
+    char name[TSSTORE_MAX_NAME_BYTES];
+
+    SegmentInfo_t* segments;    ///< Ring of segment index entries, oldest first.
+    size_t firstSegment;        ///< Ring index of the oldest segment.
+    size_t numSegments;
+    int segmentFd;              ///< Newest segment, open for appending, or -1.
+
+    BlockHeader_t block;        ///< Header of the block being filled.
+    uint8_t payload[BLOCK_PAYLOAD_SIZE];
+    size_t bitPos;
+    Coder_t coder;
+}
+Stream_t;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t bitPos;
+    size_t numBits;
+}
+BitReader_t;
+
+static char RootPath[PATH_MAX];
+static size_t MaxSegments;
+static size_t TotalSegments;
+static Stream_t* Streams[MAX_STREAMS];
+static size_t NumStreams;
+
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Append the numBits least significant bits of value to the block's bit stream, most significant
+ * bit first. The caller guarantees there is room.
+ */
+//--------------------------------------------------------------------------------------------------
+static void PutBits
+(
+    Stream_t* streamPtr,
+    uint64_t value,
+    int numBits
+)
+{
+    while (numBits > 0)
+    {
+        const size_t byte = streamPtr->bitPos / 8;
+        const int space = 8 - (streamPtr->bitPos % 8);
+        const int n = (numBits < space) ? numBits : space;
+        const uint8_t bits = (value >> (numBits - n)) & ((1u << n) - 1);
+
+        streamPtr->payload[byte] |= bits << (space - n);
+        streamPtr->bitPos += n;
+        numBits -= n;
+    }
+}
+
+static bool GetBits
+(
+    BitReader_t* readerPtr,
+    int numBits,
+    uint64_t* valuePtr
+)
+{
+    if (readerPtr->bitPos + numBits > readerPtr->numBits)
+    {
+        return false;
+    }
+
+    uint64_t value = 0;
+    while (numBits > 0)
+    {
+        const size_t byte = readerPtr->bitPos / 8;
+        const int avail = 8 - (readerPtr->bitPos % 8);
+        const int n = (numBits < avail) ? numBits : avail;
+        const uint8_t bits = (readerPtr->data[byte] >> (avail - n)) & ((1u << n) - 1);
+
+        value = (value << n) | bits;
+        readerPtr->bitPos += n;
+        numBits -= n;
+    }
+    *valuePtr = value;
+    return true;
+}
+
+static uint64_t DoubleToBits
+(
+    double value
+)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double BitsToDouble
+(
+    uint64_t bits
+)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void ResetCoder
+(
+    Coder_t* coderPtr,
+    int64_t timestamp,
+    uint64_t value
+)
+{
+    coderPtr->prevTimestamp = timestamp;
+    coderPtr->prevDelta = 0;
+    coderPtr->prevValue = value;
+    coderPtr->prevLeading = -1;
+    coderPtr->prevTrailing = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Delta-of-delta buckets: control bits, payload width and offset that makes the payload unsigned.
+ */
+//--------------------------------------------------------------------------------------------------
+static const struct
+{
+    uint8_t control;
+    int controlBits;
+    int payloadBits;
+    int64_t offset;
+}
+DodBuckets[] =
+{
+    { 0x2,  2, 7,  63 },
+    { 0x6,  3, 9,  255 },
+    { 0xE,  4, 12, 2047 },
+    { 0x1E, 5, 32, 2147483647LL },
+};
+
+static void EncodeSample
+(
+    Stream_t* streamPtr,
+    int64_t timestamp,
+    uint64_t value
+)
+{
+    Coder_t* coderPtr = &streamPtr->coder;
+
+    const int64_t delta = timestamp - coderPtr->prevTimestamp;
+    const int64_t dod = delta - coderPtr->prevDelta;
+    if (dod == 0)
+    {
+        PutBits(streamPtr, 0, 1);
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < NUM_ARRAY_MEMBERS(DodBuckets); i++)
+        {
+            const int64_t max = (1LL << DodBuckets[i].payloadBits) - 1 - DodBuckets[i].offset;
+            if (dod >= -DodBuckets[i].offset && dod <= max)
+            {
+                PutBits(streamPtr, DodBuckets[i].control, DodBuckets[i].controlBits);
+                PutBits(streamPtr, dod + DodBuckets[i].offset, DodBuckets[i].payloadBits);
+                break;
+            }
+        }
+        if (i == NUM_ARRAY_MEMBERS(DodBuckets))
+        {
+            PutBits(streamPtr, 0x1F, 5);
+            PutBits(streamPtr, (uint64_t)dod, 64);
+        }
+    }
+    coderPtr->prevDelta = delta;
+    coderPtr->prevTimestamp = timestamp;
+
+    const uint64_t xor = value ^ coderPtr->prevValue;
+    coderPtr->prevValue = value;
+    if (xor == 0)
+    {
+        PutBits(streamPtr, 0, 1);
+        return;
+    }
+    PutBits(streamPtr, 1, 1);
+
+    int leading = __builtin_clzll(xor);
+    const int trailing = __builtin_ctzll(xor);
+    if (leading > 31)
+    {
+        leading = 31;
+    }
+
+    if (coderPtr->prevLeading >= 0 &&
+        leading >= coderPtr->prevLeading &&
+        trailing >= coderPtr->prevTrailing)
+    {
+        // The meaningful bits fit in the previous window.
+        PutBits(streamPtr, 0, 1);
+        PutBits(streamPtr,
+                xor >> coderPtr->prevTrailing,
+                64 - coderPtr->prevLeading - coderPtr->prevTrailing);
+    }
+    else
+    {
+        const int meaningful = 64 - leading - trailing;
+        PutBits(streamPtr, 1, 1);
+        PutBits(streamPtr, leading, 5);
+        PutBits(streamPtr, meaningful - 1, 6);
+        PutBits(streamPtr, xor >> trailing, meaningful);
+        coderPtr->prevLeading = leading;
+        coderPtr->prevTrailing = trailing;
+    }
+}
+
+static bool DecodeSample
+(
+    BitReader_t* readerPtr,
+    Coder_t* coderPtr,
+    int64_t* timestampPtr,
+    uint64_t* valuePtr
+)
+{
+    uint64_t bits;
+
+    // Count the leading one bits of the delta-of-delta control code (at most 5).
+    int ones = 0;
+    while (ones < 5)
+    {
+        if (!GetBits(readerPtr, 1, &bits))
+        {
+            return false;
+        }
+        if (bits == 0)
+        {
+            break;
+        }
+        ones++;
+    }
+
+    int64_t dod = 0;
+    if (ones == 5)
+    {
+        if (!GetBits(readerPtr, 64, &bits))
+        {
+            return false;
+        }
+        dod = (int64_t)bits;
+    }
+    else if (ones > 0)
+    {
+        if (!GetBits(readerPtr, DodBuckets[ones - 1].payloadBits, &bits))
+        {
+            return false;
+        }
+        dod = (int64_t)bits - DodBuckets[ones - 1].offset;
+    }
+    coderPtr->prevDelta += dod;
+    coderPtr->prevTimestamp += coderPtr->prevDelta;
+    *timestampPtr = coderPtr->prevTimestamp;
+
+    if (!GetBits(readerPtr, 1, &bits))
+    {
+        return false;
+    }
+    if (bits == 1)
+    {
+        if (!GetBits(readerPtr, 1, &bits))
+        {
+            return false;
+        }
+        if (bits == 1)
+        {
+            uint64_t leading, meaningful;
+            if (!GetBits(readerPtr, 5, &leading) || !GetBits(readerPtr, 6, &meaningful))
+            {
+                return false;
+            }
+            coderPtr->prevLeading = leading;
+            coderPtr->prevTrailing = 64 - leading - (meaningful + 1);
+        }
+        else if (coderPtr->prevLeading < 0)
+        {
+            return false;
+        }
+
+        const int numBits = 64 - coderPtr->prevLeading - coderPtr->prevTrailing;
+        if (!GetBits(readerPtr, numBits, &bits))
+        {
+            return false;
+        }
+        coderPtr->prevValue ^= bits << coderPtr->prevTrailing;
+    }
+    *valuePtr = coderPtr->prevValue;
+    return true;
+}
+
+static uint32_t BlockCrc
+(
+    const BlockHeader_t* headerPtr,
+    const uint8_t* payload
+)
+{
+    uint32_t crc = le_crc_Crc32((const uint8_t*)headerPtr,
+                                offsetof(BlockHeader_t, crc),
+                                LE_CRC_START_CRC32);
+    return le_crc_Crc32(payload, headerPtr->numBytes, crc);
+}
+
+static bool IsValidHeader
+(
+    const BlockHeader_t* headerPtr
+)
+{
+    return headerPtr->magic == BLOCK_MAGIC &&
+           headerPtr->numSamples > 0 &&
+           headerPtr->numBytes <= BLOCK_PAYLOAD_SIZE &&
+           headerPtr->minTimestamp <= headerPtr->maxTimestamp;
+}
+
+static void SegmentPath
+(
+    const Stream_t* streamPtr,
+    uint32_t seq,
+    char* path,
+    size_t size
+)
+{
+    LE_ASSERT(size > snprintf(path, size, "%s/%s/%" PRIu32 ".seg", RootPath, streamPtr->name, seq));
+}
+
+static SegmentInfo_t* GetSegment
+(
+    Stream_t* streamPtr,
+    size_t i        ///< 0 is the oldest segment.
+)
+{
+    return &streamPtr->segments[(streamPtr->firstSegment + i) % MaxSegments];
+}
+
+static SegmentInfo_t* NewestSegment
+(
+    Stream_t* streamPtr
+)
+{
+    return streamPtr->numSegments ? GetSegment(streamPtr, streamPtr->numSegments - 1) : NULL;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Delete the oldest segment of the stream that uses the most segments.
+ */
+//--------------------------------------------------------------------------------------------------
+static void EvictSegment
+(
+    void
+)
+{
+    Stream_t* victimPtr = NULL;
+    for (size_t i = 0; i < NumStreams; i++)
+    {
+        // Never delete the segment currently being appended to.
+        if (Streams[i]->numSegments > 1 &&
+            (!victimPtr || Streams[i]->numSegments > victimPtr->numSegments))
+        {
+            victimPtr = Streams[i];
+        }
+    }
+    if (!victimPtr)
+    {
+        return;
+    }
+
+    SegmentInfo_t* segPtr = GetSegment(victimPtr, 0);
+    char path[PATH_MAX];
+    SegmentPath(victimPtr, segPtr->seq, path, sizeof(path));
+    if (unlink(path) != 0)
+    {
+        LE_WARN("Couldn't delete '%s' - %m", path);
+    }
+    LE_DEBUG("Evicted '%s'", path);
+
+    victimPtr->firstSegment = (victimPtr->firstSegment + 1) % MaxSegments;
+    victimPtr->numSegments--;
+    TotalSegments--;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Evict segments until at most maxSegments are left, or no segment can be evicted.
+ */
+//--------------------------------------------------------------------------------------------------
+static void EvictSegments
+(
+    size_t maxSegments
+)
+{
+    while (TotalSegments > maxSegments)
+    {
+        const size_t before = TotalSegments;
+        EvictSegment();
+        if (TotalSegments == before)
+        {
+            break;
+        }
+    }
+}
+
+static le_result_t OpenNewSegment
+(
+    Stream_t* streamPtr
+)
+{
+    if (streamPtr->segmentFd >= 0)
+    {
+        close(streamPtr->segmentFd);
+        streamPtr->segmentFd = -1;
+    }
+
+    EvictSegments(MaxSegments - 1);
+    if (streamPtr->numSegments >= MaxSegments)
+    {
+        LE_ERROR("Stream '%s' has no room for another segment", streamPtr->name);
+        return LE_NO_MEMORY;
+    }
+
+    const SegmentInfo_t* newestPtr = NewestSegment(streamPtr);
+    const uint32_t seq = newestPtr ? newestPtr->seq + 1 : 0;
+
+    char path[PATH_MAX];
+    SegmentPath(streamPtr, seq, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0)
+    {
+        LE_ERROR("Couldn't create '%s' - %m", path);
+        return LE_IO_ERROR;
+    }
+
+    streamPtr->numSegments++;
+    TotalSegments++;
+    SegmentInfo_t* segPtr = NewestSegment(streamPtr);
+    segPtr->seq = seq;
+    segPtr->minTimestamp = INT64_MAX;
+    segPtr->maxTimestamp = INT64_MIN;
+    segPtr->size = 0;
+    streamPtr->segmentFd = fd;
+    return LE_OK;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write the block being filled to the newest segment, starting a new segment if it doesn't fit.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t WriteBlock
+(
+    Stream_t* streamPtr
+)
+{
+    BlockHeader_t* headerPtr = &streamPtr->block;
+    if (headerPtr->numSamples == 0)
+    {
+        return LE_OK;
+    }
+
+    headerPtr->magic = BLOCK_MAGIC;
+    headerPtr->numBytes = (streamPtr->bitPos + 7) / 8;
+    headerPtr->crc = BlockCrc(headerPtr, streamPtr->payload);
+    const size_t blockSize = sizeof(*headerPtr) + headerPtr->numBytes;
+
+    SegmentInfo_t* segPtr = NewestSegment(streamPtr);
+    le_result_t result = LE_OK;
+    if (streamPtr->segmentFd < 0 || !segPtr || segPtr->size + blockSize > SEGMENT_SIZE)
+    {
+        result = OpenNewSegment(streamPtr);
+        if (result != LE_OK)
+        {
+            goto done;
+        }
+        segPtr = NewestSegment(streamPtr);
+    }
+
+    const struct iovec iov[] = {
+        { .iov_base = headerPtr, .iov_len = sizeof(*headerPtr) },
+        { .iov_base = streamPtr->payload, .iov_len = headerPtr->numBytes },
+    };
+    ssize_t written = writev(streamPtr->segmentFd, iov, NUM_ARRAY_MEMBERS(iov));
+    if (written != (ssize_t)blockSize || fdatasync(streamPtr->segmentFd) != 0)
+    {
+        LE_ERROR("Failed to write block of stream '%s' - %m", streamPtr->name);
+        // Don't append after a partial block. Recovery truncates it on the next start.
+        close(streamPtr->segmentFd);
+        streamPtr->segmentFd = -1;
+        result = LE_IO_ERROR;
+        goto done;
+    }
+
+    segPtr->size += blockSize;
+    if (headerPtr->minTimestamp < segPtr->minTimestamp)
+    {
+        segPtr->minTimestamp = headerPtr->minTimestamp;
+    }
+    if (headerPtr->maxTimestamp > segPtr->maxTimestamp)
+    {
+        segPtr->maxTimestamp = headerPtr->maxTimestamp;
+    }
+
+done:
+    // On failure the block's samples are dropped rather than retried forever.
+    memset(headerPtr, 0, sizeof(*headerPtr));
+    memset(streamPtr->payload, 0, sizeof(streamPtr->payload));
+    streamPtr->bitPos = 0;
+    return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Scan the blocks of a segment to fill in its index entry. If validate is true, every block's CRC
+ * is checked. The segment is truncated after the last intact block, or after the last block that
+ * is complete if validate is false.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t ScanSegment
+(
+    Stream_t* streamPtr,
+    SegmentInfo_t* segPtr,
+    bool validate
+)
+{
+    char path[PATH_MAX];
+    SegmentPath(streamPtr, segPtr->seq, path, sizeof(path));
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        LE_WARN("Couldn't open '%s' - %m", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return LE_IO_ERROR;
+    }
+
+    segPtr->minTimestamp = INT64_MAX;
+    segPtr->maxTimestamp = INT64_MIN;
+    segPtr->size = 0;
+
+    BlockHeader_t header;
+    uint8_t payload[BLOCK_PAYLOAD_SIZE];
+    while (read(fd, &header, sizeof(header)) == sizeof(header) && IsValidHeader(&header))
+    {
+        if (validate)
+        {
+            if (read(fd, payload, header.numBytes) != header.numBytes ||
+                BlockCrc(&header, payload) != header.crc)
+            {
+                break;
+            }
+        }
+        // Seeking past the end of the file succeeds, so check the block is all there.
+        else if (segPtr->size + sizeof(header) + header.numBytes > (size_t)st.st_size ||
+                 lseek(fd, header.numBytes, SEEK_CUR) < 0)
+        {
+            break;
+        }
+
+        segPtr->size += sizeof(header) + header.numBytes;
+        if (header.minTimestamp < segPtr->minTimestamp)
+        {
+            segPtr->minTimestamp = header.minTimestamp;
+        }
+        if (header.maxTimestamp > segPtr->maxTimestamp)
+        {
+            segPtr->maxTimestamp = header.maxTimestamp;
+        }
+    }
+
+    if ((size_t)st.st_size != segPtr->size)
+    {
+        LE_WARN("Truncating '%s' from %zu to %zu bytes after an incomplete block",
+                path, (size_t)st.st_size, segPtr->size);
+        if (ftruncate(fd, segPtr->size) != 0)
+        {
+            LE_ERROR("Couldn't truncate '%s' - %m", path);
+        }
+    }
+
+    close(fd);
+    return LE_OK;
+}
+
+static int CompareSeq
+(
+    const void* a,
+    const void* b
+)
+{
+    const uint32_t x = *(const uint32_t*)a;
+    const uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Rebuild a stream's segment index from the files in its directory.
+ */
+//--------------------------------------------------------------------------------------------------
+static void RecoverStream
+(
+    Stream_t* streamPtr,
+    const char* dirPath
+)
+{
+    DIR* dirPtr = opendir(dirPath);
+    if (!dirPtr)
+    {
+        return;
+    }
+
+    uint32_t* seqs = malloc(MaxSegments * sizeof(*seqs));
+    LE_ASSERT(seqs);
+    size_t numSeqs = 0;
+    size_t numFound = 0;
+    struct dirent* entPtr;
+    while ((entPtr = readdir(dirPtr)) != NULL)
+    {
+        unsigned long seq;
+        char suffix[5];
+        if (sscanf(entPtr->d_name, "%lu%4s", &seq, suffix) != 2 || strcmp(suffix, ".seg") != 0)
+        {
+            continue;
+        }
+        numFound++;
+
+        // Keep the newest MaxSegments segments.
+        if (numSeqs < MaxSegments)
+        {
+            seqs[numSeqs++] = seq;
+        }
+        else
+        {
+            qsort(seqs, numSeqs, sizeof(*seqs), CompareSeq);
+            if (seq > seqs[0])
+            {
+                seqs[0] = seq;
+            }
+        }
+    }
+    closedir(dirPtr);
+    qsort(seqs, numSeqs, sizeof(*seqs), CompareSeq);
+    if (numFound > numSeqs)
+    {
+        LE_WARN("Stream '%s' has %zu segments, ignoring the oldest %zu",
+                streamPtr->name, numFound, numFound - numSeqs);
+    }
+
+    for (size_t i = 0; i < numSeqs; i++)
+    {
+        SegmentInfo_t* segPtr = &streamPtr->segments[streamPtr->numSegments];
+        segPtr->seq = seqs[i];
+        // Only the newest segment can have been interrupted mid-write.
+        if (ScanSegment(streamPtr, segPtr, i == numSeqs - 1) == LE_OK)
+        {
+            streamPtr->numSegments++;
+        }
+    }
+    free(seqs);
+    TotalSegments += streamPtr->numSegments;
+
+    SegmentInfo_t* newestPtr = NewestSegment(streamPtr);
+    if (newestPtr && newestPtr->size + sizeof(BlockHeader_t) + BLOCK_PAYLOAD_SIZE <= SEGMENT_SIZE)
+    {
+        char path[PATH_MAX];
+        SegmentPath(streamPtr, newestPtr->seq, path, sizeof(path));
+        streamPtr->segmentFd = open(path, O_WRONLY | O_APPEND);
+    }
+
+    if (streamPtr->numSegments > 0)
+    {
+        LE_INFO("Stream '%s': %zu segments, %" PRId64 " to %" PRId64 " ms",
+                streamPtr->name,
+                streamPtr->numSegments,
+                GetSegment(streamPtr, 0)->minTimestamp,
+                newestPtr->maxTimestamp);
+    }
+}
+
+static void OpenStreamHandler
+(
+    const char* name,
+    void* contextPtr
+)
+{
+    tsStore_GetStream(name);
+}
+
+static void FlushTimerHandler
+(
+    le_timer_Ref_t timerRef
+)
+{
+    tsStore_Flush();
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Initialize the store. Must be called before any other function.
+ */
+//--------------------------------------------------------------------------------------------------
+void tsStore_Init
+(
+    const char* rootPath,
+    size_t maxBytes
+)
+{
+    LE_ASSERT(sizeof(RootPath) > snprintf(RootPath, sizeof(RootPath), "%s", rootPath));
+    MaxSegments = maxBytes / SEGMENT_SIZE;
+    LE_ASSERT(MaxSegments > 1);
+
+    LE_ASSERT(le_dir_MakePath(RootPath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == LE_OK);
+
+    // Every stream on flash counts against the budget, not just those the caller opens, and the
+    // budget may have been reduced since they were written.
+    tsStore_ForEachStream(OpenStreamHandler, NULL);
+    EvictSegments(MaxSegments);
+
+    le_timer_Ref_t timerRef = le_timer_Create("tsStoreFlush");
+    LE_ASSERT_OK(le_timer_SetMsInterval(timerRef, FLUSH_PERIOD_S * 1000));
+    LE_ASSERT_OK(le_timer_SetRepeat(timerRef, 0));
+    LE_ASSERT_OK(le_timer_SetHandler(timerRef, FlushTimerHandler));
+    LE_ASSERT_OK(le_timer_Start(timerRef));
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Get a stream by name, opening (and recovering) it from flash or creating it as needed.
+ */
+//--------------------------------------------------------------------------------------------------
+tsStore_StreamRef_t tsStore_GetStream
+(
+    const char* name
+)
+{
+    for (size_t i = 0; i < NumStreams; i++)
+    {
+        if (strcmp(Streams[i]->name, name) == 0)
+        {
+            return Streams[i];
+        }
+    }
+
+    if (NumStreams >= MAX_STREAMS)
+    {
+        LE_ERROR("Too many streams to open '%s'", name);
+        return NULL;
+    }
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') ||
+        strlen(name) >= TSSTORE_MAX_NAME_BYTES)
+    {
+        LE_ERROR("Invalid stream name '%s'", name);
+        return NULL;
+    }
+
+    char dirPath[PATH_MAX];
+    LE_ASSERT(sizeof(dirPath) > snprintf(dirPath, sizeof(dirPath), "%s/%s", RootPath, name));
+    if (le_dir_MakePath(dirPath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != LE_OK)
+    {
+        LE_ERROR("Couldn't create '%s'", dirPath);
+        return NULL;
+    }
+
+    Stream_t* streamPtr = calloc(1, sizeof(*streamPtr));
+    LE_ASSERT(streamPtr);
+    streamPtr->segments = calloc(MaxSegments, sizeof(*streamPtr->segments));
+    LE_ASSERT(streamPtr->segments);
+    strcpy(streamPtr->name, name);
+    streamPtr->segmentFd = -1;
+    RecoverStream(streamPtr, dirPath);
+
+    Streams[NumStreams++] = streamPtr;
+    return streamPtr;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Append a sample to a stream.
+ */
+//--------------------------------------------------------------------------------------------------
+le_result_t tsStore_Append
+(
+    tsStore_StreamRef_t streamRef,
+    double timestamp,
+    double value
+)
+{
+    Stream_t* streamPtr = streamRef;
+    const int64_t timestampMs = llround(timestamp * 1000.0);
+    const uint64_t valueBits = DoubleToBits(value);
+    le_result_t result = LE_OK;
+
+    BlockHeader_t* headerPtr = &streamPtr->block;
+    if (headerPtr->numSamples > 0 &&
+        (streamPtr->bitPos + MAX_SAMPLE_BITS > BLOCK_PAYLOAD_SIZE * 8 ||
+         headerPtr->numSamples == UINT16_MAX))
+    {
+        result = WriteBlock(streamPtr);
+    }
+
+    if (headerPtr->numSamples == 0)
+    {
+        headerPtr->firstTimestamp = timestampMs;
+        headerPtr->minTimestamp = timestampMs;
+        headerPtr->maxTimestamp = timestampMs;
+        headerPtr->firstValue = valueBits;
+        ResetCoder(&streamPtr->coder, timestampMs, valueBits);
+    }
+    else
+    {
+        EncodeSample(streamPtr, timestampMs, valueBits);
+        if (timestampMs < headerPtr->minTimestamp)
+        {
+            headerPtr->minTimestamp = timestampMs;
+        }
+        if (timestampMs > headerPtr->maxTimestamp)
+        {
+            headerPtr->maxTimestamp = timestampMs;
+        }
+    }
+    headerPtr->numSamples++;
+
+    return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write the partially filled blocks of all streams to flash.
+ */
+//--------------------------------------------------------------------------------------------------
+void tsStore_Flush
+(
+    void
+)
+{
+    for (size_t i = 0; i < NumStreams; i++)
+    {
+        WriteBlock(Streams[i]);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Decode one block and deliver the samples within the range.
+ */
+//--------------------------------------------------------------------------------------------------
+static le_result_t DeliverBlock
+(
+    const BlockHeader_t* headerPtr,
+    const uint8_t* payload,
+    size_t numBits,
+    int64_t startMs,
+    int64_t endMs,
+    tsStore_SampleHandlerFunc_t handlerFunc,
+    void* contextPtr
+)
+{
+    Coder_t coder;
+    ResetCoder(&coder, headerPtr->firstTimestamp, headerPtr->firstValue);
+    BitReader_t reader = { .data = payload, .bitPos = 0, .numBits = numBits };
+
+    int64_t timestampMs = headerPtr->firstTimestamp;
+    uint64_t valueBits = headerPtr->firstValue;
+    for (uint32_t i = 0; i < headerPtr->numSamples; i++)
+    {
+        if (i > 0 && !DecodeSample(&reader, &coder, &timestampMs, &valueBits))
+        {
+            LE_ERROR("Corrupt block at sample %" PRIu32, i);
+            return LE_FORMAT_ERROR;
+        }
+        if (timestampMs >= startMs && timestampMs <= endMs)
+        {
+            handlerFunc(timestampMs / 1000.0, BitsToDouble(valueBits), contextPtr);
+        }
+    }
+    return LE_OK;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Deliver all samples of a stream whose timestamps are within [startTime, endTime].
+ */
+//--------------------------------------------------------------------------------------------------
+le_result_t tsStore_Query
+(
+    tsStore_StreamRef_t streamRef,
+    double startTime,
+    double endTime,
+    tsStore_SampleHandlerFunc_t handlerFunc,
+    void* contextPtr
+)
+{
+    Stream_t* streamPtr = streamRef;
+    const int64_t startMs = llround(startTime * 1000.0);
+    const int64_t endMs = llround(endTime * 1000.0);
+    le_result_t result = LE_OK;
+
+    for (size_t i = 0; i < streamPtr->numSegments; i++)
+    {
+        const SegmentInfo_t* segPtr = GetSegment(streamPtr, i);
+        if (segPtr->size == 0 || segPtr->maxTimestamp < startMs || segPtr->minTimestamp > endMs)
+        {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        SegmentPath(streamPtr, segPtr->seq, path, sizeof(path));
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            LE_ERROR("Couldn't open '%s' - %m", path);
+            return LE_IO_ERROR;
+        }
+
+        size_t offset = 0;
+        BlockHeader_t header;
+        uint8_t payload[BLOCK_PAYLOAD_SIZE];
+        while (offset < segPtr->size &&
+               read(fd, &header, sizeof(header)) == sizeof(header) &&
+               IsValidHeader(&header))
+        {
+            offset += sizeof(header) + header.numBytes;
+            if (offset > segPtr->size)
+            {
+                LE_ERROR("Truncated block in '%s'", path);
+                result = LE_FORMAT_ERROR;
+                break;
+            }
+            if (header.maxTimestamp < startMs || header.minTimestamp > endMs)
+            {
+                if (lseek(fd, header.numBytes, SEEK_CUR) < 0)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // The rest of a segment can't be trusted after a bad block, move on to the next one.
+            if (read(fd, payload, header.numBytes) != header.numBytes ||
+                BlockCrc(&header, payload) != header.crc)
+            {
+                LE_ERROR("Corrupt block in '%s'", path);
+                result = LE_FORMAT_ERROR;
+                break;
+            }
+            if (DeliverBlock(&header, payload, header.numBytes * 8, startMs, endMs,
+                             handlerFunc, contextPtr) != LE_OK)
+            {
+                result = LE_FORMAT_ERROR;
+                break;
+            }
+        }
+        close(fd);
+    }
+
+    // Finally, the samples that haven't been written to flash yet.
+    const BlockHeader_t* headerPtr = &streamPtr->block;
+    if (headerPtr->numSamples > 0 &&
+        headerPtr->maxTimestamp >= startMs && headerPtr->minTimestamp <= endMs &&
+        DeliverBlock(headerPtr, streamPtr->payload, streamPtr->bitPos, startMs, endMs,
+                     handlerFunc, contextPtr) != LE_OK)
+    {
+        result = LE_FORMAT_ERROR;
+    }
+
+    return result;
+}
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call a function with the name of every stream in the store, whether it has been opened yet or not.
+ */
+//--------------------------------------------------------------------------------------------------
+void tsStore_ForEachStream
+(
+    tsStore_StreamHandlerFunc_t handlerFunc,
+    void* contextPtr
+)
+{
+    DIR* dirPtr = opendir(RootPath);
+    if (dirPtr == NULL)
+    {
+        LE_ERROR("Couldn't open '%s' - %m", RootPath);
+        return;
+    }
+
+    struct dirent* entryPtr;
+    while ((entryPtr = readdir(dirPtr)) != NULL)
+    {
+        if (entryPtr->d_name[0] == '.' || strlen(entryPtr->d_name) >= TSSTORE_MAX_NAME_BYTES)
+        {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        struct stat st;
+        if (sizeof(path) > snprintf(path, sizeof(path), "%s/%s", RootPath, entryPtr->d_name) &&
+            stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            handlerFunc(entryPtr->d_name, contextPtr);
+        }
+    }
+    closedir(dirPtr);
+}
+
+COMPONENT_INIT
+{
+}
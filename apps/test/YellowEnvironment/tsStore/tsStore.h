@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------------------------------
+/**
+ * @file tsStore.h
+ *
+ * Append-only, compressed storage for numeric sensor time series.
+ *
+ * Copyright (C) Sierra Wireless Inc.
+ */
+//--------------------------------------------------------------------------------------------------
+
+#ifndef TS_STORE_H_INCLUDE_GUARD
+#define TS_STORE_H_INCLUDE_GUARD
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Maximum length of a stream name, including the null terminator.
+ */
+//--------------------------------------------------------------------------------------------------
+#define TSSTORE_MAX_NAME_BYTES 64
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Reference to a stream of samples.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef struct tsStore_Stream* tsStore_StreamRef_t;
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call-back used to deliver samples from tsStore_Query().
+ *
+ * @param timestamp Seconds since the Epoch, with millisecond resolution.
+ */
+//--------------------------------------------------------------------------------------------------
+typedef void (*tsStore_SampleHandlerFunc_t)
+(
+    double timestamp,
+    double value,
+    void* contextPtr
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call-back used to list the streams from tsStore_ForEachStream().
+ */
+//--------------------------------------------------------------------------------------------------
+typedef void (*tsStore_StreamHandlerFunc_t)
+(
+    const char* name,
+    void* contextPtr
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Initialize the store. Must be called before any other function.
+ *
+ * @param rootPath Directory under which each stream gets its own sub-directory.
+ * @param maxBytes Flash budget for all streams together. Once it is used up, the oldest segment of
+ *                 the stream using the most space is deleted to make room. The streams already
+ *                 under rootPath are opened, so that their segments are counted too.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED void tsStore_Init
+(
+    const char* rootPath,
+    size_t maxBytes
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Get a stream by name, opening (and recovering) it from flash or creating it as needed.
+ *
+ * @return The stream reference or NULL if the stream can't be opened.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED tsStore_StreamRef_t tsStore_GetStream
+(
+    const char* name
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Append a sample to a stream. Samples are buffered in RAM and written to flash one compressed
+ * block at a time, when the block fills up or when tsStore_Flush() is called.
+ *
+ * @return
+ *  - LE_OK if successful
+ *  - LE_IO_ERROR if a block could not be written to flash.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED le_result_t tsStore_Append
+(
+    tsStore_StreamRef_t streamRef,
+    double timestamp,   ///< Seconds since the Epoch.
+    double value
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Write the partially filled blocks of all streams to flash.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED void tsStore_Flush
+(
+    void
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Deliver all samples of a stream whose timestamps are within [startTime, endTime], in the order
+ * they were appended. Blocks that don't overlap the range are skipped without being decoded.
+ *
+ * @return
+ *  - LE_OK if successful
+ *  - LE_IO_ERROR if a segment could not be read.
+ *  - LE_FORMAT_ERROR if corrupt data was found. The rest of the segment holding it is skipped, the
+ *    samples of the other segments are still delivered.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED le_result_t tsStore_Query
+(
+    tsStore_StreamRef_t streamRef,
+    double startTime,
+    double endTime,
+    tsStore_SampleHandlerFunc_t handlerFunc,
+    void* contextPtr
+);
+
+//--------------------------------------------------------------------------------------------------
+/**
+ * Call a function with the name of every stream in the store, including those that haven't been
+ * opened with tsStore_GetStream() since start-up.
+ */
+//--------------------------------------------------------------------------------------------------
+LE_SHARED void tsStore_ForEachStream
+(
+    tsStore_StreamHandlerFunc_t handlerFunc,
+    void* contextPtr
+);
+
+#endif // TS_STORE_H_INCLUDE_GUARD
@@ -17,6 +17,23 @@
 #include <unistd.h>
 
 
+/*
+ * Configuration registers that only change when the host writes them, so their last written value
+ * can be cached. This covers the heater profile (0x50 - 0x6F), ctrl_gas_0/1 (0x70, 0x71), ctrl_hum
+ * (0x72) and config (0x75). ctrl_meas (0x74) is excluded because writing the mode bits starts a
+ * measurement and the device clears them when it completes.
+ */
+#define BME680_CACHE_FIRST_REG 0x50
+#define BME680_CACHE_LAST_REG 0x75
+#define BME680_CTRL_MEAS_REG 0x74
+#define BME680_SPI_MEM_PAGE_REG 0x73
+#define BME680_SOFT_RESET_REG 0xE0
+
+/* Maximum number of messages that the i2c-dev driver accepts in one I2C_RDWR ioctl. */
+#define BME680_BATCH_MAX_MSGS 42
+/* Bytes of write payload that can be queued before a batch must be flushed. */
+#define BME680_BATCH_BUF_SIZE 256
+
 /*
  * Private data that is opaque to clients.
  */
@@ -25,10 +42,80 @@ struct bme680_linux_priv
     int i2c_bus_fd;
     uint16_t i2c_bus_num;
     uint16_t i2c_addr;
+
+    /* Shadow of the cacheable configuration registers. */
+    uint8_t reg_cache[BME680_CACHE_LAST_REG - BME680_CACHE_FIRST_REG + 1];
+    bool reg_cache_valid[BME680_CACHE_LAST_REG - BME680_CACHE_FIRST_REG + 1];
+
+    /* Messages queued between bme680_linux_i2c_begin_batch() and bme680_linux_i2c_end_batch(). */
+    bool batching;
+    struct i2c_msg batch_msgs[BME680_BATCH_MAX_MSGS];
+    unsigned int batch_nmsgs;
+    uint8_t batch_buf[BME680_BATCH_BUF_SIZE];
+    size_t batch_buf_len;
+
+    uint32_t num_transactions;
 };
 
+static bool bme680_linux_is_cacheable(unsigned int reg_addr)
+{
+    return reg_addr >= BME680_CACHE_FIRST_REG && reg_addr <= BME680_CACHE_LAST_REG &&
+           reg_addr != BME680_CTRL_MEAS_REG && reg_addr != BME680_SPI_MEM_PAGE_REG;
+}
+
+static void bme680_linux_invalidate_cache(struct bme680_linux_priv *priv)
+{
+    memset(priv->reg_cache_valid, 0, sizeof(priv->reg_cache_valid));
+}
+
+/*
+ * Submit all queued messages in a single I2C_RDWR transaction.
+ */
+static int8_t bme680_linux_i2c_flush(struct bme680_linux *bme680)
+{
+    struct bme680_linux_priv *priv = bme680->priv;
+    int8_t res = BME680_OK;
+
+    if (priv->batch_nmsgs == 0)
+        return res;
+
+    struct i2c_rdwr_ioctl_data i2c_xfer = {
+        .msgs = priv->batch_msgs,
+        .nmsgs = priv->batch_nmsgs,
+    };
+    priv->num_transactions++;
+    if (ioctl(priv->i2c_bus_fd, I2C_RDWR, &i2c_xfer) < 0) {
+        LE_WARN(
+            "I2C transfer of %u messages on bus %u, address %u failed - %s\n",
+            priv->batch_nmsgs, priv->i2c_bus_num, priv->i2c_addr, strerror(errno));
+        /* Some of the queued writes may not have reached the device. */
+        bme680_linux_invalidate_cache(priv);
+        res = BME680_E_COM_FAIL;
+    }
+
+    priv->batch_nmsgs = 0;
+    priv->batch_buf_len = 0;
+    return res;
+}
+
+/*
+ * Make room for nmsgs more messages and buf_len more bytes of write payload, flushing the pending
+ * batch if necessary.
+ */
+static int8_t bme680_linux_i2c_reserve(struct bme680_linux *bme680, unsigned int nmsgs, size_t buf_len)
+{
+    struct bme680_linux_priv *priv = bme680->priv;
+    if (priv->batch_nmsgs + nmsgs > BME680_BATCH_MAX_MSGS ||
+        priv->batch_buf_len + buf_len > sizeof(priv->batch_buf))
+        return bme680_linux_i2c_flush(bme680);
+    return BME680_OK;
+}
+
 static void bme680_linux_delay_ms(uint32_t period_ms, void *context)
 {
+    /* Delays are relative to the preceding accesses, so those must actually happen first. */
+    bme680_linux_i2c_flush(context);
+
     const struct timespec delay = {
         .tv_sec = period_ms / 1000,
         .tv_nsec = (period_ms % 1000) * 1000 * 1000,
@@ -43,70 +130,148 @@ static int8_t bme680_linux_i2c_read(uint8_t reg_addr, uint8_t *reg_data, uint16_
 {
     int8_t res = 0; /* Return 0 for Success, non-zero for failure */
     struct bme680_linux *bme680 = context;
+    struct bme680_linux_priv *priv = bme680->priv;
+
+    /* Serve reads of configuration registers from the cache when possible. */
+    bool cached = true;
+    for (uint16_t i = 0; i < len && cached; i++) {
+        const unsigned int reg = reg_addr + i;
+        cached = bme680_linux_is_cacheable(reg) &&
+                 priv->reg_cache_valid[reg - BME680_CACHE_FIRST_REG];
+    }
+    if (cached) {
+        memcpy(reg_data, &priv->reg_cache[reg_addr - BME680_CACHE_FIRST_REG], len);
+        return res;
+    }
 
-    struct i2c_msg i2c_msgs[] = {
-        {
-            .addr = bme680->priv->i2c_addr,
-            .flags = 0,
-            .buf = &reg_addr,
-            .len = 1,
-        },
-        {
-            .addr = bme680->priv->i2c_addr,
-            .flags = I2C_M_RD,
-            .buf = reg_data,
-            .len = len,
-        },
+    /*
+     * The read is appended to any pending writes and submitted with them, so that ordering is
+     * preserved without an extra bus transaction.
+     */
+    res = bme680_linux_i2c_reserve(bme680, 2, 1);
+    if (res != BME680_OK)
+        return res;
+
+    uint8_t *addr_buf = &priv->batch_buf[priv->batch_buf_len++];
+    *addr_buf = reg_addr;
+    priv->batch_msgs[priv->batch_nmsgs++] = (struct i2c_msg) {
+        .addr = priv->i2c_addr,
+        .flags = 0,
+        .buf = addr_buf,
+        .len = 1,
     };
-    struct i2c_rdwr_ioctl_data i2c_xfer = {
-        .msgs = i2c_msgs,
-        .nmsgs = NUM_ARRAY_MEMBERS(i2c_msgs),
+    priv->batch_msgs[priv->batch_nmsgs++] = (struct i2c_msg) {
+        .addr = priv->i2c_addr,
+        .flags = I2C_M_RD,
+        .buf = reg_data,
+        .len = len,
     };
-    if (ioctl(bme680->priv->i2c_bus_fd, I2C_RDWR, &i2c_xfer) < 0) {
+    res = bme680_linux_i2c_flush(bme680);
+    if (res != BME680_OK) {
         LE_WARN(
-            "I2C read on bus %u, address %u to register %u of length %u failed - %s\n",
-            bme680->priv->i2c_bus_num, bme680->priv->i2c_addr, reg_addr, len, strerror(errno));
-        res = BME680_E_COM_FAIL;
+            "I2C read on bus %u, address %u to register %u of length %u failed\n",
+            priv->i2c_bus_num, priv->i2c_addr, reg_addr, len);
+        return res;
+    }
+
+    for (uint16_t i = 0; i < len; i++) {
+        const unsigned int reg = reg_addr + i;
+        if (bme680_linux_is_cacheable(reg)) {
+            priv->reg_cache[reg - BME680_CACHE_FIRST_REG] = reg_data[i];
+            priv->reg_cache_valid[reg - BME680_CACHE_FIRST_REG] = true;
+        }
     }
 
     return res;
 }
 
+/*
+ * The Bosch driver writes a burst of (register, value) pairs: reg_addr is the first register and
+ * reg_data holds its value followed by the remaining pairs. Pairs that would write a cached
+ * configuration register with the value it already holds are dropped. What remains is queued as a
+ * single message and submitted immediately unless a batch is open.
+ */
 static int8_t bme680_linux_i2c_write(uint8_t reg_addr, const uint8_t *reg_data, uint16_t len, void *context)
 {
-    uint8_t buffer[64];
     int8_t res = 0; /* Return 0 for Success, non-zero for failure */
     struct bme680_linux *bme680 = context;
+    struct bme680_linux_priv *priv = bme680->priv;
 
-    if (len >= sizeof(buffer)) {
-        LE_ERROR("I2C write buffer is too small (%u)\n", sizeof(buffer));
+    if (len + 1 > sizeof(priv->batch_buf)) {
+        LE_ERROR("I2C write buffer is too small (%zu)\n", sizeof(priv->batch_buf));
         return BME680_E_INVALID_LENGTH;
     }
-    buffer[0] = reg_addr;
-    memcpy(&buffer[1], reg_data, len);
-
-    struct i2c_msg i2c_msgs[] = {
-        {
-            .addr = bme680->priv->i2c_addr,
-            .flags = 0,
-            .buf = buffer,
-            .len = len + 1,
-        },
-    };
-    struct i2c_rdwr_ioctl_data i2c_xfer = {
-        .msgs = i2c_msgs,
-        .nmsgs = NUM_ARRAY_MEMBERS(i2c_msgs),
+
+    res = bme680_linux_i2c_reserve(bme680, 1, len + 1);
+    if (res != BME680_OK)
+        return res;
+
+    uint8_t *buffer = &priv->batch_buf[priv->batch_buf_len];
+    size_t buffer_len = 0;
+    if (len % 2 == 1) {
+        for (uint16_t i = 0; i <= len; i += 2) {
+            const uint8_t reg = (i == 0) ? reg_addr : reg_data[i - 1];
+            const uint8_t val = reg_data[i];
+
+            if (reg == BME680_SOFT_RESET_REG)
+                bme680_linux_invalidate_cache(priv);
+
+            if (bme680_linux_is_cacheable(reg)) {
+                const size_t idx = reg - BME680_CACHE_FIRST_REG;
+                if (priv->reg_cache_valid[idx] && priv->reg_cache[idx] == val)
+                    continue;
+                priv->reg_cache[idx] = val;
+                priv->reg_cache_valid[idx] = true;
+            }
+            buffer[buffer_len++] = reg;
+            buffer[buffer_len++] = val;
+        }
+    } else {
+        /* Not in (register, value) pair form, so send it untouched. */
+        buffer[buffer_len++] = reg_addr;
+        memcpy(&buffer[buffer_len], reg_data, len);
+        buffer_len += len;
+    }
+
+    if (buffer_len == 0)
+        return res;
+
+    priv->batch_buf_len += buffer_len;
+    priv->batch_msgs[priv->batch_nmsgs++] = (struct i2c_msg) {
+        .addr = priv->i2c_addr,
+        .flags = 0,
+        .buf = buffer,
+        .len = buffer_len,
     };
-    if (ioctl(bme680->priv->i2c_bus_fd, I2C_RDWR, &i2c_xfer) < 0) {
-        LE_WARN(
-            "I2C write on bus %u, address %u to register %u of length %u failed - %s\n",
-            bme680->priv->i2c_bus_num, bme680->priv->i2c_addr, reg_addr, len, strerror(errno));
-        res = BME680_E_COM_FAIL;
+
+    if (!priv->batching) {
+        res = bme680_linux_i2c_flush(bme680);
+        if (res != BME680_OK) {
+            LE_WARN(
+                "I2C write on bus %u, address %u to register %u of length %u failed\n",
+                priv->i2c_bus_num, priv->i2c_addr, reg_addr, len);
+        }
     }
 
     return res;
 }
 
+void bme680_linux_i2c_begin_batch(struct bme680_linux *bme680)
+{
+    bme680->priv->batching = true;
+}
+
+int8_t bme680_linux_i2c_end_batch(struct bme680_linux *bme680)
+{
+    bme680->priv->batching = false;
+    return bme680_linux_i2c_flush(bme680);
+}
+
+uint32_t bme680_linux_i2c_get_num_transactions(const struct bme680_linux *bme680)
+{
+    return bme680->priv->num_transactions;
+}
+
 struct bme680_linux* bme680_linux_i2c_create(
     unsigned i2c_bus_num, uint8_t i2c_addr, bme680_ambient_temperature_fptr_t read_ambient_temperature)
 {
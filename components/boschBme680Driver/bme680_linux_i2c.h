@@ -17,4 +17,17 @@ struct bme680_linux* bme680_linux_i2c_create(
     unsigned i2c_bus_num, uint8_t i2c_addr, bme680_ambient_temperature_fptr_t read_ambient_temperature);
 void bme680_linux_i2c_destroy(struct bme680_linux* bme680);
 
+/*
+ * Between begin_batch and end_batch, register writes are queued rather than sent. They are
+ * submitted as a single I2C_RDWR transaction together with the next register read, delay or the
+ * end of the batch, whichever comes first. end_batch returns the result of that final submission.
+ */
+void bme680_linux_i2c_begin_batch(struct bme680_linux* bme680);
+int8_t bme680_linux_i2c_end_batch(struct bme680_linux* bme680);
+
+/*
+ * Number of I2C_RDWR transactions issued on the bus so far.
+ */
+uint32_t bme680_linux_i2c_get_num_transactions(const struct bme680_linux* bme680);
+
 #endif // _BME680_LINUX_I2C_H_
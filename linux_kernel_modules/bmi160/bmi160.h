@@ -2,10 +2,14 @@
 #ifndef BMI160_H_
 #define BMI160_H_
 
+#include <linux/pm.h>
+
 extern const struct regmap_config bmi160_regmap_config;
 
 int bmi160_core_probe(struct device *dev, struct regmap *regmap,
-		      const char *name, bool use_spi);
+		      const char *name, int irq, bool use_spi);
 void bmi160_core_remove(struct device *dev);
 
+extern const struct dev_pm_ops bmi160_pm_ops;
+
 #endif  /* BMI160_H_ */
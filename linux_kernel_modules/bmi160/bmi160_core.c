@@ -9,18 +9,22 @@
  *
  * IIO core driver for BMI160, with support for I2C/SPI busses
  *
- * TODO: magnetometer, interrupts, hardware FIFO
+ * TODO: magnetometer
  */
 #include <linux/module.h>
 #include <linux/regmap.h>
 #include <linux/acpi.h>
 #include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/pm_runtime.h>
 
 #include <linux/iio/iio.h>
 #include <linux/iio/triggered_buffer.h>
+#include <linux/iio/trigger.h>
 #include <linux/iio/trigger_consumer.h>
 #include <linux/iio/buffer.h>
 #include <linux/iio/sysfs.h>
+#include <linux/iio/events.h>
 #include <linux/version.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
 #include <linux/bitfield.h>
@@ -33,6 +37,10 @@
 #endif
 
 #include "bmi160.h"
+#include "iio_timestamp.h"
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+#include "buffer_block.h"
+#endif
 
 #define BMI160_REG_CHIP_ID			0x00
 #define BMI160_CHIP_ID_VAL			0xD1
@@ -97,6 +105,10 @@
 #define BMI160_REG_TEMPERATURE_0		0x20
 #define BMI160_REG_TEMPERATURE_1		0x21
 
+#define BMI160_REG_FIFO_LENGTH_0		0x22
+#define BMI160_FIFO_LENGTH_MASK			GENMASK(10, 0)
+#define BMI160_REG_FIFO_DATA			0x24
+
 #define BMI160_REG_ACCEL_CONFIG			0x40
 #define BMI160_ACCEL_CONFIG_ODR_MASK		GENMASK(3, 0)
 #define BMI160_ACCEL_CONFIG_BWP_MASK		GENMASK(6, 4)
@@ -118,6 +130,18 @@
 #define BMI160_GYRO_RANGE_250DPS		0x03
 #define BMI160_GYRO_RANGE_125DPS		0x04
 
+#define BMI160_REG_FIFO_CONFIG_0		0x46
+#define BMI160_FIFO_CONFIG_0_WATERMARK_UNIT	4
+
+#define BMI160_REG_FIFO_CONFIG_1		0x47
+#define BMI160_FIFO_CONFIG_1_TIME_EN		BIT(1)
+#define BMI160_FIFO_CONFIG_1_TAG_INT2_EN	BIT(2)
+#define BMI160_FIFO_CONFIG_1_TAG_INT1_EN	BIT(3)
+#define BMI160_FIFO_CONFIG_1_HEADER_EN		BIT(4)
+#define BMI160_FIFO_CONFIG_1_MAG_EN		BIT(5)
+#define BMI160_FIFO_CONFIG_1_ACC_EN		BIT(6)
+#define BMI160_FIFO_CONFIG_1_GYR_EN		BIT(7)
+
 #define BMI160_REG_INT_EN_0			0x50
 #define BMI160_INT_EN_0_ANYM_X			BIT(0)
 #define BMI160_INT_EN_0_ANYM_Y			BIT(1)
@@ -263,6 +287,18 @@
 #define BMI160_ACCEL_PMU_MIN_USLEEP		3800
 #define BMI160_GYRO_PMU_MIN_USLEEP		80000
 #define BMI160_SOFTRESET_USLEEP			1000
+/* Waking both sensors takes the gyro's 80 ms, keep them up well past that */
+#define BMI160_AUTOSUSPEND_DELAY_MS		2000
+
+#define BMI160_FIFO_LEN				1024
+/* Headerless frame: 3 x __le16 per sensor, gyro before accel */
+#define BMI160_FIFO_SENSOR_LEN			(3 * sizeof(__le16))
+#define BMI160_FIFO_DEFAULT_WATERMARK		32
+
+/* Any-motion after 2 consecutive samples, no-motion after 20.48 s */
+#define BMI160_ANYM_DUR_DEFAULT			1
+#define BMI160_SLO_NO_MOT_DUR_DEFAULT		15
+#define BMI160_MOTION_AXES			GENMASK(2, 0)
 
 #define BMI160_CHANNEL(_type, _axis, _index) {			\
 	.type = _type,						\
@@ -278,8 +314,32 @@
 		.storagebits = 16,				\
 		.endianness = IIO_LE,				\
 	},							\
+	.event_spec = (_type) == IIO_ACCEL ?			\
+		bmi160_motion_events : NULL,			\
+	.num_event_specs = (_type) == IIO_ACCEL ?		\
+		ARRAY_SIZE(bmi160_motion_events) : 0,		\
 }
 
+/*
+ * Any-motion is a rate of change rising above its threshold on one of the
+ * enabled axes, no-motion the rate of change staying below its threshold on
+ * all of them. Thresholds are raw register values shared by the axes.
+ */
+static const struct iio_event_spec bmi160_motion_events[] = {
+	{
+		.type = IIO_EV_TYPE_ROC,
+		.dir = IIO_EV_DIR_RISING,
+		.mask_separate = BIT(IIO_EV_INFO_ENABLE),
+		.mask_shared_by_type = BIT(IIO_EV_INFO_VALUE),
+	},
+	{
+		.type = IIO_EV_TYPE_ROC,
+		.dir = IIO_EV_DIR_FALLING,
+		.mask_separate = BIT(IIO_EV_INFO_ENABLE),
+		.mask_shared_by_type = BIT(IIO_EV_INFO_VALUE),
+	},
+};
+
 /* scan indexes follow DATA register order */
 enum bmi160_scan_axis {
 	BMI160_SCAN_EXT_MAGN_X = 0,
@@ -311,6 +371,10 @@ enum bmi160_pmu_state {
 	BMI160_PMU_STATE_COUNT /* Special last element */
 };
 
+/* Data registers from the magnetometer X axis to the temperature */
+#define BMI160_BURST_LEN	(BMI160_REG_TEMPERATURE_1 - \
+				 BMI160_REG_DATA_MAGN_XOUT_L + 1)
+
 struct bmi160_data {
 	struct regmap *regmap;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3, 16, 0)
@@ -320,11 +384,61 @@ struct bmi160_data {
 	 */
 	struct device *dev;
 #endif
+	/*
+	 * The hardware FIFO runs in headerless mode while the device's own
+	 * trigger is in use, the watermark interrupt firing the trigger.
+	 * mutex serializes FIFO draining with hwfifo_flush.
+	 */
+	struct mutex mutex;
+	struct iio_trigger *trig;
+	int irq;
+	/* Axes with any-motion and no-motion events enabled, bit 0 is X */
+	u8 ev_anym;
+	u8 ev_nomo;
+	bool fifo_enabled;
+	bool fifo_gyro;
+	unsigned int fifo_frame_len;
+	unsigned int watermark;
+	unsigned int fifo_wm_frames;
+	s64 irq_ts;
+	/*
+	 * Frames drained since the FIFO was enabled, the counter fed to the
+	 * timestamp estimator.
+	 */
+	u64 fifo_count;
+	struct iio_ts_est fifo_ts_est;
+	/*
+	 * Triggered buffer samples are read in one burst. Keep the buffers in
+	 * their own cache lines so they can be used for DMA by SPI controllers.
+	 */
+	__le16 burst[BMI160_BURST_LEN / sizeof(__le16)] ____cacheline_aligned;
+	u8 fifo_buf[BMI160_FIFO_LEN] ____cacheline_aligned;
 };
 
+/*
+ * Everything below the FIFO data port is status or sample data, the
+ * configuration registers above it are only changed by the driver and are
+ * served from the cache.
+ */
+static bool bmi160_is_volatile_reg(struct device *dev, unsigned int reg)
+{
+	return reg <= BMI160_REG_FIFO_DATA || reg == BMI160_REG_CMD;
+}
+
+static bool bmi160_is_precious_reg(struct device *dev, unsigned int reg)
+{
+	return reg == BMI160_REG_FIFO_DATA;
+}
+
 const struct regmap_config bmi160_regmap_config = {
 	.reg_bits = 8,
 	.val_bits = 8,
+
+	.max_register = BMI160_REG_DUMMY,
+	.cache_type = REGCACHE_RBTREE,
+
+	.volatile_reg = bmi160_is_volatile_reg,
+	.precious_reg = bmi160_is_precious_reg,
 };
 EXPORT_SYMBOL(bmi160_regmap_config);
 
@@ -521,6 +635,40 @@ int bmi160_set_mode(struct bmi160_data *data, enum bmi160_sensor_type t,
 	return 0;
 }
 
+/*
+ * Wake the sensors for a register access. They go back to sleep once the
+ * autosuspend delay has passed without another access.
+ */
+static int bmi160_runtime_get(struct bmi160_data *data)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 16, 0)
+	struct device *dev = regmap_get_device(data->regmap);
+#else
+	struct device *dev = data->dev;
+#endif
+	int ret;
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void bmi160_runtime_put(struct bmi160_data *data)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 16, 0)
+	struct device *dev = regmap_get_device(data->regmap);
+#else
+	struct device *dev = data->dev;
+#endif
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
 static
 int bmi160_set_scale(struct bmi160_data *data, enum bmi160_sensor_type t,
 		     int uscale)
@@ -620,6 +768,352 @@ static int bmi160_get_odr(struct bmi160_data *data, enum bmi160_sensor_type t,
 	return 0;
 }
 
+static unsigned int bmi160_scan_reg(int scan_index)
+{
+	if (scan_index == BMI160_SCAN_TEMPERATURE)
+		return BMI160_REG_TEMPERATURE_0;
+
+	return BMI160_REG_DATA_MAGN_XOUT_L + scan_index * sizeof(__le16);
+}
+
+static bool bmi160_scan_has(struct iio_dev *indio_dev, int first, int last)
+{
+	int i;
+
+	for (i = first; i <= last; i++)
+		if (test_bit(i, indio_dev->active_scan_mask))
+			return true;
+
+	return false;
+}
+
+/* Index of a channel's sample within a headerless FIFO frame */
+static unsigned int bmi160_fifo_index(struct bmi160_data *data, int scan_index)
+{
+	if (scan_index <= BMI160_SCAN_GYRO_Z)
+		return scan_index - BMI160_SCAN_GYRO_X;
+
+	return (data->fifo_gyro ? 3 : 0) + scan_index - BMI160_SCAN_ACCEL_X;
+}
+
+/*
+ * Drain the FIFO into the IIO buffer. When called for the watermark
+ * interrupt, the FIFO is known to have held fifo_wm_frames more frames at
+ * irq_ts, which is fed to the timestamp estimator. Frames are stamped by
+ * their position in the sample stream. Returns the number of samples pushed.
+ */
+static int bmi160_fifo_transfer(struct iio_dev *indio_dev, bool irq)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	__le16 buf[16] __aligned(8);
+	__le16 len, temp = 0;
+	unsigned int frames, n;
+	int i, j, ret;
+
+	ret = regmap_bulk_read(data->regmap, BMI160_REG_FIFO_LENGTH_0,
+			       &len, sizeof(len));
+	if (ret < 0)
+		return ret;
+
+	frames = (le16_to_cpu(len) & BMI160_FIFO_LENGTH_MASK) /
+		 data->fifo_frame_len;
+	if (!frames)
+		return 0;
+
+	/*
+	 * The burst stays on the FIFO port but its address range runs over
+	 * the cached configuration registers, which would make regmap serve
+	 * it from the cache. Callers hold the mutex, as do all writers, so no
+	 * write misses the cache while it is bypassed.
+	 */
+	regcache_cache_bypass(data->regmap, true);
+	ret = regmap_raw_read(data->regmap, BMI160_REG_FIFO_DATA,
+			      data->fifo_buf, frames * data->fifo_frame_len);
+	regcache_cache_bypass(data->regmap, false);
+	if (ret < 0)
+		return ret;
+
+	/* Temperature is not in the FIFO, sample it once per batch */
+	if (test_bit(BMI160_SCAN_TEMPERATURE, indio_dev->active_scan_mask)) {
+		ret = regmap_bulk_read(data->regmap, BMI160_REG_TEMPERATURE_0,
+				       &temp, sizeof(temp));
+		if (ret < 0)
+			return ret;
+	}
+
+	if (irq)
+		iio_ts_est_update(&data->fifo_ts_est, data->fifo_count +
+				  min(frames, data->fifo_wm_frames),
+				  data->irq_ts);
+
+	for (n = 0; n < frames; n++) {
+		const __le16 *frame = (const __le16 *)
+			&data->fifo_buf[n * data->fifo_frame_len];
+
+		j = 0;
+		for_each_set_bit(i, indio_dev->active_scan_mask,
+				 indio_dev->masklength) {
+			if (i == BMI160_SCAN_TIMESTAMP)
+				continue;
+			if (i == BMI160_SCAN_TEMPERATURE)
+				buf[j++] = temp;
+			else
+				buf[j++] = frame[bmi160_fifo_index(data, i)];
+		}
+
+		iio_push_to_buffers_with_timestamp(indio_dev, buf,
+			iio_ts_est_get(&data->fifo_ts_est,
+				       data->fifo_count + n + 1));
+	}
+
+	data->fifo_count += frames;
+
+	return frames;
+}
+
+/* Restart the sample stream the timestamp estimator follows at now */
+static int bmi160_fifo_ts_reset(struct iio_dev *indio_dev)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int odr, uodr, ret;
+	s64 now;
+
+	ret = bmi160_get_odr(data, data->fifo_gyro ? BMI160_GYRO : BMI160_ACCEL,
+			     &odr, &uodr);
+	if (ret < 0)
+		return ret;
+
+	now = iio_get_time_ns(
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+			      indio_dev
+#endif
+			      );
+	data->fifo_count = 0;
+	iio_ts_est_init(&data->fifo_ts_est,
+			div64_u64(NSEC_PER_SEC * 1000000ULL,
+				  (u64)odr * 1000000 + uodr), now);
+	iio_ts_est_update(&data->fifo_ts_est, 0, now);
+
+	return 0;
+}
+
+static int bmi160_fifo_enable(struct iio_dev *indio_dev)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	struct device *dev = indio_dev->dev.parent;
+	bool accel = bmi160_scan_has(indio_dev, BMI160_SCAN_ACCEL_X,
+				     BMI160_SCAN_ACCEL_Z);
+	bool gyro = bmi160_scan_has(indio_dev, BMI160_SCAN_GYRO_X,
+				    BMI160_SCAN_GYRO_Z);
+	int odr[2], uodr[2];
+	unsigned int config = 0, wm;
+	int ret;
+
+	if (!accel && !gyro) {
+		dev_err(dev, "FIFO needs an accel or gyro channel\n");
+		return -EINVAL;
+	}
+
+	/* Headerless frames carry every enabled sensor at a common rate */
+	if (accel && gyro) {
+		ret = bmi160_get_odr(data, BMI160_ACCEL, &odr[0], &uodr[0]);
+		if (ret < 0)
+			return ret;
+		ret = bmi160_get_odr(data, BMI160_GYRO, &odr[1], &uodr[1]);
+		if (ret < 0)
+			return ret;
+		if (odr[0] != odr[1] || uodr[0] != uodr[1]) {
+			dev_err(dev, "FIFO needs equal accel and gyro ODR\n");
+			return -EINVAL;
+		}
+	}
+
+	if (accel)
+		config |= BMI160_FIFO_CONFIG_1_ACC_EN;
+	if (gyro)
+		config |= BMI160_FIFO_CONFIG_1_GYR_EN;
+
+	data->fifo_gyro = gyro;
+	data->fifo_frame_len = (accel + gyro) * BMI160_FIFO_SENSOR_LEN;
+
+	wm = min(data->watermark * data->fifo_frame_len,
+		 BMI160_FIFO_LEN - data->fifo_frame_len);
+	wm /= BMI160_FIFO_CONFIG_0_WATERMARK_UNIT;
+	ret = regmap_write(data->regmap, BMI160_REG_FIFO_CONFIG_0, wm);
+	if (ret < 0)
+		return ret;
+
+	/* The interrupt fires once the fill level reaches the watermark */
+	data->fifo_wm_frames = max_t(unsigned int, 1,
+		DIV_ROUND_UP(wm * BMI160_FIFO_CONFIG_0_WATERMARK_UNIT,
+			     data->fifo_frame_len));
+
+	ret = regmap_write(data->regmap, BMI160_REG_FIFO_CONFIG_1, config);
+	if (ret < 0)
+		return ret;
+
+	ret = regmap_write(data->regmap, BMI160_REG_CMD,
+			   BMI160_CMD_FIFO_FLUSH);
+	if (ret < 0)
+		return ret;
+
+	ret = bmi160_fifo_ts_reset(indio_dev);
+	if (ret < 0)
+		return ret;
+	data->fifo_enabled = true;
+
+	return regmap_update_bits(data->regmap, BMI160_REG_INT_EN_1,
+				  BMI160_INT_EN_1_FWM, BMI160_INT_EN_1_FWM);
+}
+
+static int bmi160_fifo_disable(struct iio_dev *indio_dev)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_EN_1,
+				 BMI160_INT_EN_1_FWM, 0);
+	if (ret < 0)
+		return ret;
+
+	/* Hand over what is left before the buffer goes away */
+	bmi160_fifo_transfer(indio_dev, false);
+	data->fifo_enabled = false;
+
+	ret = regmap_write(data->regmap, BMI160_REG_FIFO_CONFIG_1, 0);
+	if (ret < 0)
+		return ret;
+
+	return regmap_write(data->regmap, BMI160_REG_CMD,
+			    BMI160_CMD_FIFO_FLUSH);
+}
+
+static int bmi160_trigger_set_state(struct iio_trigger *trig, bool state)
+{
+	struct iio_dev *indio_dev = iio_trigger_get_drvdata(trig);
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&data->mutex);
+	if (state)
+		ret = bmi160_fifo_enable(indio_dev);
+	else
+		ret = bmi160_fifo_disable(indio_dev);
+	mutex_unlock(&data->mutex);
+
+	return ret;
+}
+
+static int bmi160_trigger_validate_device(struct iio_trigger *trig,
+					  struct iio_dev *indio_dev)
+{
+	/* The FIFO trigger only makes sense for its own device */
+	if (indio_dev != iio_trigger_get_drvdata(trig))
+		return -EINVAL;
+
+	return 0;
+}
+
+static const struct iio_trigger_ops bmi160_trigger_ops = {
+	.owner = THIS_MODULE,
+	.set_trigger_state = bmi160_trigger_set_state,
+	.validate_device = bmi160_trigger_validate_device,
+};
+
+/* Hold a runtime PM reference for as long as the buffer is enabled */
+static int bmi160_buffer_preenable(struct iio_dev *indio_dev)
+{
+	return bmi160_runtime_get(iio_priv(indio_dev));
+}
+
+static int bmi160_buffer_postdisable(struct iio_dev *indio_dev)
+{
+	bmi160_runtime_put(iio_priv(indio_dev));
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops bmi160_buffer_setup_ops = {
+	.preenable = bmi160_buffer_preenable,
+	.postenable = iio_triggered_buffer_postenable,
+	.predisable = iio_triggered_buffer_predisable,
+	.postdisable = bmi160_buffer_postdisable,
+};
+
+static irqreturn_t bmi160_irq_handler(int irq, void *p)
+{
+	struct iio_dev *indio_dev = p;
+	struct bmi160_data *data = iio_priv(indio_dev);
+
+	data->irq_ts = iio_get_time_ns(
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+				       indio_dev
+#endif
+				       );
+
+	/* Motion shares the line, only the status registers tell them apart */
+	if (data->ev_anym || data->ev_nomo)
+		return IRQ_WAKE_THREAD;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0)
+	iio_trigger_poll(data->trig);
+#else
+	iio_trigger_poll(data->trig, data->irq_ts);
+#endif
+
+	return IRQ_HANDLED;
+}
+
+/* The axis that crossed the any-motion threshold first */
+static int bmi160_anym_axis(u8 status2)
+{
+	if (status2 & BMI160_INT_STATUS_2_ANYM_FIRST_X)
+		return IIO_MOD_X;
+	if (status2 & BMI160_INT_STATUS_2_ANYM_FIRST_Y)
+		return IIO_MOD_Y;
+
+	return IIO_MOD_Z;
+}
+
+static irqreturn_t bmi160_irq_thread(int irq, void *p)
+{
+	struct iio_dev *indio_dev = p;
+	struct bmi160_data *data = iio_priv(indio_dev);
+	u8 status[3];
+	int ret;
+
+	ret = regmap_bulk_read(data->regmap, BMI160_REG_INT_STATUS_0,
+			       status, sizeof(status));
+	if (ret < 0)
+		return IRQ_HANDLED;
+
+	if (status[1] & BMI160_INT_STATUS_1_FWM)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0)
+		iio_trigger_poll_chained(data->trig);
+#else
+		iio_trigger_poll_chained(data->trig, data->irq_ts);
+#endif
+
+	if (status[0] & BMI160_INT_STATUS_0_ANYM)
+		iio_push_event(indio_dev,
+			       IIO_MOD_EVENT_CODE(IIO_ACCEL, 0,
+				       bmi160_anym_axis(status[2]),
+				       IIO_EV_TYPE_ROC, IIO_EV_DIR_RISING),
+			       data->irq_ts);
+
+	if (status[1] & BMI160_INT_STATUS_1_NOMO)
+		iio_push_event(indio_dev,
+			       IIO_MOD_EVENT_CODE(IIO_ACCEL, 0,
+				       IIO_MOD_X_AND_Y_AND_Z,
+				       IIO_EV_TYPE_ROC, IIO_EV_DIR_FALLING),
+			       data->irq_ts);
+
+	/* Drop the temporary latch so the next interrupt raises an edge */
+	regmap_write(data->regmap, BMI160_REG_CMD, BMI160_CMD_INT_RESET);
+
+	return IRQ_HANDLED;
+}
+
 static irqreturn_t bmi160_trigger_handler(int irq, void *p)
 {
 	struct iio_poll_func *pf = p;
@@ -627,16 +1121,43 @@ static irqreturn_t bmi160_trigger_handler(int irq, void *p)
 	struct bmi160_data *data = iio_priv(indio_dev);
 	__le16 buf[16];
 	/* 3 sens x 3 axis x __le16 + 3 x __le16 pad + 4 x __le16 tstamp */
-	int i, ret, j = 0, base = BMI160_REG_DATA_MAGN_XOUT_L;
-	__le16 sample;
+	unsigned int reg, first = UINT_MAX, last = 0;
+	int i, ret, j = 0;
+
+	if (data->fifo_enabled) {
+		mutex_lock(&data->mutex);
+		bmi160_fifo_transfer(indio_dev, true);
+		mutex_unlock(&data->mutex);
+		goto done;
+	}
 
+	/*
+	 * The active channels are read with a single transfer spanning from
+	 * the lowest to the highest enabled data register, the samples are
+	 * then picked out of it in scan order.
+	 */
 	for_each_set_bit(i, indio_dev->active_scan_mask,
 			 indio_dev->masklength) {
-		ret = regmap_bulk_read(data->regmap, base + i * sizeof(sample),
-				       &sample, sizeof(sample));
+		if (i == BMI160_SCAN_TIMESTAMP)
+			continue;
+		reg = bmi160_scan_reg(i);
+		first = min(first, reg);
+		last = max(last, reg);
+	}
+
+	if (first <= last) {
+		ret = regmap_bulk_read(data->regmap, first, data->burst,
+				       last - first + sizeof(__le16));
 		if (ret < 0)
 			goto done;
-		buf[j++] = sample;
+
+		for_each_set_bit(i, indio_dev->active_scan_mask,
+				 indio_dev->masklength) {
+			if (i == BMI160_SCAN_TIMESTAMP)
+				continue;
+			reg = bmi160_scan_reg(i);
+			buf[j++] = data->burst[(reg - first) / sizeof(__le16)];
+		}
 	}
 
 	iio_push_to_buffers_with_timestamp(indio_dev, buf, iio_get_time_ns(
@@ -673,7 +1194,11 @@ static int bmi160_read_raw(struct iio_dev *indio_dev,
 	case IIO_ANGL_VEL:
 		switch (mask) {
 		case IIO_CHAN_INFO_RAW:
+			ret = bmi160_runtime_get(data);
+			if (ret < 0)
+				return ret;
 			ret = bmi160_get_data(data, chan->type, chan->channel2, val);
+			bmi160_runtime_put(data);
 			if (ret < 0)
 				return ret;
 			return IIO_VAL_INT;
@@ -697,7 +1222,12 @@ static int bmi160_read_raw(struct iio_dev *indio_dev,
 	case IIO_TEMP:
 		switch (mask) {
 		case IIO_CHAN_INFO_RAW:
-			return bmi160_read_temperature_reg(data->regmap, val);
+			ret = bmi160_runtime_get(data);
+			if (ret < 0)
+				return ret;
+			ret = bmi160_read_temperature_reg(data->regmap, val);
+			bmi160_runtime_put(data);
+			return ret;
 
 		case IIO_CHAN_INFO_SCALE:
 			/* 1000x multiplier to convert to milli-degrees celcius */
@@ -735,22 +1265,182 @@ static int bmi160_write_raw(struct iio_dev *indio_dev,
 			    int val, int val2, long mask)
 {
 	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
 
+	ret = bmi160_runtime_get(data);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&data->mutex);
 	switch (mask) {
 	case IIO_CHAN_INFO_SCALE:
-		return bmi160_set_scale(data,
-					bmi160_to_sensor(chan->type), val2);
+		ret = bmi160_set_scale(data,
+				       bmi160_to_sensor(chan->type), val2);
 		break;
 	case IIO_CHAN_INFO_SAMP_FREQ:
-		return bmi160_set_odr(data, bmi160_to_sensor(chan->type),
-				      val, val2);
+		ret = bmi160_set_odr(data, bmi160_to_sensor(chan->type),
+				     val, val2);
+		/* Frames still queued were sampled at the old rate */
+		if (ret == 0 && data->fifo_enabled) {
+			bmi160_fifo_transfer(indio_dev, false);
+			ret = bmi160_fifo_ts_reset(indio_dev);
+		}
+		break;
 	default:
-		return -EINVAL;
+		ret = -EINVAL;
+		break;
 	}
+	mutex_unlock(&data->mutex);
+	bmi160_runtime_put(data);
+
+	return ret;
+}
+
+/*
+ * Any-motion shares its engine with significant motion, which is only
+ * selected again once no axis wants any-motion events. INT2 then carries
+ * any-motion in its place. Called with data->mutex held.
+ */
+static int bmi160_set_motion_events(struct bmi160_data *data, u8 anym,
+				    u8 nomo)
+{
+	unsigned int map = 0;
+	int ret;
+
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_MOTION_3,
+				 BMI160_INT_MOTION_3_NO_MOT_SEL |
+				 BMI160_INT_MOTION_3_SIG_MOT_SEL,
+				 (nomo ? BMI160_INT_MOTION_3_NO_MOT_SEL : 0) |
+				 (anym ? 0 : BMI160_INT_MOTION_3_SIG_MOT_SEL));
+	if (ret < 0)
+		return ret;
+
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_EN_0,
+				 BMI160_MOTION_AXES,
+				 anym ? anym : BMI160_MOTION_AXES);
+	if (ret < 0)
+		return ret;
+
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_EN_2,
+				 BMI160_MOTION_AXES, nomo);
+	if (ret < 0)
+		return ret;
+
+	if (anym)
+		map |= BMI160_INT_MAP_0_INT1_ANYM_SIGMOT;
+	if (nomo)
+		map |= BMI160_INT_MAP_0_INT1_NOMO;
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_MAP_0,
+				 BMI160_INT_MAP_0_INT1_ANYM_SIGMOT |
+				 BMI160_INT_MAP_0_INT1_NOMO, map);
+	if (ret < 0)
+		return ret;
+
+	data->ev_anym = anym;
+	data->ev_nomo = nomo;
 
 	return 0;
 }
 
+static int bmi160_read_event_config(struct iio_dev *indio_dev,
+				    const struct iio_chan_spec *chan,
+				    enum iio_event_type type,
+				    enum iio_event_direction dir)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	u8 axis = BIT(chan->channel2 - IIO_MOD_X);
+
+	if (dir == IIO_EV_DIR_RISING)
+		return !!(data->ev_anym & axis);
+
+	return !!(data->ev_nomo & axis);
+}
+
+static int bmi160_write_event_config(struct iio_dev *indio_dev,
+				     const struct iio_chan_spec *chan,
+				     enum iio_event_type type,
+				     enum iio_event_direction dir,
+				     int state)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	u8 axis = BIT(chan->channel2 - IIO_MOD_X);
+	u8 anym, nomo;
+	int ret;
+
+	/* Events are only delivered through the interrupt line */
+	if (data->irq <= 0)
+		return -ENODEV;
+
+	ret = bmi160_runtime_get(data);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&data->mutex);
+	anym = data->ev_anym;
+	nomo = data->ev_nomo;
+	if (dir == IIO_EV_DIR_RISING)
+		anym = state ? anym | axis : anym & ~axis;
+	else
+		nomo = state ? nomo | axis : nomo & ~axis;
+	ret = bmi160_set_motion_events(data, anym, nomo);
+	mutex_unlock(&data->mutex);
+	bmi160_runtime_put(data);
+
+	return ret;
+}
+
+static int bmi160_read_event_value(struct iio_dev *indio_dev,
+				   const struct iio_chan_spec *chan,
+				   enum iio_event_type type,
+				   enum iio_event_direction dir,
+				   enum iio_event_info info,
+				   int *val, int *val2)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	unsigned int reg;
+	int ret;
+
+	if (info != IIO_EV_INFO_VALUE)
+		return -EINVAL;
+
+	ret = regmap_read(data->regmap, dir == IIO_EV_DIR_RISING ?
+			  BMI160_REG_INT_MOTION_1 : BMI160_REG_INT_MOTION_2,
+			  &reg);
+	if (ret < 0)
+		return ret;
+
+	*val = reg;
+
+	return IIO_VAL_INT;
+}
+
+static int bmi160_write_event_value(struct iio_dev *indio_dev,
+				    const struct iio_chan_spec *chan,
+				    enum iio_event_type type,
+				    enum iio_event_direction dir,
+				    enum iio_event_info info,
+				    int val, int val2)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	if (info != IIO_EV_INFO_VALUE || val < 0 || val > 255 || val2)
+		return -EINVAL;
+
+	ret = bmi160_runtime_get(data);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&data->mutex);
+	ret = regmap_write(data->regmap, dir == IIO_EV_DIR_RISING ?
+			   BMI160_REG_INT_MOTION_1 : BMI160_REG_INT_MOTION_2,
+			   val);
+	mutex_unlock(&data->mutex);
+	bmi160_runtime_put(data);
+
+	return ret;
+}
+
 static int bmi160_setup_sigmot_int(struct bmi160_data *data)
 {
 	int ret = 0;
@@ -792,6 +1482,16 @@ static int bmi160_setup_sigmot_int(struct bmi160_data *data)
 	if (ret < 0)
 		return ret;
 
+	ret = regmap_write(
+		data->regmap,
+		BMI160_REG_INT_MOTION_0,
+		(FIELD_PREP(BMI160_INT_MOTION_0_ANYM_DUR,
+			    BMI160_ANYM_DUR_DEFAULT) |
+		 FIELD_PREP(BMI160_INT_MOTION_0_SLO_NO_MOT_DUR,
+			    BMI160_SLO_NO_MOT_DUR_DEFAULT)));
+	if (ret < 0)
+		return ret;
+
 	/*
 	 * Enable a long latch period to easily catch the signal while polling.
 	 */
@@ -825,6 +1525,88 @@ static int bmi160_setup_sigmot_int(struct bmi160_data *data)
 	return ret;
 }
 
+static ssize_t bmi160_hwfifo_watermark_show(struct device *dev,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	struct bmi160_data *data = iio_priv(dev_to_iio_dev(dev));
+
+	return sprintf(buf, "%u\n", data->watermark);
+}
+
+static ssize_t bmi160_hwfifo_watermark_store(struct device *dev,
+					     struct device_attribute *attr,
+					     const char *buf, size_t len)
+{
+	struct bmi160_data *data = iio_priv(dev_to_iio_dev(dev));
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	if (!val || val > BMI160_FIFO_LEN / BMI160_FIFO_SENSOR_LEN)
+		return -EINVAL;
+
+	mutex_lock(&data->mutex);
+	if (data->fifo_enabled)
+		ret = -EBUSY;
+	else
+		data->watermark = val;
+	mutex_unlock(&data->mutex);
+
+	return ret < 0 ? ret : len;
+}
+
+static ssize_t bmi160_hwfifo_flush_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&data->mutex);
+	if (data->fifo_enabled)
+		ret = bmi160_fifo_transfer(indio_dev, false);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&data->mutex);
+
+	return ret < 0 ? ret : len;
+}
+
+static IIO_DEVICE_ATTR(hwfifo_watermark, S_IRUGO | S_IWUSR,
+		       bmi160_hwfifo_watermark_show,
+		       bmi160_hwfifo_watermark_store, 0);
+static IIO_DEVICE_ATTR(hwfifo_flush, S_IWUSR, NULL,
+		       bmi160_hwfifo_flush_store, 0);
+
+/*
+ * The FIFO watermark interrupt goes to INT1 as an active high edge, INT2 is
+ * left to the significant motion interrupt.
+ */
+static int bmi160_setup_fifo_int(struct bmi160_data *data)
+{
+	int ret;
+
+	ret = regmap_update_bits(data->regmap, BMI160_REG_INT_MAP_1,
+				 BMI160_INT_MAP_1_INT1_FWM,
+				 BMI160_INT_MAP_1_INT1_FWM);
+	if (ret < 0)
+		return ret;
+
+	return regmap_update_bits(data->regmap, BMI160_REG_INT_OUT_CTRL,
+				  BMI160_INT_OUT_CTRL_INT1_EDGE |
+				  BMI160_INT_OUT_CTRL_INT1_LVL |
+				  BMI160_INT_OUT_CTRL_INT1_OD |
+				  BMI160_INT_OUT_CTRL_INT1_OUTPUT_EN,
+				  BMI160_INT_OUT_CTRL_INT1_EDGE |
+				  BMI160_INT_OUT_CTRL_INT1_LVL |
+				  BMI160_INT_OUT_CTRL_INT1_OUTPUT_EN);
+}
+
 static
 IIO_CONST_ATTR(in_accel_sampling_frequency_available,
 	       "0.78125 1.5625 3.125 6.25 12.5 25 50 100 200 400 800 1600");
@@ -843,6 +1625,8 @@ static struct attribute *bmi160_attrs[] = {
 	&iio_const_attr_in_anglvel_sampling_frequency_available.dev_attr.attr,
 	&iio_const_attr_in_accel_scale_available.dev_attr.attr,
 	&iio_const_attr_in_anglvel_scale_available.dev_attr.attr,
+	&iio_dev_attr_hwfifo_watermark.dev_attr.attr,
+	&iio_dev_attr_hwfifo_flush.dev_attr.attr,
 	NULL,
 };
 
@@ -853,6 +1637,10 @@ static const struct attribute_group bmi160_attrs_group = {
 static const struct iio_info bmi160_info = {
 	.read_raw = bmi160_read_raw,
 	.write_raw = bmi160_write_raw,
+	.read_event_config = bmi160_read_event_config,
+	.write_event_config = bmi160_write_event_config,
+	.read_event_value = bmi160_read_event_value,
+	.write_event_value = bmi160_write_event_value,
 	.attrs = &bmi160_attrs_group,
 };
 
@@ -916,6 +1704,12 @@ static int bmi160_chip_init(struct bmi160_data *data, bool use_spi)
 	if (ret < 0)
 		return ret;
 
+	if (data->irq > 0) {
+		ret = bmi160_setup_fifo_int(data);
+		if (ret < 0)
+			return ret;
+	}
+
 	return 0;
 }
 
@@ -924,14 +1718,74 @@ static void bmi160_chip_uninit(struct bmi160_data *data)
 	/*
 	 * Putting the gyro in suspend and the accelerometer in lower power mode
 	 * still allows the significant motion interrupt to fire while linux is
-	 * powered down.
+	 * powered down. Without an interrupt line nobody would hear it, so the
+	 * accelerometer is suspended as well.
 	 */
 	bmi160_set_mode(data, BMI160_GYRO, BMI160_PMU_STATE_SUSPEND);
-	bmi160_set_mode(data, BMI160_ACCEL, BMI160_PMU_STATE_LOW_POWER);
+	bmi160_set_mode(data, BMI160_ACCEL, data->irq > 0 ?
+			BMI160_PMU_STATE_LOW_POWER : BMI160_PMU_STATE_SUSPEND);
+}
+
+static int bmi160_setup_trigger(struct iio_dev *indio_dev)
+{
+	struct bmi160_data *data = iio_priv(indio_dev);
+	struct device *dev = indio_dev->dev.parent;
+	int ret;
+
+	data->trig = devm_iio_trigger_alloc(dev, "%s-dev%d", indio_dev->name,
+					    indio_dev->id);
+	if (!data->trig)
+		return -ENOMEM;
+
+	data->trig->dev.parent = dev;
+	data->trig->ops = &bmi160_trigger_ops;
+	iio_trigger_set_drvdata(data->trig, indio_dev);
+
+	ret = devm_request_threaded_irq(dev, data->irq, bmi160_irq_handler,
+					bmi160_irq_thread,
+					IRQF_TRIGGER_RISING | IRQF_ONESHOT,
+					"bmi160", indio_dev);
+	if (ret < 0) {
+		dev_err(dev, "Failed to request irq %d\n", data->irq);
+		return ret;
+	}
+
+	return iio_trigger_register(data->trig);
+}
+
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+static bool block_buffer;
+module_param(block_buffer, bool, S_IRUGO);
+MODULE_PARM_DESC(block_buffer,
+	"Use the mmap-able block buffer instead of a kfifo");
+#endif
+
+static int bmi160_buffer_setup(struct iio_dev *indio_dev)
+{
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+	if (block_buffer)
+		return iio_triggered_block_buffer_setup(indio_dev, NULL,
+						bmi160_trigger_handler,
+						&bmi160_buffer_setup_ops);
+#endif
+	return iio_triggered_buffer_setup(indio_dev, NULL,
+					  bmi160_trigger_handler,
+					  &bmi160_buffer_setup_ops);
+}
+
+static void bmi160_buffer_cleanup(struct iio_dev *indio_dev)
+{
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+	if (block_buffer) {
+		iio_triggered_block_buffer_cleanup(indio_dev);
+		return;
+	}
+#endif
+	iio_triggered_buffer_cleanup(indio_dev);
 }
 
 int bmi160_core_probe(struct device *dev, struct regmap *regmap,
-		      const char *name, bool use_spi)
+		      const char *name, int irq, bool use_spi)
 {
 	struct iio_dev *indio_dev;
 	struct bmi160_data *data;
@@ -947,6 +1801,9 @@ int bmi160_core_probe(struct device *dev, struct regmap *regmap,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3, 16, 0)
 	data->dev = dev;
 #endif
+	mutex_init(&data->mutex);
+	data->irq = irq;
+	data->watermark = BMI160_FIFO_DEFAULT_WATERMARK;
 
 	ret = bmi160_chip_init(data, use_spi);
 	if (ret < 0)
@@ -962,19 +1819,38 @@ int bmi160_core_probe(struct device *dev, struct regmap *regmap,
 	indio_dev->modes = INDIO_DIRECT_MODE;
 	indio_dev->info = &bmi160_info;
 
-	ret = iio_triggered_buffer_setup(indio_dev, NULL,
-					 bmi160_trigger_handler, NULL);
+	/* Enable runtime PM, the sensors are in normal mode after init */
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_enable(dev);
+	pm_runtime_set_autosuspend_delay(dev, BMI160_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_put(dev);
+
+	ret = bmi160_buffer_setup(indio_dev);
 	if (ret < 0)
-		goto uninit;
+		goto runtime_pm_disable;
+
+	if (irq > 0) {
+		ret = bmi160_setup_trigger(indio_dev);
+		if (ret < 0)
+			goto buffer_cleanup;
+	}
 
 	ret = iio_device_register(indio_dev);
 	if (ret < 0)
-		goto buffer_cleanup;
+		goto trigger_unregister;
 
 	return 0;
+trigger_unregister:
+	if (irq > 0)
+		iio_trigger_unregister(data->trig);
 buffer_cleanup:
-	iio_triggered_buffer_cleanup(indio_dev);
-uninit:
+	bmi160_buffer_cleanup(indio_dev);
+runtime_pm_disable:
+	pm_runtime_get_sync(dev);
+	pm_runtime_put_noidle(dev);
+	pm_runtime_disable(dev);
 	bmi160_chip_uninit(data);
 	return ret;
 }
@@ -986,11 +1862,112 @@ void bmi160_core_remove(struct device *dev)
 	struct bmi160_data *data = iio_priv(indio_dev);
 
 	iio_device_unregister(indio_dev);
-	iio_triggered_buffer_cleanup(indio_dev);
+	if (data->irq > 0)
+		iio_trigger_unregister(data->trig);
+	bmi160_buffer_cleanup(indio_dev);
+	pm_runtime_get_sync(dev);
+	pm_runtime_put_noidle(dev);
+	pm_runtime_disable(dev);
 	bmi160_chip_uninit(data);
 }
 EXPORT_SYMBOL_GPL(bmi160_core_remove);
 
+#ifdef CONFIG_PM
+/*
+ * Between accesses the sensors are put in the same state as for system
+ * suspend, so significant motion and the motion events keep working.
+ */
+static int bmi160_runtime_suspend(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct bmi160_data *data = iio_priv(indio_dev);
+
+	mutex_lock(&data->mutex);
+	bmi160_chip_uninit(data);
+	mutex_unlock(&data->mutex);
+
+	return 0;
+}
+
+static int bmi160_runtime_resume(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&data->mutex);
+	ret = bmi160_set_mode(data, BMI160_ACCEL, BMI160_PMU_STATE_NORMAL);
+	if (ret == 0)
+		ret = bmi160_set_mode(data, BMI160_GYRO,
+				      BMI160_PMU_STATE_NORMAL);
+	mutex_unlock(&data->mutex);
+
+	return ret;
+}
+#endif /* CONFIG_PM */
+
+#ifdef CONFIG_PM_SLEEP
+/*
+ * The accelerometer stays in low power mode across suspend so significant
+ * motion, or the enabled motion events, can still wake the system. Register
+ * writes made while suspended only go to the cache and the whole
+ * configuration is written back on resume, in case the supply was cut. A
+ * device that was runtime suspended is left to wake on its next access.
+ */
+static int bmi160_suspend(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct bmi160_data *data = iio_priv(indio_dev);
+
+	mutex_lock(&data->mutex);
+	bmi160_chip_uninit(data);
+	regcache_cache_only(data->regmap, true);
+	regcache_mark_dirty(data->regmap);
+	/* Enabled motion events wake the system */
+	if (data->irq > 0 && (data->ev_anym || data->ev_nomo))
+		enable_irq_wake(data->irq);
+	mutex_unlock(&data->mutex);
+
+	return 0;
+}
+
+static int bmi160_resume(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct bmi160_data *data = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&data->mutex);
+	if (data->irq > 0 && (data->ev_anym || data->ev_nomo))
+		disable_irq_wake(data->irq);
+	regcache_cache_only(data->regmap, false);
+	ret = regcache_sync(data->regmap);
+	if (ret < 0) {
+		dev_err(dev, "Failed to restore registers\n");
+		goto out;
+	}
+
+	if (pm_runtime_status_suspended(dev))
+		goto out;
+
+	ret = bmi160_set_mode(data, BMI160_ACCEL, BMI160_PMU_STATE_NORMAL);
+	if (ret < 0)
+		goto out;
+
+	ret = bmi160_set_mode(data, BMI160_GYRO, BMI160_PMU_STATE_NORMAL);
+out:
+	mutex_unlock(&data->mutex);
+
+	return ret;
+}
+#endif
+
+const struct dev_pm_ops bmi160_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(bmi160_suspend, bmi160_resume)
+	SET_RUNTIME_PM_OPS(bmi160_runtime_suspend, bmi160_runtime_resume, NULL)
+};
+EXPORT_SYMBOL_GPL(bmi160_pm_ops);
+
 MODULE_AUTHOR("Daniel Baluta <daniel.baluta@intel.com");
 MODULE_DESCRIPTION("Bosch BMI160 driver");
 MODULE_LICENSE("GPL v2");
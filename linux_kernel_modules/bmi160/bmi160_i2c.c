@@ -35,7 +35,8 @@ static int bmi160_i2c_probe(struct i2c_client *client,
 	if (id)
 		name = id->name;
 
-	return bmi160_core_probe(&client->dev, regmap, name, false);
+	return bmi160_core_probe(&client->dev, regmap, name, client->irq,
+				 false);
 }
 
 static int bmi160_i2c_remove(struct i2c_client *client)
@@ -70,6 +71,7 @@ static struct i2c_driver bmi160_i2c_driver = {
 		.name			= "bmi160_i2c",
 		.acpi_match_table	= ACPI_PTR(bmi160_acpi_match),
 		.of_match_table		= of_match_ptr(bmi160_of_match),
+		.pm			= &bmi160_pm_ops,
 	},
 	.probe		= bmi160_i2c_probe,
 	.remove		= bmi160_i2c_remove,
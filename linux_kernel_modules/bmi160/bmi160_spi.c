@@ -26,7 +26,8 @@ static int bmi160_spi_probe(struct spi_device *spi)
 			(int)PTR_ERR(regmap));
 		return PTR_ERR(regmap);
 	}
-	return bmi160_core_probe(&spi->dev, regmap, id->name, true);
+	return bmi160_core_probe(&spi->dev, regmap, id->name, spi->irq,
+				 true);
 }
 
 static int bmi160_spi_remove(struct spi_device *spi)
@@ -64,6 +65,7 @@ static struct spi_driver bmi160_spi_driver = {
 		.acpi_match_table	= ACPI_PTR(bmi160_acpi_match),
 		.of_match_table		= of_match_ptr(bmi160_of_match),
 		.name			= "bmi160_spi",
+		.pm			= &bmi160_pm_ops,
 	},
 };
 module_spi_driver(bmi160_spi_driver);
@@ -25,6 +25,9 @@
 #include <linux/delay.h>
 #include <linux/iio/iio.h>
 #include <linux/iio/sysfs.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
 #include <linux/gpio/consumer.h>
 #include <linux/regulator/consumer.h>
 #include <linux/interrupt.h>
@@ -73,6 +76,10 @@ struct bmp280_data {
 	u8 oversampling_temp;
 	u8 oversampling_humid;
 
+	/* Normal mode IIR filter and standby time, as config register fields */
+	u8 filter;
+	u8 standby;
+
 	/*
 	 * Carryover value from temperature conversion, used in pressure
 	 * calculation.
@@ -90,10 +97,19 @@ struct bmp280_chip_info {
 	const int *oversampling_humid_avail;
 	int num_oversampling_humid_avail;
 
+	/* Standby time in microseconds, indexed by the t_sb field */
+	const int *standby_avail;
+	int num_standby_avail;
+
+	/* Scale of the compensated values, as returned by the read routines */
+	int temp_scale;
+	int press_scale_div;
+
 	int (*chip_config)(struct bmp280_data *);
 	int (*read_temp)(struct bmp280_data *, int *);
 	int (*read_press)(struct bmp280_data *, int *, int *);
 	int (*read_humid)(struct bmp280_data *, int *, int *);
+	int (*read_all)(struct bmp280_data *, u32 *, s32 *, u32 *);
 };
 
 /*
@@ -103,31 +119,45 @@ struct bmp280_chip_info {
 enum { T1, T2, T3 };
 enum { P1, P2, P3, P4, P5, P6, P7, P8, P9 };
 
-static const struct iio_chan_spec bmp280_channels[] = {
-	{
-		.type = IIO_PRESSURE,
-		.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED)
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)
-		| BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO)
-#endif
-		,
-    },
-	{
-		.type = IIO_TEMP,
-		.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED)
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)
-		| BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO)
-#endif
-		,
-	},
-	{
-		.type = IIO_HUMIDITYRELATIVE,
-		.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED)
+enum { BMP280_SCAN_PRESS, BMP280_SCAN_TEMP, BMP280_SCAN_HUMID,
+       BMP280_SCAN_TIMESTAMP };
+
+/*
+ * Buffered samples carry the compensated values, in the units given by the
+ * _scale attributes.
+ */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)
-		| BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO)
+#define BMP280_INFO_MASK	(BIT(IIO_CHAN_INFO_PROCESSED) |		\
+				 BIT(IIO_CHAN_INFO_SCALE) |		\
+				 BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO))
+#else
+#define BMP280_INFO_MASK	(BIT(IIO_CHAN_INFO_PROCESSED) |		\
+				 BIT(IIO_CHAN_INFO_SCALE))
 #endif
-		,
-	},
+
+#define BMP280_CHANNEL(_type, _index, _sign) {				\
+	.type = _type,							\
+	.info_mask_separate = BMP280_INFO_MASK,				\
+	.scan_index = _index,						\
+	.scan_type = {							\
+		.sign = _sign,						\
+		.realbits = 32,						\
+		.storagebits = 32,					\
+		.endianness = IIO_CPU,					\
+	},								\
+}
+
+static const struct iio_chan_spec bmp280_channels[] = {
+	BMP280_CHANNEL(IIO_PRESSURE, BMP280_SCAN_PRESS, 'u'),
+	BMP280_CHANNEL(IIO_TEMP, BMP280_SCAN_TEMP, 's'),
+	IIO_CHAN_SOFT_TIMESTAMP(BMP280_SCAN_TIMESTAMP),
+};
+
+static const struct iio_chan_spec bme280_channels[] = {
+	BMP280_CHANNEL(IIO_PRESSURE, BMP280_SCAN_PRESS, 'u'),
+	BMP280_CHANNEL(IIO_TEMP, BMP280_SCAN_TEMP, 's'),
+	BMP280_CHANNEL(IIO_HUMIDITYRELATIVE, BMP280_SCAN_HUMID, 'u'),
+	IIO_CHAN_SOFT_TIMESTAMP(BMP280_SCAN_TIMESTAMP),
 };
 
 /*
@@ -362,6 +392,40 @@ static int bmp280_read_humid(struct bmp280_data *data, int *val, int *val2)
 	return IIO_VAL_FRACTIONAL;
 }
 
+/*
+ * Read pressure, temperature and, on the BME280, humidity in one burst so
+ * that all of them come from the same measurement and share one t_fine.
+ */
+static int bmp280_read_all(struct bmp280_data *data, u32 *press, s32 *temp,
+			   u32 *humid)
+{
+	int ret;
+	u8 buf[BMP280_REG_HUMIDITY_LSB - BMP280_REG_PRESS_MSB + 1];
+	size_t len = sizeof(buf);
+	s32 adc_press, adc_temp;
+
+	/* The BMP280 stops at the temperature registers */
+	if (!data->chip_info->read_humid)
+		len = BMP280_REG_HUMIDITY_MSB - BMP280_REG_PRESS_MSB;
+
+	ret = regmap_bulk_read(data->regmap, BMP280_REG_PRESS_MSB, buf, len);
+	if (ret < 0) {
+		dev_err(data->dev, "failed to read sensor data\n");
+		return ret;
+	}
+
+	adc_press = (buf[0] << 12) | (buf[1] << 4) | (buf[2] >> 4);
+	adc_temp = (buf[3] << 12) | (buf[4] << 4) | (buf[5] >> 4);
+
+	*temp = bmp280_compensate_temp(data, adc_temp);
+	*press = bmp280_compensate_press(data, adc_press);
+	if (data->chip_info->read_humid)
+		*humid = bmp280_compensate_humidity(data,
+						    (buf[6] << 8) | buf[7]);
+
+	return 0;
+}
+
 static int bmp280_read_raw(struct iio_dev *indio_dev,
 			   struct iio_chan_spec const *chan,
 			   int *val, int *val2, long mask)
@@ -389,6 +453,27 @@ static int bmp280_read_raw(struct iio_dev *indio_dev,
 			break;
 		}
 		break;
+	case IIO_CHAN_INFO_SCALE:
+		switch (chan->type) {
+		case IIO_HUMIDITYRELATIVE:
+			*val = 1000;
+			*val2 = 1024;
+			ret = IIO_VAL_FRACTIONAL;
+			break;
+		case IIO_PRESSURE:
+			*val = 1;
+			*val2 = data->chip_info->press_scale_div;
+			ret = IIO_VAL_FRACTIONAL;
+			break;
+		case IIO_TEMP:
+			*val = data->chip_info->temp_scale;
+			ret = IIO_VAL_INT;
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+		}
+		break;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)
 	case IIO_CHAN_INFO_OVERSAMPLING_RATIO:
 		switch (chan->type) {
@@ -547,22 +632,157 @@ static ssize_t bmp280_show_press_oversampling_avail(struct device *dev,
 				 data->chip_info->num_oversampling_press_avail);
 }
 
+/* IIR filter coefficients, indexed by the filter field */
+static const int bmp280_filter_avail[] = { 0, 2, 4, 8, 16 };
+
+static ssize_t bmp280_show_filter_avail(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	return bmp280_show_avail(buf, bmp280_filter_avail,
+				 ARRAY_SIZE(bmp280_filter_avail));
+}
+
+static ssize_t bmp280_show_filter(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = iio_priv(dev_to_iio_dev(dev));
+
+	return sprintf(buf, "%d\n", bmp280_filter_avail[data->filter]);
+}
+
+static ssize_t bmp280_show_standby_avail(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = iio_priv(dev_to_iio_dev(dev));
+
+	return bmp280_show_avail(buf, data->chip_info->standby_avail,
+				 data->chip_info->num_standby_avail);
+}
+
+static ssize_t bmp280_show_standby(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bmp280_data *data = iio_priv(dev_to_iio_dev(dev));
+
+	return sprintf(buf, "%d\n",
+		       data->chip_info->standby_avail[data->standby]);
+}
+
+/*
+ * Set one of the config register fields to the index of val in avail and
+ * write it to the chip.
+ */
+static int bmp280_write_config(struct bmp280_data *data, u8 *field,
+			       const int *avail, const int n, int val)
+{
+	int i, ret;
+	u8 old;
+
+	for (i = 0; i < n; i++)
+		if (avail[i] == val)
+			break;
+	if (i == n)
+		return -EINVAL;
+
+	pm_runtime_get_sync(data->dev);
+	mutex_lock(&data->lock);
+	old = *field;
+	*field = i;
+	ret = data->chip_info->chip_config(data);
+	if (ret < 0)
+		*field = old;
+	mutex_unlock(&data->lock);
+	pm_runtime_mark_last_busy(data->dev);
+	pm_runtime_put_autosuspend(data->dev);
+
+	return ret;
+}
+
+static ssize_t bmp280_store_filter(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t len)
+{
+	struct bmp280_data *data = iio_priv(dev_to_iio_dev(dev));
+	int ret, val;
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	ret = bmp280_write_config(data, &data->filter, bmp280_filter_avail,
+				  ARRAY_SIZE(bmp280_filter_avail), val);
+
+	return ret < 0 ? ret : len;
+}
+
+static ssize_t bmp280_store_standby(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t len)
+{
+	struct bmp280_data *data = iio_priv(dev_to_iio_dev(dev));
+	int ret, val;
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	ret = bmp280_write_config(data, &data->standby,
+				  data->chip_info->standby_avail,
+				  data->chip_info->num_standby_avail, val);
+
+	return ret < 0 ? ret : len;
+}
+
 static IIO_DEVICE_ATTR(in_temp_oversampling_ratio_available,
 	S_IRUGO, bmp280_show_temp_oversampling_avail, NULL, 0);
 
 static IIO_DEVICE_ATTR(in_pressure_oversampling_ratio_available,
 	S_IRUGO, bmp280_show_press_oversampling_avail, NULL, 0);
 
+static IIO_DEVICE_ATTR(filter_coefficient, S_IRUGO | S_IWUSR,
+	bmp280_show_filter, bmp280_store_filter, 0);
+
+static IIO_DEVICE_ATTR(filter_coefficient_available,
+	S_IRUGO, bmp280_show_filter_avail, NULL, 0);
+
+static IIO_DEVICE_ATTR(standby_time_us, S_IRUGO | S_IWUSR,
+	bmp280_show_standby, bmp280_store_standby, 0);
+
+static IIO_DEVICE_ATTR(standby_time_us_available,
+	S_IRUGO, bmp280_show_standby_avail, NULL, 0);
+
+static struct attribute *bmp180_attributes[] = {
+	&iio_dev_attr_in_temp_oversampling_ratio_available.dev_attr.attr,
+	&iio_dev_attr_in_pressure_oversampling_ratio_available.dev_attr.attr,
+	NULL,
+};
+
+/* The filter and standby time only apply to the BMx280 normal mode */
 static struct attribute *bmp280_attributes[] = {
 	&iio_dev_attr_in_temp_oversampling_ratio_available.dev_attr.attr,
 	&iio_dev_attr_in_pressure_oversampling_ratio_available.dev_attr.attr,
+	&iio_dev_attr_filter_coefficient.dev_attr.attr,
+	&iio_dev_attr_filter_coefficient_available.dev_attr.attr,
+	&iio_dev_attr_standby_time_us.dev_attr.attr,
+	&iio_dev_attr_standby_time_us_available.dev_attr.attr,
 	NULL,
 };
 
+static const struct attribute_group bmp180_attrs_group = {
+	.attrs = bmp180_attributes,
+};
+
 static const struct attribute_group bmp280_attrs_group = {
 	.attrs = bmp280_attributes,
 };
 
+static const struct iio_info bmp180_info = {
+	.driver_module = THIS_MODULE,
+	.read_raw = &bmp280_read_raw,
+	.write_raw = &bmp280_write_raw,
+	.attrs = &bmp180_attrs_group,
+};
+
 static const struct iio_info bmp280_info = {
 	.driver_module = THIS_MODULE,
 	.read_raw = &bmp280_read_raw,
@@ -570,17 +790,87 @@ static const struct iio_info bmp280_info = {
 	.attrs = &bmp280_attrs_group,
 };
 
+static irqreturn_t bmp280_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct bmp280_data *data = iio_priv(indio_dev);
+	/* Pressure, temperature, humidity and the 8 byte aligned timestamp */
+	s32 buf[6] __aligned(8);
+	u32 press, humid = 0;
+	s32 temp;
+	int i, j = 0;
+	int ret;
+
+	mutex_lock(&data->lock);
+	ret = data->chip_info->read_all(data, &press, &temp, &humid);
+	mutex_unlock(&data->lock);
+	if (ret < 0)
+		goto done;
+
+	for_each_set_bit(i, indio_dev->active_scan_mask,
+			 indio_dev->masklength) {
+		switch (i) {
+		case BMP280_SCAN_PRESS:
+			buf[j++] = press;
+			break;
+		case BMP280_SCAN_TEMP:
+			buf[j++] = temp;
+			break;
+		case BMP280_SCAN_HUMID:
+			buf[j++] = humid;
+			break;
+		}
+	}
+
+	iio_push_to_buffers_with_timestamp(indio_dev, buf, pf->timestamp);
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+/* Hold a runtime PM reference for as long as the buffer is enabled */
+static int bmp280_buffer_preenable(struct iio_dev *indio_dev)
+{
+	struct bmp280_data *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = pm_runtime_get_sync(data->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(data->dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int bmp280_buffer_postdisable(struct iio_dev *indio_dev)
+{
+	struct bmp280_data *data = iio_priv(indio_dev);
+
+	pm_runtime_mark_last_busy(data->dev);
+	pm_runtime_put_autosuspend(data->dev);
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops bmp280_buffer_setup_ops = {
+	.preenable = bmp280_buffer_preenable,
+	.postenable = iio_triggered_buffer_postenable,
+	.predisable = iio_triggered_buffer_predisable,
+	.postdisable = bmp280_buffer_postdisable,
+};
+
 static int bmp280_chip_config(struct bmp280_data *data)
 {
 	int ret;
 	u8 osrs = BMP280_OSRS_TEMP_X(data->oversampling_temp + 1) |
 		  BMP280_OSRS_PRESS_X(data->oversampling_press + 1);
 
+	/* Writes to the config register may be ignored in normal mode */
 	ret = regmap_update_bits(data->regmap, BMP280_REG_CTRL_MEAS,
-				 BMP280_OSRS_TEMP_MASK |
-				 BMP280_OSRS_PRESS_MASK |
-				 BMP280_MODE_MASK,
-				 osrs | BMP280_MODE_NORMAL);
+				 BMP280_MODE_MASK, BMP280_MODE_SLEEP);
 	if (ret < 0) {
 		dev_err(data->dev,
 			"failed to write ctrl_meas register\n");
@@ -588,18 +878,35 @@ static int bmp280_chip_config(struct bmp280_data *data)
 	}
 
 	ret = regmap_update_bits(data->regmap, BMP280_REG_CONFIG,
+				 BMP280_STANDBY_MASK |
 				 BMP280_FILTER_MASK,
-				 BMP280_FILTER_4X);
+				 BMP280_STANDBY_X(data->standby) |
+				 BMP280_FILTER_X(data->filter));
 	if (ret < 0) {
 		dev_err(data->dev,
 			"failed to write config register\n");
 		return ret;
 	}
 
+	ret = regmap_update_bits(data->regmap, BMP280_REG_CTRL_MEAS,
+				 BMP280_OSRS_TEMP_MASK |
+				 BMP280_OSRS_PRESS_MASK |
+				 BMP280_MODE_MASK,
+				 osrs | BMP280_MODE_NORMAL);
+	if (ret < 0) {
+		dev_err(data->dev,
+			"failed to write ctrl_meas register\n");
+		return ret;
+	}
+
 	return ret;
 }
 
 static const int bmp280_oversampling_avail[] = { 1, 2, 4, 8, 16 };
+static const int bmp280_standby_avail[] = {
+	500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000 };
+static const int bme280_standby_avail[] = {
+	500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000 };
 
 static const struct bmp280_chip_info bmp280_chip_info = {
 	.oversampling_temp_avail = bmp280_oversampling_avail,
@@ -608,21 +915,30 @@ static const struct bmp280_chip_info bmp280_chip_info = {
 	.oversampling_press_avail = bmp280_oversampling_avail,
 	.num_oversampling_press_avail = ARRAY_SIZE(bmp280_oversampling_avail),
 
+	.standby_avail = bmp280_standby_avail,
+	.num_standby_avail = ARRAY_SIZE(bmp280_standby_avail),
+
+	.temp_scale = 10,
+	.press_scale_div = 256000,
+
 	.chip_config = bmp280_chip_config,
 	.read_temp = bmp280_read_temp,
 	.read_press = bmp280_read_press,
+	.read_all = bmp280_read_all,
 };
 
 static int bme280_chip_config(struct bmp280_data *data)
 {
-	int ret = bmp280_chip_config(data);
+	int ret;
 	u8 osrs = BMP280_OSRS_HUMIDITIY_X(data->oversampling_humid + 1);
 
+	/* ctrl_hum only takes effect after the following ctrl_meas write */
+	ret = regmap_update_bits(data->regmap, BMP280_REG_CTRL_HUMIDITY,
+				 BMP280_OSRS_HUMIDITY_MASK, osrs);
 	if (ret < 0)
 		return ret;
 
-	return regmap_update_bits(data->regmap, BMP280_REG_CTRL_HUMIDITY,
-				  BMP280_OSRS_HUMIDITY_MASK, osrs);
+	return bmp280_chip_config(data);
 }
 
 static const struct bmp280_chip_info bme280_chip_info = {
@@ -635,10 +951,17 @@ static const struct bmp280_chip_info bme280_chip_info = {
 	.oversampling_humid_avail = bmp280_oversampling_avail,
 	.num_oversampling_humid_avail = ARRAY_SIZE(bmp280_oversampling_avail),
 
+	.standby_avail = bme280_standby_avail,
+	.num_standby_avail = ARRAY_SIZE(bme280_standby_avail),
+
+	.temp_scale = 10,
+	.press_scale_div = 256000,
+
 	.chip_config = bme280_chip_config,
 	.read_temp = bmp280_read_temp,
 	.read_press = bmp280_read_press,
 	.read_humid = bmp280_read_humid,
+	.read_all = bmp280_read_all,
 };
 
 static int bmp180_measure(struct bmp280_data *data, u8 ctrl_meas)
@@ -860,6 +1183,27 @@ static int bmp180_read_press(struct bmp280_data *data,
 	return IIO_VAL_FRACTIONAL;
 }
 
+static int bmp180_read_all(struct bmp280_data *data, u32 *press, s32 *temp,
+			   u32 *humid)
+{
+	int ret;
+	s32 adc_temp, adc_press;
+
+	ret = bmp180_read_adc_temp(data, &adc_temp);
+	if (ret)
+		return ret;
+
+	*temp = bmp180_compensate_temp(data, adc_temp);
+
+	ret = bmp180_read_adc_press(data, &adc_press);
+	if (ret)
+		return ret;
+
+	*press = bmp180_compensate_press(data, adc_press);
+
+	return 0;
+}
+
 static int bmp180_chip_config(struct bmp280_data *data)
 {
 	return 0;
@@ -877,9 +1221,13 @@ static const struct bmp280_chip_info bmp180_chip_info = {
 	.num_oversampling_press_avail =
 		ARRAY_SIZE(bmp180_oversampling_press_avail),
 
+	.temp_scale = 100,
+	.press_scale_div = 1000,
+
 	.chip_config = bmp180_chip_config,
 	.read_temp = bmp180_read_temp,
 	.read_press = bmp180_read_press,
+	.read_all = bmp180_read_all,
 };
 
 static irqreturn_t bmp085_eoc_irq(int irq, void *d)
@@ -945,26 +1293,31 @@ int bmp280_common_probe(struct device *dev,
 	indio_dev->dev.parent = dev;
 	indio_dev->name = name;
 	indio_dev->channels = bmp280_channels;
+	indio_dev->num_channels = ARRAY_SIZE(bmp280_channels);
 	indio_dev->info = &bmp280_info;
 	indio_dev->modes = INDIO_DIRECT_MODE;
 
+	/* 4x IIR filter and the 0.5 ms minimum standby time */
+	data->filter = ilog2(4);
+	data->standby = 0;
+
 	switch (chip) {
 	case BMP180_CHIP_ID:
-		indio_dev->num_channels = 2;
+		indio_dev->info = &bmp180_info;
 		data->chip_info = &bmp180_chip_info;
 		data->oversampling_press = ilog2(8);
 		data->oversampling_temp = ilog2(1);
 		data->start_up_time = 10;
 		break;
 	case BMP280_CHIP_ID:
-		indio_dev->num_channels = 2;
 		data->chip_info = &bmp280_chip_info;
 		data->oversampling_press = ilog2(16);
 		data->oversampling_temp = ilog2(2);
 		data->start_up_time = 2;
 		break;
 	case BME280_CHIP_ID:
-		indio_dev->num_channels = 3;
+		indio_dev->channels = bme280_channels;
+		indio_dev->num_channels = ARRAY_SIZE(bme280_channels);
 		data->chip_info = &bme280_chip_info;
 		data->oversampling_press = ilog2(16);
 		data->oversampling_humid = ilog2(16);
@@ -1071,13 +1424,24 @@ int bmp280_common_probe(struct device *dev,
 	pm_runtime_use_autosuspend(dev);
 	pm_runtime_put(dev);
 
+	/* There is no data ready interrupt, an external trigger paces reads */
+	ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+					 bmp280_trigger_handler,
+					 &bmp280_buffer_setup_ops);
+	if (ret) {
+		dev_err(dev, "failed to setup triggered buffer\n");
+		goto out_runtime_pm_disable;
+	}
+
 	ret = iio_device_register(indio_dev);
 	if (ret)
-		goto out_runtime_pm_disable;
+		goto out_buffer_cleanup;
 
 
 	return 0;
 
+out_buffer_cleanup:
+	iio_triggered_buffer_cleanup(indio_dev);
 out_runtime_pm_disable:
 	pm_runtime_get_sync(data->dev);
 	pm_runtime_put_noidle(data->dev);
@@ -1096,6 +1460,7 @@ int bmp280_common_remove(struct device *dev)
 	struct bmp280_data *data = iio_priv(indio_dev);
 
 	iio_device_unregister(indio_dev);
+	iio_triggered_buffer_cleanup(indio_dev);
 	pm_runtime_get_sync(data->dev);
 	pm_runtime_put_noidle(data->dev);
 	pm_runtime_disable(data->dev);
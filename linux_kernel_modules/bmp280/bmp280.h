@@ -31,7 +31,11 @@
 #define BMP280_REG_COMP_PRESS_START	0x8E
 #define BMP280_COMP_PRESS_REG_COUNT	18
 
+#define BMP280_STANDBY_MASK		(BIT(7) | BIT(6) | BIT(5))
+#define BMP280_STANDBY_X(t_sb)		((t_sb) << 5)
+
 #define BMP280_FILTER_MASK		(BIT(4) | BIT(3) | BIT(2))
+#define BMP280_FILTER_X(filter)		((filter) << 2)
 #define BMP280_FILTER_OFF		0
 #define BMP280_FILTER_2X		BIT(2)
 #define BMP280_FILTER_4X		BIT(3)
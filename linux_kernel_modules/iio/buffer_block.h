@@ -0,0 +1,83 @@
+/* The industrial I/O block buffer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * The block buffer hands whole blocks of samples between the producer and
+ * user space. Blocks are allocated by the kernel, mapped into the reader's
+ * address space with mmap() on the buffer chrdev and passed back and forth
+ * with the ioctls below, so samples are never copied out of the kernel.
+ */
+
+#ifndef _IIO_BUFFER_BLOCK_H_
+#define _IIO_BUFFER_BLOCK_H_
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * struct iio_buffer_block_alloc_req - Descriptor for allocating IIO blocks
+ * @type:	Must be 0
+ * @size:	Size of a single block in bytes
+ * @count:	Number of blocks to allocate, updated with the number allocated
+ * @id:		Returns the id of the first block allocated
+ */
+struct iio_buffer_block_alloc_req {
+	__u32 type;
+	__u32 size;
+	__u32 count;
+	__u32 id;
+};
+
+/* The timestamp field is the time the block was completed */
+#define IIO_BUFFER_BLOCK_FLAG_TIMESTAMP_VALID	(1 << 0)
+
+/**
+ * struct iio_buffer_block - Descriptor for a single IIO block
+ * @id:		Identifier of the block
+ * @size:	Size of the block in bytes
+ * @bytes_used:	Number of bytes holding samples
+ * @type:	Must be 0
+ * @flags:	IIO_BUFFER_BLOCK_FLAG_* flags
+ * @data.offset: Offset to pass to mmap() to map the block
+ * @timestamp:	Completion time of the block, in the IIO timestamp clock
+ */
+struct iio_buffer_block {
+	__u32 id;
+	__u32 size;
+	__u32 bytes_used;
+	__u32 type;
+	__u32 flags;
+	union {
+		__u32 offset;
+	} data;
+	__u64 timestamp;
+};
+
+#define IIO_BLOCK_ALLOC_IOCTL	_IOWR('i', 0xa0, struct iio_buffer_block_alloc_req)
+#define IIO_BLOCK_FREE_IOCTL	_IO('i', 0xa1)
+#define IIO_BLOCK_QUERY_IOCTL	_IOWR('i', 0xa2, struct iio_buffer_block)
+#define IIO_BLOCK_ENQUEUE_IOCTL	_IOWR('i', 0xa3, struct iio_buffer_block)
+#define IIO_BLOCK_DEQUEUE_IOCTL	_IOWR('i', 0xa4, struct iio_buffer_block)
+
+#ifdef __KERNEL__
+
+#include <linux/interrupt.h>
+
+struct iio_dev;
+struct iio_buffer;
+struct iio_buffer_setup_ops;
+
+struct iio_buffer *iio_block_buffer_allocate(struct iio_dev *indio_dev);
+void iio_block_buffer_free(struct iio_buffer *buffer);
+
+int iio_triggered_block_buffer_setup(struct iio_dev *indio_dev,
+	irqreturn_t (*pollfunc_bh)(int irq, void *p),
+	irqreturn_t (*pollfunc_th)(int irq, void *p),
+	const struct iio_buffer_setup_ops *setup_ops);
+void iio_triggered_block_buffer_cleanup(struct iio_dev *indio_dev);
+
+#endif /* __KERNEL__ */
+
+#endif /* _IIO_BUFFER_BLOCK_H_ */
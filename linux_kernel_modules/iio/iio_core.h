@@ -65,6 +65,28 @@ static inline void iio_buffer_wakeup_poll(struct iio_dev *indio_dev) {}
 
 #endif
 
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+struct vm_area_struct;
+
+long iio_buffer_block_ioctl(struct iio_dev *indio_dev, struct file *filp,
+			    unsigned int cmd, unsigned long arg);
+int iio_buffer_block_mmap(struct file *filp, struct vm_area_struct *vma);
+
+#define iio_buffer_mmap_addr (&iio_buffer_block_mmap)
+
+#else
+
+static inline long iio_buffer_block_ioctl(struct iio_dev *indio_dev,
+					  struct file *filp, unsigned int cmd,
+					  unsigned long arg)
+{
+	return -EINVAL;
+}
+
+#define iio_buffer_mmap_addr NULL
+
+#endif
+
 int iio_device_register_eventset(struct iio_dev *indio_dev);
 void iio_device_unregister_eventset(struct iio_dev *indio_dev);
 void iio_device_wakeup_eventset(struct iio_dev *indio_dev);
@@ -0,0 +1,48 @@
+/* Sample timestamp estimation for IIO buffers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#ifndef _IIO_TIMESTAMP_H_
+#define _IIO_TIMESTAMP_H_
+
+#include <linux/types.h>
+
+#define IIO_TS_EST_POINTS	16
+
+/**
+ * struct iio_ts_est - linear model from a sensor counter to system time
+ * @period:	nominal length of one counter step in ns
+ * @slope:	fitted length of one counter step in ns, 16.16 fixed point
+ * @base:	counter value the model is anchored at
+ * @offset:	system time of @base
+ * @last:	last timestamp handed out
+ * @num:	number of valid entries in @pts
+ * @head:	next entry of @pts to overwrite
+ * @pts:	most recent (counter, system time) observations
+ *
+ * The counter is whatever the sensor advances at a fixed rate, a running
+ * count of samples or a hardware timestamp. Only the helpers below should
+ * touch the fields.
+ */
+struct iio_ts_est {
+	u32 period;
+	s64 slope;
+	u64 base;
+	s64 offset;
+	s64 last;
+	unsigned int num;
+	unsigned int head;
+	struct {
+		u64 count;
+		s64 ts;
+	} pts[IIO_TS_EST_POINTS];
+};
+
+void iio_ts_est_init(struct iio_ts_est *est, u32 period, s64 ts);
+void iio_ts_est_update(struct iio_ts_est *est, u64 count, s64 ts);
+s64 iio_ts_est_get(struct iio_ts_est *est, u64 count);
+
+#endif /* _IIO_TIMESTAMP_H_ */
@@ -0,0 +1,766 @@
+/* The industrial I/O block buffer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Samples are stored in blocks that user space maps and exchanges with the
+ * block ioctls. A block is in one of four states:
+ *
+ * DEQUEUED - owned by user space, after allocation and after a dequeue
+ * QUEUED   - on the incoming list, waiting for the producer
+ * ACTIVE   - being filled by the producer
+ * DONE     - on the outgoing list, waiting to be dequeued
+ *
+ * If user space does not allocate any blocks, a set is allocated on buffer
+ * enable and cycled through read(), so plain readers keep working.
+ */
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+
+#include <linux/iio/iio.h>
+#include "iio_core.h"
+#include <linux/iio/sysfs.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include "buffer_block.h"
+
+#define IIO_BLOCK_MAX_BLOCKS		32
+#define IIO_BLOCK_MAX_SIZE		(1 << 22)
+#define IIO_BLOCK_FILEIO_BLOCKS		4
+#define IIO_BLOCK_DEFAULT_LENGTH	128
+
+enum iio_block_state {
+	IIO_BLOCK_STATE_DEQUEUED,
+	IIO_BLOCK_STATE_QUEUED,
+	IIO_BLOCK_STATE_ACTIVE,
+	IIO_BLOCK_STATE_DONE,
+};
+
+struct iio_block {
+	struct list_head head;
+	struct iio_buffer_block block;
+	enum iio_block_state state;
+	void *vaddr;
+};
+
+/*
+ * lock serializes user space requests, list_lock protects the lists and the
+ * block states against the producer.
+ */
+struct iio_block_buffer {
+	struct iio_buffer buffer;
+	struct mutex lock;
+	spinlock_t list_lock;
+	struct list_head incoming;
+	struct list_head outgoing;
+	struct iio_block *active;
+	struct iio_block *blocks;
+	unsigned int num_blocks;
+	size_t block_stride;
+	size_t read_offset;
+	bool fileio;
+	bool update_needed;
+};
+
+#define iio_to_block_buffer(r) container_of(r, struct iio_block_buffer, buffer)
+
+static const struct iio_buffer_access_funcs iio_block_buffer_access_funcs;
+
+static bool iio_block_buffer_is_active(struct iio_block_buffer *bb)
+{
+	return !list_empty(&bb->buffer.buffer_list);
+}
+
+/* Called with list_lock held */
+static void iio_block_queue(struct iio_block_buffer *bb,
+			    struct iio_block *block)
+{
+	block->block.bytes_used = 0;
+	block->block.flags = 0;
+	block->state = IIO_BLOCK_STATE_QUEUED;
+	list_add_tail(&block->head, &bb->incoming);
+}
+
+/* Called with list_lock held */
+static void iio_block_done(struct iio_block_buffer *bb,
+			   struct iio_block *block)
+{
+	block->block.timestamp = iio_get_time_ns();
+	block->block.flags = IIO_BUFFER_BLOCK_FLAG_TIMESTAMP_VALID;
+	block->state = IIO_BLOCK_STATE_DONE;
+	list_add_tail(&block->head, &bb->outgoing);
+	if (bb->active == block)
+		bb->active = NULL;
+}
+
+/*
+ * Called with list_lock held. Once the buffer is disabled the partially
+ * filled block is handed out as well, so no samples are left behind.
+ */
+static struct iio_block *iio_block_next_done(struct iio_block_buffer *bb)
+{
+	struct iio_block *block = bb->active;
+
+	if (list_empty(&bb->outgoing) && block && block->block.bytes_used &&
+	    !iio_block_buffer_is_active(bb))
+		iio_block_done(bb, block);
+
+	return list_first_entry_or_null(&bb->outgoing, struct iio_block, head);
+}
+
+static bool iio_block_buffer_data_available(struct iio_buffer *r)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+	struct iio_block *block;
+	unsigned long flags;
+	bool avail;
+
+	spin_lock_irqsave(&bb->list_lock, flags);
+	block = bb->active;
+	avail = !list_empty(&bb->outgoing) ||
+		(block && block->block.bytes_used &&
+		 !iio_block_buffer_is_active(bb));
+	spin_unlock_irqrestore(&bb->list_lock, flags);
+
+	return avail;
+}
+
+static int iio_block_buffer_alloc_blocks(struct iio_block_buffer *bb,
+					 size_t size, unsigned int count)
+{
+	struct iio_block *blocks;
+	size_t stride = PAGE_ALIGN(size);
+	unsigned int i;
+
+	blocks = kcalloc(count, sizeof(*blocks), GFP_KERNEL);
+	if (!blocks)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		/* Zeroed and flagged so it can be mapped into user space */
+		blocks[i].vaddr = vmalloc_user(stride);
+		if (!blocks[i].vaddr)
+			goto error_free_blocks;
+
+		blocks[i].block.id = i;
+		blocks[i].block.size = size;
+		blocks[i].block.data.offset = i * stride;
+		blocks[i].state = IIO_BLOCK_STATE_DEQUEUED;
+	}
+
+	bb->blocks = blocks;
+	bb->num_blocks = count;
+	bb->block_stride = stride;
+
+	return 0;
+
+error_free_blocks:
+	while (i--)
+		vfree(blocks[i].vaddr);
+	kfree(blocks);
+	return -ENOMEM;
+}
+
+/*
+ * Pages still mapped by user space hold their own reference and outlive the
+ * vfree(), so the blocks can go even if the reader forgot to unmap them.
+ */
+static void iio_block_buffer_free_blocks(struct iio_block_buffer *bb)
+{
+	unsigned int i;
+
+	spin_lock_irq(&bb->list_lock);
+	INIT_LIST_HEAD(&bb->incoming);
+	INIT_LIST_HEAD(&bb->outgoing);
+	bb->active = NULL;
+	spin_unlock_irq(&bb->list_lock);
+
+	for (i = 0; i < bb->num_blocks; i++)
+		vfree(bb->blocks[i].vaddr);
+	kfree(bb->blocks);
+
+	bb->blocks = NULL;
+	bb->num_blocks = 0;
+	bb->block_stride = 0;
+	bb->read_offset = 0;
+	bb->fileio = false;
+}
+
+static int iio_request_update_block_buffer(struct iio_buffer *r)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+	unsigned int i, samples;
+	int ret = 0;
+
+	mutex_lock(&bb->lock);
+
+	if (bb->num_blocks && !bb->fileio) {
+		/* Blocks from user space must hold at least one sample */
+		if (bb->blocks[0].block.size < r->bytes_per_datum)
+			ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (!r->bytes_per_datum) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (bb->update_needed || !bb->num_blocks) {
+		iio_block_buffer_free_blocks(bb);
+		samples = DIV_ROUND_UP(r->length, IIO_BLOCK_FILEIO_BLOCKS);
+		ret = iio_block_buffer_alloc_blocks(bb,
+					samples * r->bytes_per_datum,
+					IIO_BLOCK_FILEIO_BLOCKS);
+		if (ret)
+			goto out_unlock;
+		bb->fileio = true;
+		bb->update_needed = false;
+	}
+
+	/* Drop stale samples, like the kfifo does on enable */
+	spin_lock_irq(&bb->list_lock);
+	INIT_LIST_HEAD(&bb->incoming);
+	INIT_LIST_HEAD(&bb->outgoing);
+	bb->active = NULL;
+	for (i = 0; i < bb->num_blocks; i++)
+		iio_block_queue(bb, &bb->blocks[i]);
+	spin_unlock_irq(&bb->list_lock);
+	bb->read_offset = 0;
+
+out_unlock:
+	mutex_unlock(&bb->lock);
+
+	return ret;
+}
+
+static int iio_get_length_block_buffer(struct iio_buffer *r)
+{
+	return r->length;
+}
+
+static int iio_set_length_block_buffer(struct iio_buffer *r, int length)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+
+	if (length < 1)
+		length = 1;
+	if (r->length != length) {
+		r->length = length;
+		bb->update_needed = true;
+	}
+	return 0;
+}
+
+static int iio_get_bytes_per_datum_block_buffer(struct iio_buffer *r)
+{
+	return r->bytes_per_datum;
+}
+
+static int iio_set_bytes_per_datum_block_buffer(struct iio_buffer *r,
+						size_t bpd)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+
+	if (r->bytes_per_datum != bpd) {
+		r->bytes_per_datum = bpd;
+		bb->update_needed = true;
+	}
+	return 0;
+}
+
+static int iio_store_to_block_buffer(struct iio_buffer *r, const void *data)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+	struct iio_block *block;
+	size_t bpd = r->bytes_per_datum;
+	unsigned long flags;
+	bool wake = false;
+	int ret = 0;
+
+	spin_lock_irqsave(&bb->list_lock, flags);
+
+	block = bb->active;
+	if (!block) {
+		/* Reader is not keeping up, the sample is dropped */
+		if (list_empty(&bb->incoming)) {
+			ret = -EBUSY;
+			goto out_unlock;
+		}
+		block = list_first_entry(&bb->incoming, struct iio_block, head);
+		list_del(&block->head);
+		block->state = IIO_BLOCK_STATE_ACTIVE;
+		bb->active = block;
+	}
+
+	memcpy(block->vaddr + block->block.bytes_used, data, bpd);
+	block->block.bytes_used += bpd;
+
+	/* Only whole samples go into a block */
+	if (block->block.bytes_used + bpd > block->block.size) {
+		iio_block_done(bb, block);
+		wake = true;
+	}
+
+out_unlock:
+	spin_unlock_irqrestore(&bb->list_lock, flags);
+
+	if (wake)
+		wake_up_interruptible_poll(&r->pollq, POLLIN | POLLRDNORM);
+
+	return ret;
+}
+
+static int iio_read_first_n_block_buffer(struct iio_buffer *r,
+					 size_t n, char __user *buf)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+	struct iio_block *block;
+	size_t count;
+	int ret;
+
+	if (mutex_lock_interruptible(&bb->lock))
+		return -ERESTARTSYS;
+
+	/* Blocks allocated by user space are only handed out by dequeue */
+	if (!bb->fileio) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (n < r->bytes_per_datum) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	spin_lock_irq(&bb->list_lock);
+	block = iio_block_next_done(bb);
+	spin_unlock_irq(&bb->list_lock);
+	if (!block) {
+		ret = 0;
+		goto out_unlock;
+	}
+
+	/* The producer is done with the block, only readers touch it now */
+	count = min_t(size_t, n, block->block.bytes_used - bb->read_offset);
+	count = rounddown(count, r->bytes_per_datum);
+	if (copy_to_user(buf, block->vaddr + bb->read_offset, count)) {
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	bb->read_offset += count;
+	if (bb->read_offset >= block->block.bytes_used) {
+		spin_lock_irq(&bb->list_lock);
+		list_del(&block->head);
+		iio_block_queue(bb, block);
+		spin_unlock_irq(&bb->list_lock);
+		bb->read_offset = 0;
+	}
+	ret = count;
+
+out_unlock:
+	mutex_unlock(&bb->lock);
+
+	return ret;
+}
+
+static void iio_block_buffer_release(struct iio_buffer *r)
+{
+	struct iio_block_buffer *bb = iio_to_block_buffer(r);
+
+	iio_block_buffer_free_blocks(bb);
+	mutex_destroy(&bb->lock);
+	kfree(bb);
+}
+
+static int iio_block_buffer_alloc_ioctl(struct iio_block_buffer *bb,
+					void __user *argp)
+{
+	struct iio_buffer_block_alloc_req req;
+	int ret;
+
+	if (copy_from_user(&req, argp, sizeof(req)))
+		return -EFAULT;
+
+	if (req.type || !req.size || req.size > IIO_BLOCK_MAX_SIZE ||
+	    !req.count)
+		return -EINVAL;
+
+	req.count = min_t(u32, req.count, IIO_BLOCK_MAX_BLOCKS);
+
+	mutex_lock(&bb->lock);
+	if (iio_block_buffer_is_active(bb) ||
+	    (bb->num_blocks && !bb->fileio)) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	/* Blocks set up for read() are replaced by the requested ones */
+	iio_block_buffer_free_blocks(bb);
+	ret = iio_block_buffer_alloc_blocks(bb, req.size, req.count);
+	req.id = 0;
+
+out_unlock:
+	mutex_unlock(&bb->lock);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(argp, &req, sizeof(req)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int iio_block_buffer_free_ioctl(struct iio_block_buffer *bb)
+{
+	int ret = 0;
+
+	mutex_lock(&bb->lock);
+	if (iio_block_buffer_is_active(bb)) {
+		ret = -EBUSY;
+	} else {
+		iio_block_buffer_free_blocks(bb);
+		bb->update_needed = true;
+	}
+	mutex_unlock(&bb->lock);
+
+	return ret;
+}
+
+static int iio_block_buffer_query_ioctl(struct iio_block_buffer *bb,
+					void __user *argp)
+{
+	struct iio_buffer_block block;
+	int ret = 0;
+
+	if (copy_from_user(&block, argp, sizeof(block)))
+		return -EFAULT;
+
+	mutex_lock(&bb->lock);
+	if (bb->fileio || block.id >= bb->num_blocks) {
+		ret = -EINVAL;
+	} else {
+		spin_lock_irq(&bb->list_lock);
+		block = bb->blocks[block.id].block;
+		spin_unlock_irq(&bb->list_lock);
+	}
+	mutex_unlock(&bb->lock);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(argp, &block, sizeof(block)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int iio_block_buffer_enqueue_ioctl(struct iio_block_buffer *bb,
+					  void __user *argp)
+{
+	struct iio_buffer_block block;
+	struct iio_block *b;
+	int ret = 0;
+
+	if (copy_from_user(&block, argp, sizeof(block)))
+		return -EFAULT;
+
+	mutex_lock(&bb->lock);
+	if (bb->fileio || block.id >= bb->num_blocks) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	b = &bb->blocks[block.id];
+	spin_lock_irq(&bb->list_lock);
+	if (b->state == IIO_BLOCK_STATE_DEQUEUED)
+		iio_block_queue(bb, b);
+	else
+		ret = -EBUSY;
+	spin_unlock_irq(&bb->list_lock);
+
+out_unlock:
+	mutex_unlock(&bb->lock);
+
+	return ret;
+}
+
+static int iio_block_buffer_dequeue_ioctl(struct iio_dev *indio_dev,
+					  struct iio_block_buffer *bb,
+					  struct file *filp, void __user *argp)
+{
+	struct iio_buffer_block block;
+	struct iio_block *b;
+	int ret;
+
+	for (;;) {
+		mutex_lock(&bb->lock);
+		if (bb->fileio || !bb->num_blocks) {
+			mutex_unlock(&bb->lock);
+			return -EINVAL;
+		}
+
+		spin_lock_irq(&bb->list_lock);
+		b = iio_block_next_done(bb);
+		if (b) {
+			list_del(&b->head);
+			b->state = IIO_BLOCK_STATE_DEQUEUED;
+			block = b->block;
+		}
+		spin_unlock_irq(&bb->list_lock);
+		mutex_unlock(&bb->lock);
+
+		if (b)
+			break;
+
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(bb->buffer.pollq,
+				iio_block_buffer_data_available(&bb->buffer) ||
+				indio_dev->info == NULL);
+		if (ret)
+			return ret;
+		if (indio_dev->info == NULL)
+			return -ENODEV;
+	}
+
+	if (copy_to_user(argp, &block, sizeof(block)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * iio_buffer_block_ioctl() - chrdev ioctls for block buffer access
+ *
+ * Returns -EINVAL for devices that do not use a block buffer, as for any
+ * other unknown ioctl.
+ */
+long iio_buffer_block_ioctl(struct iio_dev *indio_dev, struct file *filp,
+			    unsigned int cmd, unsigned long arg)
+{
+	struct iio_buffer *r = indio_dev->buffer;
+	struct iio_block_buffer *bb;
+	void __user *argp = (void __user *)arg;
+
+	if (!r || r->access != &iio_block_buffer_access_funcs)
+		return -EINVAL;
+
+	bb = iio_to_block_buffer(r);
+
+	switch (cmd) {
+	case IIO_BLOCK_ALLOC_IOCTL:
+		return iio_block_buffer_alloc_ioctl(bb, argp);
+	case IIO_BLOCK_FREE_IOCTL:
+		return iio_block_buffer_free_ioctl(bb);
+	case IIO_BLOCK_QUERY_IOCTL:
+		return iio_block_buffer_query_ioctl(bb, argp);
+	case IIO_BLOCK_ENQUEUE_IOCTL:
+		return iio_block_buffer_enqueue_ioctl(bb, argp);
+	case IIO_BLOCK_DEQUEUE_IOCTL:
+		return iio_block_buffer_dequeue_ioctl(indio_dev, bb, filp,
+						      argp);
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * iio_buffer_block_mmap() - chrdev mmap for block buffer access
+ *
+ * Each block is mapped on its own, at the offset reported by the query and
+ * dequeue ioctls.
+ */
+int iio_buffer_block_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct iio_dev *indio_dev = filp->private_data;
+	struct iio_buffer *r = indio_dev->buffer;
+	struct iio_block_buffer *bb;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned int id;
+	int ret;
+
+	if (!indio_dev->info)
+		return -ENODEV;
+
+	if (!r || r->access != &iio_block_buffer_access_funcs)
+		return -ENODEV;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	bb = iio_to_block_buffer(r);
+
+	mutex_lock(&bb->lock);
+	if (bb->fileio || !bb->num_blocks) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	id = offset / bb->block_stride;
+	if (id >= bb->num_blocks || offset % bb->block_stride ||
+	    vma->vm_end - vma->vm_start > bb->block_stride) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	ret = remap_vmalloc_range(vma, bb->blocks[id].vaddr, 0);
+
+out_unlock:
+	mutex_unlock(&bb->lock);
+
+	return ret;
+}
+
+static IIO_BUFFER_ENABLE_ATTR;
+static IIO_BUFFER_LENGTH_ATTR;
+
+static struct attribute *iio_block_buffer_attributes[] = {
+	&dev_attr_length.attr,
+	&dev_attr_enable.attr,
+	NULL,
+};
+
+static struct attribute_group iio_block_buffer_attribute_group = {
+	.attrs = iio_block_buffer_attributes,
+	.name = "buffer",
+};
+
+static const struct iio_buffer_access_funcs iio_block_buffer_access_funcs = {
+	.store_to = &iio_store_to_block_buffer,
+	.read_first_n = &iio_read_first_n_block_buffer,
+	.data_available = iio_block_buffer_data_available,
+	.request_update = &iio_request_update_block_buffer,
+	.get_bytes_per_datum = &iio_get_bytes_per_datum_block_buffer,
+	.set_bytes_per_datum = &iio_set_bytes_per_datum_block_buffer,
+	.get_length = &iio_get_length_block_buffer,
+	.set_length = &iio_set_length_block_buffer,
+	.release = &iio_block_buffer_release,
+};
+
+/**
+ * iio_block_buffer_allocate() - Allocate a block buffer
+ * @indio_dev: The IIO device the buffer is for
+ *
+ * Drop-in replacement for iio_kfifo_allocate() that adds mmap access.
+ */
+struct iio_buffer *iio_block_buffer_allocate(struct iio_dev *indio_dev)
+{
+	struct iio_block_buffer *bb;
+
+	bb = kzalloc(sizeof(*bb), GFP_KERNEL);
+	if (!bb)
+		return NULL;
+
+	iio_buffer_init(&bb->buffer);
+	bb->buffer.attrs = &iio_block_buffer_attribute_group;
+	bb->buffer.access = &iio_block_buffer_access_funcs;
+	bb->buffer.length = IIO_BLOCK_DEFAULT_LENGTH;
+	mutex_init(&bb->lock);
+	spin_lock_init(&bb->list_lock);
+	INIT_LIST_HEAD(&bb->incoming);
+	INIT_LIST_HEAD(&bb->outgoing);
+	bb->update_needed = true;
+
+	return &bb->buffer;
+}
+EXPORT_SYMBOL(iio_block_buffer_allocate);
+
+void iio_block_buffer_free(struct iio_buffer *buffer)
+{
+	iio_buffer_put(buffer);
+}
+EXPORT_SYMBOL(iio_block_buffer_free);
+
+static const struct iio_buffer_setup_ops iio_triggered_block_buffer_setup_ops = {
+	.postenable = &iio_triggered_buffer_postenable,
+	.predisable = &iio_triggered_buffer_predisable,
+};
+
+/**
+ * iio_triggered_block_buffer_setup() - Setup triggered block buffer and pollfunc
+ * @indio_dev:		IIO device structure
+ * @pollfunc_bh:	Function which will be used as pollfunc bottom half
+ * @pollfunc_th:	Function which will be used as pollfunc top half
+ * @setup_ops:		Buffer setup functions to use for this device.
+ *			If NULL the default setup functions for triggered
+ *			buffers will be used.
+ *
+ * Same as iio_triggered_buffer_setup(), with a block buffer in place of the
+ * kfifo. Free with iio_triggered_block_buffer_cleanup().
+ */
+int iio_triggered_block_buffer_setup(struct iio_dev *indio_dev,
+	irqreturn_t (*pollfunc_bh)(int irq, void *p),
+	irqreturn_t (*pollfunc_th)(int irq, void *p),
+	const struct iio_buffer_setup_ops *setup_ops)
+{
+	struct iio_buffer *buffer;
+	int ret;
+
+	buffer = iio_block_buffer_allocate(indio_dev);
+	if (!buffer) {
+		ret = -ENOMEM;
+		goto error_ret;
+	}
+
+	iio_device_attach_buffer(indio_dev, buffer);
+
+	indio_dev->pollfunc = iio_alloc_pollfunc(pollfunc_bh,
+						 pollfunc_th,
+						 IRQF_ONESHOT,
+						 indio_dev,
+						 "%s_consumer%d",
+						 indio_dev->name,
+						 indio_dev->id);
+	if (indio_dev->pollfunc == NULL) {
+		ret = -ENOMEM;
+		goto error_buffer_free;
+	}
+
+	if (setup_ops)
+		indio_dev->setup_ops = setup_ops;
+	else
+		indio_dev->setup_ops = &iio_triggered_block_buffer_setup_ops;
+
+	indio_dev->modes |= INDIO_BUFFER_TRIGGERED;
+
+	ret = iio_buffer_register(indio_dev,
+				  indio_dev->channels,
+				  indio_dev->num_channels);
+	if (ret)
+		goto error_dealloc_pollfunc;
+
+	return 0;
+
+error_dealloc_pollfunc:
+	iio_dealloc_pollfunc(indio_dev->pollfunc);
+error_buffer_free:
+	iio_block_buffer_free(indio_dev->buffer);
+error_ret:
+	return ret;
+}
+EXPORT_SYMBOL(iio_triggered_block_buffer_setup);
+
+/**
+ * iio_triggered_block_buffer_cleanup() - Free resources allocated by iio_triggered_block_buffer_setup()
+ * @indio_dev: IIO device structure
+ */
+void iio_triggered_block_buffer_cleanup(struct iio_dev *indio_dev)
+{
+	iio_buffer_unregister(indio_dev);
+	iio_dealloc_pollfunc(indio_dev->pollfunc);
+	iio_block_buffer_free(indio_dev->buffer);
+}
+EXPORT_SYMBOL(iio_triggered_block_buffer_cleanup);
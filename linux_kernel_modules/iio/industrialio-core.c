@@ -1098,7 +1098,7 @@ static int iio_chrdev_release(struct inode *inode, struct file *filp)
 }
 
 /* Somewhat of a cross file organization violation - ioctls here are actually
- * event related */
+ * event and block buffer related */
 static long iio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct iio_dev *indio_dev = filp->private_data;
@@ -1114,7 +1114,7 @@ static long iio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		return 0;
 	}
-	return -EINVAL;
+	return iio_buffer_block_ioctl(indio_dev, filp, cmd, arg);
 }
 
 static const struct file_operations iio_buffer_fileops = {
@@ -1122,6 +1122,7 @@ static const struct file_operations iio_buffer_fileops = {
 	.release = iio_chrdev_release,
 	.open = iio_chrdev_open,
 	.poll = iio_buffer_poll_addr,
+	.mmap = iio_buffer_mmap_addr,
 	.owner = THIS_MODULE,
 	.llseek = noop_llseek,
 	.unlocked_ioctl = iio_ioctl,
@@ -0,0 +1,165 @@
+/* Sample timestamp estimation for IIO buffers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Drivers draining a hardware FIFO only get one system timestamp per
+ * interrupt. It is taken some scheduling latency after the sample it belongs
+ * to, and the sensor clock runs slightly off its nominal rate. Every
+ * interrupt gives a (sensor counter, system time) pair. A least squares fit
+ * over the recent pairs tracks the drift of the sensor clock. The fitted line
+ * is then moved down onto the earliest pair, since latency only ever delays
+ * an interrupt.
+ *
+ * Callers serialize access to an estimator themselves.
+ */
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/math64.h>
+
+#include "iio_timestamp.h"
+
+/* A fit further than 1/8 off the nominal rate means samples went missing */
+#define IIO_TS_EST_MAX_DRIFT_SHIFT	3
+
+static unsigned int iio_ts_est_newest(const struct iio_ts_est *est)
+{
+	return (est->head + IIO_TS_EST_POINTS - 1) % IIO_TS_EST_POINTS;
+}
+
+static s64 iio_ts_est_model(const struct iio_ts_est *est, u64 count)
+{
+	return est->offset + (((s64)(count - est->base) * est->slope) >> 16);
+}
+
+static void iio_ts_est_fit(struct iio_ts_est *est)
+{
+	unsigned int i, newest = iio_ts_est_newest(est);
+	u64 c0 = est->pts[newest].count;
+	s64 t0 = est->pts[newest].ts;
+	s64 nominal = (s64)est->period << 16;
+	s64 mx = 0, my = 0, sxx = 0, sxy = 0;
+	s64 dx, dy, q, r, slope, ts;
+
+	/*
+	 * Fit the deviation from the nominal rate rather than the time
+	 * itself, relative to the newest point, to keep the sums in range
+	 * over long windows.
+	 */
+	for (i = 0; i < est->num; i++) {
+		dx = (s64)(est->pts[i].count - c0);
+		mx += dx;
+		my += est->pts[i].ts - t0 - dx * est->period;
+	}
+	mx = div_s64(mx, est->num);
+	my = div_s64(my, est->num);
+
+	for (i = 0; i < est->num; i++) {
+		dx = (s64)(est->pts[i].count - c0);
+		dy = est->pts[i].ts - t0 - dx * est->period - my;
+		dx -= mx;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+
+	/* Room for the fractional bits of the quotient */
+	while (sxx > (S64_MAX >> 17)) {
+		sxx >>= 1;
+		sxy >>= 1;
+	}
+
+	if (sxx) {
+		q = div64_s64(sxy, sxx);
+		r = sxy - q * sxx;
+		slope = nominal + q * 65536 + div64_s64(r * 65536, sxx);
+	} else {
+		slope = est->slope;
+	}
+
+	if (slope > nominal + (nominal >> IIO_TS_EST_MAX_DRIFT_SHIFT) ||
+	    slope < nominal - (nominal >> IIO_TS_EST_MAX_DRIFT_SHIFT)) {
+		/* Start over from the newest point */
+		est->pts[0] = est->pts[newest];
+		est->num = 1;
+		est->head = 1;
+		slope = nominal;
+	}
+
+	/* Anchor the line at the newest point, then lower it onto the rest */
+	est->slope = slope;
+	est->base = c0;
+	est->offset = t0;
+	for (i = 0; i < est->num; i++) {
+		ts = est->pts[i].ts +
+		     (((s64)(c0 - est->pts[i].count) * slope) >> 16);
+		if (ts < est->offset)
+			est->offset = ts;
+	}
+}
+
+/**
+ * iio_ts_est_init() - reset a timestamp estimator
+ * @est:	estimator state
+ * @period:	nominal time of one sensor counter step in ns
+ * @ts:		system time at counter zero, the timestamps handed out stay
+ *		above it
+ */
+void iio_ts_est_init(struct iio_ts_est *est, u32 period, s64 ts)
+{
+	est->period = period;
+	est->slope = (s64)period << 16;
+	est->base = 0;
+	est->offset = ts;
+	est->last = ts;
+	est->num = 0;
+	est->head = 0;
+}
+EXPORT_SYMBOL_GPL(iio_ts_est_init);
+
+/**
+ * iio_ts_est_update() - feed an observation to a timestamp estimator
+ * @est:	estimator state
+ * @count:	sensor counter value, increasing
+ * @ts:		system time at which the counter was known to have reached
+ *		@count, typically the interrupt time
+ */
+void iio_ts_est_update(struct iio_ts_est *est, u64 count, s64 ts)
+{
+	/* Nothing was sampled since the last observation */
+	if (est->num && count <= est->pts[iio_ts_est_newest(est)].count)
+		return;
+
+	est->pts[est->head].count = count;
+	est->pts[est->head].ts = ts;
+	est->head = (est->head + 1) % IIO_TS_EST_POINTS;
+	if (est->num < IIO_TS_EST_POINTS)
+		est->num++;
+
+	iio_ts_est_fit(est);
+}
+EXPORT_SYMBOL_GPL(iio_ts_est_update);
+
+/**
+ * iio_ts_est_get() - timestamp of a sample
+ * @est:	estimator state
+ * @count:	sensor counter value of the sample
+ *
+ * Samples must be asked for in order. The timestamps returned are strictly
+ * increasing even when a refit moves the line back.
+ */
+s64 iio_ts_est_get(struct iio_ts_est *est, u64 count)
+{
+	s64 ts = iio_ts_est_model(est, count);
+
+	if (ts <= est->last)
+		ts = est->last + 1;
+	est->last = ts;
+
+	return ts;
+}
+EXPORT_SYMBOL_GPL(iio_ts_est_get);
+
+MODULE_DESCRIPTION("IIO sample timestamp estimation");
+MODULE_LICENSE("GPL");
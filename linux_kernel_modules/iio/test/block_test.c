@@ -0,0 +1,407 @@
+/*
+ * Host test for the IIO block buffer state machine
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * industrialio-buffer-block.c is built against the minimal kernel API in
+ * include/ and driven the way the IIO core and user space drive it: sample
+ * stores from the producer, read() for plain readers, and the block ioctls
+ * and mmap() for block readers. Enabling and disabling the buffer is
+ * modelled by the buffer joining and leaving the device's active list.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "../industrialio-buffer-block.c"
+
+unsigned int block_test_wakeups;
+unsigned int block_test_waits;
+s64 block_test_time;
+
+static unsigned int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__,	\
+				__LINE__, #cond);			\
+			failures++;					\
+		}							\
+	} while (0)
+
+/* IIO core functions used by the setup helpers */
+static bool pollfunc_fail;
+static int pollfuncs;
+static int registered;
+
+struct iio_poll_func {
+	int unused;
+};
+
+struct iio_poll_func *iio_alloc_pollfunc(irqreturn_t (*h)(int irq, void *p),
+					 irqreturn_t (*thread)(int irq, void *p),
+					 int type, struct iio_dev *indio_dev,
+					 const char *fmt, ...)
+{
+	if (pollfunc_fail)
+		return NULL;
+
+	pollfuncs++;
+	return calloc(1, sizeof(struct iio_poll_func));
+}
+
+void iio_dealloc_pollfunc(struct iio_poll_func *pf)
+{
+	pollfuncs--;
+	free(pf);
+}
+
+int iio_buffer_register(struct iio_dev *indio_dev,
+			const struct iio_chan_spec *channels, int num_channels)
+{
+	registered++;
+	return 0;
+}
+
+void iio_buffer_unregister(struct iio_dev *indio_dev)
+{
+	registered--;
+}
+
+int iio_triggered_buffer_postenable(struct iio_dev *indio_dev)
+{
+	return 0;
+}
+
+int iio_triggered_buffer_predisable(struct iio_dev *indio_dev)
+{
+	return 0;
+}
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			unsigned long pgoff)
+{
+	return 0;
+}
+
+/* Test fixture */
+static const struct iio_buffer_access_funcs *ops(struct iio_buffer *r)
+{
+	return r->access;
+}
+
+static struct list_head active_buffers;
+
+static int enable(struct iio_buffer *r)
+{
+	int ret = ops(r)->request_update(r);
+
+	if (!ret)
+		list_add(&r->buffer_list, &active_buffers);
+	return ret;
+}
+
+static void disable(struct iio_buffer *r)
+{
+	list_del(&r->buffer_list);
+	INIT_LIST_HEAD(&r->buffer_list);
+}
+
+static int store(struct iio_buffer *r, u32 sample)
+{
+	return ops(r)->store_to(r, &sample);
+}
+
+static long ioctl(struct iio_dev *indio_dev, struct file *filp,
+		  unsigned int cmd, void *arg)
+{
+	return iio_buffer_block_ioctl(indio_dev, filp, cmd,
+				      (unsigned long)arg);
+}
+
+static enum iio_block_state state(struct iio_buffer *r, unsigned int id)
+{
+	return iio_to_block_buffer(r)->blocks[id].state;
+}
+
+static struct iio_buffer *setup(struct iio_dev *indio_dev)
+{
+	struct iio_buffer *r = iio_block_buffer_allocate(indio_dev);
+
+	indio_dev->buffer = r;
+	indio_dev->info = indio_dev;
+	ops(r)->set_bytes_per_datum(r, sizeof(u32));
+	return r;
+}
+
+/*
+ * Without blocks from user space a set is allocated on enable and drained
+ * through read(), a block at a time.
+ */
+static void test_fileio(void)
+{
+	struct iio_dev indio_dev = { 0 };
+	struct file filp = { O_NONBLOCK, &indio_dev };
+	struct iio_buffer_block block = { 0 };
+	struct iio_block_buffer *bb;
+	struct iio_buffer *r;
+	u32 buf[16];
+	unsigned int i;
+
+	r = setup(&indio_dev);
+	bb = iio_to_block_buffer(r);
+	ops(r)->set_length(r, 8);
+
+	CHECK(enable(r) == 0);
+	CHECK(bb->fileio);
+	CHECK(bb->num_blocks == IIO_BLOCK_FILEIO_BLOCKS);
+	CHECK(bb->blocks[0].block.size == 2 * sizeof(u32));
+	for (i = 0; i < bb->num_blocks; i++)
+		CHECK(state(r, i) == IIO_BLOCK_STATE_QUEUED);
+
+	/* The block ioctls are for blocks user space allocated */
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) ==
+	      -EINVAL);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_QUERY_IOCTL, &block) ==
+	      -EINVAL);
+
+	CHECK(store(r, 1) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_ACTIVE);
+	CHECK(!ops(r)->data_available(r));
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 0);
+
+	block_test_wakeups = 0;
+	CHECK(store(r, 2) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DONE);
+	CHECK(block_test_wakeups == 1);
+	CHECK(ops(r)->data_available(r));
+
+	/* Less than a sample is refused, partial reads keep the block */
+	CHECK(ops(r)->read_first_n(r, 2, (char *)buf) == -EINVAL);
+	CHECK(ops(r)->read_first_n(r, 4, (char *)buf) == 4);
+	CHECK(buf[0] == 1);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DONE);
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 4);
+	CHECK(buf[0] == 2);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_QUEUED);
+	CHECK(!ops(r)->data_available(r));
+
+	/* A reader that doesn't keep up loses the samples that don't fit */
+	for (i = 0; i < 8; i++)
+		CHECK(store(r, 10 + i) == 0);
+	CHECK(store(r, 18) == -EBUSY);
+	for (i = 0; i < 4; i++) {
+		CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 8);
+		CHECK(buf[0] == 10 + 2 * i && buf[1] == 11 + 2 * i);
+	}
+
+	/* A partly filled block is handed out once the buffer is disabled */
+	CHECK(store(r, 20) == 0);
+	CHECK(!ops(r)->data_available(r));
+	disable(r);
+	CHECK(ops(r)->data_available(r));
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 4);
+	CHECK(buf[0] == 20);
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 0);
+
+	/* Enabling again starts from empty blocks, sized for the new length */
+	CHECK(store(r, 21) == 0);
+	ops(r)->set_length(r, 16);
+	CHECK(enable(r) == 0);
+	CHECK(bb->blocks[0].block.size == 4 * sizeof(u32));
+	CHECK(!ops(r)->data_available(r));
+	disable(r);
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == 0);
+
+	iio_block_buffer_free(r);
+}
+
+/* Blocks allocated by user space cycle through the block ioctls */
+static void test_blocks(void)
+{
+	struct iio_dev indio_dev = { 0 };
+	struct file filp = { O_NONBLOCK, &indio_dev };
+	struct iio_buffer_block_alloc_req req = { 0, 3 * sizeof(u32), 2, 0 };
+	struct iio_buffer_block block = { 0 };
+	struct vm_area_struct vma;
+	struct iio_block_buffer *bb;
+	struct iio_buffer *r;
+	u32 buf[4];
+
+	r = setup(&indio_dev);
+	bb = iio_to_block_buffer(r);
+
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ALLOC_IOCTL, &req) == 0);
+	CHECK(req.count == 2 && req.id == 0);
+	CHECK(!bb->fileio);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DEQUEUED);
+	CHECK(state(r, 1) == IIO_BLOCK_STATE_DEQUEUED);
+
+	/* Once allocated, the blocks stay until freed */
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ALLOC_IOCTL, &req) == -EBUSY);
+
+	block.id = 1;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_QUERY_IOCTL, &block) == 0);
+	CHECK(block.size == 3 * sizeof(u32));
+	CHECK(block.data.offset == PAGE_SIZE);
+	block.id = 2;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_QUERY_IOCTL, &block) ==
+	      -EINVAL);
+
+	/* Each block maps on its own, shared, at its offset */
+	vma.vm_start = 0;
+	vma.vm_end = PAGE_SIZE;
+	vma.vm_pgoff = 1;
+	vma.vm_flags = VM_SHARED;
+	CHECK(iio_buffer_block_mmap(&filp, &vma) == 0);
+	vma.vm_pgoff = 2;
+	CHECK(iio_buffer_block_mmap(&filp, &vma) == -EINVAL);
+	vma.vm_pgoff = 0;
+	vma.vm_end = 2 * PAGE_SIZE;
+	CHECK(iio_buffer_block_mmap(&filp, &vma) == -EINVAL);
+	vma.vm_end = PAGE_SIZE;
+	vma.vm_flags = 0;
+	CHECK(iio_buffer_block_mmap(&filp, &vma) == -EINVAL);
+
+	/* Enabling leaves the blocks with user space until enqueued */
+	CHECK(enable(r) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DEQUEUED);
+	CHECK(store(r, 1) == -EBUSY);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ALLOC_IOCTL, &req) == -EBUSY);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_FREE_IOCTL, NULL) == -EBUSY);
+
+	block.id = 0;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ENQUEUE_IOCTL, &block) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_QUEUED);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ENQUEUE_IOCTL, &block) ==
+	      -EBUSY);
+	block.id = 1;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ENQUEUE_IOCTL, &block) == 0);
+
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) ==
+	      -EAGAIN);
+
+	/* QUEUED -> ACTIVE on the first sample, DONE when full */
+	CHECK(store(r, 1) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_ACTIVE);
+	CHECK(store(r, 2) == 0);
+	CHECK(store(r, 3) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DONE);
+	CHECK(state(r, 1) == IIO_BLOCK_STATE_QUEUED);
+
+	/* read() is for the fileio blocks only */
+	CHECK(ops(r)->read_first_n(r, sizeof(buf), (char *)buf) == -EBUSY);
+
+	/* DONE -> DEQUEUED, with the samples and the completion time */
+	memset(&block, 0xff, sizeof(block));
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) == 0);
+	CHECK(block.id == 0);
+	CHECK(block.bytes_used == 3 * sizeof(u32));
+	CHECK(block.flags & IIO_BUFFER_BLOCK_FLAG_TIMESTAMP_VALID);
+	CHECK((s64)block.timestamp == block_test_time);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_DEQUEUED);
+	memcpy(buf, bb->blocks[0].vaddr, block.bytes_used);
+	CHECK(buf[0] == 1 && buf[1] == 2 && buf[2] == 3);
+
+	/* DEQUEUED -> QUEUED clears the previous contents */
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ENQUEUE_IOCTL, &block) == 0);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_QUEUED);
+	CHECK(bb->blocks[0].block.bytes_used == 0);
+	CHECK(bb->blocks[0].block.flags == 0);
+
+	/* Blocks are filled in the order they were queued */
+	CHECK(store(r, 4) == 0);
+	CHECK(state(r, 1) == IIO_BLOCK_STATE_ACTIVE);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) ==
+	      -EAGAIN);
+
+	/* The partly filled block comes out after disable */
+	disable(r);
+	CHECK(ops(r)->data_available(r));
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) == 0);
+	CHECK(block.id == 1);
+	CHECK(block.bytes_used == sizeof(u32));
+	CHECK(state(r, 1) == IIO_BLOCK_STATE_DEQUEUED);
+	CHECK(state(r, 0) == IIO_BLOCK_STATE_QUEUED);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) ==
+	      -EAGAIN);
+
+	/* A blocking dequeue returns when interrupted */
+	filp.f_flags = 0;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_DEQUEUE_IOCTL, &block) ==
+	      -ERESTARTSYS);
+
+	/* Freed blocks fall back to fileio on the next enable */
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_FREE_IOCTL, NULL) == 0);
+	CHECK(bb->num_blocks == 0);
+	block.id = 0;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ENQUEUE_IOCTL, &block) ==
+	      -EINVAL);
+	CHECK(enable(r) == 0);
+	CHECK(bb->fileio);
+	CHECK(bb->num_blocks == IIO_BLOCK_FILEIO_BLOCKS);
+	disable(r);
+
+	iio_block_buffer_free(r);
+}
+
+/* Blocks too small for a sample are refused on enable */
+static void test_block_size(void)
+{
+	struct iio_dev indio_dev = { 0 };
+	struct file filp = { O_NONBLOCK, &indio_dev };
+	struct iio_buffer_block_alloc_req req = { 0, 2, 1, 0 };
+	struct iio_buffer *r;
+
+	r = setup(&indio_dev);
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ALLOC_IOCTL, &req) == 0);
+	CHECK(enable(r) == -EINVAL);
+
+	req.size = 0;
+	CHECK(ioctl(&indio_dev, &filp, IIO_BLOCK_ALLOC_IOCTL, &req) ==
+	      -EINVAL);
+
+	iio_block_buffer_free(r);
+}
+
+static void test_triggered_setup(void)
+{
+	struct iio_dev indio_dev = { 0 };
+
+	CHECK(iio_triggered_block_buffer_setup(&indio_dev, NULL, NULL,
+					       NULL) == 0);
+	CHECK(indio_dev.buffer &&
+	      indio_dev.buffer->access == &iio_block_buffer_access_funcs);
+	CHECK(indio_dev.setup_ops == &iio_triggered_block_buffer_setup_ops);
+	CHECK(indio_dev.modes & INDIO_BUFFER_TRIGGERED);
+	CHECK(pollfuncs == 1 && registered == 1);
+	iio_triggered_block_buffer_cleanup(&indio_dev);
+	CHECK(pollfuncs == 0 && registered == 0);
+
+	pollfunc_fail = true;
+	CHECK(iio_triggered_block_buffer_setup(&indio_dev, NULL, NULL,
+					       NULL) == -ENOMEM);
+	CHECK(registered == 0);
+	pollfunc_fail = false;
+}
+
+int main(void)
+{
+	INIT_LIST_HEAD(&active_buffers);
+
+	test_fileio();
+	test_blocks();
+	test_block_size();
+	test_triggered_setup();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("block buffer: ok\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#ifndef _BLOCK_TEST_IIO_BUFFER_H_
+#define _BLOCK_TEST_IIO_BUFFER_H_
+
+#include <linux/iio/iio.h>
+
+struct iio_buffer;
+
+struct iio_buffer_access_funcs {
+	int (*store_to)(struct iio_buffer *buffer, const void *data);
+	int (*read_first_n)(struct iio_buffer *buffer, size_t n,
+			    char __user *buf);
+	bool (*data_available)(struct iio_buffer *buffer);
+	int (*request_update)(struct iio_buffer *buffer);
+	int (*get_bytes_per_datum)(struct iio_buffer *buffer);
+	int (*set_bytes_per_datum)(struct iio_buffer *buffer, size_t bpd);
+	int (*get_length)(struct iio_buffer *buffer);
+	int (*set_length)(struct iio_buffer *buffer, int length);
+	void (*release)(struct iio_buffer *buffer);
+};
+
+struct iio_buffer {
+	int length;
+	int bytes_per_datum;
+	struct attribute_group *attrs;
+	const struct iio_buffer_access_funcs *access;
+	wait_queue_head_t pollq;
+	struct list_head buffer_list;
+	int ref;
+};
+
+struct iio_buffer_setup_ops {
+	int (*preenable)(struct iio_dev *);
+	int (*postenable)(struct iio_dev *);
+	int (*predisable)(struct iio_dev *);
+	int (*postdisable)(struct iio_dev *);
+};
+
+static inline void iio_buffer_init(struct iio_buffer *buffer)
+{
+	INIT_LIST_HEAD(&buffer->buffer_list);
+	init_waitqueue_head(&buffer->pollq);
+	buffer->ref = 1;
+}
+
+static inline void iio_buffer_put(struct iio_buffer *buffer)
+{
+	if (buffer && !--buffer->ref)
+		buffer->access->release(buffer);
+}
+
+static inline void iio_device_attach_buffer(struct iio_dev *indio_dev,
+					    struct iio_buffer *buffer)
+{
+	indio_dev->buffer = buffer;
+}
+
+int iio_buffer_register(struct iio_dev *indio_dev,
+			const struct iio_chan_spec *channels,
+			int num_channels);
+void iio_buffer_unregister(struct iio_dev *indio_dev);
+
+#endif
@@ -0,0 +1,37 @@
+/* The parts of struct iio_dev and struct iio_buffer the block buffer uses */
+#ifndef _BLOCK_TEST_IIO_H_
+#define _BLOCK_TEST_IIO_H_
+
+#include <linux/kernel.h>
+
+enum iio_shared_by {
+	IIO_SEPARATE,
+};
+
+#define INDIO_BUFFER_TRIGGERED		0x02
+
+struct iio_chan_spec;
+struct iio_buffer;
+struct iio_poll_func;
+struct iio_buffer_setup_ops;
+
+struct iio_dev {
+	int id;
+	const char *name;
+	int modes;
+	const void *info;
+	struct iio_buffer *buffer;
+	struct iio_poll_func *pollfunc;
+	const struct iio_buffer_setup_ops *setup_ops;
+	const struct iio_chan_spec *channels;
+	int num_channels;
+};
+
+extern s64 block_test_time;
+
+static inline s64 iio_get_time_ns(void)
+{
+	return ++block_test_time;
+}
+
+#endif
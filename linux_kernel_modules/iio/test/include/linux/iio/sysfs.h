@@ -0,0 +1,11 @@
+#ifndef _BLOCK_TEST_IIO_SYSFS_H_
+#define _BLOCK_TEST_IIO_SYSFS_H_
+
+#include <linux/kernel.h>
+
+#define IIO_BUFFER_ENABLE_ATTR \
+	struct device_attribute dev_attr_enable = { { "enable" } }
+#define IIO_BUFFER_LENGTH_ATTR \
+	struct device_attribute dev_attr_length = { { "length" } }
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _BLOCK_TEST_IIO_TRIGGER_CONSUMER_H_
+#define _BLOCK_TEST_IIO_TRIGGER_CONSUMER_H_
+
+#include <linux/iio/iio.h>
+
+struct iio_poll_func *iio_alloc_pollfunc(irqreturn_t (*h)(int irq, void *p),
+					 irqreturn_t (*thread)(int irq, void *p),
+					 int type, struct iio_dev *indio_dev,
+					 const char *fmt, ...);
+void iio_dealloc_pollfunc(struct iio_poll_func *pf);
+int iio_triggered_buffer_postenable(struct iio_dev *indio_dev);
+int iio_triggered_buffer_predisable(struct iio_dev *indio_dev);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Just enough of the kernel API to build the IIO block buffer in user space
+ * for block_test. Locks are no-ops, the test is single threaded.
+ */
+#ifndef _BLOCK_TEST_KERNEL_H_
+#define _BLOCK_TEST_KERNEL_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define __KERNEL__
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+
+#define __user
+
+#define ERESTARTSYS		512
+
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min_t(type, x, y)	((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define rounddown(x, y)		((x) - ((x) % (y)))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_ALIGN(x)		(((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+/* ioctl numbers only need to be distinct */
+#define _IO(t, n)		(((t) << 8) | (n))
+#define _IOWR(t, n, s)		(((t) << 8) | (n) | (sizeof(s) << 16))
+
+/* Lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+	new->prev = head->prev;
+	new->next = head;
+	head->prev->next = new;
+	head->prev = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	list_add_tail(new, head->next);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_first_entry(ptr, type, member) \
+	container_of((ptr)->next, type, member)
+#define list_first_entry_or_null(ptr, type, member) \
+	(!list_empty(ptr) ? list_first_entry(ptr, type, member) : NULL)
+
+/* Locks */
+typedef int spinlock_t;
+struct mutex {
+	int locked;
+};
+
+#define spin_lock_init(l)		(*(l) = 0)
+#define spin_lock_irq(l)		((void)(l))
+#define spin_unlock_irq(l)		((void)(l))
+#define spin_lock_irqsave(l, f)		((void)(l), (f) = 0)
+#define spin_unlock_irqrestore(l, f)	((void)(l), (void)(f))
+#define mutex_init(m)			((m)->locked = 0)
+#define mutex_destroy(m)		((void)(m))
+#define mutex_lock(m)			((m)->locked++)
+#define mutex_unlock(m)			((m)->locked--)
+#define mutex_lock_interruptible(m)	((m)->locked++, 0)
+
+/* Memory */
+#define GFP_KERNEL			0
+#define kzalloc(size, gfp)		calloc(1, size)
+#define kcalloc(n, size, gfp)		calloc(n, size)
+#define kfree(p)			free(p)
+#define vmalloc_user(size)		calloc(1, size)
+#define vfree(p)			free(p)
+
+#define copy_to_user(to, from, n)	(memcpy(to, from, n), 0)
+#define copy_from_user(to, from, n)	(memcpy(to, from, n), 0)
+
+/*
+ * The test never blocks, a reader that would wait is interrupted. A reader
+ * woken over and over without making progress is a bug, not a hang.
+ */
+typedef int wait_queue_head_t;
+extern unsigned int block_test_wakeups;
+extern unsigned int block_test_waits;
+#define init_waitqueue_head(q)		(*(q) = 0)
+#define wake_up_interruptible_poll(q, m) \
+	((void)(q), block_test_wakeups++)
+#define wait_event_interruptible(q, cond)				\
+	(++block_test_waits > 1000 ? (abort(), 0) :			\
+	 (cond) ? 0 : -ERESTARTSYS)
+
+/* Files and mappings */
+struct file {
+	unsigned int f_flags;
+	void *private_data;
+};
+
+#define VM_SHARED			0x8
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	unsigned long vm_flags;
+};
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			unsigned long pgoff);
+
+/* Devices and sysfs */
+struct device;
+struct device_type;
+struct attribute {
+	const char *name;
+};
+struct device_attribute {
+	struct attribute attr;
+};
+struct attribute_group {
+	const char *name;
+	struct attribute **attrs;
+};
+
+/* Interrupts */
+typedef int irqreturn_t;
+#define IRQF_ONESHOT			0x2000
+
+#endif
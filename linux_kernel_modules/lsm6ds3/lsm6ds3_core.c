@@ -18,6 +18,14 @@
 #include <linux/mutex.h>
 #include <linux/interrupt.h>
 #include <linux/workqueue.h>
+#include <linux/version.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/sysfs.h>
+#include <linux/iio/events.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
 #include <asm/unaligned.h>
 
 #ifdef CONFIG_OF
@@ -26,6 +34,10 @@
 #include <linux/of_gpio.h>
 #endif
 
+#include "iio_timestamp.h"
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+#include "buffer_block.h"
+#endif
 #include "lsm6ds3_core.h"
 #include "lsm6ds3_platform_data.h"
 
@@ -99,6 +111,32 @@
 #define LSM6DS3_FIFO_PEDO_E_ADDR		0x07
 #define LSM6DS3_FIFO_PEDO_E_MASK		0x80
 #define LSM6DS3_FIFO_STEP_C_FREQ		25
+#define LSM6DS3_FIFO_DEC_NONE			0x01
+#define LSM6DS3_FIFO_DEC_OFF			0x00
+#define LSM6DS3_FIFO_SIZE			4096
+#define LSM6DS3_FIFO_DEFAULT_WATERMARK		16
+#define LSM6DS3_TIMESTAMP2_ADDR			0x42
+#define LSM6DS3_TIMESTAMP_RESET_VAL		0xaa
+#define LSM6DS3_TIMESTAMP_WRAP			(1ULL << 24)
+#define LSM6DS3_TIMER_HR_ADDR			0x5c
+#define LSM6DS3_TIMER_HR_MASK			0x10
+#define LSM6DS3_TIMER_HR_TICK_NS		25000
+#define LSM6DS3_TAP_CFG_ADDR			0x58
+#define LSM6DS3_WAKE_UP_SRC_ADDR		0x1b
+#define LSM6DS3_WAKE_UP_SRC_Z_WU		0x01
+#define LSM6DS3_WAKE_UP_SRC_Y_WU		0x02
+#define LSM6DS3_WAKE_UP_SRC_X_WU		0x04
+#define LSM6DS3_WAKE_UP_SRC_WU_IA		0x08
+#define LSM6DS3_WAKE_UP_SRC_SLEEP_STATE_IA	0x10
+#define LSM6DS3_WAKE_UP_THS_ADDR		0x5b
+#define LSM6DS3_WAKE_UP_THS_MASK		0x3f
+#define LSM6DS3_INACTIVITY_EN_MASK		0x40
+#define LSM6DS3_WAKE_UP_DUR_ADDR		0x5c
+#define LSM6DS3_SLEEP_DUR_MASK			0x0f
+/* 512 accel samples, about 20 s at 26 Hz */
+#define LSM6DS3_SLEEP_DUR_DEFAULT		0x01
+#define LSM6DS3_MD1_WU_MASK			0x20
+#define LSM6DS3_MD1_INACT_STATE_MASK		0x80
 
 /* CUSTOM VALUES FOR ACCEL SENSOR */
 #define LSM6DS3_ACCEL_ODR_ADDR			0x10
@@ -304,22 +342,71 @@ static inline int64_t lsm6ds3_get_time_ns(void)
 	return timespec_to_ns(&ts);
 }
 
+/*
+ * Control registers only change when the driver writes them, so their last
+ * value is kept in cdata->reg_cache. Status, output, FIFO and embedded
+ * function registers change on their own and are always read from the
+ * device. The embedded function bank shares addresses with the control
+ * registers, it is only accessed through tf->read/write and never cached.
+ */
+static bool lsm6ds3_reg_cached(u8 reg_addr)
+{
+	if (reg_addr == LSM6DS3_WHO_AM_I)
+		return false;
+
+	if ((reg_addr >= LSM6DS3_FUNC_CFG_ACCESS_ADDR) &&
+	    (reg_addr <= LSM6DS3_FUNC_EN_ADDR))
+		return true;
+
+	return (reg_addr >= LSM6DS3_TAP_CFG_ADDR) &&
+	       (reg_addr < LSM6DS3_REG_CACHE_SIZE);
+}
+
+static void lsm6ds3_reg_cache_reset(struct lsm6ds3_data *cdata)
+{
+	bitmap_zero(cdata->reg_cache_valid, LSM6DS3_REG_CACHE_SIZE);
+}
+
+/* Wake-up and inactivity detection keep the accel running */
+static bool lsm6ds3_wake_enabled(struct lsm6ds3_data *cdata)
+{
+	return cdata->wake_axes || cdata->inact_axes;
+}
+
 static int lsm6ds3_write_data_with_mask(struct lsm6ds3_data *cdata,
 					u8 reg_addr, u8 mask, u8 data, bool b_lock)
 {
 	int err;
 	u8 new_data = 0x00, old_data = 0x00;
+	bool cached = lsm6ds3_reg_cached(reg_addr);
 
-	err = cdata->tf->read(cdata, reg_addr, 1, &old_data, b_lock);
-	if (err < 0)
-		return err;
+	if (cached && test_bit(reg_addr, cdata->reg_cache_valid)) {
+		old_data = cdata->reg_cache[reg_addr];
+	} else {
+		err = cdata->tf->read(cdata, reg_addr, 1, &old_data, b_lock);
+		if (err < 0)
+			return err;
+	}
 
 	new_data = ((old_data & (~mask)) | ((data << __ffs(mask)) & mask));
 
-	if (new_data == old_data)
-		return 1;
+	if (new_data != old_data) {
+		err = cdata->tf->write(cdata, reg_addr, 1, &new_data, b_lock);
+		if (err < 0) {
+			if (cached)
+				clear_bit(reg_addr, cdata->reg_cache_valid);
+
+			return err;
+		}
+	} else
+		err = 1;
+
+	if (cached) {
+		cdata->reg_cache[reg_addr] = new_data;
+		set_bit(reg_addr, cdata->reg_cache_valid);
+	}
 
-	return cdata->tf->write(cdata, reg_addr, 1, &new_data, b_lock);
+	return err;
 }
 
 static int lsm6ds3_input_init(struct lsm6ds3_sensor_data *sdata, u16 bustype,
@@ -531,6 +618,8 @@ static irqreturn_t lsm6ds3_save_timestamp(int irq, void *private)
 }
 
 static int lsm6ds3_disable_sensors(struct lsm6ds3_sensor_data *sdata);
+static void lsm6ds3_fifo_poll(struct lsm6ds3_data *cdata);
+static void lsm6ds3_wake_event_poll(struct lsm6ds3_data *cdata);
 
 static irqreturn_t lsm6ds3_irq_management(int irq, void *private)
 {
@@ -579,6 +668,12 @@ static irqreturn_t lsm6ds3_irq_management(int irq, void *private)
 		lsm6ds3_report_single_event(sdata, 1, sdata->timestamp);
 	}
 
+	if (lsm6ds3_wake_enabled(cdata))
+		lsm6ds3_wake_event_poll(cdata);
+
+	if ((src_fifo & LSM6DS3_FIFO_DATA_AVL) && cdata->fifo_enabled)
+		lsm6ds3_fifo_poll(cdata);
+
 	return IRQ_HANDLED;
 }
 
@@ -644,7 +739,9 @@ static int lsm6ds3_set_extra_dependency(struct lsm6ds3_sensor_data *sdata,
 		}
 	}
 
-	if (!sdata->cdata->sensors[LSM6DS3_ACCEL].enabled) {
+	/* The FIFO owns the accel ODR while it batches accel samples */
+	if (!sdata->cdata->sensors[LSM6DS3_ACCEL].enabled &&
+	    !sdata->cdata->fifo_accel) {
 		if (enable) {
 			u8 idx = 1;
 			u16 acc_odr = sdata->cdata->sensors[LSM6DS3_ACCEL].c_odr;
@@ -661,7 +758,7 @@ static int lsm6ds3_set_extra_dependency(struct lsm6ds3_sensor_data *sdata,
 				lsm6ds3_odr_table.odr_avl[idx].value, true);
 			if (err < 0)
 				return err;
-		} else {
+		} else if (!lsm6ds3_wake_enabled(sdata->cdata)) {
 			err = lsm6ds3_write_data_with_mask(sdata->cdata,
 				lsm6ds3_odr_table.addr[LSM6DS3_ACCEL],
 				lsm6ds3_odr_table.mask[LSM6DS3_ACCEL],
@@ -684,16 +781,19 @@ static int lsm6ds3_enable_pedometer(struct lsm6ds3_sensor_data *sdata,
 	    sdata->cdata->sensors[LSM6DS3_STEP_DETECTOR].enabled)
 		return 0;
 
-	if (enable)
-		value = LSM6DS3_EN_BIT;
-
+	/* Also the timestamp data set the IIO buffer relies on */
 	err = lsm6ds3_write_data_with_mask(sdata->cdata,
 						LSM6DS3_FIFO_PEDO_E_ADDR,
 						LSM6DS3_FIFO_PEDO_E_MASK,
-						value, true);
+						(enable || sdata->cdata->fifo_enabled) ?
+						LSM6DS3_EN_BIT : LSM6DS3_DIS_BIT,
+						true);
 	if (err < 0)
 		return err;
 
+	if (enable)
+		value = LSM6DS3_EN_BIT;
+
 	return lsm6ds3_write_data_with_mask(sdata->cdata,
 						LSM6DS3_PEDOMETER_EN_ADDR,
 						LSM6DS3_PEDOMETER_EN_MASK,
@@ -803,6 +903,11 @@ static int lsm6ds3_enable_sensors(struct lsm6ds3_sensor_data *sdata)
 	if (sdata->enabled)
 		return 0;
 
+	/* Accel and gyro are driven by the IIO buffer while it runs */
+	if (((sdata->sindex == LSM6DS3_ACCEL) ||
+	     (sdata->sindex == LSM6DS3_GYRO)) && sdata->cdata->fifo_enabled)
+		return -EBUSY;
+
 	err = _lsm6ds3_enable_sensors(sdata);
 	if (err < 0)
 		return err;
@@ -821,7 +926,8 @@ static int _lsm6ds3_disable_sensors(struct lsm6ds3_sensor_data *sdata)
 		if (sdata->cdata->sensors[LSM6DS3_SIGN_MOTION].enabled |
 		    sdata->cdata->sensors[LSM6DS3_STEP_COUNTER].enabled |
 		    sdata->cdata->sensors[LSM6DS3_STEP_DETECTOR].enabled |
-		    sdata->cdata->sensors[LSM6DS3_TILT].enabled) {
+		    sdata->cdata->sensors[LSM6DS3_TILT].enabled |
+		    lsm6ds3_wake_enabled(sdata->cdata)) {
 
 			err = lsm6ds3_write_data_with_mask(sdata->cdata,
 				lsm6ds3_odr_table.addr[LSM6DS3_ACCEL],
@@ -974,6 +1080,9 @@ static int lsm6ds3_init_sensors(struct lsm6ds3_data *cdata)
 	if (err < 0)
 		return err;
 
+	/* Software reset restores every register to its default */
+	lsm6ds3_reg_cache_reset(cdata);
+
 	err = lsm6ds3_write_data_with_mask(cdata,
 					   LSM6DS3_LIR_ADDR,
 					   LSM6DS3_LIR_MASK,
@@ -1413,6 +1522,886 @@ static const struct attribute_group lsm6ds3_attribute_groups[] = {
 	},
 };
 
+/*
+ * IIO buffered interface for accel and gyro.
+ *
+ * Samples are batched by the hardware FIFO in continuous mode, with the
+ * sensor timestamp counter stored as 4th data set of every pattern, and
+ * drained on the FIFO threshold interrupt through the device trigger. While
+ * the buffer runs it owns the accel/gyro ODR, so the input devices of these
+ * two sensors cannot be enabled at the same time.
+ */
+enum lsm6ds3_scan_axis {
+	LSM6DS3_SCAN_ACCEL_X = 0,
+	LSM6DS3_SCAN_ACCEL_Y,
+	LSM6DS3_SCAN_ACCEL_Z,
+	LSM6DS3_SCAN_GYRO_X,
+	LSM6DS3_SCAN_GYRO_Y,
+	LSM6DS3_SCAN_GYRO_Z,
+	LSM6DS3_SCAN_TIMESTAMP,
+};
+
+#define LSM6DS3_IIO_CHANNEL(_type, _axis, _index) {			\
+	.type = _type,							\
+	.modified = 1,							\
+	.channel2 = IIO_MOD_##_axis,					\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),		\
+	.info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),	\
+	.scan_index = _index,						\
+	.scan_type = {							\
+		.sign = 's',						\
+		.realbits = 16,						\
+		.storagebits = 16,					\
+		.endianness = IIO_LE,					\
+	},								\
+	.event_spec = (_type) == IIO_ACCEL ?				\
+		lsm6ds3_iio_motion_events : NULL,			\
+	.num_event_specs = (_type) == IIO_ACCEL ?			\
+		ARRAY_SIZE(lsm6ds3_iio_motion_events) : 0,		\
+}
+
+/*
+ * Wake-up is a rate of change rising above its threshold, inactivity the
+ * accel staying below it long enough to enter the sleep state. The device
+ * watches all axes at once, the per axis enables only filter what is
+ * reported. The threshold is the raw register value, in full scale / 64.
+ */
+static const struct iio_event_spec lsm6ds3_iio_motion_events[] = {
+	{
+		.type = IIO_EV_TYPE_ROC,
+		.dir = IIO_EV_DIR_RISING,
+		.mask_separate = BIT(IIO_EV_INFO_ENABLE),
+		.mask_shared_by_type = BIT(IIO_EV_INFO_VALUE),
+	},
+	{
+		.type = IIO_EV_TYPE_ROC,
+		.dir = IIO_EV_DIR_FALLING,
+		.mask_separate = BIT(IIO_EV_INFO_ENABLE),
+	},
+};
+
+static const struct iio_chan_spec lsm6ds3_iio_channels[] = {
+	LSM6DS3_IIO_CHANNEL(IIO_ACCEL, X, LSM6DS3_SCAN_ACCEL_X),
+	LSM6DS3_IIO_CHANNEL(IIO_ACCEL, Y, LSM6DS3_SCAN_ACCEL_Y),
+	LSM6DS3_IIO_CHANNEL(IIO_ACCEL, Z, LSM6DS3_SCAN_ACCEL_Z),
+	LSM6DS3_IIO_CHANNEL(IIO_ANGL_VEL, X, LSM6DS3_SCAN_GYRO_X),
+	LSM6DS3_IIO_CHANNEL(IIO_ANGL_VEL, Y, LSM6DS3_SCAN_GYRO_Y),
+	LSM6DS3_IIO_CHANNEL(IIO_ANGL_VEL, Z, LSM6DS3_SCAN_GYRO_Z),
+	IIO_CHAN_SOFT_TIMESTAMP(LSM6DS3_SCAN_TIMESTAMP),
+};
+
+static inline struct lsm6ds3_data *lsm6ds3_iio_cdata(struct iio_dev *indio_dev)
+{
+	return *(struct lsm6ds3_data **)iio_priv(indio_dev);
+}
+
+static inline s64 lsm6ds3_iio_time_ns(struct iio_dev *indio_dev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+	return iio_get_time_ns(indio_dev);
+#else
+	return iio_get_time_ns();
+#endif
+}
+
+static bool lsm6ds3_embedded_enabled(struct lsm6ds3_data *cdata)
+{
+	return cdata->sensors[LSM6DS3_SIGN_MOTION].enabled ||
+	       cdata->sensors[LSM6DS3_STEP_COUNTER].enabled ||
+	       cdata->sensors[LSM6DS3_STEP_DETECTOR].enabled ||
+	       cdata->sensors[LSM6DS3_TILT].enabled;
+}
+
+static bool lsm6ds3_scan_has(struct iio_dev *indio_dev, int first, int last)
+{
+	int i;
+
+	for (i = first; i <= last; i++)
+		if (test_bit(i, indio_dev->active_scan_mask))
+			return true;
+
+	return false;
+}
+
+static int lsm6ds3_fifo_set_mode(struct lsm6ds3_data *cdata, u8 mode)
+{
+	return lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_MODE_ADDR,
+					    LSM6DS3_FIFO_MODE_MASK, mode, true);
+}
+
+static void lsm6ds3_fifo_push(struct lsm6ds3_data *cdata, unsigned int patterns)
+{
+	struct iio_dev *indio_dev = cdata->indio_dev;
+	/* 6 axes plus the 8 byte aligned timestamp */
+	__le16 buf[12] __aligned(8);
+	const u8 *pattern, *accel, *gyro, *hw_ts;
+	unsigned int n;
+	u32 ticks;
+	s64 ts;
+	int i, j;
+
+	for (n = 0; n < patterns; n++) {
+		pattern = &cdata->fifo_buf[n * cdata->fifo_pattern_len];
+		gyro = pattern;
+		accel = pattern + (cdata->fifo_gyro ?
+				   LSM6DS3_FIFO_ELEMENT_LEN_BYTE : 0);
+		hw_ts = pattern + cdata->fifo_pattern_len -
+			LSM6DS3_FIFO_ELEMENT_LEN_BYTE;
+
+		/*
+		 * 24 bit counter stored as B0 = ts[15:8], B1 = ts[23:16],
+		 * B3 = ts[7:0], the step counter fills the other bytes.
+		 */
+		ticks = (hw_ts[1] << 16) | (hw_ts[0] << 8) | hw_ts[3];
+		if (ticks < cdata->fifo_ts_last)
+			cdata->fifo_ts_epoch += LSM6DS3_TIMESTAMP_WRAP;
+		cdata->fifo_ts_last = ticks;
+
+		/* The pattern that crossed the threshold raised the interrupt */
+		if (cdata->fifo_irq_countdown && !--cdata->fifo_irq_countdown)
+			iio_ts_est_update(&cdata->fifo_ts_est,
+					  cdata->fifo_ts_epoch + ticks,
+					  cdata->fifo_irq_ts);
+
+		/* Samples taken while the sensors settle after power up */
+		if (cdata->fifo_discard) {
+			cdata->fifo_discard--;
+			continue;
+		}
+
+		j = 0;
+		for_each_set_bit(i, indio_dev->active_scan_mask,
+				 indio_dev->masklength) {
+			if (i == LSM6DS3_SCAN_TIMESTAMP)
+				continue;
+			if (i <= LSM6DS3_SCAN_ACCEL_Z)
+				memcpy(&buf[j++], accel + (i -
+				       LSM6DS3_SCAN_ACCEL_X) *
+				       LSM6DS3_FIFO_BYTE_FOR_CHANNEL,
+				       sizeof(buf[0]));
+			else
+				memcpy(&buf[j++], gyro + (i -
+				       LSM6DS3_SCAN_GYRO_X) *
+				       LSM6DS3_FIFO_BYTE_FOR_CHANNEL,
+				       sizeof(buf[0]));
+		}
+
+		/* Sensor clock ticks mapped onto the IIO clock */
+		ts = iio_ts_est_get(&cdata->fifo_ts_est,
+				    cdata->fifo_ts_epoch + ticks);
+		iio_push_to_buffers_with_timestamp(indio_dev, buf, ts);
+	}
+}
+
+/* Drain all complete patterns, called with cdata->lock held */
+static int lsm6ds3_fifo_read(struct lsm6ds3_data *cdata)
+{
+	unsigned int patterns, chunk, n;
+	u8 status[2];
+	u16 words;
+	int err;
+
+	err = cdata->tf->read(cdata, LSM6DS3_FIFO_DIFF_L, 2, status, true);
+	if (err < 0)
+		return err;
+
+	/* Overwritten data may have broken the pattern alignment */
+	if (status[1] & LSM6DS3_FIFO_DATA_OVR) {
+		dev_warn_ratelimited(cdata->dev, "FIFO overrun, resetting\n");
+		cdata->fifo_irq_pending = false;
+
+		err = lsm6ds3_fifo_set_mode(cdata, LSM6DS3_FIFO_MODE_BYPASS);
+		if (err < 0)
+			return err;
+
+		return lsm6ds3_fifo_set_mode(cdata,
+					     LSM6DS3_FIFO_MODE_CONTINUOS);
+	}
+
+	words = get_unaligned_le16(status) & LSM6DS3_FIFO_DIFF_MASK;
+	patterns = words * LSM6DS3_FIFO_BYTE_FOR_CHANNEL /
+		   cdata->fifo_pattern_len;
+
+	if (cdata->fifo_irq_pending && patterns) {
+		cdata->fifo_irq_countdown = min(patterns,
+						cdata->fifo_wm_patterns);
+		cdata->fifo_irq_pending = false;
+	}
+
+	/* Whole patterns per transfer, bounded by the bus buffers */
+	chunk = LSM6DS3_RX_MAX_LENGTH / cdata->fifo_pattern_len;
+	while (patterns) {
+		n = min(patterns, chunk);
+
+		err = cdata->tf->read(cdata, LSM6DS3_FIFO_DATA_OUT_L,
+				      n * cdata->fifo_pattern_len,
+				      cdata->fifo_buf, true);
+		if (err < 0)
+			return err;
+
+		lsm6ds3_fifo_push(cdata, n);
+		patterns -= n;
+	}
+
+	return 0;
+}
+
+static int lsm6ds3_fifo_enable(struct lsm6ds3_data *cdata)
+{
+	struct iio_dev *indio_dev = cdata->indio_dev;
+	bool accel, gyro;
+	unsigned int thr;
+	u8 odr_val, reset = LSM6DS3_TIMESTAMP_RESET_VAL;
+	s64 now;
+	int err, i;
+
+	if (cdata->sensors[LSM6DS3_ACCEL].enabled ||
+	    cdata->sensors[LSM6DS3_GYRO].enabled)
+		return -EBUSY;
+
+	accel = lsm6ds3_scan_has(indio_dev, LSM6DS3_SCAN_ACCEL_X,
+				 LSM6DS3_SCAN_ACCEL_Z);
+	gyro = lsm6ds3_scan_has(indio_dev, LSM6DS3_SCAN_GYRO_X,
+				LSM6DS3_SCAN_GYRO_Z);
+	if (!accel && !gyro)
+		return -EINVAL;
+
+	for (i = 0; i < LSM6DS3_ODR_LIST_NUM; i++)
+		if (lsm6ds3_odr_table.odr_avl[i].hz == cdata->fifo_odr)
+			break;
+	if (i == LSM6DS3_ODR_LIST_NUM)
+		return -EINVAL;
+	odr_val = lsm6ds3_odr_table.odr_avl[i].value;
+
+	cdata->fifo_accel = accel;
+	cdata->fifo_gyro = gyro;
+	cdata->fifo_pattern_len = (accel + gyro + 1) *
+				  LSM6DS3_FIFO_ELEMENT_LEN_BYTE;
+	cdata->fifo_discard = max(accel ? LSM6DS3_ACCEL_STD +
+				  LSM6DS3_ACCEL_STD_FROM_PD : 0,
+				  gyro ? LSM6DS3_GYRO_STD +
+				  LSM6DS3_GYRO_STD_FROM_PD : 0);
+
+	/* Threshold in 16 bit words */
+	thr = min_t(unsigned int,
+		    cdata->fifo_watermark * cdata->fifo_pattern_len,
+		    LSM6DS3_FIFO_SIZE - cdata->fifo_pattern_len) /
+	      LSM6DS3_FIFO_BYTE_FOR_CHANNEL;
+
+	err = lsm6ds3_fifo_set_mode(cdata, LSM6DS3_FIFO_MODE_BYPASS);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_CTRL3_ADDR,
+					   LSM6DS3_FIFO_ACCEL_DECIMATOR_MASK,
+					   accel ? LSM6DS3_FIFO_DEC_NONE :
+					   LSM6DS3_FIFO_DEC_OFF, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_CTRL3_ADDR,
+					   LSM6DS3_FIFO_GYRO_DECIMATOR_MASK,
+					   gyro ? LSM6DS3_FIFO_DEC_NONE :
+					   LSM6DS3_FIFO_DEC_OFF, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_CTRL4_ADDR,
+					   LSM6DS3_FIFO_STEP_C_DECIMATOR_MASK,
+					   LSM6DS3_FIFO_DEC_NONE, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_PEDO_E_ADDR,
+					   LSM6DS3_FIFO_PEDO_E_MASK,
+					   LSM6DS3_EN_BIT, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_TIMER_HR_ADDR,
+					   LSM6DS3_TIMER_HR_MASK,
+					   LSM6DS3_EN_BIT, true);
+	if (err < 0)
+		return err;
+
+	/* Patterns in the FIFO when the threshold interrupt fires */
+	cdata->fifo_wm_patterns = max_t(unsigned int, 1,
+		DIV_ROUND_UP(thr * LSM6DS3_FIFO_BYTE_FOR_CHANNEL,
+			     cdata->fifo_pattern_len));
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_THR_L_ADDR,
+					   0xff, thr & 0xff, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_THR_H_ADDR,
+					   LSM6DS3_FIFO_THR_H_MASK, thr >> 8,
+					   true);
+	if (err < 0)
+		return err;
+
+	if (accel) {
+		err = lsm6ds3_write_data_with_mask(cdata,
+				lsm6ds3_odr_table.addr[LSM6DS3_ACCEL],
+				lsm6ds3_odr_table.mask[LSM6DS3_ACCEL],
+				odr_val, true);
+		if (err < 0)
+			return err;
+	}
+
+	if (gyro) {
+		err = lsm6ds3_write_data_with_mask(cdata,
+				lsm6ds3_odr_table.addr[LSM6DS3_GYRO],
+				lsm6ds3_odr_table.mask[LSM6DS3_GYRO],
+				odr_val, true);
+		if (err < 0)
+			return err;
+	}
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_ODR_ADDR,
+					   LSM6DS3_FIFO_ODR_MASK, odr_val, true);
+	if (err < 0)
+		return err;
+
+	/* Counter zero is the time base of the batched samples */
+	err = cdata->tf->write(cdata, LSM6DS3_TIMESTAMP2_ADDR, 1, &reset, true);
+	if (err < 0)
+		return err;
+
+	now = lsm6ds3_iio_time_ns(indio_dev);
+	iio_ts_est_init(&cdata->fifo_ts_est, LSM6DS3_TIMER_HR_TICK_NS, now);
+	iio_ts_est_update(&cdata->fifo_ts_est, 0, now);
+	cdata->fifo_ts_epoch = 0;
+	cdata->fifo_ts_last = 0;
+	cdata->fifo_irq_pending = false;
+	cdata->fifo_irq_countdown = 0;
+
+	err = lsm6ds3_fifo_set_mode(cdata, LSM6DS3_FIFO_MODE_CONTINUOS);
+	if (err < 0)
+		return err;
+
+	cdata->fifo_enabled = true;
+
+	return lsm6ds3_write_data_with_mask(cdata, LSM6DS3_INT1_CTRL_ADDR,
+					    LSM6DS3_INT1_FTH, LSM6DS3_EN_BIT,
+					    true);
+}
+
+static int lsm6ds3_fifo_disable(struct lsm6ds3_data *cdata)
+{
+	bool pedometer;
+	int err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_INT1_CTRL_ADDR,
+					   LSM6DS3_INT1_FTH, LSM6DS3_DIS_BIT,
+					   true);
+	if (err < 0)
+		return err;
+
+	/* Hand over what is left before the buffer goes away */
+	lsm6ds3_fifo_read(cdata);
+	cdata->fifo_enabled = false;
+
+	err = lsm6ds3_fifo_set_mode(cdata, LSM6DS3_FIFO_MODE_BYPASS);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_ODR_ADDR,
+					   LSM6DS3_FIFO_ODR_MASK,
+					   LSM6DS3_FIFO_ODR_OFF, true);
+	if (err < 0)
+		return err;
+
+	pedometer = cdata->sensors[LSM6DS3_SIGN_MOTION].enabled ||
+		    cdata->sensors[LSM6DS3_STEP_COUNTER].enabled ||
+		    cdata->sensors[LSM6DS3_STEP_DETECTOR].enabled;
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_FIFO_PEDO_E_ADDR,
+					   LSM6DS3_FIFO_PEDO_E_MASK,
+					   pedometer ? LSM6DS3_EN_BIT :
+					   LSM6DS3_DIS_BIT, true);
+	if (err < 0)
+		return err;
+
+	if (cdata->fifo_gyro) {
+		err = lsm6ds3_write_data_with_mask(cdata,
+				lsm6ds3_odr_table.addr[LSM6DS3_GYRO],
+				lsm6ds3_odr_table.mask[LSM6DS3_GYRO],
+				LSM6DS3_ODR_POWER_OFF_VAL, true);
+		if (err < 0)
+			return err;
+	}
+
+	/* Embedded functions keep running on the accel */
+	if (cdata->fifo_accel) {
+		err = lsm6ds3_write_data_with_mask(cdata,
+				lsm6ds3_odr_table.addr[LSM6DS3_ACCEL],
+				lsm6ds3_odr_table.mask[LSM6DS3_ACCEL],
+				(lsm6ds3_embedded_enabled(cdata) ||
+				 lsm6ds3_wake_enabled(cdata)) ?
+				lsm6ds3_odr_table.odr_avl[1].value :
+				LSM6DS3_ODR_POWER_OFF_VAL, true);
+		if (err < 0)
+			return err;
+	}
+
+	cdata->fifo_accel = false;
+	cdata->fifo_gyro = false;
+
+	return 0;
+}
+
+/* cdata->timestamp is boot time, move it to the IIO clock */
+static s64 lsm6ds3_iio_irq_time(struct lsm6ds3_data *cdata)
+{
+	return cdata->timestamp + (lsm6ds3_iio_time_ns(cdata->indio_dev) -
+				   lsm6ds3_get_time_ns());
+}
+
+static void lsm6ds3_fifo_poll(struct lsm6ds3_data *cdata)
+{
+	cdata->fifo_irq_ts = lsm6ds3_iio_irq_time(cdata);
+	cdata->fifo_irq_pending = true;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0)
+	iio_trigger_poll_chained(cdata->trig);
+#else
+	iio_trigger_poll_chained(cdata->trig, 0);
+#endif
+}
+
+/* Reading the latched source acknowledges the interrupt */
+static void lsm6ds3_wake_event_poll(struct lsm6ds3_data *cdata)
+{
+	static const u8 axis_wu[] = {
+		LSM6DS3_WAKE_UP_SRC_X_WU,
+		LSM6DS3_WAKE_UP_SRC_Y_WU,
+		LSM6DS3_WAKE_UP_SRC_Z_WU,
+	};
+	u8 src = 0x00;
+	s64 ts;
+	int i;
+
+	if (cdata->tf->read(cdata, LSM6DS3_WAKE_UP_SRC_ADDR, 1, &src,
+			    true) < 0)
+		return;
+
+	ts = lsm6ds3_iio_irq_time(cdata);
+
+	if (src & LSM6DS3_WAKE_UP_SRC_WU_IA) {
+		for (i = 0; i < ARRAY_SIZE(axis_wu); i++) {
+			if (!(src & axis_wu[i]) ||
+			    !(cdata->wake_axes & BIT(i)))
+				continue;
+
+			iio_push_event(cdata->indio_dev,
+				       IIO_MOD_EVENT_CODE(IIO_ACCEL, 0,
+					       IIO_MOD_X + i,
+					       IIO_EV_TYPE_ROC,
+					       IIO_EV_DIR_RISING), ts);
+		}
+	}
+
+	if ((src & LSM6DS3_WAKE_UP_SRC_SLEEP_STATE_IA) && cdata->inact_axes)
+		iio_push_event(cdata->indio_dev,
+			       IIO_MOD_EVENT_CODE(IIO_ACCEL, 0,
+				       IIO_MOD_X_AND_Y_AND_Z,
+				       IIO_EV_TYPE_ROC, IIO_EV_DIR_FALLING),
+			       ts);
+}
+
+/* Called with cdata->lock held */
+static int lsm6ds3_set_wake_events(struct lsm6ds3_data *cdata, u8 wake_axes,
+				   u8 inact_axes)
+{
+	bool was_on = lsm6ds3_wake_enabled(cdata);
+	bool on = wake_axes || inact_axes;
+	bool accel_used;
+	int err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_WAKE_UP_DUR_ADDR,
+					   LSM6DS3_SLEEP_DUR_MASK,
+					   LSM6DS3_SLEEP_DUR_DEFAULT, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_WAKE_UP_THS_ADDR,
+					   LSM6DS3_INACTIVITY_EN_MASK,
+					   inact_axes ? LSM6DS3_EN_BIT :
+					   LSM6DS3_DIS_BIT, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_MD1_ADDR,
+					   LSM6DS3_MD1_WU_MASK,
+					   wake_axes ? LSM6DS3_EN_BIT :
+					   LSM6DS3_DIS_BIT, true);
+	if (err < 0)
+		return err;
+
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_MD1_ADDR,
+					   LSM6DS3_MD1_INACT_STATE_MASK,
+					   inact_axes ? LSM6DS3_EN_BIT :
+					   LSM6DS3_DIS_BIT, true);
+	if (err < 0)
+		return err;
+
+	/* Run the accel at the embedded function rate if nobody else does */
+	accel_used = cdata->sensors[LSM6DS3_ACCEL].enabled ||
+		     cdata->fifo_accel || lsm6ds3_embedded_enabled(cdata);
+	if (!accel_used && on != was_on) {
+		err = lsm6ds3_write_data_with_mask(cdata,
+				lsm6ds3_odr_table.addr[LSM6DS3_ACCEL],
+				lsm6ds3_odr_table.mask[LSM6DS3_ACCEL],
+				on ? lsm6ds3_odr_table.odr_avl[1].value :
+				LSM6DS3_ODR_POWER_OFF_VAL, true);
+		if (err < 0)
+			return err;
+	}
+
+	cdata->wake_axes = wake_axes;
+	cdata->inact_axes = inact_axes;
+
+	return 0;
+}
+
+static int lsm6ds3_iio_read_event_config(struct iio_dev *indio_dev,
+					 const struct iio_chan_spec *chan,
+					 enum iio_event_type type,
+					 enum iio_event_direction dir)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	u8 axis = BIT(chan->channel2 - IIO_MOD_X);
+
+	if (dir == IIO_EV_DIR_RISING)
+		return !!(cdata->wake_axes & axis);
+
+	return !!(cdata->inact_axes & axis);
+}
+
+static int lsm6ds3_iio_write_event_config(struct iio_dev *indio_dev,
+					  const struct iio_chan_spec *chan,
+					  enum iio_event_type type,
+					  enum iio_event_direction dir,
+					  int state)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	u8 axis = BIT(chan->channel2 - IIO_MOD_X);
+	u8 wake_axes, inact_axes;
+	int err;
+
+	mutex_lock(&cdata->lock);
+	wake_axes = cdata->wake_axes;
+	inact_axes = cdata->inact_axes;
+	if (dir == IIO_EV_DIR_RISING)
+		wake_axes = state ? wake_axes | axis : wake_axes & ~axis;
+	else
+		inact_axes = state ? inact_axes | axis : inact_axes & ~axis;
+	err = lsm6ds3_set_wake_events(cdata, wake_axes, inact_axes);
+	mutex_unlock(&cdata->lock);
+
+	return err;
+}
+
+static int lsm6ds3_iio_read_event_value(struct iio_dev *indio_dev,
+					const struct iio_chan_spec *chan,
+					enum iio_event_type type,
+					enum iio_event_direction dir,
+					enum iio_event_info info,
+					int *val, int *val2)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	u8 ths = 0x00;
+	int err;
+
+	if (info != IIO_EV_INFO_VALUE)
+		return -EINVAL;
+
+	err = cdata->tf->read(cdata, LSM6DS3_WAKE_UP_THS_ADDR, 1, &ths, true);
+	if (err < 0)
+		return err;
+
+	*val = ths & LSM6DS3_WAKE_UP_THS_MASK;
+
+	return IIO_VAL_INT;
+}
+
+static int lsm6ds3_iio_write_event_value(struct iio_dev *indio_dev,
+					 const struct iio_chan_spec *chan,
+					 enum iio_event_type type,
+					 enum iio_event_direction dir,
+					 enum iio_event_info info,
+					 int val, int val2)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	int err;
+
+	if ((info != IIO_EV_INFO_VALUE) || (val < 0) ||
+	    (val > LSM6DS3_WAKE_UP_THS_MASK) || val2)
+		return -EINVAL;
+
+	mutex_lock(&cdata->lock);
+	err = lsm6ds3_write_data_with_mask(cdata, LSM6DS3_WAKE_UP_THS_ADDR,
+					   LSM6DS3_WAKE_UP_THS_MASK, val, true);
+	mutex_unlock(&cdata->lock);
+
+	return (err < 0 ? err : 0);
+}
+
+static irqreturn_t lsm6ds3_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	int err;
+
+	mutex_lock(&cdata->lock);
+	if (cdata->fifo_enabled) {
+		err = lsm6ds3_fifo_read(cdata);
+		if (err < 0)
+			dev_err(cdata->dev, "failed to read FIFO (%d)\n", err);
+	}
+	mutex_unlock(&cdata->lock);
+
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+static int lsm6ds3_iio_trigger_set_state(struct iio_trigger *trig, bool state)
+{
+	struct iio_dev *indio_dev = iio_trigger_get_drvdata(trig);
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	int err;
+
+	mutex_lock(&cdata->lock);
+	if (state)
+		err = lsm6ds3_fifo_enable(cdata);
+	else
+		err = lsm6ds3_fifo_disable(cdata);
+	mutex_unlock(&cdata->lock);
+
+	return err;
+}
+
+static int lsm6ds3_iio_trigger_validate_device(struct iio_trigger *trig,
+					       struct iio_dev *indio_dev)
+{
+	/* The FIFO threshold trigger only makes sense for its own device */
+	if (indio_dev != iio_trigger_get_drvdata(trig))
+		return -EINVAL;
+
+	return 0;
+}
+
+static const struct iio_trigger_ops lsm6ds3_iio_trigger_ops = {
+	.owner = THIS_MODULE,
+	.set_trigger_state = lsm6ds3_iio_trigger_set_state,
+	.validate_device = lsm6ds3_iio_trigger_validate_device,
+};
+
+static int lsm6ds3_iio_read_raw(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *chan,
+				int *val, int *val2, long mask)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+
+	switch (mask) {
+	case IIO_CHAN_INFO_SCALE:
+		*val = 0;
+		/* ug/LSB to nm/s^2 and udps/LSB to nrad/s */
+		if (chan->type == IIO_ACCEL)
+			*val2 = cdata->sensors[LSM6DS3_ACCEL].c_gain * 9807;
+		else
+			*val2 = cdata->sensors[LSM6DS3_GYRO].c_gain * 17453 /
+				1000;
+		return IIO_VAL_INT_PLUS_NANO;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		*val = cdata->fifo_odr;
+		return IIO_VAL_INT;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int lsm6ds3_iio_write_raw(struct iio_dev *indio_dev,
+				 struct iio_chan_spec const *chan,
+				 int val, int val2, long mask)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(indio_dev);
+	int err = 0, i;
+
+	if (mask != IIO_CHAN_INFO_SAMP_FREQ)
+		return -EINVAL;
+
+	for (i = 0; i < LSM6DS3_ODR_LIST_NUM; i++)
+		if (lsm6ds3_odr_table.odr_avl[i].hz >= val)
+			break;
+	if (i == LSM6DS3_ODR_LIST_NUM)
+		return -EINVAL;
+
+	mutex_lock(&cdata->lock);
+	if (cdata->fifo_enabled)
+		err = -EBUSY;
+	else
+		cdata->fifo_odr = lsm6ds3_odr_table.odr_avl[i].hz;
+	mutex_unlock(&cdata->lock);
+
+	return err;
+}
+
+static ssize_t lsm6ds3_iio_get_watermark(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(dev_to_iio_dev(dev));
+
+	return sprintf(buf, "%u\n", cdata->fifo_watermark);
+}
+
+static ssize_t lsm6ds3_iio_set_watermark(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct lsm6ds3_data *cdata = lsm6ds3_iio_cdata(dev_to_iio_dev(dev));
+	unsigned int watermark;
+	int err;
+
+	err = kstrtouint(buf, 10, &watermark);
+	if (err < 0)
+		return err;
+
+	if (!watermark ||
+	    (watermark > LSM6DS3_FIFO_SIZE / LSM6DS3_FIFO_ELEMENT_LEN_BYTE))
+		return -EINVAL;
+
+	mutex_lock(&cdata->lock);
+	if (cdata->fifo_enabled)
+		err = -EBUSY;
+	else
+		cdata->fifo_watermark = watermark;
+	mutex_unlock(&cdata->lock);
+
+	return (err < 0 ? err : count);
+}
+
+static IIO_CONST_ATTR_SAMP_FREQ_AVAIL("13 26 52 104 208 416");
+static IIO_DEVICE_ATTR(hwfifo_watermark, S_IWUSR | S_IRUGO,
+		       lsm6ds3_iio_get_watermark, lsm6ds3_iio_set_watermark, 0);
+
+static struct attribute *lsm6ds3_iio_attributes[] = {
+	&iio_const_attr_sampling_frequency_available.dev_attr.attr,
+	&iio_dev_attr_hwfifo_watermark.dev_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lsm6ds3_iio_attribute_group = {
+	.attrs = lsm6ds3_iio_attributes,
+};
+
+static const struct iio_info lsm6ds3_iio_info = {
+	.read_raw = lsm6ds3_iio_read_raw,
+	.write_raw = lsm6ds3_iio_write_raw,
+	.read_event_config = lsm6ds3_iio_read_event_config,
+	.write_event_config = lsm6ds3_iio_write_event_config,
+	.read_event_value = lsm6ds3_iio_read_event_value,
+	.write_event_value = lsm6ds3_iio_write_event_value,
+	.attrs = &lsm6ds3_iio_attribute_group,
+};
+
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+static bool block_buffer;
+module_param(block_buffer, bool, S_IRUGO);
+MODULE_PARM_DESC(block_buffer,
+	"Use the mmap-able block buffer instead of a kfifo");
+#endif
+
+static int lsm6ds3_iio_buffer_setup(struct iio_dev *indio_dev)
+{
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+	if (block_buffer)
+		return iio_triggered_block_buffer_setup(indio_dev, NULL,
+						lsm6ds3_iio_trigger_handler,
+						NULL);
+#endif
+	return iio_triggered_buffer_setup(indio_dev, NULL,
+					  lsm6ds3_iio_trigger_handler, NULL);
+}
+
+static void lsm6ds3_iio_buffer_cleanup(struct iio_dev *indio_dev)
+{
+#ifdef CONFIG_IIO_BUFFER_BLOCK
+	if (block_buffer) {
+		iio_triggered_block_buffer_cleanup(indio_dev);
+		return;
+	}
+#endif
+	iio_triggered_buffer_cleanup(indio_dev);
+}
+
+static int lsm6ds3_iio_init(struct lsm6ds3_data *cdata)
+{
+	struct iio_dev *indio_dev;
+	int err;
+
+	indio_dev = devm_iio_device_alloc(cdata->dev, sizeof(cdata));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	*(struct lsm6ds3_data **)iio_priv(indio_dev) = cdata;
+	cdata->indio_dev = indio_dev;
+	cdata->fifo_odr = lsm6ds3_odr_table.odr_avl[0].hz;
+	cdata->fifo_watermark = LSM6DS3_FIFO_DEFAULT_WATERMARK;
+
+	indio_dev->dev.parent = cdata->dev;
+	indio_dev->name = LSM6DS3_ACC_GYR_DEV_NAME;
+	indio_dev->channels = lsm6ds3_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(lsm6ds3_iio_channels);
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->info = &lsm6ds3_iio_info;
+
+	err = lsm6ds3_iio_buffer_setup(indio_dev);
+	if (err < 0)
+		return err;
+
+	cdata->trig = devm_iio_trigger_alloc(cdata->dev, "%s-dev%d",
+					     indio_dev->name, indio_dev->id);
+	if (!cdata->trig) {
+		err = -ENOMEM;
+		goto lsm6ds3_iio_init_buffer_cleanup;
+	}
+
+	cdata->trig->dev.parent = cdata->dev;
+	cdata->trig->ops = &lsm6ds3_iio_trigger_ops;
+	iio_trigger_set_drvdata(cdata->trig, indio_dev);
+
+	err = iio_trigger_register(cdata->trig);
+	if (err < 0)
+		goto lsm6ds3_iio_init_buffer_cleanup;
+
+	err = iio_device_register(indio_dev);
+	if (err < 0)
+		goto lsm6ds3_iio_init_trigger_unregister;
+
+	return 0;
+
+lsm6ds3_iio_init_trigger_unregister:
+	iio_trigger_unregister(cdata->trig);
+lsm6ds3_iio_init_buffer_cleanup:
+	lsm6ds3_iio_buffer_cleanup(indio_dev);
+	cdata->indio_dev = NULL;
+	return err;
+}
+
+static void lsm6ds3_iio_remove(struct lsm6ds3_data *cdata)
+{
+	if (!cdata->indio_dev)
+		return;
+
+	iio_device_unregister(cdata->indio_dev);
+	iio_trigger_unregister(cdata->trig);
+	lsm6ds3_iio_buffer_cleanup(cdata->indio_dev);
+}
+
 #ifdef CONFIG_OF
 static u32 lsm6ds3_parse_dt(struct lsm6ds3_data *cdata)
 {
@@ -1543,6 +2532,13 @@ int lsm6ds3_common_probe(struct lsm6ds3_data *cdata, int irq, u16 bustype)
 		err = lsm6ds3_allocate_workqueue(cdata);
 		if (err < 0)
 			return err;
+
+		/* The FIFO is only drained on its threshold interrupt */
+		err = lsm6ds3_iio_init(cdata);
+		if (err < 0) {
+			dev_err(cdata->dev, "failed to register IIO device\n");
+			return err;
+		}
 	}
 
 	dev_info(cdata->dev, "%s: probed\n", LSM6DS3_ACC_GYR_DEV_NAME);
@@ -1554,6 +2550,8 @@ void lsm6ds3_common_remove(struct lsm6ds3_data *cdata, int irq)
 {
 	u8 i;
 
+	lsm6ds3_iio_remove(cdata);
+
 	for (i = 0; i < LSM6DS3_SENSORS_NUMB; i++) {
 		lsm6ds3_disable_sensors(&cdata->sensors[i]);
 		lsm6ds3_input_cleanup(&cdata->sensors[i]);
@@ -1583,17 +2581,50 @@ static int lsm6ds3_suspend_sensors(struct lsm6ds3_sensor_data *sdata)
 
 	return _lsm6ds3_disable_sensors(sdata);
 }
+
+/* Write the shadowed control registers back, the device may have lost them */
+static int lsm6ds3_reg_cache_sync(struct lsm6ds3_data *cdata)
+{
+	int err = 0;
+	unsigned int reg_addr;
+
+	mutex_lock(&cdata->bank_registers_lock);
+	for_each_set_bit(reg_addr, cdata->reg_cache_valid,
+			 LSM6DS3_REG_CACHE_SIZE) {
+		err = cdata->tf->write(cdata, reg_addr, 1,
+				       &cdata->reg_cache[reg_addr], false);
+		if (err < 0)
+			break;
+	}
+	mutex_unlock(&cdata->bank_registers_lock);
+
+	return err;
+}
+
 int lsm6ds3_common_suspend(struct lsm6ds3_data *cdata)
 {
 	lsm6ds3_suspend_sensors(&cdata->sensors[LSM6DS3_ACCEL]);
 	lsm6ds3_suspend_sensors(&cdata->sensors[LSM6DS3_GYRO]);
 
+	/* Wake-up and inactivity events wake the system */
+	if (lsm6ds3_wake_enabled(cdata))
+		enable_irq_wake(cdata->irq);
+
 	return 0;
 }
 EXPORT_SYMBOL(lsm6ds3_common_suspend);
 
 int lsm6ds3_common_resume(struct lsm6ds3_data *cdata)
 {
+	int err;
+
+	if (lsm6ds3_wake_enabled(cdata))
+		disable_irq_wake(cdata->irq);
+
+	err = lsm6ds3_reg_cache_sync(cdata);
+	if (err < 0)
+		dev_err(cdata->dev, "failed to restore registers: %d\n", err);
+
 	lsm6ds3_resume_sensors(&cdata->sensors[LSM6DS3_ACCEL]);
 	lsm6ds3_resume_sensors(&cdata->sensors[LSM6DS3_GYRO]);
 
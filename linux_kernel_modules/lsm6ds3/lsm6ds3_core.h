@@ -92,6 +92,9 @@ enum {
 
 #define to_dev(obj) 			container_of(obj, struct device, kobj)
 
+/* Configuration registers live below this address, see lsm6ds3_reg_cached */
+#define LSM6DS3_REG_CACHE_SIZE		0x60
+
 struct reg_rw {
 	u8 const address;
 	u8 const init_val;
@@ -110,6 +113,8 @@ struct lsm6ds3_transfer_buffer {
 };
 
 struct lsm6ds3_data;
+struct iio_dev;
+struct iio_trigger;
 
 struct lsm6ds3_transfer_function {
 	int (*write) (struct lsm6ds3_data *cdata, u8 reg_addr, int len, u8 *data,
@@ -151,6 +156,33 @@ struct lsm6ds3_data {
 	struct mutex bank_registers_lock;
 	const struct lsm6ds3_transfer_function *tf;
 	struct lsm6ds3_transfer_buffer tb;
+
+	/* IIO buffered accel/gyro, lock serializes the FIFO state */
+	struct iio_dev *indio_dev;
+	struct iio_trigger *trig;
+	bool fifo_enabled;
+	bool fifo_accel;
+	bool fifo_gyro;
+	u8 fifo_pattern_len;
+	u8 fifo_discard;
+	u32 fifo_odr;
+	unsigned int fifo_watermark;
+	unsigned int fifo_wm_patterns;
+	u32 fifo_ts_last;
+	u64 fifo_ts_epoch;
+	/* Threshold interrupt time in the IIO clock, until a read takes it */
+	bool fifo_irq_pending;
+	s64 fifo_irq_ts;
+	unsigned int fifo_irq_countdown;
+	struct iio_ts_est fifo_ts_est;
+	/* Accel axes reporting wake-up and inactivity events, bit 0 is X */
+	u8 wake_axes;
+	u8 inact_axes;
+	u8 fifo_buf[LSM6DS3_RX_MAX_LENGTH];
+
+	/* Shadow of the configuration registers written by the driver */
+	u8 reg_cache[LSM6DS3_REG_CACHE_SIZE];
+	DECLARE_BITMAP(reg_cache_valid, LSM6DS3_REG_CACHE_SIZE);
 };
 
 int lsm6ds3_common_probe(struct lsm6ds3_data *cdata, int irq, u16 bustype);
@@ -38,6 +38,14 @@ struct mt7697_rsp_hdr {
 	__be32			result;
 } __attribute__((__packed__, aligned(4)));
 
+/* One message of a gathered write: header words followed by a byte payload */
+struct mt7697_sg {
+	const u32		*hdr;
+	size_t			hdr_len;
+	const u8		*data;
+	size_t			len;
+};
+
 typedef int (*rx_hndlr)(const struct mt7697_rsp_hdr*, void*);
 typedef int (*notify_tx_hndlr)(void*, u32);
 
@@ -49,6 +57,9 @@ struct mt7697_if_ops {
 	int (*close)(void*);
 	size_t (*read)(void*, u32*, size_t);
 	size_t (*write)(void*, const u32*, size_t);
+	int (*write_sg)(void*, const struct mt7697_sg*, size_t);
+	/* All of the messages or none of them */
+	int (*write_sg_all)(void*, const struct mt7697_sg*, size_t);
 };
 
 #endif
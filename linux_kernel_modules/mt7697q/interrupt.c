@@ -17,12 +17,17 @@
 #include <linux/device.h>
 #include <linux/gpio.h>
 #include <linux/interrupt.h>
+#include <linux/percpu.h>
 #include "interrupt.h"
 #include "queue.h"
 #include "io.h"
 #include "spi.h"
 
-static int mt7697q_irq_run(struct mt7697q_info *qinfo)
+/*
+ * One polling pass: read and clear the S2M mailbox, then service every
+ * channel it flags. Returns the mailbox value, or a negative error.
+ */
+static int mt7697q_poll_once(struct mt7697q_info *qinfo, ktime_t irq_time)
 {
 	int ret;
 	u8 ch;
@@ -36,18 +41,6 @@ static int mt7697q_irq_run(struct mt7697q_info *qinfo)
 		goto cleanup;
 	}
 
-	if (s2m_mbox) {
-		if (!queue_delayed_work(qinfo->irq_workq,
-			&qinfo->irq_delayed_work, usecs_to_jiffies(10))) {
-			dev_err(qinfo->dev,
-				"%s(): queue_delayed_work() failed\n",
-				__func__);
-			ret = -EINVAL;
-		}
-	} else {
-		enable_irq(qinfo->irq);
-	}
-
 	for (ch = 0; ch < MT7697_NUM_QUEUES; ch++) {
 		struct mt7697q_spec *qs = &qinfo->queues[ch];
 		u32 in_use = mt7697q_flags_get_in_use(qs->data.flags);
@@ -56,15 +49,16 @@ static int mt7697q_irq_run(struct mt7697q_info *qinfo)
 		if (in_use &&
 		    (s2m_mbox & (0x01 << ch))) {
 			if (dir == MT7697_QUEUE_DIR_S2M) {
-				ret = mt7697q_proc_data(qs);
+				ret = mt7697q_proc_data(qs, irq_time);
 				if (ret < 0) {
+					/* Keep servicing the other channels */
 					dev_err(qinfo->dev,
 						"%s(): mt7697q_proc_data() failed(%d)\n",
 						__func__, ret);
-					goto cleanup;
 				}
 			} else if (mt7697q_blocked_writer(qs)) {
 				WARN_ON(!qs->notify_tx_fcn);
+				this_cpu_inc(qs->stats->blocked_notify);
 				ret = qs->notify_tx_fcn(qs->priv,
 							mt7697q_get_free_words(qs));
 				if (ret < 0) {
@@ -76,55 +70,81 @@ static int mt7697q_irq_run(struct mt7697q_info *qinfo)
 		}
 	}
 
+	ret = s2m_mbox;
+
 cleanup:
 	return ret;
 }
 
-void mt7697q_irq_delayed_work(struct work_struct *irq_delayed_work)
+/*
+ * Poll the slave with the interrupt disabled, for at most
+ * MT7697Q_POLL_BUDGET passes. The interrupt is re-enabled once a pass finds
+ * the mailbox empty, i.e. every queue has been drained. If the budget runs
+ * out first, polling continues from the work queue so that other threads get
+ * to run in between.
+ *
+ * irq_time is when the interrupt that started this poll fired, or zero when
+ * the poll continues from the work queue: messages delivered there can't be
+ * attributed to an interrupt, so they are left out of the latency histogram.
+ */
+static void mt7697q_poll(struct mt7697q_info *qinfo, ktime_t irq_time)
 {
-	struct mt7697q_info *qinfo = container_of(irq_delayed_work,
-		struct mt7697q_info, irq_delayed_work.work);
+	unsigned int passes;
 	int ret;
 
-	dev_dbg(qinfo->dev, "%s(): process work\n", __func__);
-	ret = mt7697q_irq_run(qinfo);
-	if (ret < 0) {
-		dev_err(qinfo->dev, "%s(): mt7697q_irq_run() failed(%d)\n",
-			__func__, ret);
-		goto cleanup;
+	for (passes = 0; passes < MT7697Q_POLL_BUDGET; passes++) {
+		ret = mt7697q_poll_once(qinfo, irq_time);
+		if (ret <= 0) {
+			/*
+			 * Nothing pending (or the mailbox can't be read, in
+			 * which case the next interrupt retries).
+			 */
+			if (passes == 0)
+				this_cpu_inc(qinfo->stats->idle_wakeups);
+			enable_irq(qinfo->irq);
+			return;
+		}
+
+		this_cpu_inc(qinfo->stats->polls);
 	}
 
-cleanup:
-	return;
+	this_cpu_inc(qinfo->stats->budget_exhausted);
+	if (!queue_work(qinfo->irq_workq, &qinfo->irq_work)) {
+		dev_err(qinfo->dev, "%s(): queue_work() failed\n", __func__);
+	}
 }
 
 void mt7697q_irq_work(struct work_struct *irq_work)
 {
 	struct mt7697q_info *qinfo = container_of(irq_work,
 		struct mt7697q_info, irq_work);
-	int ret;
 
 	dev_dbg(qinfo->dev, "%s(): process work\n", __func__);
-	ret = mt7697q_irq_run(qinfo);
-	if (ret < 0) {
-		dev_err(qinfo->dev,
-			"%s(): mt7697q_irq_run() failed(%d)\n",
-			__func__, ret);
-		goto cleanup;
-	}
+	mt7697q_poll(qinfo, ktime_set(0, 0));
+}
 
-cleanup:
-	return;
+irqreturn_t mt7697q_irq_thread(int irq, void *arg)
+{
+	struct mt7697q_info *qinfo = (struct mt7697q_info*)arg;
+	/*
+	 * Taken once per interrupt. mt7697q_isr() wrote it before waking this
+	 * thread, and can't write it again before mt7697q_poll() re-enables
+	 * the interrupt, so the copy is never torn.
+	 */
+	const ktime_t irq_time = qinfo->irq_time;
+
+	dev_dbg(qinfo->dev, "%s(): process irq\n", __func__);
+	mt7697q_poll(qinfo, irq_time);
+	return IRQ_HANDLED;
 }
 
 irqreturn_t mt7697q_isr(int irq, void *arg)
 {
 	struct mt7697q_info *qinfo = (struct mt7697q_info*)arg;
 
+	/* Interrupts stay off until mt7697q_poll() has drained the queues */
 	disable_irq_nosync(qinfo->irq);
-	if (!queue_work(qinfo->irq_workq, &qinfo->irq_work)) {
-		dev_err(qinfo->dev, "%s(): queue_work() failed\n", __func__);
-	}
-
-	return IRQ_HANDLED;
+	qinfo->irq_time = ktime_get();
+	this_cpu_inc(qinfo->stats->irqs);
+	return IRQ_WAKE_THREAD;
 }
@@ -20,7 +20,7 @@
 #include <linux/interrupt.h>
 
 irqreturn_t mt7697q_isr(int, void*);
+irqreturn_t mt7697q_irq_thread(int, void*);
 void mt7697q_irq_work(struct work_struct*);
-void mt7697q_irq_delayed_work(struct work_struct*);
 
 #endif
@@ -16,11 +16,30 @@
 
 #include <linux/device.h>
 #include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <asm/unaligned.h>
 #include "bits.h"
 #include "queue.h"
 #include "io.h"
 #include "spi.h"
 
+static unsigned int burst_words = MT7697_IO_BURST_MAX_WORDS;
+module_param(burst_words, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(burst_words, "Words per burst SPI message (0/1 disables bursts)");
+
+static unsigned int burst_delay_us;
+module_param(burst_delay_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(burst_delay_us,
+		 "Delay after each bus command in a burst before the status read");
+
+static void mt7697io_count_msg(struct mt7697q_info *qinfo, size_t num_xfers)
+{
+	qinfo->spi_msgs++;
+	this_cpu_inc(qinfo->stats->spi_msgs);
+	this_cpu_add(qinfo->stats->spi_xfers, num_xfers);
+}
+
 static bool mt7697io_busy(u16 value)
 {
 	return BF_GET(value, MT7697_IO_STATUS_REG_BUSY_OFFSET,
@@ -39,6 +58,7 @@ static int mt7697io_write16(struct mt7697q_info *qinfo, u8 reg, u16 value)
 	};
 
 	WARN_ON(reg % sizeof(u16));
+	mt7697io_count_msg(qinfo, 1);
 	ret = qinfo->hw_ops->write(qinfo->hw_priv, txBuffer, sizeof(txBuffer));
 	if (ret < 0) {
 		dev_err(qinfo->dev, "%s(): write() failed(%d)\n",
@@ -79,6 +99,7 @@ static int mt7697io_read16(struct mt7697q_info *qinfo, u8 reg, u16 *value)
 	};
 
 	WARN_ON(reg % sizeof(u16));
+	mt7697io_count_msg(qinfo, 1);
 	ret = qinfo->hw_ops->write_then_read(qinfo->hw_priv, spi_buffer,
 					     spi_buffer, sizeof(spi_buffer));
 	if (ret < 0) {
@@ -139,6 +160,7 @@ static int mt7697io_slave_wait(struct mt7697q_info *qinfo)
 	int ret;
 	bool slave_busy;
 	do {
+		this_cpu_inc(qinfo->stats->slave_wait_spins);
 		ret = mt7697io_chk_slave_busy(qinfo, &slave_busy);
 		if (ret < 0) {
 			dev_err(qinfo->dev,
@@ -223,14 +245,12 @@ int mt7697io_clr_s2m_mbx(struct mt7697q_info *qinfo, u8 s2m_mbx)
 	return ret;
 }
 
-int mt7697io_wr(struct mt7697q_info *qinfo, u32 addr, const u32 *data,
-		size_t num)
+static int mt7697io_wr_words(struct mt7697q_info *qinfo, u32 addr,
+			     const u32 *data, size_t num)
 {
 	size_t i;
 	int ret;
 
-	WARN_ON(num == 0);
-
 	ret = mt7697io_write32(qinfo, MT7697_IO_SLAVE_REG_BUS_ADDR_LOW, addr);
 	if (ret < 0) {
 		dev_err(qinfo->dev, "%s(): mt7697io_write32() failed(%d)\n",
@@ -240,7 +260,8 @@ int mt7697io_wr(struct mt7697q_info *qinfo, u32 addr, const u32 *data,
 
 	for (i = 0; i < num; i++) {
 		ret = mt7697io_write32(
-			qinfo, MT7697_IO_SLAVE_REG_WRITE_DATA_LOW, data[i]);
+			qinfo, MT7697_IO_SLAVE_REG_WRITE_DATA_LOW,
+			get_unaligned(&data[i]));
 		if (ret < 0) {
 			dev_err(qinfo->dev,
 				"%s(): mt7697io_write32() failed(%d)\n",
@@ -275,13 +296,13 @@ cleanup:
 	return ret;
 }
 
-int mt7697io_rd(struct mt7697q_info *qinfo, u32 addr, u32 *data, size_t num)
+static int mt7697io_rd_words(struct mt7697q_info *qinfo, u32 addr, u32 *data,
+			     size_t num)
 {
 	size_t i;
+	u32 word;
 	int ret;
 
-	WARN_ON(num == 0);
-
 	ret = mt7697io_write32(qinfo, MT7697_IO_SLAVE_REG_BUS_ADDR_LOW, addr);
 	if (ret < 0) {
 		dev_err(qinfo->dev, "%s(): mt7697io_write32() failed(%d)\n",
@@ -315,19 +336,250 @@ int mt7697io_rd(struct mt7697q_info *qinfo, u32 addr, u32 *data, size_t num)
 		}
 
 		ret = mt7697io_read32(
-			qinfo, MT7697_IO_SLAVE_REG_READ_DATA_LOW, &data[i]);
+			qinfo, MT7697_IO_SLAVE_REG_READ_DATA_LOW, &word);
 		if (ret < 0) {
 			dev_err(qinfo->dev,
 				"%s(): mt7697io_read32() failed(%d)\n",
 				__func__, ret);
 			goto cleanup;
 		}
+
+		put_unaligned(word, &data[i]);
 	}
 
 cleanup:
 	return ret;
 }
 
+static void mt7697io_burst_add(struct mt7697io_burst *burst, size_t *num_xfers,
+			       u8 cmd, u8 reg, u16 value, unsigned delay_us)
+{
+	struct spi_transfer *xfer = &burst->xfers[*num_xfers];
+	u8 *tx = burst->tx[*num_xfers];
+
+	WARN_ON(*num_xfers >= MT7697_IO_BURST_MAX_XFERS);
+	tx[0] = cmd;
+	tx[1] = reg;
+	tx[2] = (value >> 8) & 0xFF;
+	tx[3] = value & 0xFF;
+
+	memset(xfer, 0, sizeof(*xfer));
+	xfer->tx_buf = tx;
+	xfer->rx_buf = (cmd == MT7697_IO_CMD_READ) ?
+		burst->rx[*num_xfers] : NULL;
+	xfer->len = MT7697_IO_XFER_LEN;
+	xfer->delay_usecs = delay_us;
+	/* Every register access is framed by its own chip select */
+	xfer->cs_change = 1;
+
+	spi_message_add_tail(xfer, &burst->msg);
+	(*num_xfers)++;
+}
+
+static u16 mt7697io_burst_rx16(const struct mt7697io_burst *burst, size_t xfer)
+{
+	return (burst->rx[xfer][2] << 8) | burst->rx[xfer][3];
+}
+
+/*
+ * Transfer up to burst_words words with one SPI message. The bus address is
+ * written first and auto-increments after each bus command. The status
+ * register is read back after each word's command instead of being polled, so
+ * the message runs without waiting on the slave. Returns the number of words
+ * completed before the first word that found the slave busy. Those words and
+ * everything after them must be transferred again.
+ */
+static int mt7697io_burst_xfer(struct mt7697q_info *qinfo, u32 addr,
+			       u32 *rd_data, const u32 *wr_data, size_t num)
+{
+	struct mt7697io_burst *burst = qinfo->burst;
+	const u16 cmd = BF_DEFINE(MT7697_IO_COMMAND_REG_BUS_SIZE_VAL_WORD,
+				  MT7697_IO_COMMAND_REG_BUS_SIZE_OFFSET,
+				  MT7697_IO_COMMAND_REG_BUS_SIZE_WIDTH) |
+			BF_DEFINE(wr_data ? MT7697_IO_COMMAND_REG_RW_VAL_WRITE :
+				  MT7697_IO_COMMAND_REG_RW_VAL_READ,
+				  MT7697_IO_COMMAND_REG_RW_OFFSET,
+				  MT7697_IO_COMMAND_REG_RW_WIDTH);
+	size_t num_xfers = 0;
+	size_t i;
+	int ret;
+
+	spi_message_init(&burst->msg);
+	mt7697io_burst_add(burst, &num_xfers, MT7697_IO_CMD_WRITE,
+			   MT7697_IO_SLAVE_REG_BUS_ADDR_LOW,
+			   BF_GET(addr, 0, 16), 0);
+	mt7697io_burst_add(burst, &num_xfers, MT7697_IO_CMD_WRITE,
+			   MT7697_IO_SLAVE_REG_BUS_ADDR_HIGH,
+			   BF_GET(addr, 16, 16), 0);
+
+	for (i = 0; i < num; i++) {
+		if (wr_data) {
+			const u32 word = get_unaligned(&wr_data[i]);
+
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_WRITE,
+					   MT7697_IO_SLAVE_REG_WRITE_DATA_LOW,
+					   BF_GET(word, 0, 16), 0);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_WRITE,
+					   MT7697_IO_SLAVE_REG_WRITE_DATA_HIGH,
+					   BF_GET(word, 16, 16), 0);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_WRITE,
+					   MT7697_IO_SLAVE_REG_COMMAND, cmd,
+					   burst_delay_us);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_READ,
+					   MT7697_IO_SLAVE_REG_STATUS, 0, 0);
+		} else {
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_WRITE,
+					   MT7697_IO_SLAVE_REG_COMMAND, cmd,
+					   burst_delay_us);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_READ,
+					   MT7697_IO_SLAVE_REG_STATUS, 0, 0);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_READ,
+					   MT7697_IO_SLAVE_REG_READ_DATA_LOW,
+					   0, 0);
+			mt7697io_burst_add(burst, &num_xfers,
+					   MT7697_IO_CMD_READ,
+					   MT7697_IO_SLAVE_REG_READ_DATA_HIGH,
+					   0, 0);
+		}
+	}
+
+	/* Release chip select at the end of the message */
+	burst->xfers[num_xfers - 1].cs_change = 0;
+
+	mt7697io_count_msg(qinfo, num_xfers);
+	ret = qinfo->hw_ops->sync(qinfo->hw_priv, &burst->msg);
+	if (ret < 0) {
+		dev_err(qinfo->dev, "%s(): sync() failed(%d)\n",
+			__func__, ret);
+		goto cleanup;
+	}
+
+	for (i = 0; i < num; i++) {
+		const size_t xfer = MT7697_IO_BURST_ADDR_XFERS +
+			(i * MT7697_IO_BURST_XFERS_PER_WORD);
+
+		if (wr_data) {
+			if (mt7697io_busy(mt7697io_burst_rx16(burst, xfer + 3)))
+				break;
+		} else {
+			if (mt7697io_busy(mt7697io_burst_rx16(burst, xfer + 1)))
+				break;
+
+			put_unaligned(mt7697io_burst_rx16(burst, xfer + 2) |
+				      (mt7697io_burst_rx16(burst, xfer + 3) << 16),
+				      &rd_data[i]);
+		}
+	}
+
+	ret = i;
+
+cleanup:
+	return ret;
+}
+
+static int mt7697io_burst(struct mt7697q_info *qinfo, u32 addr, u32 *rd_data,
+			  const u32 *wr_data, size_t num)
+{
+	const size_t max_words = min_t(size_t, burst_words,
+				       MT7697_IO_BURST_MAX_WORDS);
+	unsigned int retries = 0;
+	size_t done = 0;
+	int ret = 0;
+
+	while (done < num) {
+		const size_t words = min(num - done, max_words);
+
+		ret = mt7697io_burst_xfer(qinfo, addr + done * sizeof(u32),
+					  rd_data ? &rd_data[done] : NULL,
+					  wr_data ? &wr_data[done] : NULL,
+					  words);
+		if (ret < 0) {
+			dev_err(qinfo->dev,
+				"%s(): mt7697io_burst_xfer() failed(%d)\n",
+				__func__, ret);
+			goto cleanup;
+		}
+
+		done += ret;
+		if (ret == words) {
+			retries = 0;
+			continue;
+		}
+
+		/*
+		 * The slave was still busy when a word's status was read, so
+		 * that word and the ones after it may not have been
+		 * transferred. Wait for the slave and restart from there.
+		 */
+		this_cpu_inc(qinfo->stats->busy_retries);
+		ret = mt7697io_slave_wait(qinfo);
+		if (ret < 0) {
+			dev_err(qinfo->dev,
+				"%s(): mt7697io_slave_wait() failed(%d)\n",
+				__func__, ret);
+			goto cleanup;
+		}
+
+		if (++retries >= MT7697_IO_BURST_MAX_RETRIES) {
+			dev_warn(qinfo->dev,
+				 "%s(): slave busy, fall back to word transfers\n",
+				 __func__);
+			this_cpu_inc(qinfo->stats->fallbacks);
+			ret = rd_data ?
+				mt7697io_rd_words(qinfo,
+						  addr + done * sizeof(u32),
+						  &rd_data[done], num - done) :
+				mt7697io_wr_words(qinfo,
+						  addr + done * sizeof(u32),
+						  &wr_data[done], num - done);
+			goto cleanup;
+		}
+	}
+
+	ret = 0;
+
+cleanup:
+	return ret;
+}
+
+int mt7697io_wr(struct mt7697q_info *qinfo, u32 addr, const u32 *data,
+		size_t num)
+{
+	int ret;
+
+	WARN_ON(num == 0);
+
+	this_cpu_add(qinfo->stats->wr_words, num);
+	if ((burst_words > 1) && qinfo->burst)
+		ret = mt7697io_burst(qinfo, addr, NULL, data, num);
+	else
+		ret = mt7697io_wr_words(qinfo, addr, data, num);
+
+	return ret;
+}
+
+int mt7697io_rd(struct mt7697q_info *qinfo, u32 addr, u32 *data, size_t num)
+{
+	int ret;
+
+	WARN_ON(num == 0);
+
+	this_cpu_add(qinfo->stats->rd_words, num);
+	if ((burst_words > 1) && qinfo->burst)
+		ret = mt7697io_burst(qinfo, addr, data, NULL, num);
+	else
+		ret = mt7697io_rd_words(qinfo, addr, data, num);
+
+	return ret;
+}
+
 int mt7697io_trigger_intr(struct mt7697q_info *qinfo)
 {
 	int ret = mt7697io_write16(
@@ -23,6 +23,7 @@
 #define __MT7697_IO_H__
 
 #include <linux/types.h>
+#include <linux/spi/spi.h>
 
 /* Address is based on linker script used to build mt7697 code */
 #define MT7697_IO_SLAVE_BUFFER_ADDRESS 			0x20000200
@@ -81,6 +82,33 @@
 #define MT7697_IO_M2S_MAILBOX_REG_MAILBOX_OFFSET 	0
 #define MT7697_IO_M2S_MAILBOX_REG_MAILBOX_WIDTH 	7
 
+/*
+ * Burst transfers: the register accesses for up to MT7697_IO_BURST_MAX_WORDS
+ * words are chained into a single SPI message. Every register access is a
+ * separate 4 byte transfer.
+ */
+#define MT7697_IO_BURST_MAX_WORDS			32
+#define MT7697_IO_BURST_XFERS_PER_WORD			4
+#define MT7697_IO_BURST_ADDR_XFERS			2
+#define MT7697_IO_BURST_MAX_XFERS			\
+	(MT7697_IO_BURST_ADDR_XFERS + 				\
+	 MT7697_IO_BURST_MAX_WORDS * MT7697_IO_BURST_XFERS_PER_WORD)
+#define MT7697_IO_XFER_LEN				4
+
+/*
+ * Consecutive busy slave reports tolerated before a burst falls back to
+ * word by word transfers.
+ */
+#define MT7697_IO_BURST_MAX_RETRIES			8
+
+struct mt7697io_burst {
+	struct spi_message	msg;
+	struct spi_transfer	xfers[MT7697_IO_BURST_MAX_XFERS];
+	u8			tx[MT7697_IO_BURST_MAX_XFERS][MT7697_IO_XFER_LEN];
+	u8			rx[MT7697_IO_BURST_MAX_XFERS][MT7697_IO_XFER_LEN]
+				____cacheline_aligned;
+};
+
 struct mt7697q_info;
 
 int mt7697io_wr_m2s_mbx(struct mt7697q_info*, u8);
@@ -15,41 +15,47 @@
  */
 
 #include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
 #include <linux/spi/spi.h>
 #include "bits.h"
 #include "io.h"
 #include "queue.h"
+#include "ring.h"
 #include "spi.h"
 
-static ssize_t mt7697q_buf_diff(u32 size, u32 from, u32 to)
+static u32 mt7697q_get_size(const struct mt7697q_spec *qs)
 {
-	if (from >= size) {
-		pr_info("%s(): ERROR from(%u) >= size(%u)\n",
-		        __func__, from, size);
-		WARN_ON(from >= size);
-	}
-
-	if (to >= size) {
-		pr_info("%s(): ERROR to(%u) >= size(%u)\n",
-		        __func__, to, size);
-		WARN_ON(to >= size);
-	}
-
-	return (from <= to) ? (to - from):((size - from) + to);
+	return BF_GET(qs->data.flags, MT7697_QUEUE_FLAGS_NUM_WORDS_OFFSET,
+	              MT7697_QUEUE_FLAGS_NUM_WORDS_WIDTH);
 }
 
-static size_t mt7697q_get_capacity(const struct mt7697q_spec *qs)
+static size_t mt7697q_get_num_words(const struct mt7697q_spec *qs)
 {
-	return BF_GET(qs->data.flags, MT7697_QUEUE_FLAGS_NUM_WORDS_OFFSET,
-	              MT7697_QUEUE_FLAGS_NUM_WORDS_WIDTH) - 1;
+	return mt7697q_ring_used(mt7697q_get_size(qs), qs->data.rd_offset,
+	                         qs->data.wr_offset);
 }
 
-static size_t mt7697q_get_num_words(const struct mt7697q_spec *qs)
+/*
+ * Account one queue transfer. A received message takes several reads, so
+ * reads pass msgs == 0 and mt7697q_proc_data() counts the message when it is
+ * delivered.
+ */
+static void mt7697q_report_io(struct mt7697q_spec *qs, const char *op,
+                              size_t words, size_t msgs, u64 spi_msgs,
+                              ktime_t start)
 {
-	return mt7697q_buf_diff(BF_GET(qs->data.flags,
-	                               MT7697_QUEUE_FLAGS_NUM_WORDS_OFFSET,
-	                               MT7697_QUEUE_FLAGS_NUM_WORDS_WIDTH),
-	                        qs->data.rd_offset, qs->data.wr_offset);
+	const s64 us = ktime_us_delta(ktime_get(), start);
+
+	spi_msgs = qs->qinfo->spi_msgs - spi_msgs;
+	this_cpu_add(qs->stats->words, words);
+	this_cpu_add(qs->stats->msgs, msgs);
+	this_cpu_add(qs->stats->spi_msgs, spi_msgs);
+
+	dev_dbg(qs->qinfo->dev,
+	        "%s(): queue(%u) %s(%zu) SPI msgs(%llu) time(%lldus) rate(%lldkB/s)\n",
+	        __func__, qs->ch, op, words, spi_msgs, us,
+	        (us > 0) ? div_s64((s64)words * sizeof(u32) * 1000, us) : 0);
 }
 
 static int mt7697q_wr_init(u8 tx_ch, u8 rx_ch, struct mt7697q_spec *qs)
@@ -249,8 +255,9 @@ static int mt7697q_read_state(u8 ch, struct mt7697q_spec *qs)
 		        __func__, qs->data.flags);
 		ret = -EINVAL;
 		goto cleanup;
-	} else if ((qs->data.rd_offset > mt7697q_get_capacity(qs)) ||
-	           (qs->data.wr_offset > mt7697q_get_capacity(qs))) {
+	} else if (!mt7697q_ring_valid(mt7697q_get_size(qs),
+	                               qs->data.rd_offset,
+	                               qs->data.wr_offset)) {
 		dev_err(qs->qinfo->dev,
 		        "%s(): invalid rd/wr offset(0x%08x/0x%08x)\n",
 		        __func__, qs->data.rd_offset, qs->data.wr_offset);
@@ -328,7 +335,8 @@ cleanup:
 
 size_t mt7697q_get_free_words(const struct mt7697q_spec *qs)
 {
-	return mt7697q_get_capacity(qs) - mt7697q_get_num_words(qs);
+	return mt7697q_ring_free(mt7697q_get_size(qs), qs->data.rd_offset,
+	                         qs->data.wr_offset);
 }
 
 int mt7697q_get_s2m_mbx(struct mt7697q_info *qinfo, u8 *s2m_mbox)
@@ -362,7 +370,7 @@ int mt7697q_blocked_writer(const struct mt7697q_spec *qs)
 	return atomic_read(&qs->qinfo->blocked_writer);
 }
 
-int mt7697q_proc_data(struct mt7697q_spec *qsS2M)
+int mt7697q_proc_data(struct mt7697q_spec *qsS2M, ktime_t irq_time)
 {
 	size_t avail;
 	u32 req = 0;
@@ -447,8 +455,12 @@ int mt7697q_proc_data(struct mt7697q_spec *qsS2M)
 				        "%s(): rx_fcn() failed(%d)\n",
 				        __func__, ret);
 			}
+
+			mt7697q_stats_latency(qsS2M, irq_time);
 		}
 
+		this_cpu_inc(qsS2M->stats->msgs);
+
 		avail -= req;
 		qsS2M->qinfo->rsp.cmd.len = 0;
 		req = LEN_TO_WORD(sizeof(struct mt7697_rsp_hdr));
@@ -669,92 +681,66 @@ cleanup:
 
 EXPORT_SYMBOL(mt7697q_shutdown);
 
-size_t mt7697q_read(void *hndl, u32 *buf, size_t num)
+/* Ring transfer callbacks, off is in words from the queue base address */
+static int mt7697q_ring_rd(void *priv, u32 off, u32 *buf, u32 num)
 {
-	struct mt7697q_spec *qs = (struct mt7697q_spec*)hndl;
-	size_t rd_words = 0;
-	u16 write_offset;
-	u16 read_offset;
-	u32 buff_words;
+	struct mt7697q_spec *qs = (struct mt7697q_spec*)priv;
+	const u32 rd_addr = qs->data.base_addr + (off * sizeof(u32));
 	int ret;
 
-	mutex_lock(&qs->qinfo->mutex);
+	dev_dbg(qs->qinfo->dev,
+	        "%s(): rd(%u) queue(%u) rd offset(%u) addr(0x%08x)\n",
+	        __func__, num, qs->ch, off, rd_addr);
+	ret = mt7697io_rd(qs->qinfo, rd_addr, buf, num);
+	if (ret < 0)
+		dev_err(qs->qinfo->dev, "%s(): mt7697io_rd() failed(%d)\n",
+		        __func__, ret);
 
-	buff_words = BF_GET(qs->data.flags,
-	                    MT7697_QUEUE_FLAGS_NUM_WORDS_OFFSET,
-	                    MT7697_QUEUE_FLAGS_NUM_WORDS_WIDTH);
+	return ret;
+}
 
-	write_offset = qs->data.wr_offset;
-	read_offset = qs->data.rd_offset;
-	dev_dbg(qs->qinfo->dev, "%s(): rd(%u) queue(%d) rd/wr offset(%d/%d)",
-	        __func__, num, qs->ch, read_offset, write_offset);
-	if (read_offset > write_offset) {
-		const size_t words_to_end =  buff_words - read_offset;
-		const u32 rd_addr = qs->data.base_addr +
-			(read_offset * sizeof(u32));
-		const size_t rd_num = (num <= words_to_end) ?
-			num : words_to_end;
-
-		dev_dbg(qs->qinfo->dev,
-		        "%s(): rd(%u) queue(%u) rd offset(%u) addr(0x%08x)\n",
-		        __func__, rd_num, qs->ch, read_offset, rd_addr);
-		ret = mt7697io_rd(qs->qinfo, rd_addr, &buf[rd_words], rd_num);
-		if (ret < 0) {
-			dev_err(qs->qinfo->dev,
-			        "%s(): mt7697io_rd() failed(%d)\n",
-			        __func__, ret);
-			goto cleanup;
-		}
+static int mt7697q_ring_wr(void *priv, u32 off, const u32 *buf, u32 num)
+{
+	struct mt7697q_spec *qs = (struct mt7697q_spec*)priv;
+	const u32 write_addr = qs->data.base_addr + (off * sizeof(u32));
+	int ret;
 
-		rd_words += rd_num;
-		read_offset += rd_num;
+	dev_dbg(qs->qinfo->dev,
+	        "%s(): wr(%u) queue(%u) wr offset(%u) addr(0x%08x)\n",
+	        __func__, num, qs->ch, off, write_addr);
+	ret = mt7697io_wr(qs->qinfo, write_addr, buf, num);
+	if (ret < 0)
+		dev_err(qs->qinfo->dev, "%s(): mt7697io_wr() failed(%d)\n",
+		        __func__, ret);
 
-		if (read_offset == buff_words) {
-			/*
-			 * If we have read to the end, then
-			 * set the read pointer to the beginning
-			 */
-			read_offset = 0;
-		}
-	}
+	return ret;
+}
 
-	if (rd_words < num) {
-		/* NOTE: rd_offset assumed to be <= wr_offset at this point */
-		const size_t words_avail = write_offset - read_offset;
-		const u32 rd_addr = qs->data.base_addr +
-			(read_offset * sizeof(u32));
-		const size_t words_req = num - rd_words;
-		const size_t rd_num =
-			(words_req <= words_avail) ? words_req : words_avail;
+size_t mt7697q_read(void *hndl, u32 *buf, size_t num)
+{
+	struct mt7697q_spec *qs = (struct mt7697q_spec*)hndl;
+	const ktime_t start = ktime_get();
+	u32 read_offset;
+	u64 spi_msgs;
+	int ret;
 
-		dev_dbg(qs->qinfo->dev,
-		        "%s(): rd(%u) queue(%u) rd offset(%u) addr(0x%08x)\n",
-		        __func__, rd_num, qs->ch, read_offset, rd_addr);
-		ret = mt7697io_rd(qs->qinfo, rd_addr, &buf[rd_words], rd_num);
-		if (ret < 0) {
-			dev_err(qs->qinfo->dev,
-			        "%s(): mt7697io_rd() failed(%d)\n",
-			        __func__, ret);
-			goto cleanup;
-		}
+	mutex_lock(&qs->qinfo->mutex);
+	spi_msgs = qs->qinfo->spi_msgs;
 
-		rd_words += rd_num;
-		read_offset += rd_num;
-	}
+	read_offset = qs->data.rd_offset;
+	dev_dbg(qs->qinfo->dev, "%s(): rd(%u) queue(%d) rd/wr offset(%d/%d)",
+	        __func__, num, qs->ch, read_offset, qs->data.wr_offset);
 
-	if (read_offset >= buff_words) {
-		dev_err(qs->qinfo->dev, "%s(): rd offset(%u) >= size(%u)\n",
-		        __func__, read_offset, buff_words);
-		WARN_ON(read_offset >= buff_words);
-		ret = -EINVAL;
+	ret = mt7697q_ring_read(mt7697q_get_size(qs), &read_offset,
+	                        qs->data.wr_offset, buf, num, mt7697q_ring_rd,
+	                        qs);
+	if (ret < 0)
 		goto cleanup;
-	}
 
-	dev_dbg(qs->qinfo->dev, "%s(): queue(%u) rd offset(%u) read(%u)\n",
-	        __func__, qs->ch, read_offset, rd_words);
+	dev_dbg(qs->qinfo->dev, "%s(): queue(%u) rd offset(%u) read(%d)\n",
+	        __func__, qs->ch, read_offset, ret);
 	qs->data.rd_offset = read_offset;
-
-	ret = rd_words;
+	mt7697q_report_io(qs, "rd", ret, 0, spi_msgs, start);
 
 cleanup:
 	mutex_unlock(&qs->qinfo->mutex);
@@ -763,17 +749,15 @@ cleanup:
 
 EXPORT_SYMBOL(mt7697q_read);
 
-size_t mt7697q_write(void *hndl, const u32 *buff, size_t num)
+/*
+ * Make room for num words in the M2S queue, refreshing the read pointer from
+ * the slave if the cached one leaves too little space. Called with the mutex
+ * held.
+ */
+static int mt7697q_wr_reserve(struct mt7697q_spec *qs, size_t num)
 {
-	struct mt7697q_spec *qs = (struct mt7697q_spec*)hndl;
 	size_t avail;
-	size_t words_written = 0;
-	u16 read_offset;
-	u16 write_offset;
-	uint32_t buff_words;
-	int ret;
-
-	mutex_lock(&qs->qinfo->mutex);
+	int ret = 0;
 
 	avail = mt7697q_get_free_words(qs);
 	dev_dbg(qs->qinfo->dev, "%s(): free words(%u)\n", __func__, avail);
@@ -786,89 +770,189 @@ size_t mt7697q_write(void *hndl, const u32 *buff, size_t num)
 			goto cleanup;
 		}
 
+		avail = mt7697q_get_free_words(qs);
 		if (avail < num) {
 			dev_dbg(qs->qinfo->dev, "%s(): queue avail(%u < %u)\n",
 			        __func__, avail, num);
 			atomic_set(&qs->qinfo->blocked_writer, true);
+			this_cpu_inc(qs->stats->eagain);
 			ret = -EAGAIN;
 			goto cleanup;
 		}
 	}
 
-	buff_words = BF_GET(qs->data.flags, MT7697_QUEUE_FLAGS_NUM_WORDS_OFFSET,
-	                    MT7697_QUEUE_FLAGS_NUM_WORDS_WIDTH);
+cleanup:
+	return ret;
+}
+
+/*
+ * Copy num words to the queue buffer at *wr_offset, wrapping at the end of
+ * the buffer. Writers work on a copy of the write offset and only store it
+ * in qs->data once everything is written, so a failed transfer leaves no
+ * words behind the offset that the next push would publish.
+ */
+static int mt7697q_wr_data(struct mt7697q_spec *qs, u32 *wr_offset,
+                           const u32 *buff, size_t num)
+{
+	int ret;
 
-	read_offset = qs->data.rd_offset;
-	write_offset = qs->data.wr_offset;
 	dev_dbg(qs->qinfo->dev, "%s(): wr(%u) queue(%d) rd/wr offset(%d/%d)",
-	        __func__, num, qs->ch, read_offset, write_offset);
-	if (write_offset >= read_offset) {
-		const size_t words_to_end = buff_words - write_offset;
-		const size_t words_avail = (read_offset == 0) ?
-			(words_to_end - 1) : words_to_end;
-		const size_t words_to_write =
-			(num <= words_avail) ? num : words_avail;
-		const u32 write_addr = qs->data.base_addr +
-			(write_offset * sizeof(u32));
-
-		dev_dbg(qs->qinfo->dev,
-		        "%s(): wr(%u) queue(%u) wr offset(%u) addr(0x%08x)\n",
-		        __func__, words_to_write, qs->ch, write_offset,
-		        write_addr);
-		ret = mt7697io_wr(qs->qinfo, write_addr, &buff[words_written],
-		                  words_to_write);
-		if (ret < 0) {
-			dev_err(qs->qinfo->dev,
-			        "%s(): mt7697io_wr() failed(%d)\n",
-			        __func__, ret);
+	        __func__, num, qs->ch, qs->data.rd_offset, *wr_offset);
+
+	ret = mt7697q_ring_write(mt7697q_get_size(qs), qs->data.rd_offset,
+	                         wr_offset, buff, num, mt7697q_ring_wr, qs);
+
+	dev_dbg(qs->qinfo->dev, "%s(): queue(%u) wr offset(%u) write(%d)\n",
+	        __func__, qs->ch, *wr_offset, ret);
+	return ret;
+}
+
+size_t mt7697q_write(void *hndl, const u32 *buff, size_t num)
+{
+	struct mt7697q_spec *qs = (struct mt7697q_spec*)hndl;
+	const ktime_t start = ktime_get();
+	size_t words_written;
+	u32 wr_offset;
+	u64 spi_msgs;
+	int ret;
+
+	mutex_lock(&qs->qinfo->mutex);
+	spi_msgs = qs->qinfo->spi_msgs;
+	wr_offset = qs->data.wr_offset;
+
+	ret = mt7697q_wr_reserve(qs, num);
+	if (ret < 0)
+		goto cleanup;
+
+	ret = mt7697q_wr_data(qs, &wr_offset, buff, num);
+	if (ret < 0) {
+		dev_err(qs->qinfo->dev,
+		        "%s(): mt7697q_wr_data() failed(%d)\n",
+		        __func__, ret);
+		goto cleanup;
+	}
+
+	words_written = ret;
+	qs->data.wr_offset = wr_offset;
+	ret = mt7697q_push_wr_ptr(qs);
+	if (ret < 0) {
+		dev_err(qs->qinfo->dev,
+		        "%s(): mt7697q_push_wr_ptr() failed(%d)\n",
+		        __func__, ret);
+		goto cleanup;
+	}
+
+	ret = words_written;
+	mt7697q_report_io(qs, "wr", words_written, 1, spi_msgs, start);
+
+cleanup:
+	mutex_unlock(&qs->qinfo->mutex);
+	return ret;
+}
+
+EXPORT_SYMBOL(mt7697q_write);
+
+static size_t mt7697q_sg_words(const struct mt7697_sg *sg)
+{
+	return sg->hdr_len + LEN_TO_WORD(sg->len);
+}
+
+static int mt7697q_wr_sg(struct mt7697q_spec *qs, u32 *wr_offset,
+                         const struct mt7697_sg *sg)
+{
+	const size_t data_num = sg->len / sizeof(u32);
+	const size_t tail_len = sg->len % sizeof(u32);
+	u32 tail = 0;
+	int ret;
+
+	ret = mt7697q_wr_data(qs, wr_offset, sg->hdr, sg->hdr_len);
+	if (ret < 0)
+		goto cleanup;
+
+	if (data_num) {
+		ret = mt7697q_wr_data(qs, wr_offset, (const u32*)sg->data,
+		                      data_num);
+		if (ret < 0)
 			goto cleanup;
-		}
+	}
 
-		words_written += words_to_write;
-		num -= words_to_write;
-		write_offset += words_to_write;
-		if (write_offset == buff_words) {
-			write_offset = 0;
-		}
+	if (tail_len) {
+		memcpy(&tail, &sg->data[data_num * sizeof(u32)], tail_len);
+		ret = mt7697q_wr_data(qs, wr_offset, &tail, 1);
+		if (ret < 0)
+			goto cleanup;
 	}
 
-	if ((write_offset < read_offset) && (num > 0)) {
-		const size_t words_to_read = read_offset - write_offset - 1;
-		const size_t words_to_write = (num <= words_to_read) ?
-			num : words_to_read;
-		const uint32_t write_addr = qs->data.base_addr +
-			(write_offset * sizeof(u32));
+	ret = 0;
+
+cleanup:
+	return ret;
+}
+
+/*
+ * Write messages made of a header and a byte payload without first copying
+ * them into one buffer. Payloads go to the queue straight from the caller's
+ * buffers, which need not be word aligned. Only the last partial word of each
+ * is copied, zero padded. The messages written are published to the slave
+ * with a single write pointer update. With all set either every message is
+ * written or none, otherwise as many whole messages as fit. Returns the
+ * number of messages written, or -EAGAIN if nothing fits.
+ */
+static int mt7697q_wr_sg_batch(struct mt7697q_spec *qs,
+                               const struct mt7697_sg *sg, size_t num,
+                               bool all)
+{
+	const ktime_t start = ktime_get();
+	size_t reserve = 0;
+	size_t words = 0;
+	size_t avail;
+	size_t i;
+	u32 wr_offset;
+	u64 spi_msgs;
+	int ret;
+
+	WARN_ON(num == 0);
+
+	if (all) {
+		for (i = 0; i < num; i++)
+			reserve += mt7697q_sg_words(&sg[i]);
+	} else {
+		reserve = mt7697q_sg_words(&sg[0]);
+	}
+
+	mutex_lock(&qs->qinfo->mutex);
+	spi_msgs = qs->qinfo->spi_msgs;
+	wr_offset = qs->data.wr_offset;
+
+	ret = mt7697q_wr_reserve(qs, reserve);
+	if (ret < 0)
+		goto cleanup;
 
-		dev_dbg(qs->qinfo->dev,
-		        "%s(): wr(%u) queue(%u) wr offset(%u) addr(0x%08x)\n",
-		        __func__, words_to_write, qs->ch, write_offset,
-		        write_addr);
-		ret = mt7697io_wr(qs->qinfo, write_addr, &buff[words_written],
-		                  words_to_write);
+	avail = mt7697q_get_free_words(qs);
+	for (i = 0; i < num; i++) {
+		const size_t sg_words = mt7697q_sg_words(&sg[i]);
+
+		if (words + sg_words > avail)
+			break;
+
+		ret = mt7697q_wr_sg(qs, &wr_offset, &sg[i]);
 		if (ret < 0) {
 			dev_err(qs->qinfo->dev,
-			        "%s(): mt7697io_wr() failed(%d)\n",
+			        "%s(): mt7697q_wr_sg() failed(%d)\n",
 			        __func__, ret);
 			goto cleanup;
 		}
 
-		words_written += words_to_write;
-		num -= words_to_write;
-		write_offset += words_to_write;
-	}
-
-	if (write_offset >= buff_words) {
-		dev_err(qs->qinfo->dev, "%s(): wr offset(%u) >= size(%u)\n",
-		        __func__, write_offset, buff_words);
-		WARN_ON(write_offset >= buff_words);
-		ret = -EINVAL;
-		goto cleanup;
+		words += sg_words;
 	}
 
-	dev_dbg(qs->qinfo->dev, "%s(): queue(%u) wr offset(%u) write(%u)\n",
-	        __func__, qs->ch, write_offset, words_written);
-	qs->data.wr_offset = write_offset;
-
+	/*
+	 * Nothing of the batch is kept unless all of it was written.
+	 * Otherwise the next write would publish the orphaned words of
+	 * messages reported as not sent. Once the pointer push has started
+	 * the slave may already see the batch, so that failure keeps it.
+	 */
+	qs->data.wr_offset = wr_offset;
 	ret = mt7697q_push_wr_ptr(qs);
 	if (ret < 0) {
 		dev_err(qs->qinfo->dev,
@@ -877,14 +961,33 @@ size_t mt7697q_write(void *hndl, const u32 *buff, size_t num)
 		goto cleanup;
 	}
 
-	ret = words_written;
+	dev_dbg(qs->qinfo->dev, "%s(): queue(%u) msgs(%u/%u) words(%u)\n",
+	        __func__, qs->ch, i, num, words);
+	ret = i;
+	mt7697q_report_io(qs, "wr", words, i, spi_msgs, start);
 
 cleanup:
 	mutex_unlock(&qs->qinfo->mutex);
 	return ret;
 }
 
-EXPORT_SYMBOL(mt7697q_write);
+int mt7697q_write_sg(void *hndl, const struct mt7697_sg *sg, size_t num)
+{
+	return mt7697q_wr_sg_batch((struct mt7697q_spec*)hndl, sg, num, false);
+}
+
+EXPORT_SYMBOL(mt7697q_write_sg);
+
+/*
+ * Write a batch of commands that only make sense together. Nothing is
+ * written unless the queue has room for all of them.
+ */
+int mt7697q_write_sg_all(void *hndl, const struct mt7697_sg *sg, size_t num)
+{
+	return mt7697q_wr_sg_batch((struct mt7697q_spec*)hndl, sg, num, true);
+}
+
+EXPORT_SYMBOL(mt7697q_write_sg_all);
 
 u32 mt7697q_flags_get_in_use(u32 flags)
 {
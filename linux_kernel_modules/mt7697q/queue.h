@@ -20,6 +20,8 @@
 #include <linux/types.h>
 #include <linux/interrupt.h>
 #include "queue_i.h"
+#include "io.h"
+#include "stats.h"
 
 #define MT7697_NUM_QUEUES			6
 
@@ -34,6 +36,9 @@
 
 #define MT7697_QUEUE_DEBUG_DUMP_LIMIT 		1024
 
+/* Mailbox polling passes per interrupt before yielding to the work queue */
+#define MT7697Q_POLL_BUDGET			16
+
 struct mt7697q_data {
 	u32 flags;
 	u32 base_addr;
@@ -46,6 +51,7 @@ struct mt7697q_data {
 struct mt7697q_spec {
 	struct mt7697q_data             data;
 	struct mt7697q_info             *qinfo;
+	struct mt7697q_queue_stats __percpu *stats;
 	void                            *priv;
 	notify_tx_hndlr                 notify_tx_fcn;
 	rx_hndlr                        rx_fcn;
@@ -59,24 +65,28 @@ struct mt7697q_info {
 	struct device                   *dev;
 	void                            *hw_priv;
 	const struct mt7697spi_hw_ops   *hw_ops;
+	struct mt7697io_burst           *burst;
+	struct mt7697q_stats __percpu   *stats;
+	struct dentry                   *debugfs;
+	u64                             spi_msgs; /* protected by mutex */
 
 	struct mutex                    mutex;
 	struct workqueue_struct         *irq_workq;
 
 	struct work_struct              irq_work;
-	struct delayed_work             irq_delayed_work;
+	ktime_t                         irq_time; /* set by mt7697q_isr() */
 	atomic_t                        blocked_writer;
 	int                             gpio_pin;
 	int                             irq;
 };
 
-void mt7697q_irq_delayed_work(struct work_struct*);
 void mt7697q_irq_work(struct work_struct*);
 irqreturn_t mt7697q_isr(int, void*);
+irqreturn_t mt7697q_irq_thread(int, void*);
 
 int mt7697q_blocked_writer(const struct mt7697q_spec*);
 size_t mt7697q_get_free_words(const struct mt7697q_spec*);
-int mt7697q_proc_data(struct mt7697q_spec*);
+int mt7697q_proc_data(struct mt7697q_spec*, ktime_t);
 int mt7697q_get_s2m_mbx(struct mt7697q_info*, u8*);
 
 #endif
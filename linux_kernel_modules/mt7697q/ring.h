@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MT7697_RING_H_
+#define _MT7697_RING_H_
+
+/*
+ * Circular buffer arithmetic shared by the host and the MT7697 for the queues
+ * in slave memory. Offsets are in words. The writer owns wr and the reader
+ * owns rd. One word is always left unused so that rd == wr means empty and a
+ * full buffer holds size - 1 words.
+ *
+ * This file has no dependencies on the kernel or on the SPI transport, so it
+ * can also be built into user space tools.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+typedef uint32_t u32;
+#endif
+
+/* Offsets are in range and the buffer can hold at least one word */
+static inline bool mt7697q_ring_valid(u32 size, u32 rd, u32 wr)
+{
+	return (size > 1) && (rd < size) && (wr < size);
+}
+
+/* Words written but not yet read */
+static inline u32 mt7697q_ring_used(u32 size, u32 rd, u32 wr)
+{
+	return (rd <= wr) ? (wr - rd) : ((size - rd) + wr);
+}
+
+/* Words that can be written without overtaking the reader */
+static inline u32 mt7697q_ring_free(u32 size, u32 rd, u32 wr)
+{
+	return size - 1 - mt7697q_ring_used(size, rd, wr);
+}
+
+/* Words that can be read from rd without wrapping */
+static inline u32 mt7697q_ring_rd_span(u32 size, u32 rd, u32 wr)
+{
+	return (rd <= wr) ? (wr - rd) : (size - rd);
+}
+
+/*
+ * Words that can be written from wr without wrapping. When the reader is at
+ * offset 0 the last word stays unused, since writing it would wrap wr onto rd.
+ */
+static inline u32 mt7697q_ring_wr_span(u32 size, u32 rd, u32 wr)
+{
+	if (wr >= rd)
+		return size - wr - ((rd == 0) ? 1 : 0);
+
+	return rd - wr - 1;
+}
+
+/* Offset num words after off */
+static inline u32 mt7697q_ring_advance(u32 size, u32 off, u32 num)
+{
+	off += num;
+	return (off >= size) ? (off - size) : off;
+}
+
+/* Transfer num words at ring offset off, returns < 0 on failure */
+typedef int (*mt7697q_ring_rd_fn)(void *priv, u32 off, u32 *buf, u32 num);
+typedef int (*mt7697q_ring_wr_fn)(void *priv, u32 off, const u32 *buf,
+                                  u32 num);
+
+/*
+ * Read up to num words from *rd, in at most two transfers: up to the end of
+ * the buffer, then from 0. Returns the number of words read and advances *rd
+ * past them. A failed transfer returns its error and leaves *rd alone, so the
+ * words stay queued.
+ */
+static inline int mt7697q_ring_read(u32 size, u32 *rd, u32 wr, u32 *buf,
+                                    u32 num, mt7697q_ring_rd_fn xfer,
+                                    void *priv)
+{
+	u32 off = *rd;
+	u32 done = 0;
+	int ret;
+
+	while (done < num) {
+		u32 n = mt7697q_ring_rd_span(size, off, wr);
+
+		if (n > num - done)
+			n = num - done;
+		if (!n)
+			break;
+
+		ret = xfer(priv, off, &buf[done], n);
+		if (ret < 0)
+			return ret;
+
+		done += n;
+		off = mt7697q_ring_advance(size, off, n);
+	}
+
+	*rd = off;
+	return done;
+}
+
+/*
+ * Write up to num words at *wr, as many as fit without overtaking the reader,
+ * in at most two transfers. Returns the number of words written and advances
+ * *wr past them. A failed transfer returns its error and leaves *wr alone, so
+ * the words written before it are overwritten by the next write.
+ */
+static inline int mt7697q_ring_write(u32 size, u32 rd, u32 *wr,
+                                     const u32 *buf, u32 num,
+                                     mt7697q_ring_wr_fn xfer, void *priv)
+{
+	u32 off = *wr;
+	u32 done = 0;
+	int ret;
+
+	while (done < num) {
+		u32 n = mt7697q_ring_wr_span(size, rd, off);
+
+		if (n > num - done)
+			n = num - done;
+		if (!n)
+			break;
+
+		ret = xfer(priv, off, &buf[done], n);
+		if (ret < 0)
+			return ret;
+
+		done += n;
+		off = mt7697q_ring_advance(size, off, n);
+	}
+
+	*wr = off;
+	return done;
+}
+
+#endif
@@ -66,6 +66,7 @@ static const struct mt7697spi_hw_ops hw_ops =
 	.write			= spi_write,
 	.read			= spi_read,
 	.write_then_read	= mt7697spi_write_then_read,
+	.sync			= spi_sync,
 	.reset			= mt7697spi_reset,
 	.enable_irq		= mt7697spi_enable_irq,
 	.disable_irq		= mt7697spi_disable_irq,
@@ -142,8 +143,22 @@ static int __init mt7697spi_init(void)
 	qinfo->hw_priv = spi;
 	qinfo->hw_ops = &hw_ops;
 
+	qinfo->burst = kzalloc(sizeof(struct mt7697io_burst), GFP_KERNEL);
+	if (!qinfo->burst) {
+		dev_err(qinfo->dev, "%s(): create burst buffer failed\n",
+		        __func__);
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	ret = mt7697q_stats_init(qinfo);
+	if (ret < 0) {
+		dev_err(qinfo->dev, "%s(): mt7697q_stats_init() failed(%d)\n",
+		        __func__, ret);
+		goto cleanup;
+	}
+
 	mutex_init(&qinfo->mutex);
-	INIT_DELAYED_WORK(&qinfo->irq_delayed_work, mt7697q_irq_delayed_work);
 	INIT_WORK(&qinfo->irq_work, mt7697q_irq_work);
 
 	qinfo->irq_workq = alloc_workqueue(DRVNAME"wq",
@@ -152,7 +167,7 @@ static int __init mt7697spi_init(void)
 		dev_err(qinfo->dev, "%s(): alloc_workqueue() failed\n",
 		        __func__);
 		ret = -ENOMEM;
-		goto cleanup;
+		goto failed_stats;
 	}
 
 	qinfo->gpio_pin = MT7697_SPI_INTR_GPIO_PIN;
@@ -172,9 +187,10 @@ static int __init mt7697spi_init(void)
 	}
 
 	dev_info(qinfo->dev, "%s(): request irq(%d)\n", __func__, qinfo->irq);
-	ret = request_irq(qinfo->irq, mt7697q_isr, 0, DRVNAME, qinfo);
+	ret = request_threaded_irq(qinfo->irq, mt7697q_isr, mt7697q_irq_thread,
+	                           0, DRVNAME, qinfo);
 	if (ret < 0) {
-		dev_err(qinfo->dev, "%s(): request_irq() failed(%d)",
+		dev_err(qinfo->dev, "%s(): request_threaded_irq() failed(%d)",
 		        __func__, ret);
 		goto failed_gpio_req;
 	}
@@ -192,8 +208,14 @@ failed_gpio_req:
 failed_workqueue:
 	destroy_workqueue(qinfo->irq_workq);
 
+failed_stats:
+	mt7697q_stats_exit(qinfo);
+
 cleanup:
-	if (qinfo) kfree(qinfo);
+	if (qinfo) {
+		kfree(qinfo->burst);
+		kfree(qinfo);
+	}
 	return ret;
 }
 
@@ -243,13 +265,16 @@ static void __exit mt7697spi_exit(void)
 	}
 
 	dev_info(qinfo->dev, "%s(): remove '%s'\n", __func__, DRVNAME);
-	cancel_delayed_work_sync(&qinfo->irq_delayed_work);
+	/* Keep the interrupt off while any poll still running finishes */
+	disable_irq(qinfo->irq);
 	cancel_work_sync(&qinfo->irq_work);
 	flush_workqueue(qinfo->irq_workq);
 	destroy_workqueue(qinfo->irq_workq);
 
 	free_irq(qinfo->irq, qinfo);
 	if (qinfo->gpio_pin > 0) gpio_free(qinfo->gpio_pin);
+	mt7697q_stats_exit(qinfo);
+	kfree(qinfo->burst);
 	kfree(qinfo);
 
 cleanup:
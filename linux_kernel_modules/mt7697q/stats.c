@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include "queue.h"
+#include "spi.h"
+#include "stats.h"
+
+/*
+ * Sum a u64 member over all CPUs. The values are read without locking, so a
+ * concurrent update may or may not be included.
+ */
+#define MT7697Q_STATS_SUM(pcpu, member) ({				\
+	u64 __sum = 0;							\
+	int __cpu;							\
+	for_each_possible_cpu(__cpu)					\
+		__sum += per_cpu_ptr(pcpu, __cpu)->member;		\
+	__sum;								\
+})
+
+static int mt7697q_stats_show(struct seq_file *s, void *data)
+{
+	const struct mt7697q_info *qinfo = s->private;
+
+#define SHOW(member) \
+	seq_printf(s, "%-17s %llu\n", #member ":",			\
+	           MT7697Q_STATS_SUM(qinfo->stats, member))
+
+	SHOW(rd_words);
+	SHOW(wr_words);
+	SHOW(spi_msgs);
+	SHOW(spi_xfers);
+	SHOW(slave_wait_spins);
+	SHOW(busy_retries);
+	SHOW(fallbacks);
+	SHOW(irqs);
+	SHOW(polls);
+	SHOW(idle_wakeups);
+	SHOW(budget_exhausted);
+#undef SHOW
+
+	return 0;
+}
+
+static int mt7697q_queue_stats_show(struct seq_file *s, void *data)
+{
+	const struct mt7697q_spec *qs = s->private;
+	unsigned int i;
+
+#define SHOW(member) \
+	seq_printf(s, "%-15s %llu\n", #member ":",			\
+	           MT7697Q_STATS_SUM(qs->stats, member))
+
+	SHOW(words);
+	SHOW(msgs);
+	SHOW(spi_msgs);
+	SHOW(eagain);
+	SHOW(blocked_notify);
+#undef SHOW
+
+	seq_printf(s, "latency (us):\n");
+	for (i = 0; i < MT7697Q_LATENCY_BUCKETS; i++) {
+		const u64 count = MT7697Q_STATS_SUM(qs->stats, latency[i]);
+
+		if (i == 0)
+			seq_printf(s, "  %7s-%-7u %llu\n", "0", 1, count);
+		else if (i < MT7697Q_LATENCY_BUCKETS - 1)
+			seq_printf(s, "  %7u-%-7u %llu\n",
+			           1 << (i - 1), 1 << i, count);
+		else
+			seq_printf(s, "  %7u+%-7s %llu\n",
+			           1 << (i - 1), "", count);
+	}
+
+	return 0;
+}
+
+static int mt7697q_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mt7697q_stats_show, inode->i_private);
+}
+
+static int mt7697q_queue_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mt7697q_queue_stats_show, inode->i_private);
+}
+
+static const struct file_operations mt7697q_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mt7697q_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static const struct file_operations mt7697q_queue_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mt7697q_queue_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Account the delivery of a message against the interrupt that started the
+ * poll. A zero irq_time means the poll was not started by an interrupt, so
+ * there is nothing to measure against.
+ */
+void mt7697q_stats_latency(struct mt7697q_spec *qs, ktime_t irq_time)
+{
+	s64 us;
+	unsigned int bucket;
+
+	if (!ktime_to_ns(irq_time))
+		return;
+
+	us = ktime_us_delta(ktime_get(), irq_time);
+	bucket = (us > 0) ? fls(min_t(s64, us, U32_MAX)) : 0;
+
+	if (bucket >= MT7697Q_LATENCY_BUCKETS)
+		bucket = MT7697Q_LATENCY_BUCKETS - 1;
+
+	this_cpu_inc(qs->stats->latency[bucket]);
+}
+
+int mt7697q_stats_init(struct mt7697q_info *qinfo)
+{
+	char name[16];
+	u8 ch;
+	int ret;
+
+	qinfo->stats = alloc_percpu(struct mt7697q_stats);
+	if (!qinfo->stats) {
+		dev_err(qinfo->dev, "%s(): alloc_percpu() failed\n", __func__);
+		ret = -ENOMEM;
+		goto failed;
+	}
+
+	for (ch = 0; ch < MT7697_NUM_QUEUES; ch++) {
+		qinfo->queues[ch].stats =
+			alloc_percpu(struct mt7697q_queue_stats);
+		if (!qinfo->queues[ch].stats) {
+			dev_err(qinfo->dev, "%s(): alloc_percpu() failed\n",
+			        __func__);
+			ret = -ENOMEM;
+			goto failed;
+		}
+	}
+
+	/* Statistics still work without debugfs */
+	qinfo->debugfs = debugfs_create_dir(DRVNAME, NULL);
+	if (IS_ERR_OR_NULL(qinfo->debugfs)) {
+		dev_warn(qinfo->dev, "%s(): debugfs_create_dir() failed\n",
+		         __func__);
+		qinfo->debugfs = NULL;
+		return 0;
+	}
+
+	debugfs_create_file("stats", S_IRUSR, qinfo->debugfs, qinfo,
+	                    &mt7697q_stats_fops);
+	for (ch = 0; ch < MT7697_NUM_QUEUES; ch++) {
+		snprintf(name, sizeof(name), "queue%u", ch);
+		debugfs_create_file(name, S_IRUSR, qinfo->debugfs,
+		                    &qinfo->queues[ch],
+		                    &mt7697q_queue_stats_fops);
+	}
+
+	return 0;
+
+failed:
+	mt7697q_stats_exit(qinfo);
+	return ret;
+}
+
+void mt7697q_stats_exit(struct mt7697q_info *qinfo)
+{
+	u8 ch;
+
+	debugfs_remove_recursive(qinfo->debugfs);
+	qinfo->debugfs = NULL;
+
+	for (ch = 0; ch < MT7697_NUM_QUEUES; ch++) {
+		free_percpu(qinfo->queues[ch].stats);
+		qinfo->queues[ch].stats = NULL;
+	}
+
+	free_percpu(qinfo->stats);
+	qinfo->stats = NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MT7697_STATS_H_
+#define _MT7697_STATS_H_
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+
+/*
+ * IRQ to delivery latency histogram. Bucket 0 counts latencies below 1us and
+ * bucket n counts [2^(n-1), 2^n) us. The last bucket also counts everything
+ * above.
+ */
+#define MT7697Q_LATENCY_BUCKETS			20
+
+/*
+ * Statistics are kept per CPU, so that they can be updated with this_cpu_*()
+ * from any context without locking. Readers sum the CPUs.
+ */
+struct mt7697q_stats {
+	/* Bridge I/O */
+	u64                             rd_words;
+	u64                             wr_words;
+	u64                             spi_msgs;
+	u64                             spi_xfers;
+	u64                             slave_wait_spins;
+	u64                             busy_retries;
+	u64                             fallbacks;
+
+	/* Interrupt handling */
+	u64                             irqs;
+	u64                             polls;
+	u64                             idle_wakeups;
+	u64                             budget_exhausted;
+};
+
+struct mt7697q_queue_stats {
+	u64                             words;
+	u64                             msgs;
+	u64                             spi_msgs;
+	u64                             eagain;
+	u64                             blocked_notify;
+	u64                             latency[MT7697Q_LATENCY_BUCKETS];
+};
+
+struct mt7697q_info;
+struct mt7697q_spec;
+
+int mt7697q_stats_init(struct mt7697q_info*);
+void mt7697q_stats_exit(struct mt7697q_info*);
+void mt7697q_stats_latency(struct mt7697q_spec*, ktime_t);
+
+#endif
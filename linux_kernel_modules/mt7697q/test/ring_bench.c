@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Throughput of the queue ring against the simulated slave. For each queue
+ * and message size the host streams messages to the slave and reads them
+ * back through the other queue, and the words moved per second and SPI
+ * transfers per message are reported. The copies are memcpy() on the host,
+ * so the figures measure the ring bookkeeping and the number of transfers,
+ * not the SPI bus.
+ *
+ * Usage: ring_bench [words]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sim.h"
+
+#define BENCH_M2S		0
+#define BENCH_S2M		1
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_run(u32 qsize, u32 msg_len, unsigned long words)
+{
+	static struct sim_slave slave;
+	static u32 buf[SIM_MAX_QUEUE_WORDS];
+	const u32 sizes[SIM_NUM_QUEUES] = { qsize, qsize };
+	unsigned long recv = 0;
+	unsigned long msgs = 0;
+	struct sim_hq m2s;
+	struct sim_hq s2m;
+	double start;
+	double secs;
+	u32 n;
+	int ret;
+
+	sim_slave_init(&slave, sizes, 1);
+	sim_hq_open(&m2s, &slave, BENCH_M2S);
+	sim_hq_open(&s2m, &slave, BENCH_S2M);
+	for (n = 0; n < msg_len; n++)
+		buf[n] = n;
+
+	start = bench_now();
+	while (recv < words) {
+		/* Host to slave, until the queue is full */
+		while ((ret = sim_hq_write(&m2s, buf, msg_len)) > 0) {
+			msgs++;
+		}
+
+		if (ret != -EAGAIN) {
+			fprintf(stderr, "write failed(%d)\n", ret);
+			exit(EXIT_FAILURE);
+		}
+
+		/* The slave echoes what it received on the other queue */
+		while (mt7697q_ring_free(qsize, slave.desc[BENCH_S2M].rd_offset,
+		                         slave.desc[BENCH_S2M].wr_offset) >=
+		       msg_len &&
+		       sim_slave_recv(&slave, BENCH_M2S, buf, msg_len))
+			sim_slave_send(&slave, BENCH_S2M, buf, msg_len);
+
+		while ((ret = sim_hq_read(&s2m, buf, msg_len)) > 0)
+			recv += ret;
+	}
+	secs = bench_now() - start;
+
+	printf("%6u %6u %12.1f %10.2f\n", qsize, msg_len,
+	       2.0 * recv / secs / 1e6, (double)slave.xfers / msgs / 2);
+}
+
+int main(int argc, char *argv[])
+{
+	static const u32 qsizes[] = { 256, 1024, 4096 };
+	static const u32 msg_lens[] = { 4, 16, 64, 400 };
+	const unsigned long words = (argc > 1) ?
+		strtoul(argv[1], NULL, 0) : 1UL << 26;
+	unsigned int i;
+	unsigned int j;
+
+	printf("%6s %6s %12s %10s\n", "queue", "msg", "Mwords/s", "xfers/msg");
+	for (i = 0; i < sizeof(qsizes) / sizeof(qsizes[0]); i++) {
+		for (j = 0; j < sizeof(msg_lens) / sizeof(msg_lens[0]); j++) {
+			if (msg_lens[j] < qsizes[i])
+				bench_run(qsizes[i], msg_lens[j], words);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Host tests for the queue ring arithmetic and transfer helpers in ring.h.
+ *
+ * The first passes check the arithmetic and the read/write helpers, with
+ * their transfer callbacks, for every offset pair of small rings. The
+ * stress pass then runs a host and a simulated MT7697 slave against each
+ * other over both queue directions, interleaving writers and readers at
+ * random with random message and chunk sizes, and with injected transfer
+ * failures on the host side. Every message carries a sequence number and a
+ * payload pattern, so lost, duplicated, reordered or torn messages are
+ * caught by the consumer.
+ *
+ * Usage: ring_test [iterations [seed]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define TEST_M2S		0
+#define TEST_S2M		1
+
+#define MSG_MAGIC		0x5a000000
+#define MSG_MAX_WORDS		SIM_MAX_QUEUE_WORDS
+
+#define CHECK(cond, ...)						\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);	\
+			fprintf(stderr, __VA_ARGS__);			\
+			fprintf(stderr, "\n");				\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+struct msg_src {
+	u32 seq;
+	u32 len;			/* words of the pending message */
+	u32 buf[MSG_MAX_WORDS];
+};
+
+/* Consumer side, the stream may arrive in arbitrary chunks */
+struct msg_sink {
+	u32 seq;
+	u32 len;			/* words of the current message */
+	u32 pos;			/* words of it received so far */
+	unsigned long msgs;
+	unsigned long words;
+};
+
+static u32 msg_word(u32 seq, u32 i)
+{
+	return (seq * 0x9e3779b9) ^ (i * 0x85ebca6b);
+}
+
+static void msg_next(struct msg_src *src, u32 len)
+{
+	u32 i;
+
+	src->len = len;
+	src->buf[0] = MSG_MAGIC | ((src->seq & 0xff) << 16) | len;
+	for (i = 1; i < len; i++)
+		src->buf[i] = msg_word(src->seq, i);
+}
+
+static void msg_consume(struct msg_sink *sink, const u32 *buf, u32 num)
+{
+	u32 i;
+
+	for (i = 0; i < num; i++) {
+		const u32 w = buf[i];
+
+		if (!sink->pos) {
+			CHECK((w & 0xff000000) == MSG_MAGIC,
+			      "msg(%u) bad header(0x%08x)", sink->seq, w);
+			CHECK(((w >> 16) & 0xff) == (sink->seq & 0xff),
+			      "msg(%u) out of sequence(0x%08x)", sink->seq, w);
+			sink->len = w & 0xffff;
+			CHECK(sink->len, "msg(%u) empty", sink->seq);
+		} else {
+			CHECK(w == msg_word(sink->seq, sink->pos),
+			      "msg(%u) word(%u) corrupt(0x%08x)",
+			      sink->seq, sink->pos, w);
+		}
+
+		if (++sink->pos == sink->len) {
+			sink->pos = 0;
+			sink->seq++;
+			sink->msgs++;
+		}
+	}
+
+	sink->words += num;
+}
+
+static void check_exhaustive(void)
+{
+	u32 size;
+	u32 rd;
+	u32 wr;
+
+	for (size = 2; size < 40; size++) {
+		for (rd = 0; rd < size; rd++) {
+			for (wr = 0; wr < size; wr++) {
+				const u32 used = mt7697q_ring_used(size, rd, wr);
+				const u32 free = mt7697q_ring_free(size, rd, wr);
+				u32 n = 0;
+				u32 o;
+				int k;
+
+				CHECK(mt7697q_ring_valid(size, rd, wr),
+				      "size(%u) rd(%u) wr(%u) invalid",
+				      size, rd, wr);
+				CHECK(used + free == size - 1,
+				      "size(%u) rd(%u) wr(%u) used(%u) free(%u)",
+				      size, rd, wr, used, free);
+
+				/* Filling takes at most two spans */
+				for (o = wr, k = 0; k < 2; k++) {
+					const u32 span = mt7697q_ring_wr_span(
+						size, rd, o);
+
+					n += span;
+					o = mt7697q_ring_advance(size, o, span);
+				}
+				CHECK(n == free && !mt7697q_ring_wr_span(size, rd, o),
+				      "size(%u) rd(%u) wr(%u) fill(%u/%u)",
+				      size, rd, wr, n, free);
+				CHECK(mt7697q_ring_advance(size, o, 1) == rd,
+				      "size(%u) rd(%u) wr(%u) full at(%u)",
+				      size, rd, wr, o);
+
+				/* Draining too */
+				for (n = 0, o = rd, k = 0; k < 2; k++) {
+					const u32 span = mt7697q_ring_rd_span(
+						size, o, wr);
+
+					n += span;
+					o = mt7697q_ring_advance(size, o, span);
+				}
+				CHECK(n == used && o == wr,
+				      "size(%u) rd(%u) wr(%u) drain(%u/%u)",
+				      size, rd, wr, n, used);
+			}
+
+			CHECK(!mt7697q_ring_valid(size, rd, size),
+			      "size(%u) wr(%u) out of range accepted", size, size);
+		}
+	}
+}
+
+/* Transfer callbacks for check_helper(), failing the call numbered fail_at */
+struct xfer_log {
+	u32 *ring;
+	unsigned int calls;
+	unsigned int fail_at;
+};
+
+static int xfer_rd(void *priv, u32 off, u32 *buf, u32 num)
+{
+	struct xfer_log *log = priv;
+
+	if (++log->calls == log->fail_at)
+		return -EIO;
+
+	memcpy(buf, &log->ring[off], num * sizeof(u32));
+	return 0;
+}
+
+static int xfer_wr(void *priv, u32 off, const u32 *buf, u32 num)
+{
+	struct xfer_log *log = priv;
+
+	if (++log->calls == log->fail_at)
+		return -EIO;
+
+	memcpy(&log->ring[off], buf, num * sizeof(u32));
+	return 0;
+}
+
+/*
+ * mt7697q_ring_read/write take at most two transfers, move the words the
+ * spans allow to the right place, and leave the caller's offset alone when
+ * a transfer fails.
+ */
+static void check_helper(u32 size, u32 rd, u32 wr, u32 num)
+{
+	const u32 free = mt7697q_ring_free(size, rd, wr);
+	const u32 used = mt7697q_ring_used(size, rd, wr);
+	struct xfer_log log = { NULL, 0, 0 };
+	u32 ring[SIM_MAX_QUEUE_WORDS];
+	u32 buf[SIM_MAX_QUEUE_WORDS];
+	u32 off;
+	u32 i;
+	int ret;
+
+	for (i = 0; i < size; i++) {
+		ring[i] = 0xdead0000 | i;
+		buf[i] = 0xbeef0000 | i;
+	}
+	log.ring = ring;
+
+	off = wr;
+	ret = mt7697q_ring_write(size, rd, &off, buf, num, xfer_wr, &log);
+	CHECK(ret == (int)(num < free ? num : free) && log.calls <= 2 &&
+	      off == mt7697q_ring_advance(size, wr, ret),
+	      "write size(%u) rd(%u) wr(%u) num(%u) ret(%d) calls(%u)",
+	      size, rd, wr, num, ret, log.calls);
+	for (i = 0; i < (u32)ret; i++)
+		CHECK(ring[mt7697q_ring_advance(size, wr, i)] == buf[i],
+		      "write size(%u) wr(%u) word(%u)", size, wr, i);
+
+	log.calls = 0;
+	off = rd;
+	ret = mt7697q_ring_read(size, &off, wr, buf, num, xfer_rd, &log);
+	CHECK(ret == (int)(num < used ? num : used) && log.calls <= 2 &&
+	      off == mt7697q_ring_advance(size, rd, ret),
+	      "read size(%u) rd(%u) wr(%u) num(%u) ret(%d) calls(%u)",
+	      size, rd, wr, num, ret, log.calls);
+	for (i = 0; i < (u32)ret; i++)
+		CHECK(buf[i] == ring[mt7697q_ring_advance(size, rd, i)],
+		      "read size(%u) rd(%u) word(%u)", size, rd, i);
+
+	/* Fail the first, then the second transfer */
+	for (log.fail_at = 1; log.fail_at <= 2; log.fail_at++) {
+		log.calls = 0;
+		off = wr;
+		ret = mt7697q_ring_write(size, rd, &off, buf, num, xfer_wr,
+		                         &log);
+		CHECK(log.calls < log.fail_at || (ret == -EIO && off == wr),
+		      "write size(%u) rd(%u) wr(%u) num(%u) fail(%u)",
+		      size, rd, wr, num, log.fail_at);
+
+		log.calls = 0;
+		off = rd;
+		ret = mt7697q_ring_read(size, &off, wr, buf, num, xfer_rd,
+		                        &log);
+		CHECK(log.calls < log.fail_at || (ret == -EIO && off == rd),
+		      "read size(%u) rd(%u) wr(%u) num(%u) fail(%u)",
+		      size, rd, wr, num, log.fail_at);
+	}
+}
+
+static void check_helpers(void)
+{
+	u32 size;
+	u32 rd;
+	u32 wr;
+	u32 num;
+
+	for (size = 2; size < 40; size++)
+		for (rd = 0; rd < size; rd++)
+			for (wr = 0; wr < size; wr++)
+				for (num = 0; num < size; num++)
+					check_helper(size, rd, wr, num);
+}
+
+static void check_desc(const struct sim_slave *s, unsigned int ch)
+{
+	const struct sim_desc *d = &s->desc[ch];
+
+	CHECK(mt7697q_ring_valid(d->flags, d->rd_offset, d->wr_offset),
+	      "queue(%u) size(%u) rd(%u) wr(%u) invalid",
+	      ch, d->flags, d->rd_offset, d->wr_offset);
+}
+
+static u32 rand_len(unsigned int *seed, u32 max)
+{
+	const unsigned int r = sim_rand(seed);
+
+	/* Mostly small messages, like the WMI traffic, some huge ones */
+	if ((r & 0xf) == 0)
+		return 1 + (r >> 4) % max;
+
+	return 1 + (r >> 4) % (max < 32 ? max : 32);
+}
+
+static void check_stress(unsigned int seed, const u32 sizes[SIM_NUM_QUEUES],
+                         unsigned long steps)
+{
+	static struct sim_slave slave;
+	static struct msg_src m2s_src;
+	static struct msg_src s2m_src;
+	static u32 buf[MSG_MAX_WORDS];
+	struct msg_sink m2s_sink = { 0 };
+	struct msg_sink s2m_sink = { 0 };
+	struct sim_hq m2s;
+	struct sim_hq s2m;
+	unsigned long i;
+	u32 n;
+	int ret;
+
+	sim_slave_init(&slave, sizes, seed);
+	sim_hq_open(&m2s, &slave, TEST_M2S);
+	sim_hq_open(&s2m, &slave, TEST_S2M);
+	slave.fail_rate = 0x800;
+
+	m2s_src.seq = 0;
+	s2m_src.seq = 0;
+	msg_next(&m2s_src, rand_len(&seed, sizes[TEST_M2S] - 1));
+	msg_next(&s2m_src, rand_len(&seed, sizes[TEST_S2M] - 1));
+
+	for (i = 0; i < steps; i++) {
+		switch (sim_rand(&seed) % 4) {
+		case 0:
+			ret = sim_hq_write(&m2s, m2s_src.buf, m2s_src.len);
+			if (ret == -EAGAIN || ret == -EIO) {
+				/* Nothing published, same message again */
+				CHECK(m2s.wr == slave.desc[TEST_M2S].wr_offset,
+				      "step(%lu) write(%d) moved wr(%u/%u)", i,
+				      ret, m2s.wr,
+				      slave.desc[TEST_M2S].wr_offset);
+				break;
+			}
+
+			CHECK(ret == (int)m2s_src.len, "step(%lu) write(%d)",
+			      i, ret);
+			m2s_src.seq++;
+			msg_next(&m2s_src, rand_len(&seed, sizes[TEST_M2S] - 1));
+			break;
+
+		case 1:
+			n = sim_slave_recv(&slave, TEST_M2S, buf,
+			                   1 + sim_rand(&seed) % sizes[TEST_M2S]);
+			msg_consume(&m2s_sink, buf, n);
+			break;
+
+		case 2:
+			if (sim_slave_send(&slave, TEST_S2M, s2m_src.buf,
+			                   s2m_src.len)) {
+				s2m_src.seq++;
+				msg_next(&s2m_src,
+				         rand_len(&seed, sizes[TEST_S2M] - 1));
+			}
+			break;
+
+		case 3:
+			ret = sim_hq_read(&s2m, buf,
+			                  1 + sim_rand(&seed) % sizes[TEST_S2M]);
+			if (ret == -EIO)
+				break;
+
+			CHECK(ret >= 0, "step(%lu) read(%d)", i, ret);
+			msg_consume(&s2m_sink, buf, ret);
+			break;
+		}
+
+		check_desc(&slave, TEST_M2S);
+		check_desc(&slave, TEST_S2M);
+	}
+
+	/* Drain both directions, nothing may be left half delivered */
+	slave.fail_rate = 0;
+	while ((n = sim_slave_recv(&slave, TEST_M2S, buf, MSG_MAX_WORDS)))
+		msg_consume(&m2s_sink, buf, n);
+	while ((ret = sim_hq_read(&s2m, buf, MSG_MAX_WORDS)) > 0)
+		msg_consume(&s2m_sink, buf, ret);
+
+	CHECK(m2s_sink.seq == m2s_src.seq && !m2s_sink.pos,
+	      "seed(%u) m2s sent(%u) received(%u) pos(%u)",
+	      seed, m2s_src.seq, m2s_sink.seq, m2s_sink.pos);
+	CHECK(s2m_sink.seq == s2m_src.seq && !s2m_sink.pos,
+	      "seed(%u) s2m sent(%u) received(%u) pos(%u)",
+	      seed, s2m_src.seq, s2m_sink.seq, s2m_sink.pos);
+	CHECK(m2s_sink.msgs && s2m_sink.msgs, "seed(%u) no traffic", seed);
+}
+
+int main(int argc, char *argv[])
+{
+	static const u32 sizes[] = { 2, 3, 7, 16, 61, 256, 1024, 4096 };
+	const unsigned int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const unsigned long iterations = (argc > 1) ?
+		strtoul(argv[1], NULL, 0) : 200;
+	unsigned int seed = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1;
+	unsigned long i;
+
+	check_exhaustive();
+	printf("exhaustive: ok\n");
+
+	check_helpers();
+	printf("helpers: ok\n");
+
+	for (i = 0; i < iterations; i++) {
+		const unsigned int run = seed;
+		u32 q[SIM_NUM_QUEUES];
+
+		q[TEST_M2S] = sizes[sim_rand(&seed) % num_sizes];
+		q[TEST_S2M] = sizes[sim_rand(&seed) % num_sizes];
+		check_stress(run, q, 20000);
+		seed = sim_rand(&seed);
+	}
+
+	printf("stress: %lu runs ok\n", iterations);
+	return EXIT_SUCCESS;
+}
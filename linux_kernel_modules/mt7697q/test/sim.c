@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "sim.h"
+
+unsigned int sim_rand(unsigned int *state)
+{
+	/* xorshift32, reproducible across libcs */
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+void sim_slave_init(struct sim_slave *s, const u32 sizes[SIM_NUM_QUEUES],
+                    unsigned int seed)
+{
+	unsigned int ch;
+
+	memset(s, 0, sizeof(*s));
+	s->rand_state = seed ? seed : 1;
+	for (ch = 0; ch < SIM_NUM_QUEUES; ch++) {
+		assert(sizes[ch] > 1 && sizes[ch] <= SIM_MAX_QUEUE_WORDS);
+		s->desc[ch].flags = sizes[ch];
+		s->desc[ch].base_addr = ch * SIM_MAX_QUEUE_WORDS * sizeof(u32);
+	}
+}
+
+static int sim_xfer_fails(struct sim_slave *s)
+{
+	return s->fail_rate &&
+	       (sim_rand(&s->rand_state) & 0xffff) < s->fail_rate;
+}
+
+/*
+ * Host access to a queue buffer, one SPI message per call. These stand in
+ * for mt7697q_ring_rd()/mt7697q_ring_wr() in queue.c, the ring handling
+ * around them is the driver's own, from ring.h.
+ */
+static int sim_hq_xfer_rd(void *priv, u32 off, u32 *buf, u32 num)
+{
+	struct sim_hq *q = priv;
+	struct sim_slave *s = q->slave;
+
+	s->xfers++;
+	if (sim_xfer_fails(s))
+		return -EIO;
+
+	memcpy(buf, &s->mem[q->base / sizeof(u32) + off], num * sizeof(u32));
+	s->xfer_words += num;
+	return 0;
+}
+
+static int sim_hq_xfer_wr(void *priv, u32 off, const u32 *buf, u32 num)
+{
+	struct sim_hq *q = priv;
+	struct sim_slave *s = q->slave;
+
+	s->xfers++;
+	if (sim_xfer_fails(s))
+		return -EIO;
+
+	memcpy(&s->mem[q->base / sizeof(u32) + off], buf, num * sizeof(u32));
+	s->xfer_words += num;
+	return 0;
+}
+
+void sim_hq_open(struct sim_hq *q, struct sim_slave *s, unsigned int ch)
+{
+	q->slave = s;
+	q->ch = ch;
+	q->size = s->desc[ch].flags;
+	q->base = s->desc[ch].base_addr;
+	q->rd = s->desc[ch].rd_offset;
+	q->wr = s->desc[ch].wr_offset;
+	assert(mt7697q_ring_valid(q->size, q->rd, q->wr));
+}
+
+/*
+ * Write num words as one message, in the steps of mt7697q_write(): reserve,
+ * write behind a copy of the write offset, commit it and push it with the
+ * mailbox bit. Returns -EAGAIN if the words don't fit even after refreshing
+ * the reader's offset.
+ */
+int sim_hq_write(struct sim_hq *q, const u32 *buf, u32 num)
+{
+	u32 wr = q->wr;
+	int ret;
+
+	if (mt7697q_ring_free(q->size, q->rd, q->wr) < num) {
+		q->slave->xfers++;
+		q->rd = q->slave->desc[q->ch].rd_offset;
+		if (mt7697q_ring_free(q->size, q->rd, q->wr) < num)
+			return -EAGAIN;
+	}
+
+	ret = mt7697q_ring_write(q->size, q->rd, &wr, buf, num,
+	                         sim_hq_xfer_wr, q);
+	if (ret < 0)
+		return ret;
+
+	assert((u32)ret == num);
+	q->wr = wr;
+	q->slave->xfers += 2;
+	q->slave->desc[q->ch].wr_offset = q->wr;
+	q->slave->m2s_mbx |= 1 << q->ch;
+	return ret;
+}
+
+/* Read up to num words the slave has published, like mt7697q_read() */
+int sim_hq_read(struct sim_hq *q, u32 *buf, u32 num)
+{
+	int ret;
+
+	q->slave->xfers++;
+	q->wr = q->slave->desc[q->ch].wr_offset;
+
+	ret = mt7697q_ring_read(q->size, &q->rd, q->wr, buf, num,
+	                        sim_hq_xfer_rd, q);
+	if (ret > 0) {
+		q->slave->xfers++;
+		q->slave->desc[q->ch].rd_offset = q->rd;
+	}
+
+	return ret;
+}
+
+/* The slave works on its own memory */
+static int sim_slave_xfer_rd(void *priv, u32 off, u32 *buf, u32 num)
+{
+	const u32 *mem = priv;
+
+	memcpy(buf, &mem[off], num * sizeof(u32));
+	return 0;
+}
+
+static int sim_slave_xfer_wr(void *priv, u32 off, const u32 *buf, u32 num)
+{
+	u32 *mem = priv;
+
+	memcpy(&mem[off], buf, num * sizeof(u32));
+	return 0;
+}
+
+u32 sim_slave_recv(struct sim_slave *s, unsigned int ch, u32 *buf, u32 num)
+{
+	struct sim_desc *d = &s->desc[ch];
+	u32 rd = d->rd_offset;
+	int ret;
+
+	s->m2s_mbx &= ~(1 << ch);
+	ret = mt7697q_ring_read(d->flags, &rd, d->wr_offset, buf, num,
+	                        sim_slave_xfer_rd,
+	                        &s->mem[d->base_addr / sizeof(u32)]);
+	assert(ret >= 0);
+
+	d->rd_offset = rd;
+	return ret;
+}
+
+u32 sim_slave_send(struct sim_slave *s, unsigned int ch, const u32 *buf,
+                   u32 num)
+{
+	struct sim_desc *d = &s->desc[ch];
+	u32 wr = d->wr_offset;
+	int ret;
+
+	if (mt7697q_ring_free(d->flags, d->rd_offset, wr) < num)
+		return 0;
+
+	ret = mt7697q_ring_write(d->flags, d->rd_offset, &wr, buf, num,
+	                         sim_slave_xfer_wr,
+	                         &s->mem[d->base_addr / sizeof(u32)]);
+	assert((u32)ret == num);
+
+	d->wr_offset = wr;
+	return ret;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MT7697Q_SIM_H_
+#define _MT7697Q_SIM_H_
+
+/*
+ * User space model of the MT7697 side of the SPI queues. The slave memory
+ * holds one descriptor per queue followed by the queue buffers, like the
+ * firmware lays them out. The host accesses it only through counted,
+ * word-sized transfers, as it would over SPI, and signals the slave through a
+ * mailbox bit per queue. The slave side works on its memory directly.
+ *
+ * Both sides move words in and out of the queues with mt7697q_ring_read()
+ * and mt7697q_ring_write() from ring.h, the same code the driver uses. Only
+ * the transfers, the pointer exchange and the slave are simulated here.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../ring.h"
+
+typedef uint16_t u16;
+
+#define SIM_NUM_QUEUES		2
+#define SIM_MAX_QUEUE_WORDS	4096
+
+/* Same layout as struct mt7697q_data */
+struct sim_desc {
+	u32 flags;
+	u32 base_addr;
+	u16 rd_offset;
+	u16 reserved1;
+	u16 wr_offset;
+	u16 reserved2;
+};
+
+struct sim_slave {
+	struct sim_desc desc[SIM_NUM_QUEUES];
+	u32 mem[SIM_NUM_QUEUES * SIM_MAX_QUEUE_WORDS];
+
+	u32 m2s_mbx;			/* queues the host has signalled */
+
+	unsigned long xfers;		/* host transfers, SPI messages */
+	unsigned long xfer_words;
+
+	/*
+	 * Fault injection: when non zero, each host data transfer fails
+	 * with this probability (out of 65536). Descriptor accesses never
+	 * fail, see sim_hq_write.
+	 */
+	unsigned int fail_rate;
+	unsigned int rand_state;
+};
+
+/* Host view of one queue, like struct mt7697q_spec */
+struct sim_hq {
+	struct sim_slave *slave;
+	unsigned int ch;
+	u32 size;
+	u32 base;
+	u32 rd;
+	u32 wr;
+};
+
+unsigned int sim_rand(unsigned int *state);
+
+void sim_slave_init(struct sim_slave *s, const u32 sizes[SIM_NUM_QUEUES],
+                    unsigned int seed);
+
+/* Host side, the steps of mt7697q_write/mt7697q_read in queue.c */
+void sim_hq_open(struct sim_hq *q, struct sim_slave *s, unsigned int ch);
+int sim_hq_write(struct sim_hq *q, const u32 *buf, u32 num);
+int sim_hq_read(struct sim_hq *q, u32 *buf, u32 num);
+
+/* Slave side: consume from a host-to-slave queue, produce into the other */
+u32 sim_slave_recv(struct sim_slave *s, unsigned int ch, u32 *buf, u32 num);
+u32 sim_slave_send(struct sim_slave *s, unsigned int ch, const u32 *buf,
+                   u32 num);
+
+#endif
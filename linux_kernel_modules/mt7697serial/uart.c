@@ -10,6 +10,8 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/file.h>
 #include <linux/delay.h>
@@ -97,38 +99,143 @@ cleanup:
 	return ret;
 }
 
+static size_t mt7697_uart_rx_avail(const struct mt7697_uart_info *uart_info)
+{
+	return uart_info->rx_tail - uart_info->rx_head;
+}
+
+/*
+ * Make sure at least need bytes are buffered. Each read asks the tty for all
+ * the room left in the buffer, so one read usually covers several messages.
+ */
+static int mt7697_uart_rx_fill(struct mt7697_uart_info *uart_info, size_t need)
+{
+	mm_segment_t oldfs;
+	size_t avail;
+	int ret = 0;
+
+	WARN_ON(need > MT7697_UART_RX_BUF_LEN);
+
+	oldfs = get_fs();
+	set_fs(get_ds());
+
+	while ((avail = mt7697_uart_rx_avail(uart_info)) < need) {
+		if (MT7697_UART_RX_BUF_LEN - uart_info->rx_head < need) {
+			memmove(uart_info->rx_buf,
+			        &uart_info->rx_buf[uart_info->rx_head], avail);
+			uart_info->rx_head = 0;
+			uart_info->rx_tail = avail;
+		}
+
+		ret = mt7697_uart_rx_poll(uart_info);
+		if (ret)
+			goto cleanup;
+
+		ret = kernel_read(uart_info->fd_hndl, 0,
+		                  &uart_info->rx_buf[uart_info->rx_tail],
+		                  MT7697_UART_RX_BUF_LEN - uart_info->rx_tail);
+		dev_dbg(uart_info->dev, "%s(): read(%d)\n", __func__, ret);
+		if (ret < 0) {
+			dev_err(uart_info->dev,
+			        "%s(): kernel_read() failed(%d)\n", __func__,
+			        ret);
+			goto cleanup;
+		} else if (!ret) {
+			dev_warn(uart_info->dev, "%s(): CLOSED\n", __func__);
+			ret = -EPIPE;
+			goto cleanup;
+		}
+
+		uart_info->rx_tail += ret;
+		uart_info->stats.rx_reads++;
+		uart_info->stats.rx_bytes += ret;
+		ret = 0;
+	}
+
+cleanup:
+	set_fs(oldfs);
+	return ret;
+}
+
+static void mt7697_uart_rx_consume(struct mt7697_uart_info *uart_info,
+                                   size_t len)
+{
+	uart_info->rx_head += len;
+	uart_info->rx_msg_left -= min(uart_info->rx_msg_left, len);
+	if (uart_info->rx_head == uart_info->rx_tail) {
+		uart_info->rx_head = 0;
+		uart_info->rx_tail = 0;
+	}
+}
+
+/* Drop the rest of a message its handler did not read */
+static int mt7697_uart_rx_skip(struct mt7697_uart_info *uart_info)
+{
+	size_t len;
+	int ret = 0;
+
+	while (uart_info->rx_msg_left) {
+		ret = mt7697_uart_rx_fill(uart_info, 1);
+		if (ret)
+			goto cleanup;
+
+		len = min(uart_info->rx_msg_left,
+		          mt7697_uart_rx_avail(uart_info));
+		uart_info->stats.rx_skipped += len;
+		mt7697_uart_rx_consume(uart_info, len);
+	}
+
+cleanup:
+	return ret;
+}
+
+/*
+ * The link has no framing of its own, so a lost or corrupt byte leaves the
+ * stream misaligned. Only headers that look like a message the MT7697 sends
+ * are accepted. Anything else is skipped a byte at a time until one does.
+ */
+static bool mt7697_uart_valid_hdr(const struct mt7697_rsp_hdr *rsp)
+{
+	return ((rsp->cmd.grp == MT7697_CMD_GRP_UART) ||
+	        (rsp->cmd.grp == MT7697_CMD_GRP_80211) ||
+	        (rsp->cmd.grp == MT7697_CMD_GRP_BT)) &&
+	       (rsp->cmd.len >= sizeof(struct mt7697_rsp_hdr)) &&
+	       (rsp->cmd.len <= MT7697_UART_MAX_MSG_LEN);
+}
+
 static void mt7697_uart_rx_work(struct work_struct *rx_work)
 {
 	struct mt7697_uart_info* uart_info = container_of(rx_work,
 	                                                  struct mt7697_uart_info, rx_work);
-	size_t ret;
 	int err;
 
 	while (1) {
-		ret = mt7697_uart_rx_poll(uart_info);
-		if (ret) {
+		err = mt7697_uart_rx_fill(uart_info,
+		                          sizeof(struct mt7697_rsp_hdr));
+		if (err) {
 			dev_err(uart_info->dev,
-			        "%s(): mt7697_uart_rx_poll() failed(%d)\n",
-			        __func__, ret);
+			        "%s(): mt7697_uart_rx_fill() failed(%d)\n",
+			        __func__, err);
 			goto cleanup;
 		}
 
-		ret = mt7697_uart_read(uart_info, (u32*)&uart_info->rsp,
-		                       LEN_TO_WORD(sizeof(struct mt7697_rsp_hdr)));
-		if (ret != LEN_TO_WORD(sizeof(struct mt7697_rsp_hdr))) {
-			if (ret) {
-				dev_err(uart_info->dev,
-				        "%s(): mt7697_uart_read() failed(%d != %d)\n",
-				        __func__, ret,
-				        LEN_TO_WORD(sizeof(struct mt7697_rsp_hdr)));
-			} else {
-				dev_warn(uart_info->dev, "%s(): closed\n",
-				         __func__);
-			}
-
-			goto cleanup;
+		memcpy(&uart_info->rsp, &uart_info->rx_buf[uart_info->rx_head],
+		       sizeof(struct mt7697_rsp_hdr));
+		if (!mt7697_uart_valid_hdr(&uart_info->rsp)) {
+			dev_warn_ratelimited(uart_info->dev,
+			                     "%s(): bad header grp(%u) len(%u), resync\n",
+			                     __func__, uart_info->rsp.cmd.grp,
+			                     uart_info->rsp.cmd.len);
+			uart_info->stats.rx_resyncs++;
+			mt7697_uart_rx_consume(uart_info, 1);
+			continue;
 		}
 
+		mt7697_uart_rx_consume(uart_info, sizeof(struct mt7697_rsp_hdr));
+		uart_info->rx_msg_left = LEN_TO_WORD(uart_info->rsp.cmd.len -
+			sizeof(struct mt7697_rsp_hdr)) * sizeof(u32);
+		uart_info->stats.rx_msgs++;
+
 		if (uart_info->rsp.result < 0) {
 			dev_warn(uart_info->dev,
 			         "%s(): cmd(%u) result(%d)\n",
@@ -166,6 +273,14 @@ static void mt7697_uart_rx_work(struct work_struct *rx_work)
 				        __func__, err);
 			}
 		}
+
+		err = mt7697_uart_rx_skip(uart_info);
+		if (err) {
+			dev_err(uart_info->dev,
+			        "%s(): mt7697_uart_rx_skip() failed(%d)\n",
+			        __func__, err);
+			goto cleanup;
+		}
 	}
 
 cleanup:
@@ -222,6 +337,9 @@ void* mt7697_uart_open(rx_hndlr rx_fcn, void* rx_hndl)
 
 	uart_info->rx_fcn = rx_fcn;
 	uart_info->rx_hndl = rx_hndl;
+	uart_info->rx_head = 0;
+	uart_info->rx_tail = 0;
+	uart_info->rx_msg_left = 0;
 	atomic_set(&uart_info->close, 0);
 	schedule_work(&uart_info->rx_work);
 	ret = uart_info;
@@ -281,76 +399,63 @@ cleanup:
 
 EXPORT_SYMBOL(mt7697_uart_close);
 
+/*
+ * Called by rx_fcn() from the Rx work to read the body of the current message.
+ * The data comes from the receive buffer, which is refilled as needed.
+ */
 size_t mt7697_uart_read(void *arg, u32 *buf, size_t len)
 {
-	mm_segment_t oldfs;
 	struct mt7697_uart_info *uart_info = arg;
 	u8* ptr = (u8*)buf;
 	size_t ret = 0;
-	unsigned long count = len * sizeof(u32);
+	size_t count = len * sizeof(u32);
+	size_t num;
 	int err;
 
-	oldfs = get_fs();
-	set_fs(get_ds());
-
 	if (!uart_info->fd_hndl) {
 		dev_err(uart_info->dev, "%s(): device closed\n", __func__);
 		goto cleanup;
 	}
 
-	dev_dbg(uart_info->dev, "%s(): len(%u)\n", __func__, len * sizeof(u32));
-	while (1) {
-		err = kernel_read(uart_info->fd_hndl, 0, ptr, count);
-		dev_dbg(uart_info->dev, "%s(): read(%d)\n", __func__, err);
-		if (err < 0) {
+	dev_dbg(uart_info->dev, "%s(): len(%u)\n", __func__, count);
+	if (count > uart_info->rx_msg_left) {
+		dev_warn(uart_info->dev,
+		         "%s(): read(%u) past end of message(%u)\n",
+		         __func__, count, uart_info->rx_msg_left);
+	}
+
+	while (count) {
+		err = mt7697_uart_rx_fill(uart_info, 1);
+		if (err) {
 			dev_err(uart_info->dev,
-			        "%s(): kernel_read() failed(%d)\n", __func__,
-			        err);
-			goto cleanup;
-		} else if (!err) {
-			dev_warn(uart_info->dev, "%s(): CLOSED\n", __func__);
+			        "%s(): mt7697_uart_rx_fill() failed(%d)\n",
+			        __func__, err);
 			goto cleanup;
 		}
 
-		count -= err;
-		if (!count) break;
-
-		ptr += err;
+		num = min(count, mt7697_uart_rx_avail(uart_info));
+		memcpy(ptr, &uart_info->rx_buf[uart_info->rx_head], num);
+		mt7697_uart_rx_consume(uart_info, num);
+		ptr += num;
+		count -= num;
 	}
 
 	ret = len;
 
 cleanup:
 	dev_dbg(uart_info->dev, "%s(): return(%u)\n", __func__, ret);
-	set_fs(oldfs);
 	return ret;
 }
 
 EXPORT_SYMBOL(mt7697_uart_read);
 
-size_t mt7697_uart_write(void *arg, const u32 *buf, size_t len)
+static int mt7697_uart_wr_buf(struct mt7697_uart_info *uart_info,
+                              const u8 *ptr, size_t left)
 {
-	mm_segment_t oldfs;
 	ssize_t num_write;
-	size_t end = len * sizeof(u32);
-	size_t left = end;
-	size_t ret = 0;
-	struct mt7697_uart_info *uart_info = arg;
-	u8* ptr = (u8*)buf;
-
-	mutex_lock(&uart_info->mutex);
-
-	oldfs = get_fs();
-	set_fs(get_ds());
-
-	if (uart_info->fd_hndl == MT7697_UART_INVALID_FD ||
-	    IS_ERR(uart_info->fd_hndl)) {
-		dev_warn(uart_info->dev, "%s(): device closed\n", __func__);
-		goto cleanup;
-	}
+	int ret = 0;
 
-	dev_dbg(uart_info->dev, "%s(): len(%u)\n", __func__, len);
-	while (1) {
+	while (left) {
 		num_write = kernel_write(uart_info->fd_hndl, ptr, left, 0);
 		dev_dbg(uart_info->dev, "%s(): written(%u)\n", __func__,
 		        num_write);
@@ -358,18 +463,46 @@ size_t mt7697_uart_write(void *arg, const u32 *buf, size_t len)
 			dev_err(uart_info->dev,
 			        "%s(): kernel_write() failed(%d)\n", __func__,
 			        num_write);
+			ret = num_write;
 			goto cleanup;
 		} else if (!num_write) {
 			dev_warn(uart_info->dev, "%s(): CLOSED\n", __func__);
+			ret = -EPIPE;
 			goto cleanup;
 		}
 
+		uart_info->stats.tx_writes++;
+		uart_info->stats.tx_bytes += num_write;
 		left -= num_write;
-		if (!left) break;
-
 		ptr += num_write;
 	}
 
+cleanup:
+	return ret;
+}
+
+size_t mt7697_uart_write(void *arg, const u32 *buf, size_t len)
+{
+	mm_segment_t oldfs;
+	size_t ret = 0;
+	struct mt7697_uart_info *uart_info = arg;
+
+	mutex_lock(&uart_info->mutex);
+
+	oldfs = get_fs();
+	set_fs(get_ds());
+
+	if (uart_info->fd_hndl == MT7697_UART_INVALID_FD ||
+	    IS_ERR(uart_info->fd_hndl)) {
+		dev_warn(uart_info->dev, "%s(): device closed\n", __func__);
+		goto cleanup;
+	}
+
+	dev_dbg(uart_info->dev, "%s(): len(%u)\n", __func__, len);
+	if (mt7697_uart_wr_buf(uart_info, (const u8*)buf, len * sizeof(u32)))
+		goto cleanup;
+
+	uart_info->stats.tx_msgs++;
 	ret = len;
 
 cleanup:
@@ -381,6 +514,98 @@ cleanup:
 
 EXPORT_SYMBOL(mt7697_uart_write);
 
+/*
+ * Write messages made of a header and a byte payload, padding each payload to
+ * a whole number of words. The mutex keeps other writers from interleaving.
+ * Returns the number of messages written.
+ */
+int mt7697_uart_write_sg(void *arg, const struct mt7697_sg *sg, size_t num)
+{
+	static const u8 pad[sizeof(u32)];
+	mm_segment_t oldfs;
+	struct mt7697_uart_info *uart_info = arg;
+	size_t i = 0;
+	int ret = -EPIPE;
+
+	mutex_lock(&uart_info->mutex);
+
+	oldfs = get_fs();
+	set_fs(get_ds());
+
+	if (uart_info->fd_hndl == MT7697_UART_INVALID_FD ||
+	    IS_ERR(uart_info->fd_hndl)) {
+		dev_warn(uart_info->dev, "%s(): device closed\n", __func__);
+		goto cleanup;
+	}
+
+	for (i = 0; i < num; i++) {
+		dev_dbg(uart_info->dev, "%s(): hdr len(%u) data len(%u)\n",
+		        __func__, sg[i].hdr_len, sg[i].len);
+		ret = mt7697_uart_wr_buf(uart_info, (const u8*)sg[i].hdr,
+		                         sg[i].hdr_len * sizeof(u32));
+		if (ret < 0)
+			goto cleanup;
+
+		ret = mt7697_uart_wr_buf(uart_info, sg[i].data, sg[i].len);
+		if (ret < 0)
+			goto cleanup;
+
+		ret = mt7697_uart_wr_buf(uart_info, pad,
+		                         LEN32_ALIGNED(sg[i].len) - sg[i].len);
+		if (ret < 0)
+			goto cleanup;
+	}
+
+	ret = num;
+
+cleanup:
+	uart_info->stats.tx_msgs += i;
+
+	/* A partial message can't be taken back, report the whole ones */
+	if ((ret < 0) && i)
+		ret = i;
+
+	dev_dbg(uart_info->dev, "%s(): return(%d)\n", __func__, ret);
+	set_fs(oldfs);
+	mutex_unlock(&uart_info->mutex);
+	return ret;
+}
+
+EXPORT_SYMBOL(mt7697_uart_write_sg);
+
+static int mt7697_uart_stats_show(struct seq_file *s, void *data)
+{
+	const struct mt7697_uart_info *uart_info = s->private;
+
+#define SHOW(member) \
+	seq_printf(s, "%-11s %llu\n", #member ":", uart_info->stats.member)
+
+	SHOW(rx_bytes);
+	SHOW(rx_reads);
+	SHOW(rx_msgs);
+	SHOW(rx_resyncs);
+	SHOW(rx_skipped);
+	SHOW(tx_bytes);
+	SHOW(tx_writes);
+	SHOW(tx_msgs);
+#undef SHOW
+
+	return 0;
+}
+
+static int mt7697_uart_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mt7697_uart_stats_show, inode->i_private);
+}
+
+static const struct file_operations mt7697_uart_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mt7697_uart_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int mt7697_uart_probe(struct platform_device *pdev)
 {
 	struct mt7697_uart_info* uart_info;
@@ -407,6 +632,17 @@ static int mt7697_uart_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, uart_info);
 
+	/* Statistics still work without debugfs */
+	uart_info->debugfs = debugfs_create_dir(MT7697_UART_DRVNAME, NULL);
+	if (IS_ERR_OR_NULL(uart_info->debugfs)) {
+		dev_warn(&pdev->dev, "%s(): debugfs_create_dir() failed\n",
+		         __func__);
+		uart_info->debugfs = NULL;
+	} else {
+		debugfs_create_file("stats", S_IRUSR, uart_info->debugfs,
+		                    uart_info, &mt7697_uart_stats_fops);
+	}
+
 	dev_info(&pdev->dev, "%s(): '%s' initialized\n", __func__,
 	         MT7697_UART_DRVNAME);
 	return 0;
@@ -433,6 +669,7 @@ static int mt7697_uart_remove(struct platform_device *pdev)
 		        __func__, ret);
 	}
 
+	debugfs_remove_recursive(uart_info->debugfs);
 	kfree(uart_info);
 	return ret;
 }
@@ -26,6 +26,11 @@
 #define MT7697_UART_DEVICE     "/dev/ttyHS0"
 #define MT7697_UART_INVALID_FD NULL
 
+/* Receive buffer, filled with as much as the tty has on each read */
+#define MT7697_UART_RX_BUF_LEN 8192
+/* Longest message accepted as valid while hunting for a header */
+#define MT7697_UART_MAX_MSG_LEN 4096
+
 #define mt7697_uart_shutdown_req mt7697_cmd_hdr
 #define mt7697_uart_shutdown_rsp mt7697_rsp_hdr
 
@@ -34,6 +39,17 @@ enum mt7697_uart_cmd_types {
 	MT7697_CMD_UART_SHUTDOWN_RSP,
 };
 
+struct mt7697_uart_stats {
+	u64                    rx_bytes;
+	u64                    rx_reads;
+	u64                    rx_msgs;
+	u64                    rx_resyncs;
+	u64                    rx_skipped;
+	u64                    tx_bytes;
+	u64                    tx_writes;
+	u64                    tx_msgs;
+};
+
 struct mt7697_uart_info {
 	struct platform_device *pdev;
 	struct device	       *dev;
@@ -49,6 +65,18 @@ struct mt7697_uart_info {
 
 	wait_queue_head_t      close_wq;
 	atomic_t	       close;
+
+	/*
+	 * Only the Rx work reads, so the buffer needs no lock. Bytes in
+	 * [rx_head, rx_tail) have been read from the tty but not consumed.
+	 */
+	u8                     rx_buf[MT7697_UART_RX_BUF_LEN];
+	size_t                 rx_head;
+	size_t                 rx_tail;
+	size_t                 rx_msg_left;
+
+	struct mt7697_uart_stats stats;
+	struct dentry          *debugfs;
 };
 
 #endif
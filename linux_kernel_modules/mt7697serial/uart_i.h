@@ -23,5 +23,6 @@ void* mt7697_uart_open(rx_hndlr, void*);
 int mt7697_uart_close(void*);
 size_t mt7697_uart_read(void*, u32*, size_t);
 size_t mt7697_uart_write(void*, const u32*, size_t);
+int mt7697_uart_write_sg(void*, const struct mt7697_sg*, size_t);
 
 #endif
@@ -481,6 +481,8 @@ static int mt7697_cfg80211_scan(struct wiphy *wiphy,
 {
 	struct mt7697_vif *vif = mt7697_vif_from_wdev(request->wdev);
 	struct mt7697_cfg80211_info *cfg = wiphy_to_cfg(wiphy);
+	u32 mode;
+	u32 option;
 	int ret;
 
 	dev_dbg(cfg->dev, "%s(): START SCAN\n", __func__);
@@ -504,8 +506,15 @@ static int mt7697_cfg80211_scan(struct wiphy *wiphy,
 					GFP_KERNEL);
 	}
 
+	ret = mt7697_scan_cache_begin(cfg, request, &mode, &option);
+	if (ret > 0) {
+		dev_dbg(cfg->dev, "%s(): scan served from cache\n", __func__);
+		ret = 0;
+		goto out;
+	}
+
 	vif->scan_req = request;
-	ret = mt7697_wr_scan_req(cfg, vif->fw_vif_idx, request);
+	ret = mt7697_wr_scan_req(cfg, vif->fw_vif_idx, mode, option, request);
 	if (ret < 0) {
 		dev_err(cfg->dev, "%s(): mt7697_wr_scan_req() failed(%d)\n",
 			__func__, ret);
@@ -1022,7 +1031,7 @@ int mt7697_cfg80211_stop(struct mt7697_vif *vif)
 	struct mt7697_sta *sta, *sta_next;
 	int ret = 0;
 
-	mt7697_tx_stop(vif->cfg);
+	mt7697_tx_stop(vif);
 
 	if (vif->wdev.iftype == NL80211_IFTYPE_STATION) {
 		ret = mt7697_wr_disconnect_req(vif->cfg, NULL);
@@ -1145,6 +1154,7 @@ static int mt7697_cfg80211_vif_init(struct mt7697_vif *vif)
 
 	set_bit(WMM_ENABLED, &vif->flags);
 	spin_lock_init(&vif->if_lock);
+	mt7697_reconnect_init(vif);
 
 	return 0;
 }
@@ -1156,6 +1166,9 @@ static void mt7697_cfg80211_disconnect_work(struct work_struct *work)
 	struct mt7697_cfg80211_info *cfg = vif->cfg;
 	int ret;
 
+	if (mt7697_reconnect_timeout(vif))
+		goto cleanup;
+
 	ret = mt7697_disconnect(vif);
 	if (ret < 0) {
 		dev_err(cfg->dev, "%s(): mt7697_disconnect() failed(%d)\n",
@@ -1194,6 +1207,8 @@ static void mt7697_cleanup_vif(struct mt7697_cfg80211_info *cfg)
 		WARN_ON(vif->sta_count > 0);
 		spin_unlock_bh(&cfg->vif_list_lock);
 
+		del_timer_sync(&vif->disconnect_timer);
+		cancel_work_sync(&vif->disconnect_work);
 		unregister_netdev(vif->ndev);
 
 		spin_lock_bh(&cfg->vif_list_lock);
@@ -1270,6 +1285,11 @@ struct wireless_dev* mt7697_interface_add(struct mt7697_cfg80211_info *cfg,
 		INIT_LIST_HEAD(&vif->sta_list);
 		vif->sta_max = MT7697_MAX_STA;
 
+		skb_queue_head_init(&vif->rx_pool);
+		skb_queue_head_init(&vif->rx_queue);
+		netif_napi_add(ndev, &vif->napi, mt7697_rx_poll,
+			       NAPI_POLL_WEIGHT);
+
 		ndev->addr_assign_type = NET_ADDR_PERM;
 		ndev->addr_len = ETH_ALEN;
 		ndev->dev_addr = cfg->mac_addr.addr;
@@ -1524,8 +1544,6 @@ int mt7697_cfg80211_init(struct mt7697_cfg80211_info *cfg)
 	s32 err = 0;
 
 	dev_dbg(cfg->dev, "%s(): init mt7697 cfg80211\n", __func__);
-	cfg->tx_req.cmd.grp = MT7697_CMD_GRP_80211;
-	cfg->tx_req.cmd.type = MT7697_CMD_TX_RAW;
 
 	cfg->wireless_mode = MT7697_WIFI_PHY_11ABGN_MIXED;
 
@@ -1537,7 +1555,8 @@ int mt7697_cfg80211_init(struct mt7697_cfg80211_info *cfg)
 	                          BIT(NL80211_IFTYPE_ADHOC) |
 	                          BIT(NL80211_IFTYPE_AP));
 
-	wiphy->max_scan_ssids = MT7697_SCAN_MAX_ITEMS;
+	/* firmware scan request carries a single SSID */
+	wiphy->max_scan_ssids = 1;
 	wiphy->max_scan_ie_len = IEEE80211_MAX_SSID_LEN;
 
 	wiphy->max_scan_ie_len = 1000; /* FIX: what is correct limit? */
@@ -1623,9 +1642,14 @@ void mt7697_cfg80211_cleanup(struct mt7697_cfg80211_info *cfg)
 {
 	dev_dbg(cfg->dev, "%s(): cleanup\n", __func__);
 
+	mt7697_reconnect_debugfs_exit(cfg);
+
 	dev_dbg(cfg->dev, "%s(): cleanup vif\n", __func__);
 	mt7697_cleanup_vif(cfg);
 
+	dev_dbg(cfg->dev, "%s(): flush scan cache\n", __func__);
+	mt7697_scan_cache_flush(cfg);
+
 	dev_dbg(cfg->dev, "%s(): destroy Tx workqueues\n", __func__);
 	flush_workqueue(cfg->tx_workq);
 	destroy_workqueue(cfg->tx_workq);
@@ -33,14 +33,19 @@
 #define MT7697_CH_MIN_5G_CHANNEL	34
 #define MT7697_CH_MAX_5G_CHANNEL	216
 
-#define MT7697_SCAN_MAX_ITEMS		16
+#define MT7697_SCAN_MAX_ITEMS		64
 #define MT7697_IFACE_MAX_CNT		4
 #define MT7697_IFACE_NAME_LEN		32
 #define MT7697_MAX_STA			10
 #define MT7697_MAX_MC_FILTERS_PER_LIST 	7
 #define MT7697_MAX_COOKIE_NUM		180
 #define MT7697_TX_TIMEOUT      		10
-#define MT7697_TX_PKT_POOL_LEN		256
+#define MT7697_TX_RING_LEN		256
+#define MT7697_TX_RING_WAKE_THRESH	(MT7697_TX_RING_LEN / 4)
+#define MT7697_TX_BATCH_LEN		16
+#define MT7697_RX_SKB_LEN		LEN32_ALIGNED(IEEE80211_MAX_FRAME_LEN)
+#define MT7697_RX_POOL_LEN		64
+#define MT7697_RX_QUEUE_LEN		256
 /* TODO update below */
 #define MT7697_DISCON_TIMER_INTVAL_MSEC (300 * 1000)
 
@@ -81,9 +86,71 @@ enum mt7697_vif_state {
 	SCHED_SCANNING,
 };
 
-struct mt7697_tx_pkt {
-	struct list_head next;
-	struct sk_buff *skb;
+/*
+ * Frames waiting for the Tx work. There is a single net device, so
+ * ndo_start_xmit() is the only producer (serialized by the netdev Tx lock) and
+ * the Tx work the only consumer. Each index is written by one side only.
+ * The lock only keeps mt7697_notify_tx() from queueing the Tx work once
+ * mt7697_tx_stop() has set stopped.
+ */
+struct mt7697_tx_ring {
+	struct sk_buff *skb[MT7697_TX_RING_LEN];
+	unsigned int head;
+	unsigned int tail;
+	spinlock_t lock;
+	bool stopped;
+};
+
+/*
+ * Scan results keyed by BSSID. Entries are refreshed by every scan indication
+ * and dropped once they have not been seen for the expiry time.
+ */
+struct mt7697_scan_entry {
+	unsigned long seen;
+	u8 bssid[ETH_ALEN];
+	u32 ch;
+	s32 rssi;
+	u32 len;
+	u8 *frame;
+};
+
+struct mt7697_scan_cache {
+	struct mutex lock;
+	struct mt7697_scan_entry entry[MT7697_SCAN_MAX_ITEMS];
+	unsigned long scan_start;
+	unsigned long last_scan;
+	unsigned long last_full;
+	bool partial;
+};
+
+/*
+ * Fast reconnect after a link loss: the last good BSS is retried directly
+ * and, failing that, the strongest cached BSS of the same ESS. Times are in
+ * msec from the disconnect indication to the connect indication.
+ */
+struct mt7697_reconnect {
+	struct mutex lock;
+	bool valid;
+	bool active;
+	bool armed;
+	u8 attempt;
+	u8 ssid_len;
+	u8 ssid[IEEE80211_MAX_SSID_LEN];
+	u8 bssid[ETH_ALEN];
+	u8 target[ETH_ALEN];
+	u32 ch;
+	u8 pmk[MT7697_WIFI_LENGTH_PMK];
+	bool has_pmk;
+	unsigned long lost;
+
+	u32 attempts;
+	u32 directed;
+	u32 alternate;
+	u32 failed;
+	u32 last_ms;
+	u32 min_ms;
+	u32 max_ms;
+	u64 total_ms;
 };
 
 struct mt7697_cfg80211_info {
@@ -99,17 +166,13 @@ struct mt7697_cfg80211_info {
 
 	struct work_struct init_work;
 
-	spinlock_t tx_skb_list_lock;
-	atomic_t tx_skb_pool_idx;
-	struct mt7697_tx_pkt tx_skb_pool[MT7697_TX_PKT_POOL_LEN];
-	struct sk_buff_head tx_skb_queue;
-	struct list_head tx_skb_list;
+	struct mt7697_tx_ring tx_ring;
 	struct workqueue_struct *tx_workq;
 	struct work_struct tx_work;
-	struct mt7697_tx_raw_packet tx_req;
 
-	u8 rx_data[LEN32_ALIGNED(IEEE80211_MAX_FRAME_LEN)];
 	u8 probe_data[LEN32_ALIGNED(IEEE80211_MAX_DATA_LEN)];
+	struct mt7697_scan_cache scan_cache;
+	struct dentry *debugfs;
 
 	enum mt7697_port_type port_type;
 	enum mt7697_wifi_phy_mode_t wireless_mode;
@@ -166,6 +229,7 @@ struct mt7697_vif {
 
 	struct work_struct disconnect_work;
 	struct timer_list disconnect_timer;
+	struct mt7697_reconnect reconnect;
 
 	enum mt7697_wifi_auth_mode_t auth_mode;
 	u8 auto_connect;
@@ -188,6 +252,11 @@ struct mt7697_vif {
 	int reconnect_flag;
 	u8 listen_intvl_t;
 
+	/* Rx frames are read into skbs from rx_pool and queued for NAPI */
+	struct napi_struct napi;
+	struct sk_buff_head rx_pool;
+	struct sk_buff_head rx_queue;
+
 	struct net_device_stats net_stats;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,44)
 	bool locally_generated;
@@ -220,10 +289,29 @@ struct mt7697_vif *mt7697_get_vif_by_idx(struct mt7697_cfg80211_info*, u32);
 struct wireless_dev *mt7697_interface_add(struct mt7697_cfg80211_info*,
 	const char*, enum nl80211_iftype, u8);
 int mt7697_notify_tx(void*, u32);
-void mt7697_tx_stop(struct mt7697_cfg80211_info*);
+void mt7697_tx_start(struct mt7697_vif*);
+void mt7697_tx_stop(struct mt7697_vif*);
 void mt7697_tx_work(struct work_struct*);
 int mt7697_data_tx(struct sk_buff*, struct net_device*);
 int mt7697_rx_data(struct mt7697_cfg80211_info*, u32, u32);
+int mt7697_rx_poll(struct napi_struct*, int);
+void mt7697_rx_refill(struct mt7697_vif*);
+void mt7697_scan_cache_init(struct mt7697_cfg80211_info*);
+void mt7697_scan_cache_flush(struct mt7697_cfg80211_info*);
+int mt7697_scan_cache_update(struct mt7697_cfg80211_info*, u32, s32,
+	const u8*, u32);
+int mt7697_scan_cache_begin(struct mt7697_cfg80211_info*,
+	struct cfg80211_scan_request*, u32*, u32*);
+void mt7697_scan_cache_end(struct mt7697_cfg80211_info*, bool);
+int mt7697_scan_cache_best(struct mt7697_cfg80211_info*, const u8*, u8,
+	const u8*, u8*, u32*);
+void mt7697_reconnect_init(struct mt7697_vif*);
+void mt7697_reconnect_connected(struct mt7697_vif*, const u8*, u32);
+bool mt7697_reconnect_start(struct mt7697_vif*);
+bool mt7697_reconnect_timeout(struct mt7697_vif*);
+void mt7697_reconnect_cancel(struct mt7697_vif*);
+void mt7697_reconnect_debugfs_init(struct mt7697_cfg80211_info*);
+void mt7697_reconnect_debugfs_exit(struct mt7697_cfg80211_info*);
 int mt7697_proc_80211cmd(const struct mt7697_rsp_hdr*, void*);
 
 void mt7697_disconnect_timer_hndlr(unsigned long);
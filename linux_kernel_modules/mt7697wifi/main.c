@@ -55,6 +55,9 @@ static int mt7697_open(struct net_device *ndev)
 
 	dev_dbg(cfg->dev, "%s(): open net device\n", __func__);
 
+	mt7697_rx_refill(vif);
+	napi_enable(&vif->napi);
+
 	if (!cfg->rxq_hdl && !cfg->txq_hdl) {
 		dev_dbg(cfg->dev, "%s(): open mt7697 uart\n", __func__);
 		cfg->txq_hdl = cfg->hif_ops->open(mt7697_proc_80211cmd, cfg);
@@ -67,6 +70,7 @@ static int mt7697_open(struct net_device *ndev)
 	}
 
 	set_bit(WLAN_ENABLED, &vif->flags);
+	mt7697_tx_start(vif);
 
 	if (test_bit(CONNECTED, &vif->flags)) {
 		netif_carrier_on(ndev);
@@ -88,6 +92,11 @@ static int mt7697_stop(struct net_device *ndev)
 	dev_dbg(cfg->dev, "%s(): stop net device\n", __func__);
 	clear_bit(WLAN_ENABLED, &vif->flags);
 
+	/* Nothing refills the pool once NAPI is off, until the next open */
+	napi_disable(&vif->napi);
+	skb_queue_purge(&vif->rx_queue);
+	skb_queue_purge(&vif->rx_pool);
+
 	ret = mt7697_cfg80211_stop(vif);
 	if (ret < 0) {
 		dev_err(cfg->dev,
@@ -194,8 +203,6 @@ void mt7697_init_netdev(struct net_device *ndev)
 	ndev->wireless_handlers = &mt7697_wireless_hndlrs;
 	ndev->destructor = free_netdev;
 	ndev->watchdog_timeo = MT7697_TX_TIMEOUT;
-	ndev->needed_headroom = sizeof(struct ieee80211_hdr) +
-	                        sizeof(struct mt7697_llc_snap_hdr);
 	ndev->hw_features |= NETIF_F_IP_CSUM | NETIF_F_RXCSUM;
 }
 
@@ -229,14 +236,11 @@ static int mt7697_probe(struct platform_device *pdev)
 
 	INIT_WORK(&cfg->init_work, mt7697_init_hw_start);
 	INIT_WORK(&cfg->tx_work, mt7697_tx_work);
+	spin_lock_init(&cfg->tx_ring.lock);
 
 	spin_lock_init(&cfg->vif_list_lock);
 	INIT_LIST_HEAD(&cfg->vif_list);
-
-	spin_lock_init(&cfg->tx_skb_list_lock);
-	INIT_LIST_HEAD(&cfg->tx_skb_list);
-	atomic_set(&cfg->tx_skb_pool_idx, 0);
-	memset(cfg->tx_skb_pool, 0, sizeof(cfg->tx_skb_pool));
+	mt7697_scan_cache_init(cfg);
 
 	mt7697_to_lower(&hw_itf);
 	dev_dbg(&pdev->dev, "%s(): hw_itf('%s')\n", __func__, hw_itf);
@@ -245,12 +249,17 @@ static int mt7697_probe(struct platform_device *pdev)
 		if_ops.shutdown		= mt7697q_shutdown;
 		if_ops.read		= mt7697q_read;
 		if_ops.write		= mt7697q_write;
+		if_ops.write_sg		= mt7697q_write_sg;
+		if_ops.write_sg_all	= mt7697q_write_sg_all;
 		if_ops.unblock_writer	= mt7697q_unblock_writer;
 	} else if (!strcmp(hw_itf, "uart")) {
 		if_ops.open		= mt7697_uart_open;
 		if_ops.close		= mt7697_uart_close;
 		if_ops.read		= mt7697_uart_read;
 		if_ops.write		= mt7697_uart_write;
+		if_ops.write_sg		= mt7697_uart_write_sg;
+		/* The UART blocks until everything is out */
+		if_ops.write_sg_all	= mt7697_uart_write_sg;
 	} else {
 		dev_err(&pdev->dev,
 			"%s(): invalid hw itf(spi/uart) module paramter('%s')\n",
@@ -261,11 +270,12 @@ static int mt7697_probe(struct platform_device *pdev)
 
 	cfg->hif_ops = &if_ops;
 	cfg->dev = &pdev->dev;
-	skb_queue_head_init(&cfg->tx_skb_queue);
 
 	cfg->vif_start = itf_idx_start;
 	cfg->vif_max = MT7697_MAX_STA;
 
+	mt7697_reconnect_debugfs_init(cfg);
+
 	err = mt7697_cfg80211_init(cfg);
 	if (err < 0) {
 		dev_err(&pdev->dev,
@@ -366,6 +376,7 @@ int mt7697_disconnect(struct mt7697_vif *vif)
 	int ret = 0;
 
 	dev_dbg(vif->cfg->dev, "%s(): disconnect\n", __func__);
+	mt7697_reconnect_cancel(vif);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,44)
 	vif->locally_generated = true;
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jiffies.h>
+#include <linux/etherdevice.h>
+#include "common.h"
+#include "core.h"
+
+/*
+ * When the link to the AP is lost the driver first tries to rejoin the last
+ * BSS on its channel, then the strongest other BSS of the same ESS found in
+ * the scan cache. Only when both attempts time out is the disconnect reported
+ * to cfg80211, which falls back to the scan/connect sequence from user space.
+ */
+#define MT7697_RECONNECT_MAX_ATTEMPTS	2
+
+static bool fast_reconnect = true;
+module_param(fast_reconnect, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fast_reconnect, "Reconnect to a known BSS on link loss");
+
+static unsigned int fast_reconnect_timeout_ms = 2000;
+module_param(fast_reconnect_timeout_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fast_reconnect_timeout_ms,
+	"Time (msec) allowed for each fast reconnect attempt");
+
+static void mt7697_reconnect_arm(struct mt7697_vif *vif)
+{
+	vif->reconnect.armed = true;
+	mod_timer(&vif->disconnect_timer,
+		jiffies + msecs_to_jiffies(fast_reconnect_timeout_ms));
+}
+
+static void mt7697_reconnect_disarm(struct mt7697_vif *vif)
+{
+	/* A timer that already fired is consumed by the disconnect work */
+	if (del_timer(&vif->disconnect_timer))
+		vif->reconnect.armed = false;
+}
+
+/* Called with the reconnect lock held */
+static int mt7697_reconnect_attempt(struct mt7697_vif *vif)
+{
+	struct mt7697_reconnect *rc = &vif->reconnect;
+	struct mt7697_cfg80211_info *cfg = vif->cfg;
+	u32 ch;
+	int ret;
+
+	if (rc->attempt >= MT7697_RECONNECT_MAX_ATTEMPTS) {
+		ret = -ETIMEDOUT;
+		goto cleanup;
+	}
+
+	if (!rc->attempt) {
+		memcpy(rc->target, rc->bssid, ETH_ALEN);
+		ch = rc->ch;
+	} else {
+		ret = mt7697_scan_cache_best(cfg, rc->ssid, rc->ssid_len,
+			rc->bssid, rc->target, &ch);
+		if (ret < 0) {
+			dev_dbg(cfg->dev, "%s(): no alternate BSS\n", __func__);
+			goto cleanup;
+		}
+	}
+
+	rc->attempt++;
+	rc->attempts++;
+	dev_dbg(cfg->dev, "%s(): attempt(%u) %pM ch(%u)\n",
+		__func__, rc->attempt, rc->target, ch);
+
+	ret = mt7697_wr_reconnect_req(cfg, vif->fw_vif_idx, rc->ssid,
+		rc->ssid_len, rc->target, ch, rc->has_pmk ? rc->pmk:NULL);
+	if (ret < 0) {
+		dev_err(cfg->dev,
+			"%s(): mt7697_wr_reconnect_req() failed(%d)\n",
+			__func__, ret);
+		goto cleanup;
+	}
+
+	mt7697_reconnect_arm(vif);
+
+cleanup:
+	return ret;
+}
+
+/* Report the link loss that fast reconnect was hiding from cfg80211 */
+static void mt7697_reconnect_give_up(struct mt7697_vif *vif)
+{
+	struct mt7697_cfg80211_info *cfg = vif->cfg;
+	int ret;
+
+	dev_dbg(cfg->dev, "%s(): fast reconnect failed\n", __func__);
+
+	ret = mt7697_wr_disconnect_req(cfg, NULL);
+	if (ret < 0)
+		dev_err(cfg->dev,
+			"%s(): mt7697_wr_disconnect_req() failed(%d)\n",
+			__func__, ret);
+
+	if (vif->sme_state == SME_CONNECTED) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,44)
+		cfg80211_disconnected(vif->ndev, 0, NULL, 0, false,
+				      GFP_KERNEL);
+#else
+		cfg80211_disconnected(vif->ndev, 0, NULL, 0, GFP_KERNEL);
+#endif
+	}
+
+	netif_stop_queue(vif->ndev);
+	vif->sme_state = SME_DISCONNECTED;
+	spin_lock_bh(&vif->if_lock);
+	clear_bit(CONNECT_PEND, &vif->flags);
+	clear_bit(CONNECTED, &vif->flags);
+	spin_unlock_bh(&vif->if_lock);
+}
+
+void mt7697_reconnect_init(struct mt7697_vif *vif)
+{
+	struct mt7697_reconnect *rc = &vif->reconnect;
+
+	memset(rc, 0, sizeof(*rc));
+	mutex_init(&rc->lock);
+}
+
+/*
+ * Connect indication: remember the BSS for the next link loss and, if this
+ * completes a fast reconnect, account for the time it took.
+ */
+void mt7697_reconnect_connected(struct mt7697_vif *vif, const u8 *bssid,
+	                        u32 ch)
+{
+	u8 pmk[MT7697_WIFI_LENGTH_PMK] = {0};
+	struct mt7697_reconnect *rc = &vif->reconnect;
+	u32 ms;
+
+	mutex_lock(&rc->lock);
+
+	if (rc->active) {
+		mt7697_reconnect_disarm(vif);
+		rc->active = false;
+
+		ms = jiffies_to_msecs(jiffies - rc->lost);
+		if (rc->attempt == 1)
+			rc->directed++;
+		else
+			rc->alternate++;
+
+		rc->last_ms = ms;
+		rc->total_ms += ms;
+		if (!rc->min_ms || (ms < rc->min_ms))
+			rc->min_ms = ms;
+		if (ms > rc->max_ms)
+			rc->max_ms = ms;
+
+		dev_dbg(vif->cfg->dev, "%s(): reconnected in %u msec\n",
+			__func__, ms);
+	}
+
+	if ((vif->ssid_len <= 0) || (vif->ssid_len > IEEE80211_MAX_SSID_LEN)) {
+		rc->valid = false;
+		goto cleanup;
+	}
+
+	rc->ssid_len = vif->ssid_len;
+	memcpy(rc->ssid, vif->ssid, vif->ssid_len);
+	memcpy(rc->bssid, bssid, ETH_ALEN);
+	rc->ch = ch;
+	rc->has_pmk = memcmp(pmk, vif->pmk, sizeof(pmk)) != 0;
+	memcpy(rc->pmk, vif->pmk, sizeof(rc->pmk));
+	rc->valid = true;
+
+cleanup:
+	mutex_unlock(&rc->lock);
+}
+
+/*
+ * Disconnect indication for a connected station. Returns true if a fast
+ * reconnect owns the link loss, in which case cfg80211 is not told yet.
+ */
+bool mt7697_reconnect_start(struct mt7697_vif *vif)
+{
+	struct mt7697_reconnect *rc = &vif->reconnect;
+	struct mt7697_cfg80211_info *cfg = vif->cfg;
+	bool handled = false;
+	int ret;
+
+	if (!fast_reconnect || test_bit(DESTROY_IN_PROGRESS, &cfg->flag))
+		goto out;
+
+	mutex_lock(&rc->lock);
+
+	/* A failed attempt, the timeout moves on to the next one */
+	if (rc->active) {
+		handled = true;
+		goto cleanup;
+	}
+
+	if (!rc->valid || (vif->sme_state != SME_CONNECTED))
+		goto cleanup;
+
+	rc->active = true;
+	rc->attempt = 0;
+	rc->lost = jiffies;
+	set_bit(CONNECT_PEND, &vif->flags);
+
+	ret = mt7697_reconnect_attempt(vif);
+	if (ret < 0) {
+		rc->active = false;
+		rc->failed++;
+		clear_bit(CONNECT_PEND, &vif->flags);
+		goto cleanup;
+	}
+
+	handled = true;
+
+cleanup:
+	mutex_unlock(&rc->lock);
+out:
+	return handled;
+}
+
+/*
+ * Disconnect timer expiry. Returns true if the timer belonged to a fast
+ * reconnect, which is then moved to its next attempt or abandoned.
+ */
+bool mt7697_reconnect_timeout(struct mt7697_vif *vif)
+{
+	struct mt7697_reconnect *rc = &vif->reconnect;
+	bool give_up = false;
+	bool handled;
+
+	mutex_lock(&rc->lock);
+
+	handled = rc->armed;
+	rc->armed = false;
+	if (!rc->active)
+		goto cleanup;
+
+	if (mt7697_reconnect_attempt(vif) < 0) {
+		rc->active = false;
+		rc->valid = false;
+		rc->failed++;
+		give_up = true;
+	}
+
+cleanup:
+	mutex_unlock(&rc->lock);
+
+	if (give_up)
+		mt7697_reconnect_give_up(vif);
+
+	return handled;
+}
+
+/* Local disconnect, forget the BSS and stop any reconnect in progress */
+void mt7697_reconnect_cancel(struct mt7697_vif *vif)
+{
+	struct mt7697_reconnect *rc = &vif->reconnect;
+
+	mutex_lock(&rc->lock);
+	mt7697_reconnect_disarm(vif);
+	rc->active = false;
+	rc->valid = false;
+	mutex_unlock(&rc->lock);
+}
+
+static int mt7697_reconnect_show(struct seq_file *s, void *unused)
+{
+	struct mt7697_cfg80211_info *cfg = s->private;
+	struct mt7697_vif *vif;
+
+	spin_lock_bh(&cfg->vif_list_lock);
+	list_for_each_entry(vif, &cfg->vif_list, next) {
+		const struct mt7697_reconnect *rc = &vif->reconnect;
+		const u32 ok = rc->directed + rc->alternate;
+
+		seq_printf(s, "%s:\n", vif->ndev->name);
+		seq_printf(s, "  attempts:  %u\n", rc->attempts);
+		seq_printf(s, "  directed:  %u\n", rc->directed);
+		seq_printf(s, "  alternate: %u\n", rc->alternate);
+		seq_printf(s, "  failed:    %u\n", rc->failed);
+		seq_printf(s, "  last ms:   %u\n", rc->last_ms);
+		seq_printf(s, "  min ms:    %u\n", rc->min_ms);
+		seq_printf(s, "  max ms:    %u\n", rc->max_ms);
+		seq_printf(s, "  avg ms:    %llu\n",
+			   ok ? div_u64(rc->total_ms, ok):0);
+	}
+	spin_unlock_bh(&cfg->vif_list_lock);
+
+	return 0;
+}
+
+static int mt7697_reconnect_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mt7697_reconnect_show, inode->i_private);
+}
+
+static const struct file_operations mt7697_reconnect_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mt7697_reconnect_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void mt7697_reconnect_debugfs_init(struct mt7697_cfg80211_info *cfg)
+{
+	/* Reconnect still works without debugfs */
+	cfg->debugfs = debugfs_create_dir(DRVNAME, NULL);
+	if (IS_ERR_OR_NULL(cfg->debugfs)) {
+		dev_warn(cfg->dev, "%s(): debugfs_create_dir() failed\n",
+		         __func__);
+		cfg->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("reconnect", S_IRUSR, cfg->debugfs, cfg,
+	                    &mt7697_reconnect_fops);
+}
+
+void mt7697_reconnect_debugfs_exit(struct mt7697_cfg80211_info *cfg)
+{
+	debugfs_remove_recursive(cfg->debugfs);
+	cfg->debugfs = NULL;
+}
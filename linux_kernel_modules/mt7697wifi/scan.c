@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2017 Sierra Wireless Corporation
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/etherdevice.h>
+#include "common.h"
+#include "core.h"
+
+/*
+ * Scans requested within this time of the last completed firmware scan are
+ * answered from the cache without using the radio.
+ */
+static unsigned int scan_cache_fresh_ms = 35000;
+module_param(scan_cache_fresh_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(scan_cache_fresh_ms,
+	"Age (msec) below which scan requests are served from the cache (0 - disabled)");
+
+static unsigned int scan_cache_expire_ms = 120000;
+module_param(scan_cache_expire_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(scan_cache_expire_ms,
+	"Age (msec) after which a BSS not seen again is dropped from the cache");
+
+/*
+ * Between full active scans the cache is refreshed with partial passive
+ * scans. A full scan is forced once this interval has elapsed.
+ */
+static unsigned int scan_full_interval_ms = 300000;
+module_param(scan_full_interval_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(scan_full_interval_ms,
+	"Interval (msec) between full active scans (0 - always full)");
+
+static bool mt7697_scan_aged(unsigned long stamp, unsigned int ms)
+{
+	return time_after_eq(jiffies, stamp + msecs_to_jiffies(ms));
+}
+
+static struct ieee80211_channel *mt7697_scan_channel(
+	struct mt7697_cfg80211_info *cfg, u32 ch)
+{
+	struct ieee80211_supported_band *band;
+	u32 freq;
+
+	if ((ch > 0) && (ch <= MT7697_CH_MAX_2G_CHANNEL)) {
+		band = cfg->wiphy->bands[IEEE80211_BAND_2GHZ];
+	} else if ((ch >= MT7697_CH_MIN_5G_CHANNEL) &&
+		   (ch <= MT7697_CH_MAX_5G_CHANNEL)) {
+		band = cfg->wiphy->bands[IEEE80211_BAND_5GHZ];
+	} else {
+		dev_err(cfg->dev, "%s(): invalid channel(%u)\n", __func__, ch);
+		return NULL;
+	}
+
+	if (!band) {
+		dev_err(cfg->dev, "%s(): band not supported channel(%u)\n",
+			__func__, ch);
+		return NULL;
+	}
+
+	freq = ieee80211_channel_to_frequency(ch, band->band);
+	if (!freq) {
+		dev_err(cfg->dev,
+			"%s(): ieee80211_channel_to_frequency() failed\n",
+			__func__);
+		return NULL;
+	}
+
+	return ieee80211_get_channel(cfg->wiphy, freq);
+}
+
+static int mt7697_scan_inform(struct mt7697_cfg80211_info *cfg,
+	                      const struct mt7697_scan_entry *entry)
+{
+	struct ieee80211_channel *channel;
+	struct cfg80211_bss *bss;
+	int ret;
+
+	channel = mt7697_scan_channel(cfg, entry->ch);
+	if (!channel) {
+		dev_err(cfg->dev, "%s(): mt7697_scan_channel() failed\n",
+			__func__);
+		ret = -EINVAL;
+		goto cleanup;
+	}
+
+	bss = cfg80211_inform_bss_frame(cfg->wiphy, channel,
+		(struct ieee80211_mgmt*)entry->frame, entry->len,
+		entry->rssi * 100, GFP_KERNEL);
+	if (!bss) {
+		dev_err(cfg->dev, "%s(): cfg80211_inform_bss_frame() failed\n",
+			__func__);
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+#ifdef DEBUG
+	print_hex_dump(KERN_DEBUG, DRVNAME" BSS BSSID ",
+		DUMP_PREFIX_OFFSET, 16, 1, bss->bssid, ETH_ALEN, 0);
+#endif
+	dev_dbg(cfg->dev,
+		"%s(): BSS signal(%d) scan width(%u) cap(0x%08x)\n",
+		__func__, bss->signal, bss->scan_width, bss->capability);
+	if (bss->channel) {
+		dev_dbg(cfg->dev,
+			"%s(): BSS channel band(%u) center freq(%u)\n",
+			__func__, bss->channel->band,
+			bss->channel->center_freq);
+	}
+
+	cfg80211_put_bss(cfg->wiphy, bss);
+	ret = 0;
+
+cleanup:
+	return ret;
+}
+
+static void mt7697_scan_cache_drop(struct mt7697_scan_entry *entry)
+{
+	kfree(entry->frame);
+	memset(entry, 0, sizeof(*entry));
+}
+
+static void mt7697_scan_cache_expire(struct mt7697_scan_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < MT7697_SCAN_MAX_ITEMS; i++) {
+		struct mt7697_scan_entry *entry = &cache->entry[i];
+
+		if (entry->frame &&
+		    mt7697_scan_aged(entry->seen, scan_cache_expire_ms))
+			mt7697_scan_cache_drop(entry);
+	}
+}
+
+/* Report cached entries last seen before 'before' to cfg80211 */
+static unsigned int mt7697_scan_cache_report(struct mt7697_cfg80211_info *cfg,
+	                                     unsigned long before)
+{
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	unsigned int cnt = 0;
+	unsigned int i;
+
+	for (i = 0; i < MT7697_SCAN_MAX_ITEMS; i++) {
+		const struct mt7697_scan_entry *entry = &cache->entry[i];
+
+		if (!entry->frame || !time_before(entry->seen, before))
+			continue;
+
+		if (!mt7697_scan_inform(cfg, entry))
+			cnt++;
+	}
+
+	return cnt;
+}
+
+static bool mt7697_scan_directed(const struct cfg80211_scan_request *req)
+{
+	return req->n_ssids && req->ssids[0].ssid_len;
+}
+
+void mt7697_scan_cache_init(struct mt7697_cfg80211_info *cfg)
+{
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+
+	memset(cache, 0, sizeof(*cache));
+	mutex_init(&cache->lock);
+}
+
+void mt7697_scan_cache_flush(struct mt7697_cfg80211_info *cfg)
+{
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	unsigned int i;
+
+	mutex_lock(&cache->lock);
+	for (i = 0; i < MT7697_SCAN_MAX_ITEMS; i++)
+		mt7697_scan_cache_drop(&cache->entry[i]);
+
+	cache->last_scan = 0;
+	cache->last_full = 0;
+	mutex_unlock(&cache->lock);
+}
+
+/*
+ * Store a beacon/probe response from a scan indication and report it to
+ * cfg80211. An existing entry for the BSSID is replaced, otherwise a free or
+ * the least recently seen entry is used.
+ */
+int mt7697_scan_cache_update(struct mt7697_cfg80211_info *cfg, u32 ch,
+	                     s32 rssi, const u8 *frame, u32 len)
+{
+	const struct ieee80211_mgmt *mgmt = (const struct ieee80211_mgmt*)frame;
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	struct mt7697_scan_entry *entry = NULL;
+	struct mt7697_scan_entry *oldest = NULL;
+	unsigned int i;
+	int ret;
+
+	if (len < offsetof(struct ieee80211_mgmt, u.probe_resp.variable)) {
+		dev_err(cfg->dev, "%s(): invalid frame len(%u)\n",
+			__func__, len);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&cache->lock);
+
+	for (i = 0; i < MT7697_SCAN_MAX_ITEMS; i++) {
+		struct mt7697_scan_entry *e = &cache->entry[i];
+
+		if (!e->frame) {
+			if (!entry)
+				entry = e;
+			continue;
+		}
+
+		if (ether_addr_equal(e->bssid, mgmt->bssid)) {
+			entry = e;
+			break;
+		}
+
+		if (!oldest || time_before(e->seen, oldest->seen))
+			oldest = e;
+	}
+
+	if (!entry) {
+		dev_dbg(cfg->dev, "%s(): cache full, evict %pM\n",
+			__func__, oldest->bssid);
+		entry = oldest;
+	}
+
+	if (!entry->frame || (entry->len != len)) {
+		u8 *buf = kmalloc(len, GFP_KERNEL);
+		if (!buf) {
+			dev_err(cfg->dev, "%s(): kmalloc() failed\n", __func__);
+			ret = -ENOMEM;
+			goto cleanup;
+		}
+
+		kfree(entry->frame);
+		entry->frame = buf;
+	}
+
+	memcpy(entry->frame, frame, len);
+	memcpy(entry->bssid, mgmt->bssid, ETH_ALEN);
+	entry->len = len;
+	entry->ch = ch;
+	entry->rssi = rssi;
+	entry->seen = jiffies;
+
+	ret = mt7697_scan_inform(cfg, entry);
+	if (ret < 0) {
+		dev_err(cfg->dev, "%s(): mt7697_scan_inform() failed(%d)\n",
+			__func__, ret);
+		mt7697_scan_cache_drop(entry);
+		goto cleanup;
+	}
+
+cleanup:
+	mutex_unlock(&cache->lock);
+out:
+	return ret;
+}
+
+/*
+ * Find the strongest cached BSS advertising the given SSID, other than the
+ * excluded BSSID. Used to pick another AP of the same ESS on reconnect.
+ */
+int mt7697_scan_cache_best(struct mt7697_cfg80211_info *cfg, const u8 *ssid,
+	                   u8 ssid_len, const u8 *exclude, u8 *bssid, u32 *ch)
+{
+	const size_t ie_offset =
+		offsetof(struct ieee80211_mgmt, u.probe_resp.variable);
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	const struct mt7697_scan_entry *best = NULL;
+	unsigned int i;
+	int ret;
+
+	mutex_lock(&cache->lock);
+
+	mt7697_scan_cache_expire(cache);
+
+	for (i = 0; i < MT7697_SCAN_MAX_ITEMS; i++) {
+		const struct mt7697_scan_entry *entry = &cache->entry[i];
+		const struct ieee80211_mgmt *mgmt;
+		const u8 *ie;
+
+		if (!entry->frame || ether_addr_equal(entry->bssid, exclude))
+			continue;
+
+		mgmt = (const struct ieee80211_mgmt*)entry->frame;
+		ie = cfg80211_find_ie(WLAN_EID_SSID, mgmt->u.probe_resp.variable,
+			entry->len - ie_offset);
+		if (!ie || (ie[1] != ssid_len) || memcmp(&ie[2], ssid, ssid_len))
+			continue;
+
+		if (!best || (entry->rssi > best->rssi))
+			best = entry;
+	}
+
+	if (!best) {
+		ret = -ENOENT;
+		goto cleanup;
+	}
+
+	dev_dbg(cfg->dev, "%s(): %pM ch(%u) rssi(%d)\n",
+		__func__, best->bssid, best->ch, best->rssi);
+	memcpy(bssid, best->bssid, ETH_ALEN);
+	*ch = best->ch;
+	ret = 0;
+
+cleanup:
+	mutex_unlock(&cache->lock);
+	return ret;
+}
+
+/*
+ * Decide how to satisfy a scan request. Returns 1 when the request was
+ * completed from the cache, otherwise 0 with the firmware scan mode/option to
+ * use. A partial passive scan is enough to refresh a cache that had a full
+ * scan recently; directed scans always go to the radio.
+ */
+int mt7697_scan_cache_begin(struct mt7697_cfg80211_info *cfg,
+	                    struct cfg80211_scan_request *req,
+	                    u32 *mode, u32 *option)
+{
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	bool directed = mt7697_scan_directed(req);
+	unsigned int cnt;
+	int ret;
+
+	mutex_lock(&cache->lock);
+
+	mt7697_scan_cache_expire(cache);
+
+	if (!directed && scan_cache_fresh_ms && cache->last_scan &&
+	    !mt7697_scan_aged(cache->last_scan, scan_cache_fresh_ms)) {
+		cnt = mt7697_scan_cache_report(cfg, jiffies + 1);
+		dev_dbg(cfg->dev, "%s(): served %u BSS from cache\n",
+			__func__, cnt);
+		if (cnt) {
+			cfg80211_scan_done(req, false);
+			ret = 1;
+			goto cleanup;
+		}
+	}
+
+	if (!directed && scan_full_interval_ms && cache->last_full &&
+	    !mt7697_scan_aged(cache->last_full, scan_full_interval_ms)) {
+		*mode = MT7697_WIFI_SCAN_MODE_PARTIAL;
+		*option = MT7697_WIFI_SCAN_OPTION_PASSIVE;
+		cache->partial = true;
+	} else {
+		*mode = MT7697_WIFI_SCAN_MODE_FULL;
+		*option = MT7697_WIFI_SCAN_OPTION_FORCE_ACTIVE;
+		cache->partial = false;
+	}
+
+	dev_dbg(cfg->dev, "%s(): %s scan\n", __func__,
+		cache->partial ? "partial passive":"full active");
+	cache->scan_start = jiffies;
+	ret = 0;
+
+cleanup:
+	mutex_unlock(&cache->lock);
+	return ret;
+}
+
+/*
+ * Called on scan completion before cfg80211 is notified. BSSs a partial scan
+ * did not hear again are re-reported so the result set stays complete until
+ * they expire.
+ */
+void mt7697_scan_cache_end(struct mt7697_cfg80211_info *cfg, bool aborted)
+{
+	struct mt7697_scan_cache *cache = &cfg->scan_cache;
+	unsigned int cnt;
+
+	if (aborted)
+		return;
+
+	mutex_lock(&cache->lock);
+
+	cache->last_scan = jiffies ? jiffies:1;
+	if (cache->partial) {
+		mt7697_scan_cache_expire(cache);
+		cnt = mt7697_scan_cache_report(cfg, cache->scan_start);
+		dev_dbg(cfg->dev, "%s(): re-reported %u cached BSS\n",
+			__func__, cnt);
+	} else {
+		cache->last_full = cache->last_scan;
+	}
+
+	mutex_unlock(&cache->lock);
+}
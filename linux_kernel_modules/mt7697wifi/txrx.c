@@ -14,158 +14,254 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <linux/circ_buf.h>
 #include <linux/etherdevice.h>
 #include "common.h"
 #include "core.h"
 
+/*
+ * Called when the MT7697 has freed room in a Tx queue that a write found full.
+ * The frames are still in the Tx ring, so restart the Tx work to send them.
+ */
 int mt7697_notify_tx(void* priv, u32 free)
 {
 	struct mt7697_cfg80211_info *cfg = (struct mt7697_cfg80211_info*)priv;
-	int ret = 0;
+	struct mt7697_tx_ring *ring = &cfg->tx_ring;
 
-	spin_lock_bh(&cfg->tx_skb_list_lock);
-	if (!list_empty(&cfg->tx_skb_list)) {
-		struct mt7697_tx_pkt *tx_pkt = list_entry(&cfg->tx_skb_list,
-			struct mt7697_tx_pkt, next);
-		if (tx_pkt->skb->len >= free) {
-			cfg->hif_ops->unblock_writer(cfg->txq_hdl);
-			ret = queue_work(cfg->tx_workq, &cfg->tx_work);
-			if (ret < 0) {
-				dev_err(cfg->dev,
-					"%s(): queue_work() failed(%d)\n",
-					__func__, ret);
-				goto cleanup;
-			}
-		}
-	}
+	dev_dbg(cfg->dev, "%s(): free words(%u)\n", __func__, free);
+	cfg->hif_ops->unblock_writer(cfg->txq_hdl);
 
-cleanup:
-	spin_unlock_bh(&cfg->tx_skb_list_lock);
-	return ret;
+	spin_lock_bh(&ring->lock);
+	if (!ring->stopped &&
+	    CIRC_CNT(ACCESS_ONCE(ring->head), ring->tail, MT7697_TX_RING_LEN))
+		queue_work(cfg->tx_workq, &cfg->tx_work);
+	spin_unlock_bh(&ring->lock);
+
+	return 0;
 }
 
 int mt7697_data_tx(struct sk_buff *skb, struct net_device *ndev)
 {
 	struct mt7697_cfg80211_info *cfg = mt7697_priv(ndev);
-	struct mt7697_vif *vif = netdev_priv(ndev);
-	struct mt7697_tx_pkt *tx_skb;
-	int ret = 0;
-
-	dev_dbg(cfg->dev, "%s(): tx len(%u)\n", __func__, skb->len);
+	struct mt7697_tx_ring *ring = &cfg->tx_ring;
+	const unsigned int head = ring->head;
+	const unsigned int len = skb->len;
 
-	dev_dbg(cfg->dev, "%s(): headroom skb/needed(%u/%u)\n",
-		__func__, skb_headroom(skb), ndev->needed_headroom);
-	if (skb_headroom(skb) < ndev->needed_headroom) {
-		struct sk_buff *tmp_skb = skb;
+	dev_dbg(cfg->dev, "%s(): tx len(%u)\n", __func__, len);
 
-		skb = skb_realloc_headroom(skb, ndev->needed_headroom);
-		kfree_skb(tmp_skb);
-		if (skb == NULL) {
-			dev_dbg(cfg->dev, "%s(): tx dropped\n", __func__);
-			goto cleanup;
-		}
+	if (!CIRC_SPACE(head, ACCESS_ONCE(ring->tail), MT7697_TX_RING_LEN)) {
+		/* Only reached if the queue was woken from elsewhere */
+		dev_dbg(cfg->dev, "%s(): tx ring full\n", __func__);
+		netif_stop_queue(ndev);
+		return NETDEV_TX_BUSY;
 	}
 
-	tx_skb = &cfg->tx_skb_pool[atomic_read(&cfg->tx_skb_pool_idx)];
-	if (tx_skb->skb) {
-		dev_warn(cfg->dev, "%s(): tx pool full\n",
-			__func__);
-		ret = NETDEV_TX_BUSY;
-		goto cleanup;
-	}
-
-	tx_skb->skb = skb;
-	dev_dbg(cfg->dev, "%s(): tx pkt(%u/%p)\n",
-		__func__, atomic_read(&cfg->tx_skb_pool_idx), tx_skb->skb);
-
-	atomic_inc(&cfg->tx_skb_pool_idx);
-	if (atomic_read(&cfg->tx_skb_pool_idx) >= MT7697_TX_PKT_POOL_LEN)
-		atomic_set(&cfg->tx_skb_pool_idx, 0);
+	/* Account the bytes before the Tx work can complete them */
+	ring->skb[head] = skb;
+	netdev_sent_queue(ndev, len);
+	smp_store_release(&ring->head, (head + 1) & (MT7697_TX_RING_LEN - 1));
 
-	spin_lock_bh(&cfg->tx_skb_list_lock);
-	list_add_tail(&tx_skb->next, &cfg->tx_skb_list);
-	spin_unlock_bh(&cfg->tx_skb_list_lock);
+	if (!CIRC_SPACE(ring->head, ACCESS_ONCE(ring->tail),
+			MT7697_TX_RING_LEN)) {
+		netif_stop_queue(ndev);
 
-	ret = queue_work(cfg->tx_workq, &cfg->tx_work);
-	if (ret < 0) {
-		dev_err(cfg->dev, "%s(): queue_work() failed(%d)\n",
-			__func__, ret);
-		ret = NETDEV_TX_BUSY;
-		goto cleanup;
+		/* Pairs with the barrier in mt7697_tx_work() */
+		smp_mb();
+		if (CIRC_SPACE(ring->head, ACCESS_ONCE(ring->tail),
+			       MT7697_TX_RING_LEN) >= MT7697_TX_RING_WAKE_THRESH)
+			netif_wake_queue(ndev);
 	}
 
+	queue_work(cfg->tx_workq, &cfg->tx_work);
 	return NETDEV_TX_OK;
+}
 
-cleanup:
-	vif->net_stats.tx_dropped++;
-	vif->net_stats.tx_aborted_errors++;
+static void mt7697_tx_complete(struct sk_buff *skb, bool sent)
+{
+	struct mt7697_vif *vif = netdev_priv(skb->dev);
 
-	dev_kfree_skb(skb);
-	return ret;
+	if (sent) {
+		dev_dbg(vif->cfg->dev, "%s(): tx complete pkt(%p)\n",
+			__func__, skb);
+		vif->net_stats.tx_packets++;
+		vif->net_stats.tx_bytes += skb->len;
+		dev_consume_skb_any(skb);
+	} else {
+		vif->net_stats.tx_errors++;
+		dev_kfree_skb_any(skb);
+	}
 }
 
+/*
+ * Drain the Tx ring, up to MT7697_TX_BATCH_LEN frames per queue write. When
+ * the MT7697 queue is full the remaining frames stay in the ring until
+ * mt7697_notify_tx() restarts the work.
+ */
 void mt7697_tx_work(struct work_struct *work)
 {
 	struct mt7697_cfg80211_info *cfg = container_of(work,
 		struct mt7697_cfg80211_info, tx_work);
-	struct mt7697_tx_pkt *tx_pkt, *tx_pkt_next = NULL;
-	struct ieee80211_hdr *hdr;
+	struct mt7697_tx_ring *ring = &cfg->tx_ring;
+	struct sk_buff *skb[MT7697_TX_BATCH_LEN];
+	struct net_device *ndev = NULL;
+	unsigned int tail = ring->tail;
+	unsigned int bytes;
+	unsigned int num;
+	unsigned int done;
+	unsigned int sent;
+	unsigned int i;
 	int ret;
 
-	list_for_each_entry_safe(tx_pkt, tx_pkt_next, &cfg->tx_skb_list, next) {
-		struct mt7697_vif *vif = netdev_priv(tx_pkt->skb->dev);
-		WARN_ON(!vif);
-
-		/* validate length for ether packet */
-		if (tx_pkt->skb->len < sizeof(*hdr)) {
-			dev_err(cfg->dev, "%s(): invalid skb len(%u < %u)\n",
-				__func__, tx_pkt->skb->len, sizeof(*hdr));
-			vif->net_stats.tx_errors++;
-		}
-
-		ret = mt7697_wr_tx_raw_packet(cfg, tx_pkt->skb->data,
-			tx_pkt->skb->len);
-		if (ret < 0) {
-			dev_dbg(cfg->dev,
-				"%s(): mt7697_wr_tx_raw_packet() failed(%d)\n",
+	while (1) {
+		const unsigned int head = smp_load_acquire(&ring->head);
+
+		num = min_t(unsigned int, MT7697_TX_BATCH_LEN,
+			    CIRC_CNT(head, tail, MT7697_TX_RING_LEN));
+		if (!num)
+			break;
+
+		for (i = 0; i < num; i++)
+			skb[i] = ring->skb[(tail + i) & (MT7697_TX_RING_LEN - 1)];
+
+		ndev = skb[0]->dev;
+		ret = mt7697_wr_tx_raw_packets(cfg, skb, num);
+		if (ret == -EAGAIN) {
+			dev_dbg(cfg->dev, "%s(): tx queue full\n", __func__);
+			break;
+		} else if (ret < 0) {
+			/* Drop the batch rather than retry it forever */
+			dev_err(cfg->dev,
+				"%s(): mt7697_wr_tx_raw_packets() failed(%d)\n",
 				__func__, ret);
-			vif->net_stats.tx_errors++;
+			done = num;
+			sent = 0;
+		} else {
+			done = ret;
+			sent = ret;
 		}
 
-		dev_dbg(cfg->dev, "%s(): tx complete pkt(%p)\n", __func__,
-			tx_pkt->skb);
-		vif->net_stats.tx_packets++;
-		vif->net_stats.tx_bytes += tx_pkt->skb->len;
-
-		spin_lock_bh(&cfg->tx_skb_list_lock);
-		list_del(&tx_pkt->next);
-		spin_unlock_bh(&cfg->tx_skb_list_lock);
+		bytes = 0;
+		for (i = 0; i < done; i++) {
+			bytes += skb[i]->len;
+			mt7697_tx_complete(skb[i], i < sent);
+		}
 
-		__skb_queue_tail(&cfg->tx_skb_queue, tx_pkt->skb);
-		tx_pkt->skb = NULL;
+		tail = (tail + done) & (MT7697_TX_RING_LEN - 1);
+		smp_store_release(&ring->tail, tail);
+		netdev_completed_queue(ndev, done, bytes);
 	}
 
-	__skb_queue_purge(&cfg->tx_skb_queue);
+	if (ndev && netif_queue_stopped(ndev) && netif_carrier_ok(ndev)) {
+		/* Pairs with the barrier in mt7697_data_tx() */
+		smp_mb();
+		if (CIRC_SPACE(ACCESS_ONCE(ring->head), tail,
+			       MT7697_TX_RING_LEN) >= MT7697_TX_RING_WAKE_THRESH)
+			netif_wake_queue(ndev);
+	}
 }
 
-void mt7697_tx_stop(struct mt7697_cfg80211_info *cfg)
+void mt7697_tx_start(struct mt7697_vif *vif)
 {
-	struct mt7697_tx_pkt *tx_pkt, *tx_pkt_next = NULL;
+	struct mt7697_tx_ring *ring = &vif->cfg->tx_ring;
 
-	list_for_each_entry_safe(tx_pkt, tx_pkt_next, &cfg->tx_skb_list, next) {
-		struct mt7697_vif *vif = netdev_priv(tx_pkt->skb->dev);
-		WARN_ON(!vif);
+	spin_lock_bh(&ring->lock);
+	ring->stopped = false;
+	spin_unlock_bh(&ring->lock);
+}
 
+void mt7697_tx_stop(struct mt7697_vif *vif)
+{
+	struct mt7697_cfg80211_info *cfg = vif->cfg;
+	struct mt7697_tx_ring *ring = &cfg->tx_ring;
+
+	/*
+	 * Stop both the producer and the consumer before taking over. Once
+	 * stopped is set, mt7697_notify_tx() can't queue the work again.
+	 */
+	netif_tx_disable(vif->ndev);
+	spin_lock_bh(&ring->lock);
+	ring->stopped = true;
+	spin_unlock_bh(&ring->lock);
+	cancel_work_sync(&cfg->tx_work);
+
+	while (ring->tail != ring->head) {
 		dev_dbg(cfg->dev, "%s(): tx drop pkt(%p)\n", __func__,
-			tx_pkt->skb);
+			ring->skb[ring->tail]);
 		vif->net_stats.tx_dropped++;
+		dev_kfree_skb_any(ring->skb[ring->tail]);
+		ring->tail = (ring->tail + 1) & (MT7697_TX_RING_LEN - 1);
+	}
+
+	netdev_reset_queue(vif->ndev);
+}
+
+static struct sk_buff *mt7697_rx_skb_get(struct mt7697_vif *vif)
+{
+	struct sk_buff *skb;
+
+	skb = skb_dequeue(&vif->rx_pool);
+	if (!skb)
+		skb = netdev_alloc_skb_ip_align(vif->ndev, MT7697_RX_SKB_LEN);
+
+	return skb;
+}
+
+/* Return an skb that never reached the stack to the pool */
+static void mt7697_rx_skb_put(struct mt7697_vif *vif, struct sk_buff *skb)
+{
+	if (skb_queue_len(&vif->rx_pool) >= MT7697_RX_POOL_LEN) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	skb_trim(skb, 0);
+	skb_queue_tail(&vif->rx_pool, skb);
+}
+
+void mt7697_rx_refill(struct mt7697_vif *vif)
+{
+	struct sk_buff *skb;
+
+	while (skb_queue_len(&vif->rx_pool) < MT7697_RX_POOL_LEN) {
+		skb = netdev_alloc_skb_ip_align(vif->ndev, MT7697_RX_SKB_LEN);
+		if (!skb)
+			break;
 
-		spin_lock_bh(&cfg->tx_skb_list_lock);
-		list_del(&tx_pkt->next);
-		spin_unlock_bh(&cfg->tx_skb_list_lock);
+		skb_queue_tail(&vif->rx_pool, skb);
 	}
 }
 
+/* Consume a frame that has nowhere to go so the queue stays in step */
+static int mt7697_rx_discard(struct mt7697_cfg80211_info *cfg, u32 len)
+{
+	u32 buf[32];
+	size_t words = LEN_TO_WORD(len);
+	int ret = 0;
+
+	while (words) {
+		const size_t num = min(words, ARRAY_SIZE(buf));
+
+		ret = cfg->hif_ops->read(cfg->rxq_hdl, buf, num);
+		if (ret != num) {
+			dev_err(cfg->dev, "%s(): read() failed(%d != %d)\n",
+				__func__, ret, num);
+			ret = (ret < 0) ? ret:-EIO;
+			goto cleanup;
+		}
+
+		words -= num;
+	}
+
+	ret = 0;
+
+cleanup:
+	return ret;
+}
+
+/*
+ * Read a frame from the MT7697 straight into an skb from the vif's pool and
+ * hand it to NAPI. Runs in the queue's process context.
+ */
 int mt7697_rx_data(struct mt7697_cfg80211_info *cfg, u32 len, u32 if_idx)
 {
 	struct mt7697_vif *vif;
@@ -175,66 +271,95 @@ int mt7697_rx_data(struct mt7697_cfg80211_info *cfg, u32 len, u32 if_idx)
 
 	vif = mt7697_get_vif_by_idx(cfg, if_idx);
 	if (!vif) {
-		dev_err(cfg->dev, "%s(): mt7697_get_vif_by_idx(%u) failed\n",
-			    __func__, if_idx);
-		ret = -EINVAL;
-		goto cleanup;
+		dev_dbg(cfg->dev, "%s(): no interface(%u)\n",
+			__func__, if_idx);
+		goto discard;
 	}
 
 	dev_dbg(cfg->dev, "%s(): vif(%u)\n", __func__, vif->fw_vif_idx);
 	if (!(vif->ndev->flags & IFF_UP)) {
 		dev_warn(cfg->dev, "%s(): net device NOT up\n", __func__);
-		ret = -EINVAL;
-		goto cleanup;
+		goto discard;
 	}
 
 	if ((len < sizeof(*hdr)) || (len > IEEE80211_MAX_FRAME_LEN)) {
 		dev_warn(cfg->dev, "%s(): invalid Rx frame size(%u)\n",
 			__func__, len);
 		vif->net_stats.rx_length_errors++;
-		ret = -EINVAL;
-		goto cleanup;
+		vif->net_stats.rx_errors++;
+		goto discard;
+	}
+
+	if (skb_queue_len(&vif->rx_queue) >= MT7697_RX_QUEUE_LEN) {
+		dev_dbg(cfg->dev, "%s(): rx backlog full\n", __func__);
+		vif->net_stats.rx_dropped++;
+		goto discard;
 	}
 
-	skb = dev_alloc_skb(len);
+	skb = mt7697_rx_skb_get(vif);
 	if (!skb) {
-		dev_err(cfg->dev, "%s(): dev_alloc_skb() failed\n", __func__);
-		ret = -ENOMEM;
+		dev_err(cfg->dev, "%s(): no rx skb\n", __func__);
+		vif->net_stats.rx_dropped++;
+		goto discard;
+	}
+
+	ret = cfg->hif_ops->read(cfg->rxq_hdl, (u32*)skb->data,
+		LEN_TO_WORD(len));
+	if (ret != LEN_TO_WORD(len)) {
+		dev_err(cfg->dev, "%s(): read() failed(%d != %d)\n",
+			__func__, ret, LEN_TO_WORD(len));
+		ret = (ret < 0) ? ret:-EIO;
+		vif->net_stats.rx_errors++;
+		mt7697_rx_skb_put(vif, skb);
 		goto cleanup;
 	}
 
 	skb_put(skb, len);
-	memcpy(skb->data, cfg->rx_data, len);
-	skb->dev = vif->ndev;
-
-	vif->net_stats.rx_packets++;
-	vif->net_stats.rx_bytes += len;
-
-	skb->protocol = eth_type_trans(skb, skb->dev);
-	skb->ip_summed = CHECKSUM_UNNECESSARY;
-	dev_dbg(cfg->dev, "%s(): rx frame protocol(%u) type(%u)\n",
-		__func__, skb->protocol, skb->pkt_type);
-
-	ret = netif_rx_ni(skb);
-	if (ret != NET_RX_SUCCESS) {
-		if (ret == NET_RX_DROP) {
-			dev_warn(cfg->dev, "%s(): rx frame dropped\n", __func__);
-			vif->net_stats.rx_dropped++;
-			ret = 0;
-			goto cleanup;
-		}
+	skb_queue_tail(&vif->rx_queue, skb);
 
-		dev_err(cfg->dev, "%s(): netif_rx_ni() failed(%d)\n", __func__,
-			ret);
-		goto cleanup;
-	}
+	/* Let the softirq run the poll as soon as the schedule is done */
+	local_bh_disable();
+	napi_schedule(&vif->napi);
+	local_bh_enable();
+
+	ret = 0;
+	goto cleanup;
+
+discard:
+	ret = mt7697_rx_discard(cfg, len);
 
 cleanup:
-	if (ret < 0) {
-		vif->net_stats.rx_dropped++;
-		vif->net_stats.rx_errors++;
-		if (skb) dev_kfree_skb(skb);
+	return ret;
+}
+
+int mt7697_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct mt7697_vif *vif = container_of(napi, struct mt7697_vif, napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while ((done < budget) && (skb = skb_dequeue(&vif->rx_queue))) {
+		vif->net_stats.rx_packets++;
+		vif->net_stats.rx_bytes += skb->len;
+
+		skb->protocol = eth_type_trans(skb, vif->ndev);
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		dev_dbg(vif->cfg->dev, "%s(): rx frame protocol(%u) type(%u)\n",
+			__func__, skb->protocol, skb->pkt_type);
+
+		napi_gro_receive(napi, skb);
+		done++;
 	}
 
-	return ret;
+	mt7697_rx_refill(vif);
+
+	if (done < budget) {
+		napi_complete(napi);
+
+		/* A frame queued after the dequeue found nothing to schedule */
+		if (!skb_queue_empty(&vif->rx_queue))
+			napi_schedule(napi);
+	}
+
+	return done;
 }
@@ -376,65 +376,14 @@ static int mt7697_proc_scan_ind(const struct mt7697_rsp_hdr* rsp,
 	rx_mgmt_frame = (struct ieee80211_mgmt*)cfg->probe_data;
 	fc = rx_mgmt_frame->frame_control;
 	if (ieee80211_is_beacon(fc) || ieee80211_is_probe_resp(fc)) {
-		struct cfg80211_bss *bss;
-		struct ieee80211_channel *channel;
-		struct ieee80211_supported_band *band;
-		u32 freq;
-
-		if ((ch > 0) && (ch <= MT7697_CH_MAX_2G_CHANNEL)) {
-			band = cfg->wiphy->bands[IEEE80211_BAND_2GHZ];
-		} else if ((ch >= MT7697_CH_MIN_5G_CHANNEL) &&
-			   (ch <= MT7697_CH_MAX_5G_CHANNEL)) {
-			band = cfg->wiphy->bands[IEEE80211_BAND_5GHZ];
-		} else {
-			dev_err(cfg->dev, "%s(): invalid channel(%u)\n",
-				__func__, ch);
-			ret = -EINVAL;
-			goto cleanup;
-		}
-
-		freq = ieee80211_channel_to_frequency(ch, band->band);
-		if (!freq) {
-			dev_err(cfg->dev,
-				"%s(): ieee80211_channel_to_frequency() failed\n",
-				__func__);
-			ret = -EINVAL;
-			goto cleanup;
-		}
-
-		channel = ieee80211_get_channel(cfg->wiphy, freq);
-		if (!channel) {
-			dev_err(cfg->dev,
-				"%s(): ieee80211_get_channel() failed\n",
-				__func__);
-			ret = -EINVAL;
-			goto cleanup;
-		}
-
-		bss = cfg80211_inform_bss_frame(cfg->wiphy, channel,
-			rx_mgmt_frame, probe_rsp_len, rssi * 100,
-			GFP_ATOMIC);
-		if (!bss) {
+		ret = mt7697_scan_cache_update(cfg, ch, rssi, cfg->probe_data,
+			probe_rsp_len);
+		if (ret < 0) {
 			dev_err(cfg->dev,
-				"%s(): cfg80211_inform_bss_frame() failed\n",
-				__func__);
-			ret = -ENOMEM;
+				"%s(): mt7697_scan_cache_update() failed(%d)\n",
+				__func__, ret);
 			goto cleanup;
 		}
-#ifdef DEBUG
-		print_hex_dump(KERN_DEBUG, DRVNAME" BSS BSSID ",
-			DUMP_PREFIX_OFFSET, 16, 1, bss->bssid, ETH_ALEN, 0);
-#endif
-		dev_dbg(cfg->dev,
-			"%s(): BSS signal(%d) scan width(%u) cap(0x%08x)\n",
-			__func__, bss->signal, bss->scan_width,
-			bss->capability);
-		if (bss->channel) {
-			dev_dbg(cfg->dev,
-				"%s(): BSS channel band(%u) center freq(%u)\n",
-				__func__, bss->channel->band,
-				bss->channel->center_freq);
-		}
 	} else {
 		dev_err(cfg->dev, "%s(): Rx unsupported mgmt frame\n",
 			__func__);
@@ -479,6 +428,7 @@ static int mt7697_proc_scan_rsp(const struct mt7697_rsp_hdr* rsp,
 
 		dev_dbg(cfg->dev, "%s(): vif(%u)\n",
 			__func__, vif->fw_vif_idx);
+		mt7697_scan_cache_end(cfg, true);
 		cfg80211_scan_done(vif->scan_req, true);
 		vif->scan_req = NULL;
 	}
@@ -517,6 +467,7 @@ static int mt7697_proc_scan_complete_ind(struct mt7697_cfg80211_info *cfg)
 
 	if (vif->scan_req != NULL) {
 		dev_dbg(cfg->dev, "%s(): vif(%u)\n", __func__, vif->fw_vif_idx);
+		mt7697_scan_cache_end(cfg, false);
 		cfg80211_scan_done(vif->scan_req, false);
 		vif->scan_req = NULL;
 	}
@@ -601,6 +552,8 @@ static int mt7697_proc_connect_ind(const struct mt7697_rsp_hdr* rsp,
 				        __func__, ret);
 				goto cleanup;
 			}
+
+			mt7697_reconnect_connected(vif, bssid, channel);
 		}
 	} else {
 		struct station_info sinfo = {0};
@@ -687,6 +640,16 @@ static int mt7697_proc_disconnect_ind(struct mt7697_cfg80211_info *cfg)
 
 		dev_dbg(cfg->dev, "%s(): vif(%u)\n", __func__, vif->fw_vif_idx);
 
+		if (mt7697_reconnect_start(vif)) {
+			dev_dbg(cfg->dev, "%s(): fast reconnect\n", __func__);
+			netif_stop_queue(vif->ndev);
+			spin_lock_bh(&vif->if_lock);
+			clear_bit(CONNECTED, &vif->flags);
+			spin_unlock_bh(&vif->if_lock);
+			ret = 0;
+			goto cleanup;
+		}
+
 		ret = mt7697_wr_disconnect_req(vif->cfg, NULL);
 		if (ret < 0) {
 			dev_err(vif->cfg->dev,
@@ -769,24 +732,6 @@ static int mt7697_rx_raw(const struct mt7697_rsp_hdr* rsp,
 		goto cleanup;
 	}
 
-	ret = cfg->hif_ops->read(cfg->rxq_hdl, (u32*)cfg->rx_data,
-		LEN_TO_WORD(LEN32_ALIGNED(rsp->result)));
-	if (ret != LEN_TO_WORD(LEN32_ALIGNED(rsp->result))) {
-		dev_err(cfg->dev, "%s(): read() failed(%d != %d)\n",
-			__func__, ret,
-			LEN_TO_WORD(LEN32_ALIGNED(rsp->result)));
-		ret = (ret < 0) ? ret:-EIO;
-		goto cleanup;
-	}
-
-//	print_hex_dump(KERN_DEBUG, DRVNAME" RX ", DUMP_PREFIX_OFFSET,
-//		16, 1, cfg->rx_data, rsp->result, 0);
-
-	if (list_empty(&cfg->vif_list)) {
-		dev_dbg(cfg->dev, "%s(): no interfaces\n", __func__);
-		goto cleanup;
-	}
-
 	/* TODO: interface index come from MT7697 */
 	ret = mt7697_rx_data(cfg, rsp->result, 0);
 	if (ret) {
@@ -1024,21 +969,27 @@ cleanup:
 	return ret;
 }
 
-int mt7697_wr_set_pmk_req(const struct mt7697_cfg80211_info *cfg, const u8 *pmk)
+static void mt7697_pmk_to_hex(u8 *dst, const u8 *pmk)
 {
 	u8 tmp[2*sizeof(u8) + 1];
+	int i;
+
+	for (i = 0; i < MT7697_WIFI_LENGTH_PMK; i++) {
+		snprintf(tmp, sizeof(tmp), "%02x", pmk[i]);
+		memcpy(&dst[i*2], tmp, 2*sizeof(u8));
+	}
+}
+
+int mt7697_wr_set_pmk_req(const struct mt7697_cfg80211_info *cfg, const u8 *pmk)
+{
 	struct mt7697_set_pmk_req req;
-	int i, ret;
+	int ret;
 
 	req.cmd.len = sizeof(struct mt7697_set_pmk_req);
 	req.cmd.grp = MT7697_CMD_GRP_80211;
 	req.cmd.type = MT7697_CMD_SET_PMK_REQ;
 	req.port = cfg->port_type;
-
-	for (i = 0; i < MT7697_WIFI_LENGTH_PMK; i++) {
-		snprintf(tmp, sizeof(tmp), "%02x", pmk[i]);
-		memcpy(&req.pmk[i*2], tmp, 2*sizeof(u8));
-	}
+	mt7697_pmk_to_hex(req.pmk, pmk);
 
 	dev_dbg(cfg->dev, "%s(): <-- SET PMK port(%u) len(%u)\n",
 		__func__, req.port, req.cmd.len);
@@ -1176,6 +1127,97 @@ cleanup:
 	return ret;
 }
 
+static void mt7697_sg_cmd(struct mt7697_sg *sg, const void *req, size_t len)
+{
+	sg->hdr = (const u32*)req;
+	sg->hdr_len = LEN_TO_WORD(len);
+	sg->data = NULL;
+	sg->len = 0;
+}
+
+/*
+ * Reconnect to a known BSS. The SSID, BSSID, channel, security and reload
+ * commands are gathered into one queue write so the firmware sees the whole
+ * configuration at once instead of after five separate round trips. The
+ * batch is written whole or not at all, the firmware must never get new
+ * settings without the reload. A NULL pmk selects an open network.
+ */
+int mt7697_wr_reconnect_req(const struct mt7697_cfg80211_info *cfg,
+	                    u8 if_idx, const u8 *ssid, u8 ssid_len,
+	                    const u8 bssid[ETH_ALEN], u8 ch, const u8 *pmk)
+{
+	struct mt7697_set_ssid_req ssid_req;
+	struct mt7697_set_bssid_req bssid_req;
+	struct mt7697_set_channel_req ch_req;
+	struct mt7697_set_pmk_req pmk_req;
+	struct mt7697_set_security_mode_req sec_req;
+	struct mt7697_reload_settings_req reload_req;
+	struct mt7697_sg sg[5];
+	size_t num = 0;
+	int ret;
+
+	memset(&ssid_req, 0, sizeof(ssid_req));
+	ssid_req.cmd.len = sizeof(struct mt7697_set_ssid_req);
+	ssid_req.cmd.grp = MT7697_CMD_GRP_80211;
+	ssid_req.cmd.type = MT7697_CMD_SET_SSID_REQ;
+	ssid_req.port = cfg->port_type;
+	ssid_req.len = ssid_len;
+	memcpy(ssid_req.ssid, ssid, ssid_len);
+	mt7697_sg_cmd(&sg[num++], &ssid_req, ssid_req.cmd.len);
+
+	bssid_req.cmd.len = sizeof(struct mt7697_set_bssid_req);
+	bssid_req.cmd.grp = MT7697_CMD_GRP_80211;
+	bssid_req.cmd.type = MT7697_CMD_SET_BSSID_REQ;
+	memcpy(bssid_req.bssid, bssid, ETH_ALEN);
+	mt7697_sg_cmd(&sg[num++], &bssid_req, bssid_req.cmd.len);
+
+	ch_req.cmd.len = sizeof(struct mt7697_set_channel_req);
+	ch_req.cmd.grp = MT7697_CMD_GRP_80211;
+	ch_req.cmd.type = MT7697_CMD_SET_CHANNEL_REQ;
+	ch_req.port = cfg->port_type;
+	ch_req.ch = ch;
+	mt7697_sg_cmd(&sg[num++], &ch_req, ch_req.cmd.len);
+
+	if (pmk) {
+		pmk_req.cmd.len = sizeof(struct mt7697_set_pmk_req);
+		pmk_req.cmd.grp = MT7697_CMD_GRP_80211;
+		pmk_req.cmd.type = MT7697_CMD_SET_PMK_REQ;
+		pmk_req.port = cfg->port_type;
+		mt7697_pmk_to_hex(pmk_req.pmk, pmk);
+		mt7697_sg_cmd(&sg[num++], &pmk_req, pmk_req.cmd.len);
+	} else {
+		sec_req.cmd.len = sizeof(struct mt7697_set_security_mode_req);
+		sec_req.cmd.grp = MT7697_CMD_GRP_80211;
+		sec_req.cmd.type = MT7697_CMD_SET_SECURITY_MODE_REQ;
+		sec_req.port = cfg->port_type;
+		sec_req.auth_mode = MT7697_WIFI_AUTH_MODE_OPEN;
+		sec_req.encrypt_type =
+			MT7697_WIFI_ENCRYPT_TYPE_ENCRYPT_DISABLED;
+		mt7697_sg_cmd(&sg[num++], &sec_req, sec_req.cmd.len);
+	}
+
+	reload_req.cmd.len = sizeof(struct mt7697_reload_settings_req);
+	reload_req.cmd.grp = MT7697_CMD_GRP_80211;
+	reload_req.cmd.type = MT7697_CMD_RELOAD_SETTINGS_REQ;
+	reload_req.if_idx = if_idx;
+	mt7697_sg_cmd(&sg[num++], &reload_req, reload_req.cmd.len);
+
+	dev_dbg(cfg->dev, "%s(): <-- RECONNECT ch(%u) cmds(%u)\n",
+		__func__, ch, num);
+	ret = cfg->hif_ops->write_sg_all(cfg->txq_hdl, sg, num);
+	if (ret != num) {
+		dev_err(cfg->dev, "%s(): write_sg_all() failed(%d != %u)\n",
+			__func__, ret, num);
+		ret = (ret < 0) ? ret:-EIO;
+		goto cleanup;
+	}
+
+	ret = 0;
+
+cleanup:
+	return ret;
+}
+
 int mt7697_wr_mac_addr_req(const struct mt7697_cfg80211_info *cfg)
 {
 	struct mt7697_mac_addr_req req;
@@ -1370,6 +1412,7 @@ cleanup:
 }
 
 int mt7697_wr_scan_req(const struct mt7697_cfg80211_info *cfg, u32 if_idx,
+	               u32 mode, u32 option,
 	               const struct cfg80211_scan_request *req)
 {
 	struct mt7697_scan_req scan_req;
@@ -1380,8 +1423,8 @@ int mt7697_wr_scan_req(const struct mt7697_cfg80211_info *cfg, u32 if_idx,
 	scan_req.cmd.grp = MT7697_CMD_GRP_80211;
 	scan_req.cmd.type = MT7697_CMD_SCAN_REQ;
 	scan_req.if_idx = if_idx;
-	scan_req.mode = MT7697_WIFI_SCAN_MODE_FULL;
-	scan_req.option = MT7697_WIFI_SCAN_OPTION_FORCE_ACTIVE;
+	scan_req.mode = mode;
+	scan_req.option = option;
 
 	dev_dbg(cfg->dev, "%s(): # ssids(%d)\n", __func__, req->n_ssids);
 	WARN_ON(req->n_ssids > 1);
@@ -1475,29 +1518,41 @@ cleanup:
 	return ret;
 }
 
-int mt7697_wr_tx_raw_packet(struct mt7697_cfg80211_info* cfg,
-			    const u8* data, u32 len)
+/*
+ * Send up to MT7697_TX_BATCH_LEN frames with one gathered write. Each frame is
+ * sent straight from its skb. Returns the number of frames written, which may
+ * be fewer than num when the queue fills up.
+ */
+int mt7697_wr_tx_raw_packets(struct mt7697_cfg80211_info* cfg,
+			     struct sk_buff **skb, unsigned int num)
 {
+	struct mt7697_tx_raw_packet req[MT7697_TX_BATCH_LEN];
+	struct mt7697_sg sg[MT7697_TX_BATCH_LEN];
+	unsigned int i;
 	int ret;
 
-	cfg->tx_req.cmd.len = sizeof(struct mt7697_cmd_hdr) + sizeof(len) + len;
-	cfg->tx_req.len = len;
-	WARN_ON(len > sizeof(cfg->tx_req.data));
-	memcpy(cfg->tx_req.data, data, len);
-
-	dev_dbg(cfg->dev, "%s(): <-- TX RAW PKT len(%u)\n",
-		__func__, cfg->tx_req.len);
-	ret = cfg->hif_ops->write(cfg->txq_hdl, (const u32*)&cfg->tx_req,
-		LEN_TO_WORD(LEN32_ALIGNED(cfg->tx_req.cmd.len)));
-	if (ret != LEN_TO_WORD(LEN32_ALIGNED(cfg->tx_req.cmd.len))) {
-		dev_dbg(cfg->dev, "%s(): write() failed(%d != %d)\n",
-			__func__, ret,
-			LEN_TO_WORD(LEN32_ALIGNED(cfg->tx_req.cmd.len)));
-		ret = (ret < 0) ? ret:-EIO;
-		goto cleanup;
+	WARN_ON(num > MT7697_TX_BATCH_LEN);
+	for (i = 0; i < num; i++) {
+		WARN_ON(skb[i]->len > IEEE80211_MAX_FRAME_LEN);
+		req[i].cmd.len = sizeof(struct mt7697_tx_raw_packet) +
+			skb[i]->len;
+		req[i].cmd.grp = MT7697_CMD_GRP_80211;
+		req[i].cmd.type = MT7697_CMD_TX_RAW;
+		req[i].len = skb[i]->len;
+
+		sg[i].hdr = (const u32*)&req[i];
+		sg[i].hdr_len = LEN_TO_WORD(sizeof(struct mt7697_tx_raw_packet));
+		sg[i].data = skb[i]->data;
+		sg[i].len = skb[i]->len;
 	}
 
-	ret = 0;
+	dev_dbg(cfg->dev, "%s(): <-- TX RAW PKT num(%u)\n", __func__, num);
+	ret = cfg->hif_ops->write_sg(cfg->txq_hdl, sg, num);
+	if (ret < 0) {
+		dev_dbg(cfg->dev, "%s(): write_sg() failed(%d)\n",
+			__func__, ret);
+		goto cleanup;
+	}
 
 cleanup:
 	return ret;
@@ -247,10 +247,10 @@ struct mt7697_disconnect_ind {
 	u8                    bssid[LEN32_ALIGNED(ETH_ALEN)];
 } __attribute__((packed, aligned(4)));
 
+/* Header only, the frame follows it in the same write */
 struct mt7697_tx_raw_packet {
 	struct mt7697_cmd_hdr cmd;
 	__be32                len;
-	u8                    data[LEN32_ALIGNED(IEEE80211_MAX_FRAME_LEN)];
 } __attribute__((packed, aligned(4)));
 
 struct mt7697_rx_raw_packet {
@@ -265,18 +265,21 @@ int mt7697_wr_set_channel_req(const struct mt7697_cfg80211_info*, u8);
 int mt7697_wr_set_bssid_req(const struct mt7697_cfg80211_info*, const u8[ETH_ALEN]);
 int mt7697_wr_set_ssid_req(const struct mt7697_cfg80211_info*, u8, const u8[]);
 int mt7697_wr_reload_settings_req(const struct mt7697_cfg80211_info*, u8);
+int mt7697_wr_reconnect_req(const struct mt7697_cfg80211_info*, u8, const u8*,
+	u8, const u8[ETH_ALEN], u8, const u8*);
 int mt7697_wr_mac_addr_req(const struct mt7697_cfg80211_info*);
 int mt7697_wr_cfg_req(const struct mt7697_cfg80211_info*);
 int mt7697_wr_set_op_mode_req(const struct mt7697_cfg80211_info*);
 int mt7697_wr_get_listen_interval_req(const struct mt7697_cfg80211_info*);
 int mt7697_wr_set_listen_interval_req(const struct mt7697_cfg80211_info*, u32);
-int mt7697_wr_scan_req(const struct mt7697_cfg80211_info*, u32,
+int mt7697_wr_scan_req(const struct mt7697_cfg80211_info*, u32, u32, u32,
 	               const struct cfg80211_scan_request*);
 int mt7697_wr_set_security_mode_req(const struct mt7697_cfg80211_info*, u8, u8);
 int mt7697_wr_get_security_mode_req(const struct mt7697_cfg80211_info*, u32);
 int mt7697_wr_scan_stop_req(const struct mt7697_cfg80211_info*);
 int mt7697_wr_disconnect_req(const struct mt7697_cfg80211_info*, const u8*);
-int mt7697_wr_tx_raw_packet(struct mt7697_cfg80211_info*, const u8*, u32);
+int mt7697_wr_tx_raw_packets(struct mt7697_cfg80211_info*, struct sk_buff**,
+	unsigned int);
 int mt7697_proc_data(void*);
 
 #endif
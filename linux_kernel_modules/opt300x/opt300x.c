@@ -25,12 +25,18 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/pm_runtime.h>
 #include <linux/slab.h>
 #include <linux/types.h>
+#include <linux/version.h>
 
+#include <linux/iio/buffer.h>
 #include <linux/iio/events.h>
 #include <linux/iio/iio.h>
 #include <linux/iio/sysfs.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
 
 #define OPT300x_RESULT		0x00
 #define OPT300x_CONFIGURATION	0x01
@@ -79,6 +85,9 @@
 #define OPT300x_RESULT_READY_SHORT	150
 #define OPT300x_RESULT_READY_LONG	1000
 
+/* Idle time after the last reading before the device is shut down again */
+#define OPT300x_AUTOSUSPEND_DELAY_MS	2000
+
 
 struct opt300x_scale {
 	int val;
@@ -114,6 +123,16 @@ struct opt300x {
 	u8			low_thresh_exp;
 
 	bool			use_irq;
+
+	/*
+	 * Continuous mode is on while either of these is set, each holding a
+	 * runtime PM reference. Otherwise the device is shut down between
+	 * single conversions.
+	 */
+	bool			event_enabled;
+	bool			buffer_enabled;
+	struct iio_trigger	*trig;
+	s64			irq_ts;
 };
 
 
@@ -143,6 +162,14 @@ static const struct iio_event_spec opt300x_event_spec[] = {
 	},
 };
 
+/* Buffered samples are mantissa << exponent, in units of _scale */
+#define OPT300x_SCAN_TYPE {			\
+	.sign = 'u',				\
+	.realbits = 23,				\
+	.storagebits = 32,			\
+	.endianness = IIO_CPU,			\
+}
+
 static const struct opt300x_chip opt3001_chip = {
 	.device_id = OPT3001_DEVICE_ID,
 	.scaler_numerator = 1,
@@ -166,7 +193,10 @@ static const struct opt300x_chip opt3001_chip = {
 			/* values reported in lux */
 			.type = IIO_LIGHT,
 			.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED) |
+					      BIT(IIO_CHAN_INFO_SCALE) |
 					      BIT(IIO_CHAN_INFO_INT_TIME),
+			.scan_index = 0,
+			.scan_type = OPT300x_SCAN_TYPE,
 			.event_spec = opt300x_event_spec,
 			.num_event_specs = ARRAY_SIZE(opt300x_event_spec),
 		},
@@ -197,7 +227,10 @@ static const struct opt300x_chip opt3002_chip = {
 			/* values reported in nW/cm^2 */
 			.type = IIO_INTENSITY,
 			.info_mask_separate = BIT(IIO_CHAN_INFO_PROCESSED) |
+					      BIT(IIO_CHAN_INFO_SCALE) |
 					      BIT(IIO_CHAN_INFO_INT_TIME),
+			.scan_index = 0,
+			.scan_type = OPT300x_SCAN_TYPE,
 			.event_spec = opt300x_event_spec,
 			.num_event_specs = ARRAY_SIZE(opt300x_event_spec),
 		},
@@ -251,6 +284,46 @@ static void opt300x_set_mode(struct opt300x *opt, u16 *reg, u16 mode)
 	opt->mode = mode;
 }
 
+static int opt300x_write_mode(struct opt300x *opt, u16 mode)
+{
+	int ret;
+	u16 reg;
+
+	ret = i2c_smbus_read_word_swapped(opt->client, OPT300x_CONFIGURATION);
+	if (ret < 0) {
+		dev_err(opt->dev, "failed to read register %02x\n",
+				OPT300x_CONFIGURATION);
+		return ret;
+	}
+
+	reg = ret;
+	opt300x_set_mode(opt, &reg, mode);
+
+	ret = i2c_smbus_write_word_swapped(opt->client, OPT300x_CONFIGURATION,
+			reg);
+	if (ret < 0)
+		dev_err(opt->dev, "failed to write register %02x\n",
+				OPT300x_CONFIGURATION);
+
+	return ret;
+}
+
+/* Restore the low-limit value, clearing OPT300x_LOW_LIMIT_EOC_ENABLE */
+static int opt300x_write_low_limit(struct opt300x *opt)
+{
+	int ret;
+	u16 value;
+
+	value = (opt->low_thresh_exp << 12) | opt->low_thresh_mantissa;
+	ret = i2c_smbus_write_word_swapped(opt->client, OPT300x_LOW_LIMIT,
+					   value);
+	if (ret < 0)
+		dev_err(opt->dev, "failed to write register %02x\n",
+				OPT300x_LOW_LIMIT);
+
+	return ret;
+}
+
 
 static int opt300x_get_reading(struct opt300x *opt, int *val, int *val2)
 {
@@ -258,7 +331,6 @@ static int opt300x_get_reading(struct opt300x *opt, int *val, int *val2)
 	u16 mantissa;
 	u16 reg;
 	u8 exponent;
-	u16 value;
 	long timeout;
 
 	if (opt->use_irq) {
@@ -351,20 +423,13 @@ err:
 	if (opt->use_irq) {
 		/*
 		 * Disable the end-of-conversion interrupt mechanism by
-		 * restoring the low-level limit value (clearing
-		 * OPT300x_LOW_LIMIT_EOC_ENABLE). Note that selectively clearing
-		 * those enable bits would affect the actual limit value due to
-		 * bit-overlap and therefore can't be done.
+		 * restoring the low-level limit value. Note that selectively
+		 * clearing those enable bits would affect the actual limit
+		 * value due to bit-overlap and therefore can't be done.
 		 */
-		value = (opt->low_thresh_exp << 12) | opt->low_thresh_mantissa;
-		ret = i2c_smbus_write_word_swapped(opt->client,
-						   OPT300x_LOW_LIMIT,
-						   value);
-		if (ret < 0) {
-			dev_err(opt->dev, "failed to write register %02x\n",
-					OPT300x_LOW_LIMIT);
+		ret = opt300x_write_low_limit(opt);
+		if (ret < 0)
 			return ret;
-		}
 	}
 
 	exponent = OPT300x_REG_EXPONENT(opt->result);
@@ -375,6 +440,27 @@ err:
 	return IIO_VAL_INT_PLUS_MICRO;
 }
 
+/*
+ * In continuous mode the result register always holds the last completed
+ * conversion, so there is no need to start one and wait for it.
+ */
+static int opt300x_get_latest(struct opt300x *opt, int *val, int *val2)
+{
+	int ret;
+
+	ret = i2c_smbus_read_word_swapped(opt->client, OPT300x_RESULT);
+	if (ret < 0) {
+		dev_err(opt->dev, "failed to read register %02x\n",
+				OPT300x_RESULT);
+		return ret;
+	}
+
+	opt300x_to_iio_ret(opt, OPT300x_REG_EXPONENT(ret),
+			OPT300x_REG_MANTISSA(ret), val, val2);
+
+	return IIO_VAL_INT_PLUS_MICRO;
+}
+
 static int opt300x_get_int_time(struct opt300x *opt, int *val, int *val2)
 {
 	*val = 0;
@@ -421,17 +507,28 @@ static int opt300x_read_raw(struct iio_dev *iio,
 	struct opt300x *opt = iio_priv(iio);
 	int ret;
 
-	if (opt->mode == OPT300x_CONFIGURATION_M_CONTINUOUS)
-		return -EBUSY;
-
 	if (chan->type != opt->chip->channels[0].type)
 		return -EINVAL;
 
+	ret = pm_runtime_get_sync(opt->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(opt->dev);
+		return ret;
+	}
+
 	mutex_lock(&opt->lock);
 
 	switch (mask) {
 	case IIO_CHAN_INFO_PROCESSED:
-		ret = opt300x_get_reading(opt, val, val2);
+		if (opt->mode == OPT300x_CONFIGURATION_M_CONTINUOUS)
+			ret = opt300x_get_latest(opt, val, val2);
+		else
+			ret = opt300x_get_reading(opt, val, val2);
+		break;
+	case IIO_CHAN_INFO_SCALE:
+		*val = opt->chip->scaler_numerator;
+		*val2 = opt->chip->scaler_denominator;
+		ret = IIO_VAL_FRACTIONAL;
 		break;
 	case IIO_CHAN_INFO_INT_TIME:
 		ret = opt300x_get_int_time(opt, val, val2);
@@ -442,6 +539,9 @@ static int opt300x_read_raw(struct iio_dev *iio,
 
 	mutex_unlock(&opt->lock);
 
+	pm_runtime_mark_last_busy(opt->dev);
+	pm_runtime_put_autosuspend(opt->dev);
+
 	return ret;
 }
 
@@ -551,6 +651,10 @@ static int opt300x_write_event_value(struct iio_dev *iio,
 		goto err;
 	}
 
+	/* The buffer owns the low-limit register, see opt300x_buffer_enable */
+	if (reg == OPT300x_LOW_LIMIT && opt->buffer_enabled)
+		goto err;
+
 	ret = i2c_smbus_write_word_swapped(opt->client, reg, value);
 	if (ret < 0) {
 		dev_err(opt->dev, "failed to write register %02x\n", reg);
@@ -569,7 +673,7 @@ static int opt300x_read_event_config(struct iio_dev *iio,
 {
 	struct opt300x *opt = iio_priv(iio);
 
-	return opt->mode == OPT300x_CONFIGURATION_M_CONTINUOUS;
+	return opt->event_enabled;
 }
 
 static int opt300x_write_event_config(struct iio_dev *iio,
@@ -577,45 +681,174 @@ static int opt300x_write_event_config(struct iio_dev *iio,
 		enum iio_event_direction dir, int state)
 {
 	struct opt300x *opt = iio_priv(iio);
+	bool was_enabled;
 	int ret;
 	u16 mode;
-	u16 reg;
 
-	if (state && opt->mode == OPT300x_CONFIGURATION_M_CONTINUOUS)
-		return 0;
-
-	if (!state && opt->mode == OPT300x_CONFIGURATION_M_SHUTDOWN)
-		return 0;
+	ret = pm_runtime_get_sync(opt->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(opt->dev);
+		return ret;
+	}
+	ret = 0;
 
 	mutex_lock(&opt->lock);
 
-	mode = state ? OPT300x_CONFIGURATION_M_CONTINUOUS
-		: OPT300x_CONFIGURATION_M_SHUTDOWN;
+	was_enabled = opt->event_enabled;
+	if (!!state == opt->event_enabled)
+		goto err;
 
-	ret = i2c_smbus_read_word_swapped(opt->client, OPT300x_CONFIGURATION);
-	if (ret < 0) {
-		dev_err(opt->dev, "failed to read register %02x\n",
-				OPT300x_CONFIGURATION);
+	/* A running buffer keeps the device in continuous mode */
+	mode = (state || opt->buffer_enabled) ?
+		OPT300x_CONFIGURATION_M_CONTINUOUS :
+		OPT300x_CONFIGURATION_M_SHUTDOWN;
+
+	ret = opt300x_write_mode(opt, mode);
+	if (ret < 0)
 		goto err;
-	}
 
-	reg = ret;
-	opt300x_set_mode(opt, &reg, mode);
+	opt->event_enabled = state;
 
-	ret = i2c_smbus_write_word_swapped(opt->client, OPT300x_CONFIGURATION,
-			reg);
+err:
+	mutex_unlock(&opt->lock);
+
+	/* Enabled events keep the reference taken above */
+	if (opt->event_enabled && !was_enabled)
+		return ret;
+	if (!opt->event_enabled && was_enabled)
+		pm_runtime_put_noidle(opt->dev);
+	pm_runtime_mark_last_busy(opt->dev);
+	pm_runtime_put_autosuspend(opt->dev);
+
+	return ret;
+}
+
+/*
+ * The end-of-conversion enable lives in the low-limit register, so while
+ * the buffer runs the low threshold only exists in opt->low_thresh_* and
+ * both thresholds are compared in software, see opt300x_buffer_sample.
+ */
+static int opt300x_buffer_enable(struct opt300x *opt)
+{
+	int ret;
+
+	ret = i2c_smbus_write_word_swapped(opt->client, OPT300x_LOW_LIMIT,
+					   OPT300x_LOW_LIMIT_EOC_ENABLE);
 	if (ret < 0) {
 		dev_err(opt->dev, "failed to write register %02x\n",
-				OPT300x_CONFIGURATION);
-		goto err;
+				OPT300x_LOW_LIMIT);
+		return ret;
 	}
 
-err:
+	opt->buffer_enabled = true;
+
+	ret = opt300x_write_mode(opt, OPT300x_CONFIGURATION_M_CONTINUOUS);
+	if (ret < 0) {
+		opt->buffer_enabled = false;
+		opt300x_write_low_limit(opt);
+	}
+
+	return ret;
+}
+
+static int opt300x_buffer_disable(struct opt300x *opt)
+{
+	int ret;
+
+	opt->buffer_enabled = false;
+
+	ret = opt300x_write_low_limit(opt);
+	if (ret < 0)
+		return ret;
+
+	return opt300x_write_mode(opt, opt->event_enabled ?
+				  OPT300x_CONFIGURATION_M_CONTINUOUS :
+				  OPT300x_CONFIGURATION_M_SHUTDOWN);
+}
+
+static irqreturn_t opt300x_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *iio = pf->indio_dev;
+	struct opt300x *opt = iio_priv(iio);
+	/* Sample and the 8 byte aligned timestamp */
+	u32 buf[4] __aligned(8);
+
+	/* Called from opt300x_irq, right after the result was read */
+	buf[0] = OPT300x_REG_MANTISSA(opt->result) <<
+		 OPT300x_REG_EXPONENT(opt->result);
+
+	iio_push_to_buffers_with_timestamp(iio, buf, opt->irq_ts);
+
+	iio_trigger_notify_done(iio->trig);
+
+	return IRQ_HANDLED;
+}
+
+static int opt300x_set_trigger_state(struct iio_trigger *trig, bool state)
+{
+	struct iio_dev *iio = iio_trigger_get_drvdata(trig);
+	struct opt300x *opt = iio_priv(iio);
+	int ret;
+
+	mutex_lock(&opt->lock);
+	if (state)
+		ret = opt300x_buffer_enable(opt);
+	else
+		ret = opt300x_buffer_disable(opt);
 	mutex_unlock(&opt->lock);
 
 	return ret;
 }
 
+static int opt300x_trigger_validate_device(struct iio_trigger *trig,
+		struct iio_dev *iio)
+{
+	/* The end-of-conversion trigger only makes sense for its own device */
+	if (iio != iio_trigger_get_drvdata(trig))
+		return -EINVAL;
+
+	return 0;
+}
+
+static const struct iio_trigger_ops opt300x_trigger_ops = {
+	.owner = THIS_MODULE,
+	.set_trigger_state = opt300x_set_trigger_state,
+	.validate_device = opt300x_trigger_validate_device,
+};
+
+/* Hold a runtime PM reference for as long as the buffer is enabled */
+static int opt300x_buffer_preenable(struct iio_dev *iio)
+{
+	struct opt300x *opt = iio_priv(iio);
+	int ret;
+
+	ret = pm_runtime_get_sync(opt->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(opt->dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int opt300x_buffer_postdisable(struct iio_dev *iio)
+{
+	struct opt300x *opt = iio_priv(iio);
+
+	pm_runtime_mark_last_busy(opt->dev);
+	pm_runtime_put_autosuspend(opt->dev);
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops opt300x_buffer_setup_ops = {
+	.preenable = opt300x_buffer_preenable,
+	.postenable = iio_triggered_buffer_postenable,
+	.predisable = iio_triggered_buffer_predisable,
+	.postdisable = opt300x_buffer_postdisable,
+};
+
 static const struct iio_info opt300x_info = {
 	.attrs = &opt300x_attribute_group,
 	.read_raw = opt300x_read_raw,
@@ -729,12 +962,58 @@ static int opt300x_configure(struct opt300x *opt)
 	return 0;
 }
 
+/* Read a buffered sample and check the thresholds the device can't */
+static int opt300x_buffer_sample(struct iio_dev *iio)
+{
+	struct opt300x *opt = iio_priv(iio);
+	u32 value;
+	int ret;
+
+	ret = i2c_smbus_read_word_swapped(opt->client, OPT300x_RESULT);
+	if (ret < 0) {
+		dev_err(opt->dev, "failed to read register %02x\n",
+				OPT300x_RESULT);
+		return ret;
+	}
+	opt->result = ret;
+
+	if (!opt->event_enabled)
+		return 0;
+
+	value = OPT300x_REG_MANTISSA(ret) << OPT300x_REG_EXPONENT(ret);
+	if (value > (opt->high_thresh_mantissa << opt->high_thresh_exp))
+		iio_push_event(iio,
+				IIO_UNMOD_EVENT_CODE(IIO_LIGHT, 0,
+						IIO_EV_TYPE_THRESH,
+						IIO_EV_DIR_RISING),
+				opt->irq_ts);
+	if (value < (opt->low_thresh_mantissa << opt->low_thresh_exp))
+		iio_push_event(iio,
+				IIO_UNMOD_EVENT_CODE(IIO_LIGHT, 0,
+						IIO_EV_TYPE_THRESH,
+						IIO_EV_DIR_FALLING),
+				opt->irq_ts);
+
+	return 0;
+}
+
+static irqreturn_t opt300x_irq_handler(int irq, void *_iio)
+{
+	struct iio_dev *iio = _iio;
+	struct opt300x *opt = iio_priv(iio);
+
+	opt->irq_ts = iio_get_time_ns();
+
+	return IRQ_WAKE_THREAD;
+}
+
 static irqreturn_t opt300x_irq(int irq, void *_iio)
 {
 	struct iio_dev *iio = _iio;
 	struct opt300x *opt = iio_priv(iio);
 	int ret;
 	bool wake_result_ready_queue = false;
+	bool poll_trigger = false;
 
 
 	if (!opt->ok_to_ignore_lock)
@@ -748,6 +1027,11 @@ static irqreturn_t opt300x_irq(int irq, void *_iio)
 	}
 
 	if ((ret & OPT300x_CONFIGURATION_M_MASK) ==
+			OPT300x_CONFIGURATION_M_CONTINUOUS && opt->buffer_enabled) {
+		if ((ret & OPT300x_CONFIGURATION_CRF) &&
+		    !opt300x_buffer_sample(iio))
+			poll_trigger = true;
+	} else if ((ret & OPT300x_CONFIGURATION_M_MASK) ==
 			OPT300x_CONFIGURATION_M_CONTINUOUS) {
 		if (ret & OPT300x_CONFIGURATION_FH)
 			iio_push_event(iio,
@@ -780,9 +1064,53 @@ out:
 	if (wake_result_ready_queue)
 		wake_up(&opt->result_ready_queue);
 
+	if (poll_trigger)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0)
+		iio_trigger_poll_chained(opt->trig);
+#else
+		iio_trigger_poll_chained(opt->trig, opt->irq_ts);
+#endif
+
 	return IRQ_HANDLED;
 }
 
+static int opt300x_setup_buffer(struct iio_dev *iio)
+{
+	struct opt300x *opt = iio_priv(iio);
+	int ret;
+
+	ret = iio_triggered_buffer_setup(iio, NULL, opt300x_trigger_handler,
+			&opt300x_buffer_setup_ops);
+	if (ret) {
+		dev_err(opt->dev, "failed to setup triggered buffer\n");
+		return ret;
+	}
+
+	opt->trig = devm_iio_trigger_alloc(opt->dev, "%s-dev%d", iio->name,
+			iio->id);
+	if (!opt->trig) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	opt->trig->dev.parent = opt->dev;
+	opt->trig->ops = &opt300x_trigger_ops;
+	iio_trigger_set_drvdata(opt->trig, iio);
+
+	ret = iio_trigger_register(opt->trig);
+	if (ret) {
+		dev_err(opt->dev, "failed to register trigger\n");
+		goto err;
+	}
+
+	return 0;
+
+err:
+	iio_triggered_buffer_cleanup(iio);
+
+	return ret;
+}
+
 static int opt300x_probe(struct i2c_client *client,
 		const struct i2c_device_id *id)
 {
@@ -823,15 +1151,10 @@ static int opt300x_probe(struct i2c_client *client,
 	iio->modes = INDIO_DIRECT_MODE;
 	iio->info = &opt300x_info;
 
-	ret = devm_iio_device_register(dev, iio);
-	if (ret) {
-		dev_err(dev, "failed to register IIO device\n");
-		return ret;
-	}
-
 	/* Make use of INT pin only if valid IRQ no. is given */
 	if (irq > 0) {
-		ret = request_threaded_irq(irq, NULL, opt300x_irq,
+		ret = request_threaded_irq(irq, opt300x_irq_handler,
+				opt300x_irq,
 				IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
 				"opt300x", iio);
 		if (ret) {
@@ -840,11 +1163,44 @@ static int opt300x_probe(struct i2c_client *client,
 		}
 		opt->use_irq = true;
 		dev_info(opt->dev,"enabling interrupt based operation");
+
+		/* Buffered samples are paced by the end-of-conversion IRQ */
+		ret = opt300x_setup_buffer(iio);
+		if (ret)
+			goto err_free_irq;
 	} else {
 		dev_info(opt->dev, "enabling interrupt-less operation\n");
 	}
 
+	/* Enable runtime PM, opt300x_configure left the device shut down */
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_enable(dev);
+	pm_runtime_set_autosuspend_delay(dev, OPT300x_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_put(dev);
+
+	ret = iio_device_register(iio);
+	if (ret) {
+		dev_err(dev, "failed to register IIO device\n");
+		goto err_runtime_pm_disable;
+	}
+
 	return 0;
+
+err_runtime_pm_disable:
+	pm_runtime_get_sync(dev);
+	pm_runtime_put_noidle(dev);
+	pm_runtime_disable(dev);
+	if (opt->use_irq) {
+		iio_trigger_unregister(opt->trig);
+		iio_triggered_buffer_cleanup(iio);
+	}
+err_free_irq:
+	if (opt->use_irq)
+		free_irq(irq, iio);
+
+	return ret;
 }
 
 static int opt300x_remove(struct i2c_client *client)
@@ -854,8 +1210,17 @@ static int opt300x_remove(struct i2c_client *client)
 	int ret;
 	u16 reg;
 
-	if (opt->use_irq)
+	iio_device_unregister(iio);
+
+	if (opt->use_irq) {
+		iio_trigger_unregister(opt->trig);
+		iio_triggered_buffer_cleanup(iio);
 		free_irq(client->irq, iio);
+	}
+
+	pm_runtime_get_sync(opt->dev);
+	pm_runtime_put_noidle(opt->dev);
+	pm_runtime_disable(opt->dev);
 
 	ret = i2c_smbus_read_word_swapped(opt->client, OPT300x_CONFIGURATION);
 	if (ret < 0) {
@@ -878,6 +1243,80 @@ static int opt300x_remove(struct i2c_client *client)
 	return 0;
 }
 
+#ifdef CONFIG_PM
+/*
+ * Only reached with no buffer or event active. A single conversion returns
+ * to shutdown on its own, this also catches one that was cut short.
+ */
+static int opt300x_runtime_suspend(struct device *dev)
+{
+	struct iio_dev *iio = dev_get_drvdata(dev);
+	struct opt300x *opt = iio_priv(iio);
+	int ret;
+
+	mutex_lock(&opt->lock);
+	ret = opt300x_write_mode(opt, OPT300x_CONFIGURATION_M_SHUTDOWN);
+	mutex_unlock(&opt->lock);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Readings start their own conversion, there is nothing to restore */
+static int opt300x_runtime_resume(struct device *dev)
+{
+	return 0;
+}
+#endif /* CONFIG_PM */
+
+#ifdef CONFIG_PM_SLEEP
+/*
+ * Enabled threshold events stay in continuous mode and wake the system. A
+ * buffer alone has nobody to consume it, so conversions stop until resume.
+ */
+static int opt300x_suspend(struct device *dev)
+{
+	struct iio_dev *iio = dev_get_drvdata(dev);
+	struct opt300x *opt = iio_priv(iio);
+	int ret = 0;
+
+	mutex_lock(&opt->lock);
+	if (opt->event_enabled) {
+		if (opt->use_irq)
+			enable_irq_wake(opt->client->irq);
+	} else if (opt->buffer_enabled) {
+		ret = opt300x_write_mode(opt, OPT300x_CONFIGURATION_M_SHUTDOWN);
+	}
+	mutex_unlock(&opt->lock);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int opt300x_resume(struct device *dev)
+{
+	struct iio_dev *iio = dev_get_drvdata(dev);
+	struct opt300x *opt = iio_priv(iio);
+	int ret = 0;
+
+	mutex_lock(&opt->lock);
+	if (opt->event_enabled) {
+		if (opt->use_irq)
+			disable_irq_wake(opt->client->irq);
+	} else if (opt->buffer_enabled) {
+		ret = opt300x_write_mode(opt,
+				OPT300x_CONFIGURATION_M_CONTINUOUS);
+	}
+	mutex_unlock(&opt->lock);
+
+	return ret < 0 ? ret : 0;
+}
+#endif /* CONFIG_PM_SLEEP */
+
+static const struct dev_pm_ops opt300x_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(opt300x_suspend, opt300x_resume)
+	SET_RUNTIME_PM_OPS(opt300x_runtime_suspend, opt300x_runtime_resume,
+			   NULL)
+};
+
 static const struct i2c_device_id opt300x_id[] = {
 	{ "opt3001", (kernel_ulong_t)&opt3001_chip },
 	{ "opt3002", (kernel_ulong_t)&opt3002_chip },
@@ -899,6 +1338,7 @@ static struct i2c_driver opt300x_driver = {
 	.driver = {
 		.name = "opt300x",
 		.of_match_table = of_match_ptr(opt300x_of_match),
+		.pm = &opt300x_pm_ops,
 	},
 };
 